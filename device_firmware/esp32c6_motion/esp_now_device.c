@@ -1,31 +1,184 @@
+#include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "esp_log.h"
 #include "esp_now.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
+#include "esp_random.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "nvs.h"
+#include "sodium.h"
 #include "device_config.h"
 #include "esp_now_device.h"
-#include "../home_base_firmware/main/include/protocol.h"
+#include "sdkconfig.h"
+#include "protocol.h"
 
 static const char *TAG = "esp_now_device";
 
+#ifdef CONFIG_ESP_NOW_PROTOCOL_V2
+    #define ESP_NOW_PROTOCOL_V2 1
+#else
+    #define ESP_NOW_PROTOCOL_V2 0
+#endif
+
+// Replay protection: boot_id is bumped in NVS on every boot, seq counts
+// frames within a boot. The home base drops repeats of (boot_id, seq).
+// Without NVS, boot_id is random so a reboot still looks like a new boot.
+static uint32_t s_boot_id = 0;
+// seq is taken from both the app task and the receive callback (acks)
+static atomic_uint_fast32_t s_seq = 0;
+
+// Ed25519 key v2 motion events and command acks are signed with. boot_id and
+// seq are part of the signed payload, so the home base can trust them for replay filtering
+// once this device's public key is registered there (POST /api/v1/keys).
+static uint8_t s_sign_sk[crypto_sign_SECRETKEYBYTES];
+static bool s_sign_ready = false;
+
 // Message queue for received messages
 static QueueHandle_t esp_now_queue = NULL;
 #define ESP_NOW_QUEUE_SIZE 20
 
+// Recently accepted downlink command ids; a retransmit whose ack was lost is
+// acked again without being queued twice
+#define RECENT_COMMANDS 8
+static uint32_t s_recent_cmd[RECENT_COMMANDS];
+static int s_recent_next = 0;
+
+static esp_err_t send_v2(const uint8_t *peer_mac, mesh_fields_t *fields);
+
+// Random non-zero boot_id for boots whose counter can't be persisted
+static uint32_t random_boot_id(void)
+{
+    uint32_t id;
+    do {
+        id = esp_random();
+    } while (id == 0);
+    return id;
+}
+
+// Load and advance the persistent boot counter
+static void load_boot_id(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open("device", NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        s_boot_id = random_boot_id();
+        ESP_LOGW(TAG, "NVS unavailable, using random boot_id %lu", (unsigned long)s_boot_id);
+        return;
+    }
+
+    nvs_get_u32(nvs_handle, "boot_id", &s_boot_id);
+    s_boot_id++;
+    if (nvs_set_u32(nvs_handle, "boot_id", s_boot_id) != ESP_OK || nvs_commit(nvs_handle) != ESP_OK) {
+        // The next boot would read the same counter back and reuse it
+        s_boot_id = random_boot_id();
+        ESP_LOGW(TAG, "Failed to persist boot_id, using random %lu", (unsigned long)s_boot_id);
+    }
+    nvs_close(nvs_handle);
+}
+
+// Load the signing key, generating and persisting one on first boot
+static void load_signing_key(void)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    if (sodium_init() < 0) {
+        ESP_LOGE(TAG, "Failed to initialize libsodium, frames go out unsigned");
+        return;
+    }
+
+    nvs_handle_t nvs_handle;
+    bool opened = nvs_open("device", NVS_READWRITE, &nvs_handle) == ESP_OK;
+    size_t len = sizeof(s_sign_sk);
+    if (!opened || nvs_get_blob(nvs_handle, "sign_sk", s_sign_sk, &len) != ESP_OK || len != sizeof(s_sign_sk)) {
+        crypto_sign_keypair(public_key, s_sign_sk);
+        if (!opened || nvs_set_blob(nvs_handle, "sign_sk", s_sign_sk, sizeof(s_sign_sk)) != ESP_OK ||
+            nvs_commit(nvs_handle) != ESP_OK) {
+            // The home base only knows the key it was given; this one is lost on reboot
+            ESP_LOGW(TAG, "Failed to persist signing key, it changes on every boot");
+        }
+    }
+    if (opened) {
+        nvs_close(nvs_handle);
+    }
+    s_sign_ready = true;
+}
+
+bool esp_now_device_get_public_key(char *hex, size_t hex_len)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    if (!s_sign_ready || hex_len < 2 * sizeof(public_key) + 1) {
+        return false;
+    }
+    crypto_sign_ed25519_sk_to_pk(public_key, s_sign_sk);
+    sodium_bin2hex(hex, hex_len, public_key, sizeof(public_key));
+    return true;
+}
+
+static bool command_seen(uint32_t cmd_id)
+{
+    for (int i = 0; i < RECENT_COMMANDS; i++) {
+        if (s_recent_cmd[i] == cmd_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ack a downlink command to the home base (always v2: v1 has no command id).
+// send_v2() signs it, so the home base can tell it from a spoofed ack.
+static void send_ack(const uint8_t *peer_mac, uint32_t cmd_id, uint8_t status)
+{
+    mesh_fields_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.type = MSG_TYPE_ACK;
+    strncpy(ack.device_id, device_config_get()->device_id, sizeof(ack.device_id) - 1);
+    ack.cmd_id = cmd_id;
+    ack.status = status;
+    ack.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_STATUS);
+
+    if (send_v2(peer_mac, &ack) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to ack command %lu", (unsigned long)cmd_id);
+    }
+}
+
 // Callback for received messages
 static void on_data_recv(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
-    if (len != sizeof(mesh_message_t)) {
-        ESP_LOGW(TAG, "Invalid message size: %d != %d", len, (int)sizeof(mesh_message_t));
+    mesh_message_t msg;
+    if (!protocol_decode_frame(data, len, &msg)) {
+        ESP_LOGW(TAG, "Invalid message (%d bytes)", len);
         return;
     }
 
-    mesh_message_t msg;
-    memcpy(&msg, data, sizeof(mesh_message_t));
+    // Downlink commands carry an id the home base waits to see acked
+    mesh_fields_t fields;
+    if (msg.type == MSG_TYPE_COMMAND && protocol_v2_decode(data, len, &fields) &&
+        (fields.present & MESH_HAS(MESH_FIELD_CMD_ID))) {
+        const char *device_id = device_config_get()->device_id;
+        if (strcmp(fields.device_id, MESH_BROADCAST_ID) == 0) {
+            // Group command: everyone, or only the devices set in the bitmap
+            if ((fields.present & MESH_HAS(MESH_FIELD_TARGETS)) &&
+                !protocol_targets_include(fields.targets, protocol_target_bit(device_id))) {
+                return;
+            }
+        } else if (strncmp(fields.device_id, device_id, sizeof(fields.device_id)) != 0) {
+            return;   // Addressed to another device
+        }
+        if (command_seen(fields.cmd_id)) {
+            send_ack(mac_addr, fields.cmd_id, MESH_ACK_OK);
+            return;
+        }
+        if (xQueueSend(esp_now_queue, &msg, 0) != pdTRUE) {
+            send_ack(mac_addr, fields.cmd_id, MESH_ACK_BUSY);
+            return;
+        }
+        s_recent_cmd[s_recent_next] = fields.cmd_id;
+        s_recent_next = (s_recent_next + 1) % RECENT_COMMANDS;
+        send_ack(mac_addr, fields.cmd_id, MESH_ACK_OK);
+        return;
+    }
     
     // Queue for processing
     if (xQueueSend(esp_now_queue, &msg, pdMS_TO_TICKS(100)) != pdTRUE) {
@@ -54,6 +207,15 @@ esp_err_t esp_now_device_init(void)
         return ESP_ERR_NO_MEM;
     }
 
+    load_boot_id();
+    ESP_LOGI(TAG, "Boot id %lu", (unsigned long)s_boot_id);
+
+    char public_key[2 * crypto_sign_PUBLICKEYBYTES + 1];
+    load_signing_key();
+    if (esp_now_device_get_public_key(public_key, sizeof(public_key))) {
+        ESP_LOGI(TAG, "Signing key %s", public_key);
+    }
+
     // Initialize WiFi (required for ESP-NOW)
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     esp_wifi_init(&cfg);
@@ -101,35 +263,78 @@ esp_err_t esp_now_device_add_peer(const uint8_t *peer_mac)
     return ret;
 }
 
+// Send a v2 frame stamped with boot_id/seq
+static esp_err_t send_v2(const uint8_t *peer_mac, mesh_fields_t *fields)
+{
+    uint8_t signature[crypto_sign_BYTES];
+
+    fields->boot_id = s_boot_id;
+    fields->seq = (uint32_t)atomic_fetch_add(&s_seq, 1);
+    fields->present |= MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+
+    // Sign "{timestamp}:{payload}" as the home base renders it, boot_id/seq included
+    // (acks carry no timestamp and sign "0:{payload}")
+    if (s_sign_ready && protocol_binds_seq(fields)) {
+        char payload[sizeof(((mesh_message_t *)0)->payload)];
+        char message[11 + sizeof(payload)];
+        protocol_render_payload(fields, payload, sizeof(payload));
+        int message_len = snprintf(message, sizeof(message), "%lu:%s", (unsigned long)fields->timestamp, payload);
+        crypto_sign_detached(signature, NULL, (const unsigned char *)message,
+                             (unsigned long long)message_len, s_sign_sk);
+        fields->signature = signature;
+        fields->present |= MESH_HAS(MESH_FIELD_SIGNATURE);
+    }
+
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    int len = protocol_v2_encode(fields, frame, sizeof(frame));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Frame does not fit in %d bytes", MESH_PROTO_V2_MAX_LEN);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return esp_now_send(peer_mac, frame, len);
+}
+
+// Send a frame in the configured wire format (v2 TLV or legacy fixed v1)
+static esp_err_t send_fields(const uint8_t *peer_mac, mesh_fields_t *fields)
+{
+    if (ESP_NOW_PROTOCOL_V2) {
+        return send_v2(peer_mac, fields);
+    }
+
+    mesh_message_t msg;
+    protocol_fields_to_message(fields, &msg);
+    return esp_now_send(peer_mac, (uint8_t *)&msg, sizeof(msg));
+}
+
 esp_err_t esp_now_device_send_motion_event(const uint8_t *peer_mac, 
                                             uint32_t timestamp, 
                                             bool motion_detected,
                                             const uint8_t *signature)
 {
-    mesh_message_t msg;
-    memset(&msg, 0, sizeof(mesh_message_t));
+    mesh_fields_t fields;
+    memset(&fields, 0, sizeof(fields));
     
     const device_config_t *config = device_config_get();
     
     // Fill message
-    msg.type = MSG_TYPE_MOTION;
-    strncpy(msg.device_id, config->device_id, sizeof(msg.device_id) - 1);
-    msg.timestamp = timestamp;
-    
-    // Create motion event payload JSON
-    snprintf(msg.payload, sizeof(msg.payload), 
-             "{\"motion\":%s,\"sensitivity\":%d,\"cooldown\":%d}",
-             motion_detected ? "true" : "false",
-             config->motion_sensitivity,
-             config->motion_cooldown_ms);
-    
-    // Copy signature
+    fields.type = MSG_TYPE_MOTION;
+    strncpy(fields.device_id, config->device_id, sizeof(fields.device_id) - 1);
+    fields.timestamp = timestamp;
+    fields.motion = motion_detected;
+    fields.sensitivity = config->motion_sensitivity;
+    fields.cooldown_ms = config->motion_cooldown_ms;
+    fields.present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_MOTION) |
+                     MESH_HAS(MESH_FIELD_SENSITIVITY) | MESH_HAS(MESH_FIELD_COOLDOWN_MS);
+    
+    // Signature covers "{timestamp}:{payload}" with the canonical rendered payload.
+    // v2 frames are re-signed in send_v2() once boot_id/seq are in the payload.
     if (signature) {
-        memcpy(msg.signature, signature, sizeof(msg.signature));
+        fields.signature = signature;
+        fields.present |= MESH_HAS(MESH_FIELD_SIGNATURE);
     }
     
     // Send via ESP-NOW
-    esp_err_t ret = esp_now_send(peer_mac, (uint8_t *)&msg, sizeof(msg));
+    esp_err_t ret = send_fields(peer_mac, &fields);
     
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Motion event sent: motion=%s", motion_detected ? "true" : "false");
@@ -142,24 +347,24 @@ esp_err_t esp_now_device_send_motion_event(const uint8_t *peer_mac,
 
 esp_err_t esp_now_device_send_heartbeat(const uint8_t *peer_mac, uint32_t timestamp)
 {
-    mesh_message_t msg;
-    memset(&msg, 0, sizeof(mesh_message_t));
+    mesh_fields_t fields;
+    memset(&fields, 0, sizeof(fields));
     
     const device_config_t *config = device_config_get();
     
     // Fill message
-    msg.type = MSG_TYPE_HEARTBEAT;
-    strncpy(msg.device_id, config->device_id, sizeof(msg.device_id) - 1);
-    msg.timestamp = timestamp;
+    fields.type = MSG_TYPE_HEARTBEAT;
+    strncpy(fields.device_id, config->device_id, sizeof(fields.device_id) - 1);
+    fields.timestamp = timestamp;
     
-    // Create heartbeat payload
+    // Heartbeat carries two integers; v2 sends them as varints
     uint32_t heap = esp_get_free_heap_size();
-    snprintf(msg.payload, sizeof(msg.payload), 
-             "{\"heap\":%lu,\"uptime\":%lu}",
-             heap, timestamp);
+    fields.heap = heap;
+    fields.uptime = timestamp;
+    fields.present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_HEAP) | MESH_HAS(MESH_FIELD_UPTIME);
     
     // Send via ESP-NOW
-    esp_err_t ret = esp_now_send(peer_mac, (uint8_t *)&msg, sizeof(msg));
+    esp_err_t ret = send_fields(peer_mac, &fields);
     
     if (ret == ESP_OK) {
         ESP_LOGD(TAG, "Heartbeat sent (heap=%lu)", heap);
@@ -186,7 +391,11 @@ void esp_now_device_process_messages(esp_now_message_handler_t handler)
         // Handle known types
         switch (msg.type) {
             case MSG_TYPE_COMMAND:
-                ESP_LOGI(TAG, "Command received: %s", msg.payload);
+                if (strcmp(msg.device_id, MESH_BROADCAST_ID) == 0) {
+                    ESP_LOGI(TAG, "Group command received: %s", msg.payload);
+                } else {
+                    ESP_LOGI(TAG, "Command received: %s", msg.payload);
+                }
                 break;
             
             case MSG_TYPE_LOG:
@@ -9,6 +9,7 @@
 #include "freertos/task.h"
 #include "device_config.h"
 #include "http_server.h"
+#include "esp_now_device.h"
 
 static const char *TAG = "http_server";
 static httpd_handle_t server = NULL;
@@ -255,6 +256,10 @@ static esp_err_t handler_status(httpd_req_t *req)
     cJSON_AddNumberToObject(root, "motion_gpio", config->motion_gpio);
     cJSON_AddNumberToObject(root, "motion_sensitivity", config->motion_sensitivity);
     cJSON_AddNumberToObject(root, "display_brightness", config->display_brightness);
+    char public_key[65];
+    if (esp_now_device_get_public_key(public_key, sizeof(public_key))) {
+        cJSON_AddStringToObject(root, "public_key", public_key);
+    }
     
     char *json_str = cJSON_Print(root);
     httpd_resp_set_type(req, "application/json");
@@ -3,16 +3,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
-
-// Forward declare mesh_message_t
-typedef struct {
-    uint8_t type;
-    char device_id[16];
-    uint32_t timestamp;
-    char payload[200];
-    uint8_t signature[64];
-} mesh_message_t;
+#include "protocol.h"   // Shared with home base (mesh_message_t, v2 codec)
 
 /**
  * Handler function type for received ESP-NOW messages
@@ -36,13 +29,22 @@ esp_err_t esp_now_device_add_peer(const uint8_t *peer_mac);
  * @param peer_mac Home base MAC address
  * @param timestamp Event timestamp (Unix seconds)
  * @param motion_detected True if motion detected, false if cleared
- * @param signature Ed25519 signature of the motion event (64 bytes)
+ * @param signature Ed25519 signature of the motion event (64 bytes), for v1
+ *                  frames; v2 frames are signed with the device key instead
+ *                  so the signature also covers boot_id and seq
  */
 esp_err_t esp_now_device_send_motion_event(const uint8_t *peer_mac,
                                             uint32_t timestamp,
                                             bool motion_detected,
                                             const uint8_t *signature);
 
+/**
+ * Hex public key of the device's signing key (register it with the home base)
+ * @param hex Output, at least 65 bytes
+ * @return false before esp_now_device_init() or if hex is too small
+ */
+bool esp_now_device_get_public_key(char *hex, size_t hex_len);
+
 /**
  * Send heartbeat to home base
  * @param peer_mac Home base MAC address
@@ -5,6 +5,7 @@
 #include "nvs_flash.h"
 #include "cJSON.h"
 #include "device_config.h"
+#include "unraid_client.h"
 
 static const char *TAG = "device_config";
 
@@ -24,6 +25,7 @@ static const device_config_t DEFAULT_CONFIG = {
     .led_brightness = 80,
     .camera_enabled = false,
     .board_variant = "esp32p4_eth",
+    .log_psram_kb = -1,
 };
 
 esp_err_t device_config_init(void)
@@ -53,7 +55,7 @@ esp_err_t device_config_load(void)
     }
 
     // Try to read configuration JSON
-    char config_str[512];
+    char config_str[1024];
     size_t len = sizeof(config_str) - 1;
     err = nvs_get_str(nvs_handle, "config", config_str, &len);
 
@@ -71,6 +73,7 @@ esp_err_t device_config_load(void)
 
         // Extract fields from JSON
         cJSON *item;
+        g_device_config.log_psram_kb = DEFAULT_CONFIG.log_psram_kb;
         
         item = cJSON_GetObjectItem(root, "device_id");
         if (item && item->valuestring) {
@@ -106,6 +109,21 @@ esp_err_t device_config_load(void)
             strncpy(g_device_config.board_variant, item->valuestring, sizeof(g_device_config.board_variant) - 1);
         }
 
+        item = cJSON_GetObjectItem(root, "uplink_urls");
+        if (item && item->valuestring) {
+            strncpy(g_device_config.uplink_urls, item->valuestring, sizeof(g_device_config.uplink_urls) - 1);
+        }
+
+        item = cJSON_GetObjectItem(root, "uplink_hedge_ms");
+        if (cJSON_IsNumber(item) && item->valuedouble >= 0 && item->valuedouble <= UNRAID_UPLINK_HEDGE_MAX_MS) {
+            g_device_config.uplink_hedge_ms = (uint32_t)item->valueint;
+        } else if (item) {
+            ESP_LOGW(TAG, "Ignoring out-of-range uplink_hedge_ms");
+        }
+
+        item = cJSON_GetObjectItem(root, "log_psram_kb");
+        if (item) g_device_config.log_psram_kb = item->valueint;
+
         cJSON_Delete(root);
         ESP_LOGI(TAG, "Loaded config: device_id=%s, network_id=%d", 
                  g_device_config.device_id, g_device_config.network_id);
@@ -139,6 +157,9 @@ esp_err_t device_config_save(const device_config_t *config)
     cJSON_AddNumberToObject(root, "led_brightness", config->led_brightness);
     cJSON_AddBoolToObject(root, "camera_enabled", config->camera_enabled);
     cJSON_AddStringToObject(root, "board_variant", config->board_variant);
+    cJSON_AddStringToObject(root, "uplink_urls", config->uplink_urls);
+    cJSON_AddNumberToObject(root, "uplink_hedge_ms", config->uplink_hedge_ms);
+    cJSON_AddNumberToObject(root, "log_psram_kb", config->log_psram_kb);
 
     char *config_str = cJSON_PrintUnformatted(root);
     if (!config_str) {
@@ -201,6 +222,9 @@ char* device_config_to_json_string(void)
     cJSON_AddNumberToObject(root, "led_brightness", g_device_config.led_brightness);
     cJSON_AddBoolToObject(root, "camera_enabled", g_device_config.camera_enabled);
     cJSON_AddStringToObject(root, "board_variant", g_device_config.board_variant);
+    cJSON_AddStringToObject(root, "uplink_urls", g_device_config.uplink_urls);
+    cJSON_AddNumberToObject(root, "uplink_hedge_ms", g_device_config.uplink_hedge_ms);
+    cJSON_AddNumberToObject(root, "log_psram_kb", g_device_config.log_psram_kb);
 
     return cJSON_PrintUnformatted(root);
 }
@@ -0,0 +1,267 @@
+#include "device_registry.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mesh_timer_wheel.h"
+#include "protocol.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_DEVICE_REGISTRY_SIZE
+    #define DEVICE_REGISTRY_SIZE CONFIG_DEVICE_REGISTRY_SIZE
+#else
+    #define DEVICE_REGISTRY_SIZE 128
+#endif
+
+#ifdef CONFIG_DEVICE_OFFLINE_TIMEOUT_S
+    #define DEVICE_OFFLINE_TIMEOUT_MS (CONFIG_DEVICE_OFFLINE_TIMEOUT_S * 1000u)
+#else
+    #define DEVICE_OFFLINE_TIMEOUT_MS 90000u
+#endif
+
+// Offline deadlines run on a 1 s wheel tick
+#define DEVICE_TICK_MS 1000u
+#define DEVICE_TIMEOUT_TICKS ((DEVICE_OFFLINE_TIMEOUT_MS + DEVICE_TICK_MS - 1) / DEVICE_TICK_MS)
+
+typedef struct {
+    bool used;
+    mesh_timer_t timer;      // Offline deadline, re-armed by every frame
+    device_registry_entry_t info;
+} device_slot_t;
+
+// Open-addressed by MAC with linear probing; devices are never removed
+static device_slot_t s_slots[DEVICE_REGISTRY_SIZE];
+static int s_count = 0;
+static int s_offline = 0;
+static uint32_t s_overflows = 0;
+static mesh_timer_wheel_t s_wheel;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t device_registry_tick(uint32_t now_ms)
+{
+    return now_ms / DEVICE_TICK_MS;
+}
+
+static uint32_t device_registry_hash(const uint8_t *mac)
+{
+    // FNV-1a over the MAC
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash ^= mac[i];
+        hash *= 16777619u;
+    }
+    return hash % DEVICE_REGISTRY_SIZE;
+}
+
+// Slot holding mac, or the empty slot it would go in, or NULL if full (lock held)
+static device_slot_t *device_registry_slot(const uint8_t *mac)
+{
+    uint32_t start = device_registry_hash(mac);
+    for (uint32_t i = 0; i < DEVICE_REGISTRY_SIZE; i++) {
+        device_slot_t *slot = &s_slots[(start + i) % DEVICE_REGISTRY_SIZE];
+        if (!slot->used || memcmp(slot->info.mac, mac, sizeof(slot->info.mac)) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+void device_registry_init(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_slots, 0, sizeof(s_slots));
+    s_count = 0;
+    s_offline = 0;
+    s_overflows = 0;
+    mesh_timer_wheel_init(&s_wheel, device_registry_tick((uint32_t)(esp_timer_get_time() / 1000)));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+bool device_registry_update(const mesh_rx_frame_t *frame)
+{
+    const mesh_message_t *msg = &frame->msg;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    // Parse outside the lock; heartbeats carry the canonical protocol_render_payload() text
+    unsigned long heap = 0, uptime = 0;
+    bool has_health = msg->type == MSG_TYPE_HEARTBEAT &&
+                      sscanf(msg->payload, "{\"heap\":%lu,\"uptime\":%lu}", &heap, &uptime) == 2;
+
+    portENTER_CRITICAL(&s_lock);
+    device_slot_t *slot = device_registry_slot(frame->src_mac);
+    if (!slot) {
+        s_overflows++;
+        portEXIT_CRITICAL(&s_lock);
+        return false;
+    }
+
+    device_registry_entry_t *info = &slot->info;
+    if (!slot->used) {
+        slot->used = true;
+        s_count++;
+        memcpy(info->mac, frame->src_mac, sizeof(info->mac));
+        info->first_seen_ms = now_ms;
+        info->rssi_avg = frame->rssi;
+    }
+
+    memcpy(info->device_id, msg->device_id, sizeof(info->device_id));
+    info->device_id[sizeof(info->device_id) - 1] = '\0';
+    info->last_seen_ms = now_ms;
+    info->last_type = msg->type;
+    info->frames++;
+    info->rssi = frame->rssi;
+    info->rssi_avg = (int8_t)((3 * (int)info->rssi_avg + frame->rssi) / 4);
+    if (info->offline) {
+        info->offline = false;
+        s_offline--;
+    }
+
+    // +1 tick so a device is always silent for at least the full timeout
+    mesh_timer_wheel_arm(&s_wheel, &slot->timer, device_registry_tick(now_ms) + DEVICE_TIMEOUT_TICKS + 1);
+
+    switch (msg->type) {
+        case MSG_TYPE_HEARTBEAT:
+            info->heartbeats++;
+            if (has_health) {
+                info->heap = (uint32_t)heap;
+                info->uptime = (uint32_t)uptime;
+            }
+            break;
+        case MSG_TYPE_MOTION:
+            info->motion_events++;
+            break;
+        case MSG_TYPE_LOG:
+            info->logs++;
+            break;
+        default:
+            break;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return true;
+}
+
+int device_registry_count(void)
+{
+    return s_count;
+}
+
+int device_registry_offline_count(void)
+{
+    return s_offline;
+}
+
+uint32_t device_registry_overflows(void)
+{
+    return s_overflows;
+}
+
+bool device_registry_poll_offline(uint32_t now_ms, device_registry_entry_t *entry)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    mesh_timer_t *timer = mesh_timer_wheel_poll(&s_wheel, device_registry_tick(now_ms));
+    if (timer) {
+        device_slot_t *slot = (device_slot_t *)((char *)timer - offsetof(device_slot_t, timer));
+        slot->info.offline = true;
+        slot->info.outages++;
+        s_offline++;
+        *entry = slot->info;
+        found = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+bool device_registry_next(int *cursor, device_registry_entry_t *entry)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    while (*cursor < DEVICE_REGISTRY_SIZE && !found) {
+        device_slot_t *slot = &s_slots[(*cursor)++];
+        if (slot->used) {
+            *entry = slot->info;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+bool device_registry_find(const uint8_t *mac, device_registry_entry_t *entry)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    device_slot_t *slot = device_registry_slot(mac);
+    if (slot && slot->used) {
+        *entry = slot->info;
+        found = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+bool device_registry_find_id(const char *device_id, device_registry_entry_t *entry)
+{
+    bool found = false;
+
+    // Linear: only used for downlink commands addressed by name
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < DEVICE_REGISTRY_SIZE && !found; i++) {
+        if (s_slots[i].used && strncmp(s_slots[i].info.device_id, device_id, sizeof(s_slots[i].info.device_id)) == 0) {
+            *entry = s_slots[i].info;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+bool device_registry_is_online(const device_registry_entry_t *entry, uint32_t now_ms)
+{
+    return !entry->offline && (now_ms - entry->last_seen_ms) < DEVICE_OFFLINE_TIMEOUT_MS;
+}
+
+size_t device_registry_format_json(const device_registry_entry_t *entry, uint32_t now_ms,
+                                   char *buf, size_t len)
+{
+    // device_id comes off the air; keep it inside the JSON string
+    char id[sizeof(entry->device_id)];
+    size_t n = 0;
+    for (size_t i = 0; i < sizeof(entry->device_id) - 1 && entry->device_id[i]; i++) {
+        char c = entry->device_id[i];
+        id[n++] = (c == '"' || c == '\\' || (unsigned char)c < 0x20) ? '_' : c;
+    }
+    id[n] = '\0';
+
+    // Dashboard contract (useAPI.ts Device) first, then the registry counters
+    uint32_t age_s = (now_ms - entry->last_seen_ms) / 1000;
+    time_t seen = time(NULL) - age_s;
+    struct tm tm;
+    char last_seen[24];
+    gmtime_r(&seen, &tm);
+    strftime(last_seen, sizeof(last_seen), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    int written = snprintf(buf, len,
+        "{\"device_id\":\"%s\",\"online\":%s,\"last_seen\":\"%s\",\"rssi\":%d,"
+        "\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"last_seen_s\":%lu,\"frames\":%lu,"
+        "\"heartbeats\":%lu,\"motion\":%lu,\"logs\":%lu,\"heap\":%lu,\"uptime\":%lu,"
+        "\"rssi_avg\":%d,\"outages\":%lu}",
+        id, device_registry_is_online(entry, now_ms) ? "true" : "false", last_seen, entry->rssi,
+        entry->mac[0], entry->mac[1], entry->mac[2], entry->mac[3], entry->mac[4], entry->mac[5],
+        (unsigned long)age_s,
+        (unsigned long)entry->frames, (unsigned long)entry->heartbeats,
+        (unsigned long)entry->motion_events, (unsigned long)entry->logs,
+        (unsigned long)entry->heap, (unsigned long)entry->uptime,
+        entry->rssi_avg, (unsigned long)entry->outages);
+
+    return (written > 0 && (size_t)written < len) ? (size_t)written : 0;
+}
@@ -1,81 +1,224 @@
+#include <stdio.h>
 #include <string.h>
 #include "esp_now.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "protocol.h"
+#include "log_storage.h"
+#include "mesh_worker_pool.h"
+#include "mesh_dedup.h"
+#include "mesh_verify.h"
+#include "device_registry.h"
+#include "mesh_downlink.h"
+#include "unraid_client.h"
+#include "sdkconfig.h"
 
 static const char *TAG = "esp_now";
 
-// Message queue for handling received messages asynchronously
-static QueueHandle_t s_mesh_queue = NULL;
-#define MESH_QUEUE_SIZE 20
+// How often silent devices are checked for (one registry wheel tick)
+#define MESH_LIVENESS_PERIOD_MS 1000
+#define MESH_LIVENESS_STACK_SIZE 3072
+#define MESH_LIVENESS_PRIORITY 2
 
-// Forward declaration
-void send_log_to_unraid(mesh_message_t *msg);
+// Frames dropped because the owning worker's ring was full
+static volatile uint32_t s_dropped = 0;
 
 // Callback when data is received
-static void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len) {
-    if (len != sizeof(mesh_message_t)) {
+static void OnDataRecv(const esp_now_recv_info_t *recv_info, const uint8_t *incomingData, int len) {
+    const uint8_t *mac_addr = recv_info->src_addr;
+    int8_t rssi = recv_info->rx_ctrl ? (int8_t)recv_info->rx_ctrl->rssi : 0;
+    bool accepted;
+
+    if (protocol_is_v2(incomingData, len)) {
+        mesh_fields_t fields;
+        if (!protocol_v2_decode(incomingData, len, &fields)) {
+            ESP_LOGE(TAG, "Malformed v2 frame (%d bytes)", len);
+            return;
+        }
+        // Drop link-layer retransmits and replays before they cost a slot.
+        // Only a peek: the window moves once the worker has verified the frame.
+        if (fields.present & MESH_HAS(MESH_FIELD_SEQ)) {
+            mesh_dedup_result_t seen = mesh_dedup_peek(fields.device_id, fields.boot_id, fields.seq);
+            if (seen != MESH_DEDUP_ACCEPT) {
+                ESP_LOGD(TAG, "%s from %s (boot %lu seq %lu)",
+                         seen == MESH_DEDUP_DUPLICATE ? "Duplicate" : "Replay",
+                         fields.device_id, (unsigned long)fields.boot_id, (unsigned long)fields.seq);
+                return;
+            }
+        }
+        // Command acks settle the downlink table, but only once a worker has
+        // verified them; an ack without a command id settles nothing
+        if (fields.type == MSG_TYPE_ACK && !(fields.present & MESH_HAS(MESH_FIELD_CMD_ID))) {
+            return;
+        }
+        accepted = mesh_worker_pool_submit_fields(mac_addr, rssi, &fields);
+    } else if (len == sizeof(mesh_message_t)) {
+        // Legacy fixed-size v1 frame
+        accepted = mesh_worker_pool_submit(mac_addr, rssi, (const mesh_message_t *)incomingData);
+    } else {
         ESP_LOGE(TAG, "Invalid message size: %d != %d", len, (int)sizeof(mesh_message_t));
         return;
     }
 
-    // Queue the message for processing
-    mesh_message_t msg;
-    memcpy(&msg, incomingData, sizeof(mesh_message_t));
-    
-    if (xQueueSend(s_mesh_queue, &msg, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Message queue full, dropping message from %s", msg.device_id);
+    // Handed to the worker that owns this device; never block the WiFi task
+    if (!accepted) {
+        uint32_t dropped = ++s_dropped;
+        if ((dropped & 0x3F) == 1) {
+            ESP_LOGW(TAG, "Worker ring full, dropping messages (%lu dropped so far)", (unsigned long)dropped);
+        }
     }
 }
 
-// Task to process received messages
-static void mesh_processing_task(void *pvParameters) {
-    mesh_message_t msg;
-    
-    while (1) {
-        if (xQueueReceive(s_mesh_queue, &msg, pdMS_TO_TICKS(1000))) {
-            ESP_LOGI(TAG, "Processing message type=0x%02x from %s", msg.type, msg.device_id);
+// Downlink transport: devices become peers only while a command is on the air,
+// so the 20-entry ESP-NOW peer table never limits how many devices we can reach
+static esp_err_t mesh_downlink_transmit(const uint8_t *mac, const uint8_t *frame, size_t len) {
+    if (!esp_now_is_peer_exist(mac)) {
+        esp_now_peer_info_t peer = {0};
+        memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        peer.channel = 0;
+        peer.ifidx = WIFI_IF_STA;
+        peer.encrypt = false;
+        esp_err_t err = esp_now_add_peer(&peer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return esp_now_send(mac, frame, len);
+}
+
+// Link-layer result of a downlink send
+static void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+    mesh_downlink_on_sent(mac_addr, status == ESP_NOW_SEND_SUCCESS, (uint32_t)(esp_timer_get_time() / 1000));
+    esp_now_del_peer(mac_addr);
+}
+
+// True if the frame's (boot_id, seq) may move its sender's replay window:
+// signed together with the payload, or from a sender with no key to check
+static bool mesh_frame_records_seq(const mesh_rx_frame_t *frame) {
+    switch (frame->auth) {
+        case MESH_AUTH_VERIFIED:
+            return frame->seq_bound;
+        case MESH_AUTH_UNKNOWN_KEY:
+        case MESH_AUTH_PENDING:     // Verification disabled
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Route a single frame based on type (runs on the worker that owns the device)
+static void mesh_process_frame(mesh_rx_frame_t *frame) {
+    mesh_message_t *msg = &frame->msg;
+
+    // Forged frames stop here instead of costing an uplink POST and a backend verify
+    if (frame->auth == MESH_AUTH_FORGED) {
+        ESP_LOGW(TAG, "Dropping frame with invalid signature from %s", msg->device_id);
+        return;
+    }
+#ifdef CONFIG_MESH_VERIFY_REQUIRE_KEY
+    if (frame->auth == MESH_AUTH_UNKNOWN_KEY) {
+        ESP_LOGW(TAG, "Dropping frame from %s: no public key loaded", msg->device_id);
+        return;
+    }
+#endif
+
+    if (frame->has_seq && mesh_frame_records_seq(frame)) {
+        // Catches a replay queued before the original was recorded
+        mesh_dedup_result_t seen = mesh_dedup_check(msg->device_id, frame->boot_id, frame->seq);
+        if (seen != MESH_DEDUP_ACCEPT) {
+            ESP_LOGD(TAG, "%s from %s (boot %lu seq %lu)",
+                     seen == MESH_DEDUP_DUPLICATE ? "Duplicate" : "Replay",
+                     msg->device_id, (unsigned long)frame->boot_id, (unsigned long)frame->seq);
+            return;
+        }
+    }
+
+    ESP_LOGI(TAG, "Processing message type=0x%02x from %s", msg->type, msg->device_id);
+
+    if (!device_registry_update(frame)) {
+        ESP_LOGW(TAG, "Device registry full, %s not tracked", msg->device_id);
+    }
+
+    switch (msg->type) {
+        case MSG_TYPE_HEARTBEAT:
+            ESP_LOGD(TAG, "Heartbeat from %s (rssi %d)", msg->device_id, frame->rssi);
+            break;
             
-            // Route message based on type
-            switch (msg.type) {
-                case MSG_TYPE_HEARTBEAT:
-                    ESP_LOGD(TAG, "Heartbeat from %s", msg.device_id);
-                    // In production: update device status, RSSI, etc.
-                    break;
-                    
-                case MSG_TYPE_MOTION:
-                    ESP_LOGI(TAG, "Motion event from %s", msg.device_id);
-                    send_log_to_unraid(&msg);
-                    break;
-                    
-                case MSG_TYPE_LOG:
-                    ESP_LOGD(TAG, "Log from %s: %s", msg.device_id, msg.payload);
-                    send_log_to_unraid(&msg);
-                    break;
-                    
-                case MSG_TYPE_COMMAND:
-                    ESP_LOGI(TAG, "Command received: %s", msg.payload);
-                    // In production: validate signature and execute command
-                    break;
-                    
-                default:
-                    ESP_LOGW(TAG, "Unknown message type: 0x%02x", msg.type);
+        case MSG_TYPE_MOTION:
+            ESP_LOGI(TAG, "Motion event from %s", msg->device_id);
+            send_log_to_unraid(msg);
+            break;
+            
+        case MSG_TYPE_LOG:
+            ESP_LOGD(TAG, "Log from %s: %s", msg->device_id, msg->payload);
+            send_log_to_unraid(msg);
+            break;
+            
+        case MSG_TYPE_ACK:
+            // Unsigned or forged acks from a device with a key never get here.
+            // Acks are v2 only and always carry boot_id/seq.
+            if (!frame->has_seq || (frame->auth == MESH_AUTH_VERIFIED && !frame->seq_bound)) {
+                ESP_LOGW(TAG, "Dropping ack from %s: boot_id/seq missing or not signed", msg->device_id);
+                break;
             }
+            mesh_downlink_on_ack(frame->src_mac, msg->device_id, frame->cmd_id, frame->status,
+                                 (uint32_t)(esp_timer_get_time() / 1000));
+            break;
+            
+        case MSG_TYPE_COMMAND:
+            ESP_LOGI(TAG, "Command received: %s", msg->payload);
+            // In production: validate signature and execute command
+            break;
+            
+        default:
+            ESP_LOGW(TAG, "Unknown message type: 0x%02x", msg->type);
+    }
+}
+
+// Raise an alert for every device whose heartbeat deadline expired
+static void mesh_liveness_task(void *arg) {
+    device_registry_entry_t entry;
+    char message[96];
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(MESH_LIVENESS_PERIOD_MS));
+
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        while (device_registry_poll_offline(now_ms, &entry)) {
+            unsigned long silent_s = (unsigned long)((now_ms - entry.last_seen_ms) / 1000);
+            ESP_LOGW(TAG, "Device %s offline: nothing heard for %lu s", entry.device_id, silent_s);
+            snprintf(message, sizeof(message), "Device offline: nothing heard for %lu s (outage %lu)",
+                     silent_s, (unsigned long)entry.outages);
+            log_storage_add_log(entry.device_id, "warning", "network", message);
         }
     }
 }
 
 void init_esp_now(void) {
-    // Create message queue
-    s_mesh_queue = xQueueCreate(MESH_QUEUE_SIZE, sizeof(mesh_message_t));
-    if (!s_mesh_queue) {
-        ESP_LOGE(TAG, "Failed to create message queue");
+    mesh_dedup_init();
+    device_registry_init();
+
+#ifdef CONFIG_MESH_VERIFY_SIGNATURES
+    // Workers verify each burst of queued frames before handling them
+    if (mesh_verify_init() == ESP_OK) {
+        mesh_worker_pool_set_verifier(mesh_verify_batch);
+    }
+#endif
+
+    // Start the sharded processing workers before any frame can arrive
+    if (mesh_worker_pool_start(mesh_process_frame) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start mesh worker pool");
         return;
     }
 
+    if (xTaskCreate(mesh_liveness_task, "mesh_live", MESH_LIVENESS_STACK_SIZE, NULL,
+                    MESH_LIVENESS_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start liveness task; offline devices will not be alerted");
+    }
+
     // Initialize Wi-Fi in Station mode (required for ESP-NOW)
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     esp_wifi_init(&cfg);
@@ -89,8 +232,10 @@ void init_esp_now(void) {
     }
     
     esp_now_register_recv_cb(OnDataRecv);
-    ESP_LOGI(TAG, "ESP-NOW Initialized in STA mode");
+    esp_now_register_send_cb(OnDataSent);
 
-    // Create message processing task
-    xTaskCreate(mesh_processing_task, "mesh_proc", 4096, NULL, 5, NULL);
+    if (mesh_downlink_init(mesh_downlink_transmit, 0) != ESP_OK || mesh_downlink_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start command downlink");
+    }
+    ESP_LOGI(TAG, "ESP-NOW Initialized in STA mode");
 }
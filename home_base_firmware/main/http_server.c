@@ -3,9 +3,19 @@
 #include <cJSON.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "protocol.h"
 #include "device_config.h"
 #include "log_storage.h"
+#include "log_journal.h"
+#include "mesh_worker_pool.h"
+#include "mesh_dedup.h"
+#include "mesh_verify.h"
+#include "device_registry.h"
+#include "mesh_downlink.h"
+#include "unraid_client.h"
+#include "uplink_breaker.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_spiffs.h"
 
@@ -34,11 +44,265 @@ static esp_err_t status_get_handler(httpd_req_t *req)
 }
 
 // Handler for GET /api/v1/devices
+// Streams the registry in one pass through a fixed buffer; no heap allocation
 static esp_err_t devices_get_handler(httpd_req_t *req)
 {
-    // Placeholder: in a real app, query the mesh node list
-    cJSON *root = cJSON_CreateArray();
-    
+    char buffer[1024];
+    char item[320];
+    size_t used = 0;
+    bool first = true;
+    int cursor = 0;
+    device_registry_entry_t entry;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    httpd_resp_set_type(req, "application/json");
+    buffer[used++] = '[';
+
+    while (device_registry_next(&cursor, &entry)) {
+        size_t len = device_registry_format_json(&entry, now_ms, item, sizeof(item));
+        if (len == 0) {
+            continue;
+        }
+        if (used + len + 2 > sizeof(buffer)) {
+            if (httpd_resp_send_chunk(req, buffer, used) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            used = 0;
+        }
+        if (!first) {
+            buffer[used++] = ',';
+        }
+        memcpy(&buffer[used], item, len);
+        used += len;
+        first = false;
+    }
+
+    buffer[used++] = ']';
+    if (httpd_resp_send_chunk(req, buffer, used) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Handler for GET /api/v1/metrics
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    cJSON *root = cJSON_CreateObject();
+
+    // Mesh worker pool: per-worker backlog and busy time
+    cJSON *mesh = cJSON_AddObjectToObject(root, "mesh");
+    cJSON *workers = cJSON_AddArrayToObject(mesh, "workers");
+    for (int i = 0; i < mesh_worker_pool_get_worker_count(); i++) {
+        mesh_worker_stats_t stats;
+        mesh_worker_pool_get_stats(i, &stats);
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "worker", i);
+        cJSON_AddNumberToObject(item, "core", stats.core);
+        cJSON_AddNumberToObject(item, "processed", stats.processed);
+        cJSON_AddNumberToObject(item, "busy_us", (double)stats.busy_us);
+        cJSON_AddNumberToObject(item, "max_busy_us", stats.max_busy_us);
+
+        // Ingress lanes: backlog, drops, overload shedding and queueing delay
+        cJSON *lanes = cJSON_AddObjectToObject(item, "lanes");
+        for (int lane = 0; lane < MESH_LANE_COUNT; lane++) {
+            cJSON *lane_item = cJSON_AddObjectToObject(lanes, mesh_worker_pool_lane_name(lane));
+            cJSON_AddNumberToObject(lane_item, "depth", stats.lanes[lane].depth);
+            cJSON_AddNumberToObject(lane_item, "high_water", stats.lanes[lane].high_water);
+            cJSON_AddNumberToObject(lane_item, "accepted", stats.lanes[lane].accepted);
+            cJSON_AddNumberToObject(lane_item, "dropped", stats.lanes[lane].dropped);
+            cJSON_AddNumberToObject(lane_item, "shed", stats.lanes[lane].shed);
+            cJSON_AddNumberToObject(lane_item, "processed", stats.lanes[lane].processed);
+            cJSON_AddNumberToObject(lane_item, "max_wait_ms", stats.lanes[lane].max_wait_ms);
+        }
+        cJSON_AddItemToArray(workers, item);
+    }
+
+    // Duplicate / replay filter in front of the workers
+    mesh_dedup_stats_t dedup;
+    mesh_dedup_get_stats(&dedup);
+    cJSON *dedup_item = cJSON_AddObjectToObject(mesh, "dedup");
+    cJSON_AddNumberToObject(dedup_item, "peers", dedup.peers);
+    cJSON_AddNumberToObject(dedup_item, "accepted", dedup.accepted);
+    cJSON_AddNumberToObject(dedup_item, "duplicates", dedup.duplicates);
+    cJSON_AddNumberToObject(dedup_item, "replays", dedup.replays);
+    cJSON_AddNumberToObject(dedup_item, "restarts", dedup.restarts);
+    cJSON_AddNumberToObject(dedup_item, "resyncs", dedup.resyncs);
+    cJSON_AddNumberToObject(dedup_item, "evictions", dedup.evictions);
+
+    // Device registry occupancy
+    cJSON *registry_item = cJSON_AddObjectToObject(mesh, "registry");
+    cJSON_AddNumberToObject(registry_item, "devices", device_registry_count());
+    cJSON_AddNumberToObject(registry_item, "offline", device_registry_offline_count());
+    cJSON_AddNumberToObject(registry_item, "overflows", device_registry_overflows());
+
+    // Edge signature verification
+    mesh_verify_stats_t verify;
+    mesh_verify_get_stats(&verify);
+    cJSON *verify_item = cJSON_AddObjectToObject(mesh, "verify");
+    cJSON_AddNumberToObject(verify_item, "keys", verify.keys);
+    cJSON_AddNumberToObject(verify_item, "verified", verify.verified);
+    cJSON_AddNumberToObject(verify_item, "forged", verify.forged);
+    cJSON_AddNumberToObject(verify_item, "unknown_key", verify.unknown_key);
+    cJSON_AddNumberToObject(verify_item, "unsigned", verify.unsigned_frames);
+    cJSON_AddNumberToObject(verify_item, "batches", verify.batches);
+    cJSON_AddNumberToObject(verify_item, "batch_frames", verify.batch_frames);
+
+    // Uplink to the Unraid backend: delivery and connection reuse
+    unraid_uplink_stats_t uplink;
+    unraid_uplink_get_stats(&uplink);
+    cJSON *uplink_item = cJSON_AddObjectToObject(root, "uplink");
+    cJSON_AddNumberToObject(uplink_item, "queued", uplink.queued);
+    cJSON_AddNumberToObject(uplink_item, "sent", uplink.sent);
+    cJSON_AddNumberToObject(uplink_item, "rejected", uplink.rejected);
+    cJSON_AddNumberToObject(uplink_item, "failed", uplink.failed);
+    cJSON_AddNumberToObject(uplink_item, "dropped", uplink.dropped);
+    cJSON_AddNumberToObject(uplink_item, "dropped_motion", uplink.dropped_motion);
+    cJSON_AddNumberToObject(uplink_item, "evicted", uplink.evicted);
+    cJSON_AddNumberToObject(uplink_item, "queue_high_water", uplink.queue_high_water);
+    cJSON_AddStringToObject(uplink_item, "overflow", unraid_overflow_policy_name(unraid_uplink_get_overflow_policy()));
+    cJSON_AddNumberToObject(uplink_item, "requests", uplink.requests);
+    cJSON_AddNumberToObject(uplink_item, "connects", uplink.connects);
+    cJSON_AddNumberToObject(uplink_item, "reused", uplink.reused);
+    cJSON_AddNumberToObject(uplink_item, "reconnects", uplink.reconnects);
+    cJSON_AddNumberToObject(uplink_item, "idle_closes", uplink.idle_closes);
+    cJSON_AddNumberToObject(uplink_item, "reuse_rate", unraid_uplink_reuse_rate(&uplink));
+    cJSON_AddNumberToObject(uplink_item, "last_status", uplink.last_status);
+    cJSON_AddNumberToObject(uplink_item, "oversize", uplink.oversize);
+    cJSON_AddStringToObject(uplink_item, "format", unraid_uplink_format_name(unraid_uplink_get_format()));
+    cJSON_AddNumberToObject(uplink_item, "batches", uplink.batches);
+    cJSON_AddNumberToObject(uplink_item, "avg_batch",
+                            uplink.batches ? (double)uplink.batched / uplink.batches : 0);
+    cJSON_AddNumberToObject(uplink_item, "max_batch", uplink.max_batch);
+    cJSON_AddNumberToObject(uplink_item, "last_batch", uplink.last_batch);
+    cJSON_AddNumberToObject(uplink_item, "last_batch_bytes", uplink.last_batch_bytes);
+    cJSON_AddNumberToObject(uplink_item, "max_hold_ms", uplink.max_hold_ms);
+
+    // Backoff and circuit breaker: state, how often it tripped, what it held back
+    cJSON *breaker_item = cJSON_AddObjectToObject(uplink_item, "breaker");
+    cJSON_AddStringToObject(breaker_item, "state", uplink_breaker_state_name(uplink.breaker_state));
+    cJSON_AddNumberToObject(breaker_item, "opens", uplink.breaker_opens);
+    cJSON_AddNumberToObject(breaker_item, "probes", uplink.breaker_probes);
+    cJSON_AddNumberToObject(breaker_item, "shed", uplink.shed);
+    cJSON_AddNumberToObject(breaker_item, "batch_budget", uplink.batch_budget);
+    cJSON_AddNumberToObject(breaker_item, "srtt_ms", uplink.srtt_ms);
+
+    // Targets in priority order, each behind its own breaker
+    unraid_uplink_target_stats_t targets[UNRAID_UPLINK_TARGETS_MAX];
+    int target_count = unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX);
+    cJSON_AddNumberToObject(uplink_item, "active_target", uplink.active_target);
+    cJSON_AddNumberToObject(uplink_item, "failovers", uplink.failovers);
+    cJSON_AddNumberToObject(uplink_item, "hedge_ms", unraid_uplink_get_hedge_ms());
+    cJSON_AddNumberToObject(uplink_item, "hedges", uplink.hedges);
+    cJSON_AddNumberToObject(uplink_item, "hedge_wins", uplink.hedge_wins);
+    cJSON *targets_item = cJSON_AddArrayToObject(uplink_item, "targets");
+    for (int i = 0; i < target_count; i++) {
+        cJSON *target_item = cJSON_CreateObject();
+        cJSON_AddStringToObject(target_item, "url", targets[i].url);
+        cJSON_AddStringToObject(target_item, "state", uplink_breaker_state_name(targets[i].breaker_state));
+        cJSON_AddNumberToObject(target_item, "requests", targets[i].requests);
+        cJSON_AddNumberToObject(target_item, "answered", targets[i].answered);
+        cJSON_AddNumberToObject(target_item, "failed", targets[i].failed);
+        cJSON_AddNumberToObject(target_item, "hedged", targets[i].hedged);
+        cJSON_AddNumberToObject(target_item, "opens", targets[i].opens);
+        cJSON_AddNumberToObject(target_item, "srtt_ms", targets[i].srtt_ms);
+        cJSON_AddNumberToObject(target_item, "batch_budget", targets[i].batch_budget);
+        cJSON_AddItemToArray(targets_item, target_item);
+    }
+    // Compression: ratio and CPU cost per batch
+    cJSON *gzip_item = cJSON_AddObjectToObject(uplink_item, "gzip");
+    cJSON_AddBoolToObject(gzip_item, "enabled", unraid_uplink_get_gzip());
+    cJSON_AddNumberToObject(gzip_item, "batches", uplink.gzipped);
+    cJSON_AddNumberToObject(gzip_item, "skipped", uplink.gzip_skipped);
+    cJSON_AddNumberToObject(gzip_item, "in_bytes", uplink.gzip_in_bytes);
+    cJSON_AddNumberToObject(gzip_item, "out_bytes", uplink.gzip_out_bytes);
+    cJSON_AddNumberToObject(gzip_item, "ratio", unraid_uplink_gzip_ratio(&uplink));
+    uint32_t gzip_attempts = uplink.gzipped + uplink.gzip_skipped;
+    cJSON_AddNumberToObject(gzip_item, "avg_us",
+                            gzip_attempts ? (double)uplink.gzip_us / gzip_attempts : 0);
+    cJSON_AddNumberToObject(gzip_item, "last_us", uplink.last_gzip_us);
+    cJSON_AddNumberToObject(gzip_item, "max_us", uplink.max_gzip_us);
+    // WebSocket stream: frames in flight against the backend's window
+    cJSON *stream_item = cJSON_AddObjectToObject(uplink_item, "stream");
+    cJSON_AddBoolToObject(stream_item, "enabled", unraid_uplink_get_stream());
+    cJSON_AddBoolToObject(stream_item, "up", uplink.stream_up);
+    cJSON_AddNumberToObject(stream_item, "connects", uplink.stream_connects);
+    cJSON_AddNumberToObject(stream_item, "frames", uplink.streamed);
+    cJSON_AddNumberToObject(stream_item, "acked", uplink.stream_acked);
+    cJSON_AddNumberToObject(stream_item, "resent", uplink.stream_resent);
+    cJSON_AddNumberToObject(stream_item, "fallbacks", uplink.stream_fallbacks);
+    cJSON_AddNumberToObject(stream_item, "in_flight", uplink.stream_in_flight);
+    cJSON_AddNumberToObject(stream_item, "window", uplink.stream_window);
+    cJSON_AddNumberToObject(stream_item, "last_ack_ms", uplink.last_ack_ms);
+    cJSON_AddNumberToObject(stream_item, "max_ack_ms", uplink.max_ack_ms);
+    cJSON_AddNumberToObject(uplink_item, "next_seq", uplink.next_seq);
+    cJSON_AddNumberToObject(uplink_item, "unkeyed", uplink.unkeyed);
+    cJSON *flushes = cJSON_AddObjectToObject(uplink_item, "flushes");
+    for (int reason = 0; reason < UNRAID_FLUSH_REASON_COUNT; reason++) {
+        cJSON_AddNumberToObject(flushes, unraid_flush_reason_name(reason), uplink.flushes[reason]);
+    }
+
+    // Store-and-forward spool: depth, age and replay progress
+    uplink_spool_stats_t spool;
+    unraid_uplink_get_spool_stats(&spool);
+    cJSON *spool_item = cJSON_AddObjectToObject(uplink_item, "spool");
+    cJSON_AddNumberToObject(spool_item, "batches", spool.records);
+    cJSON_AddNumberToObject(spool_item, "entries", spool.entries);
+    cJSON_AddNumberToObject(spool_item, "bytes", spool.bytes);
+    cJSON_AddNumberToObject(spool_item, "oldest_age_s", spool.oldest_age_s);
+    cJSON_AddNumberToObject(spool_item, "spooled", uplink.spooled);
+    cJSON_AddNumberToObject(spool_item, "spilled", uplink.spilled);
+    cJSON_AddNumberToObject(spool_item, "replayed", uplink.replayed);
+    cJSON_AddNumberToObject(spool_item, "replay_rate", uplink.replay_rate);
+    cJSON_AddNumberToObject(spool_item, "recovered", spool.recovered);
+    cJSON_AddNumberToObject(spool_item, "lost", spool.lost);
+    cJSON_AddNumberToObject(spool_item, "corrupt", spool.corrupt);
+    cJSON_AddNumberToObject(spool_item, "segments", spool.segments);
+    cJSON_AddNumberToObject(spool_item, "min_erases", spool.min_erases);
+    cJSON_AddNumberToObject(spool_item, "max_erases", spool.max_erases);
+
+    // Log store RAM: per-entry cost, how many entries the budget holds, and
+    // the PSRAM tier behind it
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    cJSON *store_item = cJSON_AddObjectToObject(root, "log_storage");
+    cJSON_AddNumberToObject(store_item, "budget_bytes", mem.budget);
+    cJSON_AddNumberToObject(store_item, "record_bytes", mem.record_size);
+    cJSON_AddNumberToObject(store_item, "arena_bytes", mem.arena_size);
+    cJSON_AddNumberToObject(store_item, "name_table_bytes", mem.names_size);
+    cJSON_AddNumberToObject(store_item, "entries", mem.entries);
+    cJSON_AddNumberToObject(store_item, "text_bytes", mem.text_bytes);
+    cJSON_AddNumberToObject(store_item, "bytes_per_entry", mem.bytes_per_entry);
+    cJSON_AddNumberToObject(store_item, "max_entries", mem.max_entries);
+    cJSON_AddNumberToObject(store_item, "devices", mem.devices);
+    cJSON_AddNumberToObject(store_item, "levels", mem.levels);
+    cJSON_AddNumberToObject(store_item, "categories", mem.categories);
+    cJSON_AddNumberToObject(store_item, "inline_names", mem.inline_names);
+    cJSON_AddNumberToObject(store_item, "psram_budget_bytes", mem.psram_budget);
+    cJSON_AddNumberToObject(store_item, "psram_entries", mem.psram_entries);
+    cJSON_AddNumberToObject(store_item, "psram_max_entries", mem.psram_max_entries);
+    cJSON_AddNumberToObject(store_item, "demotions", mem.demotions);
+    cJSON_AddNumberToObject(store_item, "demoted", mem.demoted);
+    cJSON_AddNumberToObject(store_item, "promoted", mem.promoted);
+    cJSON_AddNumberToObject(store_item, "dropped", mem.dropped);
+
+    // Log history on flash: what is held, write batching and boot recovery
+    log_journal_stats_t journal;
+    uint32_t journal_missed;
+    log_storage_get_journal_stats(&journal, &journal_missed);
+    cJSON *journal_item = cJSON_AddObjectToObject(root, "log_journal");
+    cJSON_AddNumberToObject(journal_item, "segments", journal.segments);
+    cJSON_AddNumberToObject(journal_item, "logs", journal.logs);
+    cJSON_AddNumberToObject(journal_item, "motion_events", journal.motions);
+    cJSON_AddNumberToObject(journal_item, "appended", journal.appended);
+    cJSON_AddNumberToObject(journal_item, "flushes", journal.flushes);
+    cJSON_AddNumberToObject(journal_item, "bytes_written", journal.bytes_written);
+    cJSON_AddNumberToObject(journal_item, "missed", journal_missed);
+    cJSON_AddNumberToObject(journal_item, "recovered", journal.recovered);
+    cJSON_AddNumberToObject(journal_item, "corrupt", journal.corrupt);
+    cJSON_AddNumberToObject(journal_item, "scanned_segments", journal.scanned_segments);
+    cJSON_AddNumberToObject(journal_item, "recovery_us", journal.recovery_us);
+
     char *json_str = cJSON_PrintUnformatted(root);
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, (const char *)json_str, strlen(json_str));
@@ -397,6 +661,138 @@ static esp_err_t config_hardware_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// POST /api/config/uplink
+// {"targets": ["http://a:8000/logs/ingest", ...], "hedge_ms": 100}
+// Applied at once and saved, so it survives a reboot
+static esp_err_t config_uplink_handler(httpd_req_t *req)
+{
+    char buffer[1024];
+    int received = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (received <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No data");
+        return ESP_FAIL;
+    }
+    buffer[received] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    device_config_t config = *device_config_get();
+
+    // A list of URLs, or one comma-separated string
+    cJSON *item = cJSON_GetObjectItem(root, "targets");
+    if (cJSON_IsArray(item)) {
+        size_t used = 0;
+        cJSON *url;
+        config.uplink_urls[0] = '\0';
+        cJSON_ArrayForEach(url, item) {
+            if (!cJSON_IsString(url)) {
+                continue;
+            }
+            int n = snprintf(&config.uplink_urls[used], sizeof(config.uplink_urls) - used, "%s%s",
+                             used ? "," : "", url->valuestring);
+            used = n > 0 && used + n < sizeof(config.uplink_urls) ? used + n : sizeof(config.uplink_urls);
+        }
+    } else if (cJSON_IsString(item)) {
+        strncpy(config.uplink_urls, item->valuestring, sizeof(config.uplink_urls) - 1);
+        config.uplink_urls[sizeof(config.uplink_urls) - 1] = '\0';
+    }
+
+    item = cJSON_GetObjectItem(root, "hedge_ms");
+    if (item && (!cJSON_IsNumber(item) || item->valuedouble < 0 ||
+                 item->valuedouble > UNRAID_UPLINK_HEDGE_MAX_MS)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "hedge_ms must be 0-5000");
+        return ESP_FAIL;
+    }
+    if (item) config.uplink_hedge_ms = (uint32_t)item->valueint;
+    cJSON_Delete(root);
+
+    if (strlen(config.uplink_urls) == sizeof(config.uplink_urls) - 1 ||
+        unraid_uplink_set_targets(config.uplink_urls, config.uplink_hedge_ms) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid targets: 1-4 http(s) URLs");
+        return ESP_FAIL;
+    }
+    device_config_save(&config);
+
+    unraid_uplink_target_stats_t targets[UNRAID_UPLINK_TARGETS_MAX];
+    int count = unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX);
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "applied");
+    cJSON *list = cJSON_AddArrayToObject(response, "targets");
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(list, cJSON_CreateString(targets[i].url));
+    }
+    cJSON_AddNumberToObject(response, "hedge_ms", unraid_uplink_get_hedge_ms());
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, (const char *)json_str, strlen(json_str));
+
+    free(json_str);
+    cJSON_Delete(response);
+    return ESP_OK;
+}
+
+// POST /api/config/logs
+// {"psram_kb": 4096} - PSRAM for older log entries, 0 for SRAM only
+// Applied at once and saved, so it survives a reboot
+static esp_err_t config_logs_handler(httpd_req_t *req)
+{
+    char buffer[128];
+    int received = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (received <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No data");
+        return ESP_FAIL;
+    }
+    buffer[received] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+    cJSON *item = cJSON_GetObjectItem(root, "psram_kb");
+    int psram_kb = cJSON_IsNumber(item) ? item->valueint : -1;
+    cJSON_Delete(root);
+
+    if (psram_kb < 0 || psram_kb > 16384) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "psram_kb must be 0-16384");
+        return ESP_FAIL;
+    }
+    esp_err_t err = log_storage_set_capacity((uint32_t)psram_kb * 1024);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "psram_kb must be 0 or at least 16");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not enough free PSRAM");
+        return ESP_FAIL;
+    }
+
+    device_config_t config = *device_config_get();
+    config.log_psram_kb = psram_kb;
+    device_config_save(&config);
+
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "applied");
+    cJSON_AddNumberToObject(response, "psram_kb", mem.psram_budget / 1024);
+    cJSON_AddNumberToObject(response, "psram_max_entries", mem.psram_max_entries);
+    cJSON_AddNumberToObject(response, "entries", log_storage_get_log_count());
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, (const char *)json_str, strlen(json_str));
+
+    free(json_str);
+    cJSON_Delete(response);
+    return ESP_OK;
+}
+
 // === Log and Motion Endpoints ===
 
 // GET /api/logs - Retrieve device logs with optional filtering
@@ -473,6 +869,130 @@ static esp_err_t motion_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Authenticate a request the backend signed with the network key over
+// "{timestamp}:{nonce}:{body}". Sends the error response on failure.
+static esp_err_t check_backend_signature(httpd_req_t *req, cJSON *root, const char *body)
+{
+    cJSON *timestamp = cJSON_GetObjectItem(root, "timestamp");
+    const char *nonce = cJSON_GetStringValue(cJSON_GetObjectItem(root, "nonce"));
+    const char *signature = cJSON_GetStringValue(cJSON_GetObjectItem(root, "signature"));
+
+    if (!signature || !nonce || !cJSON_IsNumber(timestamp)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing signature, timestamp or nonce");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = mesh_verify_command((int64_t)timestamp->valuedouble, nonce, body, signature,
+                                        (int64_t)time(NULL));
+    const char *reason;
+    switch (err) {
+        case ESP_OK:
+            return ESP_OK;
+        case ESP_ERR_INVALID_ARG:
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed signature or nonce");
+            return ESP_FAIL;
+        case ESP_ERR_NO_MEM:
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        case ESP_ERR_INVALID_STATE:
+            reason = "Network key not provisioned";
+            break;
+        case ESP_ERR_TIMEOUT:
+            reason = "Timestamp outside window or clock not synced";
+            break;
+        case ESP_ERR_INVALID_RESPONSE:
+            reason = "Nonce already used";
+            break;
+        default:
+            reason = "Invalid signature";
+            break;
+    }
+    ESP_LOGW(TAG, "Rejected signed request: %s", reason);
+    httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, reason);
+    return ESP_FAIL;
+}
+
+// POST /api/v1/keys - Load a device public key or the network key
+// Body: {"device_id": "...", "public_key": "<64 hex>"} or {"network_key": "<64 hex>"},
+// plus "timestamp", "nonce" and "signature" (network key) over
+// "device_key:{device_id}:{public_key}" or "network_key:{network_key}".
+// The first network key may be loaded unsigned while none is provisioned.
+static esp_err_t keys_post_handler(httpd_req_t *req)
+{
+    char buffer[512];
+    int received = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (received <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No data");
+        return ESP_FAIL;
+    }
+    buffer[received] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    const char *device_id = cJSON_GetStringValue(cJSON_GetObjectItem(root, "device_id"));
+    const char *public_key = cJSON_GetStringValue(cJSON_GetObjectItem(root, "public_key"));
+    const char *network_key = cJSON_GetStringValue(cJSON_GetObjectItem(root, "network_key"));
+    bool signed_request = cJSON_GetObjectItem(root, "signature") != NULL;
+
+    char body[160];
+    int body_len;
+    if (network_key) {
+        body_len = snprintf(body, sizeof(body), "network_key:%s", network_key);
+    } else if (device_id && public_key) {
+        body_len = snprintf(body, sizeof(body), "device_key:%s:%s", device_id, public_key);
+    } else {
+        body_len = -1;
+    }
+    if (body_len < 0 || body_len >= (int)sizeof(body)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected device_id + public_key or network_key (64 hex chars)");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err;
+    if (!signed_request && network_key && !mesh_verify_has_network_key()) {
+        // First provisioning; refused if another request got there first
+        err = mesh_verify_provision_network_key(network_key);
+    } else if (!signed_request) {
+        cJSON_Delete(root);
+        ESP_LOGW(TAG, "Rejected unsigned key update");
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Key updates must be signed with the network key");
+        return ESP_FAIL;
+    } else if (check_backend_signature(req, root, body) != ESP_OK) {
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    } else if (network_key) {
+        err = mesh_verify_set_network_key(network_key);
+    } else {
+        err = mesh_verify_set_key(device_id, public_key);
+    }
+    cJSON_Delete(root);
+
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected device_id + public_key or network_key (64 hex chars)");
+        return ESP_FAIL;
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Key updates must be signed with the network key");
+        return ESP_FAIL;
+    }
+    if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Key table full");
+        return ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Key loaded but not persisted: %s", esp_err_to_name(err));
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, err == ESP_OK ? "{\"status\": \"stored\"}" : "{\"status\": \"loaded\"}");
+    return ESP_OK;
+}
+
 // POST /api/v1/command - Receive signed commands from Unraid/home base
 static esp_err_t command_post_handler(httpd_req_t *req)
 {
@@ -507,7 +1027,6 @@ static esp_err_t command_post_handler(httpd_req_t *req)
     // Extract command fields
     const char *command = cJSON_GetStringValue(cJSON_GetObjectItem(root, "command"));
     const char *target_device = cJSON_GetStringValue(cJSON_GetObjectItem(root, "target_device"));
-    const char *signature = cJSON_GetStringValue(cJSON_GetObjectItem(root, "signature"));
     
     if (!command || !target_device) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing command or target_device");
@@ -515,8 +1034,31 @@ static esp_err_t command_post_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
     
-    // TODO: Verify signature (requires network private key from device_config)
-    // For now, log the command and return success
+    // Verify the backend's signature over "{timestamp}:{nonce}:{command}:{payload_json}"
+    // and that it is fresh and not a replay
+    const char *payload_json = cJSON_GetStringValue(cJSON_GetObjectItem(root, "payload_json"));
+    if (!payload_json) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing payload_json");
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
+    
+    size_t body_len = strlen(command) + strlen(payload_json) + 2;
+    char *body = malloc(body_len);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
+    snprintf(body, body_len, "%s:%s", command, payload_json);
+    esp_err_t verify_err = check_backend_signature(req, root, body);
+    free(body);
+    
+    if (verify_err != ESP_OK) {
+        ESP_LOGW(TAG, "Rejected command '%s'", command);
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
     
     ESP_LOGI(TAG, "Received command '%s' for device '%s'", command, target_device);
     
@@ -524,13 +1066,107 @@ static esp_err_t command_post_handler(httpd_req_t *req)
     log_storage_add_log("home_base", "info", "command", 
                        "Received command from Unraid");
     
-    // In a real implementation, forward to target device via ESP-NOW
-    // mesh_send_command(target_device, command, ...);
+    // What the device receives: {"command": ..., "payload": {...}}
+    char device_payload[sizeof(((mesh_message_t *)0)->payload)];
+    cJSON *frame_json = cJSON_CreateObject();
+    cJSON_AddStringToObject(frame_json, "command", command);
+    cJSON *args = cJSON_Parse(payload_json);
+    cJSON_AddItemToObject(frame_json, "payload", args ? args : cJSON_CreateObject());
+    bool fits = cJSON_PrintPreallocated(frame_json, device_payload, sizeof(device_payload), false);
+    cJSON_Delete(frame_json);
+    if (!fits) {
+        httpd_resp_send_err(req, HTTPD_413_PAYLOAD_TOO_LARGE, "Command does not fit in one ESP-NOW frame");
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
     
+    // Queue on the downlink. "all" and "target_devices" lists go out as one
+    // broadcast; devices that miss it are repaired by unicast.
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
     cJSON *response = cJSON_CreateObject();
+    cJSON *ids = cJSON_CreateArray();
+    cJSON *group_list = cJSON_GetObjectItem(root, "target_devices");
+    int queued = 0, rejected = 0, covered = 0;
+    device_registry_entry_t entry;
+    
+    if (strcmp(target_device, "all") == 0 || cJSON_IsArray(group_list)) {
+        bool everyone = strcmp(target_device, "all") == 0;
+        int capacity = device_registry_count();
+        int count = 0, selected = 0;
+        mesh_downlink_target_t *targets = capacity > 0 ? calloc(capacity, sizeof(*targets)) : NULL;
+        int cursor = 0;
+        while (targets && count < capacity && device_registry_next(&cursor, &entry)) {
+            mesh_downlink_target_t *target = &targets[count++];
+            memcpy(target->mac, entry.mac, sizeof(target->mac));
+            memcpy(target->device_id, entry.device_id, sizeof(target->device_id));
+            target->selected = everyone;
+        }
+        if (!everyone) {
+            cJSON *item;
+            cJSON_ArrayForEach(item, group_list) {
+                const char *id = cJSON_GetStringValue(item);
+                bool known = false;
+                for (int i = 0; id && i < count; i++) {
+                    if (strncmp(targets[i].device_id, id, sizeof(targets[i].device_id)) == 0) {
+                        targets[i].selected = true;
+                        known = true;
+                    }
+                }
+                rejected += known ? 0 : 1;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            selected += targets[i].selected;
+        }
+        
+        uint32_t id;
+        if (selected > 0 && mesh_downlink_submit_group(targets, count, command, device_payload, now_ms, &id, &covered) == ESP_OK) {
+            cJSON_AddItemToArray(ids, cJSON_CreateNumber(id));
+            queued = selected;
+        } else {
+            rejected += selected;
+        }
+        free(targets);
+        
+        if (!everyone && selected == 0) {
+            cJSON_Delete(ids);
+            cJSON_Delete(response);
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown target_devices");
+            return ESP_FAIL;
+        }
+    } else if (device_registry_find_id(target_device, &entry)) {
+        uint32_t id;
+        if (mesh_downlink_submit(entry.mac, entry.device_id, command, device_payload, now_ms, &id) == ESP_OK) {
+            cJSON_AddItemToArray(ids, cJSON_CreateNumber(id));
+            queued++;
+        } else {
+            rejected++;
+        }
+    } else {
+        cJSON_Delete(ids);
+        cJSON_Delete(response);
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown target_device");
+        return ESP_FAIL;
+    }
+    
+    if (queued == 0 && rejected > 0) {
+        cJSON_Delete(ids);
+        cJSON_Delete(response);
+        cJSON_Delete(root);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Command queue full", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    
     cJSON_AddStringToObject(response, "status", "queued");
     cJSON_AddStringToObject(response, "command", command);
     cJSON_AddStringToObject(response, "target_device", target_device);
+    cJSON_AddItemToObject(response, "command_ids", ids);
+    cJSON_AddNumberToObject(response, "devices", queued);
+    cJSON_AddNumberToObject(response, "broadcast", covered);
+    cJSON_AddNumberToObject(response, "rejected", rejected);
     
     char *json_str = cJSON_PrintUnformatted(response);
     httpd_resp_set_type(req, "application/json");
@@ -542,12 +1178,86 @@ static esp_err_t command_post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Handler for GET /api/v1/commands[?id=N]
+// Delivery state of downlink commands, streamed like /api/v1/devices
+static esp_err_t commands_get_handler(httpd_req_t *req)
+{
+    char buffer[1024];
+    char item[256];
+    char query[32];
+    char id_str[16];
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    mesh_downlink_entry_t entry;
+
+    httpd_resp_set_type(req, "application/json");
+
+    // One command id; a group command lists every member device
+    bool filter = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                  httpd_query_key_value(query, "id", id_str, sizeof(id_str)) == ESP_OK;
+    uint32_t filter_id = filter ? (uint32_t)strtoul(id_str, NULL, 10) : 0;
+    size_t used;
+    bool first = true;
+    int cursor = 0;
+
+    if (filter) {
+        if (!mesh_downlink_find(filter_id, &entry)) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown command id");
+            return ESP_FAIL;
+        }
+        used = (size_t)snprintf(buffer, sizeof(buffer), "{\"id\":%lu,\"commands\":[", (unsigned long)filter_id);
+    } else {
+        mesh_downlink_stats_t stats;
+        mesh_downlink_get_stats(&stats);
+        used = (size_t)snprintf(buffer, sizeof(buffer),
+            "{\"stats\":{\"submitted\":%lu,\"pending\":%lu,\"acked\":%lu,\"failed\":%lu,"
+            "\"retransmits\":%lu,\"link_failures\":%lu,\"ack_timeouts\":%lu,"
+            "\"broadcasts\":%lu,\"repairs\":%lu},\"commands\":[",
+            (unsigned long)stats.submitted, (unsigned long)stats.pending, (unsigned long)stats.acked,
+            (unsigned long)stats.failed, (unsigned long)stats.retransmits,
+            (unsigned long)stats.link_failures, (unsigned long)stats.ack_timeouts,
+            (unsigned long)stats.broadcasts, (unsigned long)stats.repairs);
+    }
+
+    while (mesh_downlink_next(&cursor, &entry)) {
+        if (filter && entry.id != filter_id) {
+            continue;
+        }
+        size_t len = mesh_downlink_format_json(&entry, now_ms, item, sizeof(item));
+        if (len == 0) {
+            continue;
+        }
+        if (used + len + 3 > sizeof(buffer)) {
+            if (httpd_resp_send_chunk(req, buffer, used) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            used = 0;
+        }
+        if (!first) {
+            buffer[used++] = ',';
+        }
+        memcpy(&buffer[used], item, len);
+        used += len;
+        first = false;
+    }
+
+    buffer[used++] = ']';
+    buffer[used++] = '}';
+    if (httpd_resp_send_chunk(req, buffer, used) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 // POST /api/reboot
 static esp_err_t reboot_handler(httpd_req_t *req)
 {
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, "{\"status\": \"rebooting\"}");
-    
+
+    // Don't lose logs still waiting in the uplink batch or the journal buffer
+    unraid_uplink_flush();
+    log_storage_flush();
+
     // Schedule reboot after a delay to allow response to be sent
     vTaskDelay(pdMS_TO_TICKS(500));
     esp_restart();
@@ -579,7 +1289,7 @@ void start_webserver(void)
 
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = 24;
 
     ESP_LOGI(TAG, "Starting web server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
@@ -609,6 +1319,14 @@ void start_webserver(void)
         };
         httpd_register_uri_handler(server, &devices_uri);
 
+        httpd_uri_t metrics_uri = {
+            .uri = "/api/v1/metrics",
+            .method = HTTP_GET,
+            .handler = metrics_get_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &metrics_uri);
+
         // Device config endpoints
         httpd_uri_t device_type_get_uri = {
             .uri = "/api/device/type",
@@ -682,6 +1400,22 @@ void start_webserver(void)
         };
         httpd_register_uri_handler(server, &config_hardware_uri);
 
+        httpd_uri_t config_uplink_uri = {
+            .uri = "/api/config/uplink",
+            .method = HTTP_POST,
+            .handler = config_uplink_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &config_uplink_uri);
+
+        httpd_uri_t config_logs_uri = {
+            .uri = "/api/config/logs",
+            .method = HTTP_POST,
+            .handler = config_logs_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &config_logs_uri);
+
         httpd_uri_t reboot_uri = {
             .uri = "/api/reboot",
             .method = HTTP_POST,
@@ -716,7 +1450,23 @@ void start_webserver(void)
         };
         httpd_register_uri_handler(server, &command_uri);
 
-        ESP_LOGI(TAG, "Web server started with %d endpoints", 15);
+        httpd_uri_t keys_uri = {
+            .uri = "/api/v1/keys",
+            .method = HTTP_POST,
+            .handler = keys_post_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &keys_uri);
+
+        httpd_uri_t commands_uri = {
+            .uri = "/api/v1/commands",
+            .method = HTTP_GET,
+            .handler = commands_get_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &commands_uri);
+
+        ESP_LOGI(TAG, "Web server started with %d endpoints", 19);
     } else {
         ESP_LOGE(TAG, "Failed to start web server");
     }
@@ -16,6 +16,9 @@ typedef struct {
     uint8_t led_brightness;      // 0-100%
     bool camera_enabled;         // Camera enabled flag
     char board_variant[32];      // Board variant string
+    char uplink_urls[256];       // Comma-separated uplink targets, empty for the build default
+    uint32_t uplink_hedge_ms;    // Motion hedge budget for those targets, 0 = off
+    int32_t log_psram_kb;        // PSRAM for older logs, 0 = off, -1 for the build default
 } device_config_t;
 
 /**
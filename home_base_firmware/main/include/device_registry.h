@@ -0,0 +1,104 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mesh_ring.h"
+
+/**
+ * In-memory registry of mesh devices heard by the home base.
+ *
+ * Fixed-size open-addressed hash table keyed by sender MAC, updated by the
+ * mesh workers on every accepted frame. Nothing is allocated after boot;
+ * readers copy entries out one at a time.
+ *
+ * Each device has a deadline on a timer wheel (mesh_timer_wheel.h) that
+ * every frame pushes out by the offline timeout, so detecting silent
+ * devices costs O(1) per frame instead of a periodic scan of the table.
+ */
+
+/**
+ * Snapshot of one device
+ */
+typedef struct {
+    uint8_t mac[6];
+    char device_id[16];
+    uint32_t first_seen_ms;  // ms since boot
+    uint32_t last_seen_ms;
+    uint8_t last_type;       // MSG_TYPE_* of the latest frame
+    uint32_t frames;         // All accepted frames
+    uint32_t heartbeats;
+    uint32_t motion_events;
+    uint32_t logs;
+    uint32_t heap;           // From the latest heartbeat
+    uint32_t uptime;
+    int8_t rssi;             // Latest frame, dBm
+    int8_t rssi_avg;         // Smoothed over recent frames, dBm
+    bool offline;            // Deadline expired and no frame since
+    uint32_t outages;        // Times reported offline
+} device_registry_entry_t;
+
+/**
+ * Forget all devices
+ */
+void device_registry_init(void);
+
+/**
+ * Record an accepted frame (called by mesh workers)
+ * @return false if the device is new and the table is full
+ */
+bool device_registry_update(const mesh_rx_frame_t *frame);
+
+/**
+ * Number of devices tracked
+ */
+int device_registry_count(void);
+
+/**
+ * Number of devices currently reported offline
+ */
+int device_registry_offline_count(void);
+
+/**
+ * Devices refused because the table was full
+ */
+uint32_t device_registry_overflows(void);
+
+/**
+ * Hand out one device whose offline deadline has passed, marking it offline.
+ * Each silence is reported once; call repeatedly until it returns false.
+ */
+bool device_registry_poll_offline(uint32_t now_ms, device_registry_entry_t *entry);
+
+/**
+ * Copy out the next device, starting from *cursor = 0
+ * @return false once all devices have been returned
+ */
+bool device_registry_next(int *cursor, device_registry_entry_t *entry);
+
+/**
+ * Find a device by MAC
+ */
+bool device_registry_find(const uint8_t *mac, device_registry_entry_t *entry);
+
+/**
+ * Find a device by the device_id it last reported
+ */
+bool device_registry_find_id(const char *device_id, device_registry_entry_t *entry);
+
+/**
+ * True if the device was heard from within the offline timeout
+ */
+bool device_registry_is_online(const device_registry_entry_t *entry, uint32_t now_ms);
+
+/**
+ * Format one device as a JSON object into buf (no allocation)
+ * Leads with the dashboard's fields (device_id, online, last_seen as UTC
+ * ISO 8601, rssi), followed by the registry counters.
+ * @return Length written, or 0 if buf is too small
+ */
+size_t device_registry_format_json(const device_registry_entry_t *entry, uint32_t now_ms,
+                                   char *buf, size_t len);
+
+#endif // DEVICE_REGISTRY_H
@@ -0,0 +1,100 @@
+#ifndef LOG_JOURNAL_H
+#define LOG_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "log_storage.h"
+
+/**
+ * Append-only flash history for the log and motion stores (log_storage.c).
+ *
+ * Records go into the "logs" data partition, split into fixed-size segments
+ * used in ring order like the uplink spool. Appends collect in a RAM buffer
+ * and reach flash in one write per flush, so a burst of logs costs one
+ * flash operation rather than one per entry. Each record carries a CRC over
+ * its header and payload.
+ *
+ * Each segment starts with a header (sequence number, erase count, CRC) and
+ * a seal, left erased while the segment is being filled and programmed with
+ * its record counts once it is full. At boot the headers and seals alone
+ * give the order and contents of every segment; only the newest one is
+ * scanned record by record, to find where appends continue. A torn write
+ * ends that scan, and appends then move on to a fresh segment.
+ *
+ * When the partition is full the oldest segment is erased.
+ *
+ * Not thread-safe; log_storage's flush task serializes access.
+ */
+
+#define LOG_JOURNAL_PARTITION_LABEL "logs"
+#define LOG_JOURNAL_PARTITION_SUBTYPE 0x41
+
+typedef enum {
+    LOG_JOURNAL_LOG = 1,
+    LOG_JOURNAL_MOTION = 2,
+    LOG_JOURNAL_CLEAR_LOGS = 3,      // Everything before it in the store was cleared
+    LOG_JOURNAL_CLEAR_MOTION = 4,
+} log_journal_kind_t;
+
+typedef struct log_journal_stats {
+    uint32_t segments;       // Segments in the partition
+    uint32_t segment_size;
+    uint32_t logs;           // Log records held
+    uint32_t motions;        // Motion records held
+    uint32_t appended;       // Records appended since boot
+    uint32_t flushes;        // Flash writes of the append buffer
+    uint32_t bytes_written;
+    uint32_t recovered;      // Records replayed at boot
+    uint32_t corrupt;        // Records that failed their CRC
+    uint32_t scanned_segments; // Segments read record by record at boot
+    uint32_t recovery_us;    // Time to mount and index the partition
+} log_journal_stats_t;
+
+/**
+ * Called for each record replayed, oldest first. For the clear kinds only
+ * `id` is set: the first ID issued after the clear.
+ */
+typedef void (*log_journal_replay_cb_t)(log_journal_kind_t kind, const device_log_t *log,
+                                        const motion_event_t *event, uint32_t id, void *ctx);
+
+/**
+ * Mount the "logs" partition and index its segments
+ * @return ESP_ERR_NOT_FOUND if there is no such partition,
+ *         ESP_ERR_INVALID_SIZE if it holds fewer than two segments
+ */
+esp_err_t log_journal_init(void);
+
+/**
+ * Replay, oldest first, at least the newest `logs` log records and `motions`
+ * motion records (more if they share segments with them), and every clear
+ * record among them
+ */
+esp_err_t log_journal_replay(uint32_t logs, uint32_t motions, log_journal_replay_cb_t cb, void *ctx);
+
+/**
+ * Buffer a record; written to flash by log_journal_flush or when the buffer
+ * fills
+ */
+esp_err_t log_journal_append_log(const device_log_t *log);
+
+esp_err_t log_journal_append_motion(const motion_event_t *event);
+
+/**
+ * Record that a store was cleared; `next_id` is the first ID issued after
+ */
+esp_err_t log_journal_append_clear(log_journal_kind_t kind, uint32_t next_id);
+
+/**
+ * Write buffered records to flash
+ */
+esp_err_t log_journal_flush(void);
+
+/**
+ * Was the partition mounted?
+ */
+bool log_journal_ready(void);
+
+void log_journal_get_stats(log_journal_stats_t *stats);
+
+#endif // LOG_JOURNAL_H
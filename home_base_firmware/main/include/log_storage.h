@@ -2,9 +2,45 @@
 #define LOG_STORAGE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
 
-#define MAX_LOGS 500
+/**
+ * RAM for the log store, records and messages together. Each entry takes a
+ * LOG_RECORD_SIZE-byte record plus the length of its message; device IDs,
+ * levels and categories are interned in small tables outside the budget.
+ * The budget is split for messages averaging LOG_STORAGE_AVG_MESSAGE bytes:
+ * shorter ones fit MAX_LOGS entries, longer ones fewer.
+ */
+#ifdef CONFIG_LOG_STORAGE_KB
+    #define LOG_STORAGE_BYTES (CONFIG_LOG_STORAGE_KB * 1024)
+#else
+    #define LOG_STORAGE_BYTES (48 * 1024)
+#endif
+
+#ifdef CONFIG_LOG_STORAGE_AVG_MESSAGE
+    #define LOG_STORAGE_AVG_MESSAGE CONFIG_LOG_STORAGE_AVG_MESSAGE
+#else
+    #define LOG_STORAGE_AVG_MESSAGE 64
+#endif
+
+/**
+ * PSRAM for the log store's cold tier, which holds older entries once the
+ * SRAM tier above is full. Set at runtime by log_storage_set_capacity; 0
+ * keeps the store in SRAM alone. Split like the SRAM budget, so at the
+ * default 2 MB it holds about 23,800 entries.
+ */
+#ifdef CONFIG_LOG_STORAGE_PSRAM_KB
+    #define LOG_STORAGE_PSRAM_BYTES (CONFIG_LOG_STORAGE_PSRAM_KB * 1024)
+#else
+    #define LOG_STORAGE_PSRAM_BYTES 0
+#endif
+#define LOG_STORAGE_PSRAM_MIN_BYTES (16 * 1024)
+
+#define LOG_RECORD_SIZE 24
+#define MAX_LOGS (LOG_STORAGE_BYTES / (LOG_RECORD_SIZE + LOG_STORAGE_AVG_MESSAGE))
 #define MAX_MOTION_EVENTS 100
 
 /**
@@ -29,13 +65,58 @@ typedef struct {
     char media_path[128]; // Path to captured image/video
 } motion_event_t;
 
+/*
+ * Any task may add entries; adds from different tasks are serialized by a
+ * short spinlock. Listings, lookups and counts take no lock and never delay
+ * an add: they copy each entry out and skip copies torn by a concurrent
+ * write, so they see only whole entries.
+ *
+ * Entries are persisted to the "logs" flash partition (log_journal.h) by a
+ * background task, within CONFIG_LOG_JOURNAL_FLUSH_MS of being added or
+ * sooner once CONFIG_LOG_JOURNAL_FLUSH_BATCH are waiting. Entries added
+ * since the last flush are lost on power failure, and their IDs may be
+ * issued again after the reboot.
+ *
+ * Log entries are held in two tiers: the newest MAX_LOGS or so in SRAM,
+ * where every add goes, and older ones in PSRAM when a cold tier is set.
+ * Adds move the oldest SRAM entries to PSRAM in batches as needed. Listings,
+ * lookups and counts cover both tiers.
+ */
+
+struct log_journal_stats;
+
 /**
- * Initialize log storage (NVS)
+ * Initialize log storage, restoring the entries and IDs held at the last
+ * flush before reboot. Calling it again discards the RAM copy and restores
+ * from flash once more.
  */
 void log_storage_init(void);
 
 /**
- * Add a log entry (FIFO - oldest entries removed when full)
+ * Give the cold tier `psram_bytes` of PSRAM (0 to do without one), keeping
+ * the newest entries that fit. When it is disabled the newest of its
+ * entries are moved back to SRAM while there is room. Before
+ * log_storage_init, sets the size it allocates.
+ * @return ESP_ERR_INVALID_ARG below LOG_STORAGE_PSRAM_MIN_BYTES,
+ *         ESP_ERR_NO_MEM if the PSRAM is not free (the old tier is kept)
+ */
+esp_err_t log_storage_set_capacity(uint32_t psram_bytes);
+
+/**
+ * Write entries added since the last flush to flash now
+ */
+void log_storage_flush(void);
+
+/**
+ * Journal counters, and entries overwritten in RAM before they could be
+ * written to flash (`missed`)
+ */
+void log_storage_get_journal_stats(struct log_journal_stats *stats, uint32_t *missed);
+
+/**
+ * Add a log entry (FIFO - the oldest entries are overwritten when full).
+ * Each entry gets the next ID; IDs are never reused, even after a clear.
+ * Strings are truncated to the device_log_t field sizes.
  */
 void log_storage_add_log(const char *device_id, const char *level, 
                          const char *category, const char *message);
@@ -46,7 +127,9 @@ void log_storage_add_log(const char *device_id, const char *level,
 void log_storage_add_motion_event(const char *device_id, const char *media_path);
 
 /**
- * Get all logs (optional device_id filter)
+ * Get all logs (optional device_id filter), newest first, as held when the
+ * call started; it stops early at entries overwritten meanwhile and skips
+ * IDs lost at power failure.
  * Returns JSON array string (caller must free)
  */
 char* log_storage_get_logs_json(const char *device_id, int limit);
@@ -58,10 +141,55 @@ char* log_storage_get_logs_json(const char *device_id, int limit);
 char* log_storage_get_motion_json(const char *device_id, int limit);
 
 /**
- * Get count of stored logs
+ * Copy out the log entry with this ID
+ * @return false if it was never stored or has been overwritten
+ */
+bool log_storage_get_log(uint32_t id, device_log_t *out);
+
+/**
+ * Copy out the motion event with this ID
+ * @return false if it was never stored or has been overwritten
+ */
+bool log_storage_get_motion_event(uint32_t id, motion_event_t *out);
+
+/**
+ * Get count of stored logs, in both tiers
  */
 uint32_t log_storage_get_log_count(void);
 
+/**
+ * Memory used by the log store. The first group is the SRAM tier.
+ */
+typedef struct {
+    uint32_t budget;          // LOG_STORAGE_BYTES: records and message arena
+    uint32_t record_size;     // Fixed bytes per entry
+    uint32_t arena_size;      // Bytes for messages
+    uint32_t names_size;      // Interned name tables, outside the budget
+    uint32_t entries;         // Entries held in SRAM
+    uint32_t text_bytes;      // Arena bytes the held entries use
+    uint32_t bytes_per_entry; // Record plus average message, as held
+    uint32_t max_entries;     // Entries the budget holds at that average
+    uint32_t devices;         // Names interned
+    uint32_t levels;
+    uint32_t categories;
+    uint32_t inline_names;    // Names stored with the message: their table was full
+    uint32_t psram_budget;    // Cold tier bytes, 0 without one
+    uint32_t psram_entries;   // Entries held in PSRAM
+    uint32_t psram_max_entries; // Record slots in PSRAM
+    uint32_t demotions;       // Batches moved from SRAM to PSRAM
+    uint32_t demoted;         // Entries in them
+    uint32_t promoted;        // Entries moved back to SRAM as the cold tier went away
+    uint32_t dropped;         // Entries SRAM evicted before they could be demoted
+} log_storage_memory_t;
+
+void log_storage_get_memory(log_storage_memory_t *mem);
+
+/**
+ * Log entries a budget of `budget` bytes holds when messages average
+ * `message_bytes`
+ */
+uint32_t log_storage_capacity_for(uint32_t budget, uint32_t message_bytes);
+
 /**
  * Get count of stored motion events
  */
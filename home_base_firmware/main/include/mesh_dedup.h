@@ -0,0 +1,68 @@
+#ifndef MESH_DEDUP_H
+#define MESH_DEDUP_H
+
+#include <stdint.h>
+
+/**
+ * Per-peer duplicate / replay filter for ESP-NOW frames.
+ *
+ * Each sender gets a 64-frame sliding window over its sequence numbers
+ * (highest seq seen plus a bitmap of the 63 before it), keyed by the
+ * device_id its frames are signed under rather than the spoofable MAC. A
+ * frame is accepted once; a repeat inside the window is a duplicate,
+ * anything older than the window is a replay, however far back. A higher
+ * boot_id starts a fresh window (the sender rebooted), a slightly lower one
+ * is a replay from an earlier boot. A boot_id MESH_DEDUP_RESYNC_GAP or more
+ * behind re-syncs the window instead: the sender rebooted onto a random
+ * boot_id because it could not persist its counter.
+ *
+ * The WiFi task only peeks, to drop retransmits before they cost a ring
+ * slot. Windows move in mesh_dedup_check(), which workers call once a
+ * frame's signature (covering boot_id and seq) has verified, so a forged
+ * frame can neither advance nor re-sync the window of a device with a key.
+ * Devices without a loaded key can be impersonated outright; their windows
+ * only filter retransmits.
+ */
+
+#define MESH_DEDUP_WINDOW 64
+
+typedef enum {
+    MESH_DEDUP_ACCEPT = 0,   // First time this (boot_id, seq) was seen
+    MESH_DEDUP_DUPLICATE,    // Already seen inside the window
+    MESH_DEDUP_REPLAY,       // Older than the window or from an earlier boot
+} mesh_dedup_result_t;
+
+typedef struct {
+    uint32_t peers;          // Peers currently tracked
+    uint32_t accepted;
+    uint32_t duplicates;
+    uint32_t replays;
+    uint32_t restarts;       // Window resets because a peer rebooted
+    uint32_t resyncs;        // Window resets after a large backwards boot_id jump
+    uint32_t evictions;      // Peers forgotten to make room (table full)
+} mesh_dedup_stats_t;
+
+/**
+ * Forget all peers and reset counters
+ */
+void mesh_dedup_init(void);
+
+/**
+ * Classify a frame against its sender's window without recording it
+ * Unknown senders are accepted and not added; rejections are counted.
+ */
+mesh_dedup_result_t mesh_dedup_peek(const char *device_id, uint32_t boot_id, uint32_t seq);
+
+/**
+ * Check a frame against its sender's window and record it if new
+ * Only call this once boot_id and seq are authenticated, or the sender has
+ * no key to authenticate them with.
+ */
+mesh_dedup_result_t mesh_dedup_check(const char *device_id, uint32_t boot_id, uint32_t seq);
+
+/**
+ * Snapshot the filter counters
+ */
+void mesh_dedup_get_stats(mesh_dedup_stats_t *stats);
+
+#endif // MESH_DEDUP_H
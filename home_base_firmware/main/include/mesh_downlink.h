@@ -0,0 +1,165 @@
+#ifndef MESH_DOWNLINK_H
+#define MESH_DOWNLINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/**
+ * Reliable command downlink from the home base to mesh devices.
+ *
+ * Commands wait in a fixed table of outstanding commands, chained into one
+ * FIFO queue per device. Each device has at most one command on the air, so
+ * commands to one device arrive in order, while up to max_inflight devices
+ * are served at once. A command is sent as a v2 MSG_TYPE_COMMAND frame
+ * carrying its id; the ESP-NOW send callback reports whether the radio got a
+ * link-layer ack, and the device answers with a MSG_TYPE_ACK frame for the
+ * same id. Missing link or application acks are retransmitted with
+ * exponential backoff until the attempt limit.
+ *
+ * A group command goes out as one broadcast frame instead of a unicast per
+ * device. Every covered device acks the shared id; when the ack window
+ * closes, devices that stayed silent fall back to the unicast path above,
+ * paced by the same in-flight limit.
+ *
+ * All entry points are thread safe. Time is passed in explicitly (ms since
+ * boot) so the engine can be driven by a simulated clock.
+ */
+
+#define MESH_DOWNLINK_COMMAND_LEN 24
+
+typedef enum {
+    MESH_DL_FREE = 0,
+    MESH_DL_QUEUED,          // Waiting behind earlier commands or for its retry time
+    MESH_DL_BROADCAST,       // Covered by a group broadcast, waiting for the device's ack
+    MESH_DL_SENDING,         // Handed to ESP-NOW, waiting for the send callback
+    MESH_DL_WAIT_ACK,        // Radio delivered, waiting for the device's ack
+    MESH_DL_ACKED,
+    MESH_DL_FAILED,          // Attempts exhausted or rejected by the radio
+} mesh_downlink_state_t;
+
+/**
+ * Snapshot of one command
+ */
+typedef struct {
+    uint32_t id;
+    uint8_t mac[6];
+    char device_id[16];
+    char command[MESH_DOWNLINK_COMMAND_LEN];
+    mesh_downlink_state_t state;
+    uint8_t attempts;        // Transmissions so far
+    bool broadcast;          // First transmission was a group broadcast
+    uint32_t queued_ms;
+    uint32_t done_ms;        // When acked or failed
+} mesh_downlink_entry_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t acked;
+    uint32_t failed;
+    uint32_t retransmits;
+    uint32_t link_failures;  // Send callback reported no link-layer ack
+    uint32_t ack_timeouts;
+    uint32_t pending;        // Queued or in flight now
+    uint32_t broadcasts;     // Group broadcast frames sent
+    uint32_t repairs;        // Group members that needed a unicast repair
+} mesh_downlink_stats_t;
+
+/**
+ * One device considered for a group command
+ */
+typedef struct {
+    uint8_t mac[6];
+    char device_id[16];
+    bool selected;           // false: known device the command must not reach
+} mesh_downlink_target_t;
+
+/**
+ * Transmit one frame to a device (non-blocking; completion is reported
+ * through mesh_downlink_on_sent())
+ */
+typedef esp_err_t (*mesh_downlink_send_t)(const uint8_t *mac, const uint8_t *frame, size_t len);
+
+/**
+ * Reset the table and set the transport
+ * @param max_inflight Devices served concurrently, 0 for the Kconfig default
+ */
+esp_err_t mesh_downlink_init(mesh_downlink_send_t send, int max_inflight);
+
+/**
+ * Start the task that drives retransmits and dispatch
+ */
+esp_err_t mesh_downlink_start(void);
+
+/**
+ * Queue a command for a device
+ * @param payload Command text sent to the device (JSON)
+ * @param id_out Command id for status lookups
+ * @return ESP_ERR_NO_MEM if the table is full of pending commands,
+ *         ESP_ERR_INVALID_SIZE if the payload does not fit in one frame
+ */
+esp_err_t mesh_downlink_submit(const uint8_t *mac, const char *device_id, const char *command,
+                               const char *payload, uint32_t now_ms, uint32_t *id_out);
+
+/**
+ * Queue one command for a group of devices under a single id
+ *
+ * Pass every known device, marking the targets as selected. Selected devices
+ * with nothing else queued are covered by one broadcast frame; the rest are
+ * queued as unicasts. The broadcast carries a target bitmap unless every
+ * device is covered, and a target whose bit collides with a device that must
+ * not run the command is sent a unicast instead.
+ * @param covered_out Targets covered by the broadcast (may be NULL)
+ * @return ESP_ERR_NO_MEM if the table cannot hold every target,
+ *         ESP_ERR_INVALID_SIZE if the payload does not fit in one frame
+ */
+esp_err_t mesh_downlink_submit_group(const mesh_downlink_target_t *targets, int count, const char *command,
+                                     const char *payload, uint32_t now_ms, uint32_t *id_out, int *covered_out);
+
+/**
+ * ESP-NOW send callback result for a device
+ */
+void mesh_downlink_on_sent(const uint8_t *mac, bool delivered, uint32_t now_ms);
+
+/**
+ * Application ack from a device (MSG_TYPE_ACK)
+ * Only pass acks whose signature verified for device_id; it must match the
+ * device the command was queued for.
+ */
+void mesh_downlink_on_ack(const uint8_t *mac, const char *device_id, uint32_t id, uint8_t status,
+                          uint32_t now_ms);
+
+/**
+ * Handle timeouts and transmit every command that is due
+ * @return ms until the next deadline (capped at one second)
+ */
+uint32_t mesh_downlink_run(uint32_t now_ms);
+
+/**
+ * Copy out the next command in the table, starting from *cursor = 0
+ */
+bool mesh_downlink_next(int *cursor, mesh_downlink_entry_t *entry);
+
+/**
+ * Copy out a command by id (for a group command, its first device)
+ */
+bool mesh_downlink_find(uint32_t id, mesh_downlink_entry_t *entry);
+
+/**
+ * Snapshot the counters
+ */
+void mesh_downlink_get_stats(mesh_downlink_stats_t *stats);
+
+/**
+ * Name of a state for status output
+ */
+const char *mesh_downlink_state_name(mesh_downlink_state_t state);
+
+/**
+ * Format one command as a JSON object into buf (no allocation)
+ * @return Length written, or 0 if buf is too small
+ */
+size_t mesh_downlink_format_json(const mesh_downlink_entry_t *entry, uint32_t now_ms, char *buf, size_t len);
+
+#endif // MESH_DOWNLINK_H
@@ -0,0 +1,95 @@
+#ifndef MESH_RING_H
+#define MESH_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "protocol.h"
+
+/**
+ * Signature verdict for a received frame
+ */
+typedef enum {
+    MESH_AUTH_PENDING = 0,   // Not checked yet
+    MESH_AUTH_VERIFIED,      // Signature valid for the device's key
+    MESH_AUTH_UNSIGNED,      // Type that devices do not sign (heartbeat)
+    MESH_AUTH_UNKNOWN_KEY,   // No public key loaded for this device
+    MESH_AUTH_FORGED,        // Signature does not verify
+} mesh_auth_t;
+
+/**
+ * Received frame as stored in an ingress ring slot
+ */
+typedef struct {
+    mesh_message_t msg;
+    uint8_t src_mac[6];      // Sender MAC from the ESP-NOW callback
+    uint8_t auth;            // mesh_auth_t, set by the consumer before handling
+    int8_t rssi;             // Received signal strength, dBm (0 if unknown)
+    uint32_t rx_time_ms;     // Receive time (ms since boot)
+    bool has_seq;            // v2 frame carried boot_id/seq
+    bool seq_bound;          // ... and they are part of the signed payload
+    uint32_t boot_id;
+    uint32_t seq;
+    uint32_t cmd_id;         // MSG_TYPE_ACK: command being acked
+    uint8_t status;          // MSG_TYPE_ACK: MESH_ACK_*
+} mesh_rx_frame_t;
+
+/**
+ * Single-producer / single-consumer ring of preallocated frame slots.
+ *
+ * The producer (WiFi task) writes each frame exactly once, straight into a
+ * reserved slot, and never blocks: when the ring is full the frame is
+ * dropped and counted. The consumer processes the frame in place and then
+ * releases the slot.
+ */
+typedef struct {
+    mesh_rx_frame_t *slots;
+    uint32_t mask;               // capacity - 1 (capacity is a power of two)
+    _Atomic uint32_t head;       // Next slot the producer fills
+    _Atomic uint32_t tail;       // Next slot the consumer reads
+    _Atomic uint32_t accepted;   // Frames committed by the producer
+    _Atomic uint32_t dropped;    // Frames rejected because the ring was full
+    _Atomic uint32_t high_water; // Deepest occupancy observed
+} mesh_ring_t;
+
+/**
+ * Initialize a ring over caller-provided slot storage
+ * @param capacity Number of slots, must be a power of two
+ * @return false if capacity is not a power of two
+ */
+bool mesh_ring_init(mesh_ring_t *ring, mesh_rx_frame_t *slots, uint32_t capacity);
+
+/**
+ * Reserve the next free slot for writing (producer only)
+ * Returns NULL and counts a drop if the ring is full.
+ */
+mesh_rx_frame_t *mesh_ring_reserve(mesh_ring_t *ring);
+
+/**
+ * Publish the slot returned by the last mesh_ring_reserve() (producer only)
+ */
+void mesh_ring_commit(mesh_ring_t *ring);
+
+/**
+ * Get the oldest published slot without removing it (consumer only)
+ * Returns NULL if the ring is empty.
+ */
+mesh_rx_frame_t *mesh_ring_peek(mesh_ring_t *ring);
+
+/**
+ * Get the n-th published slot (0 = oldest) without removing it (consumer only)
+ * Returns NULL if fewer than n + 1 slots are waiting.
+ */
+mesh_rx_frame_t *mesh_ring_peek_at(mesh_ring_t *ring, uint32_t n);
+
+/**
+ * Return the slot obtained from mesh_ring_peek() to the producer (consumer only)
+ */
+void mesh_ring_release(mesh_ring_t *ring);
+
+/**
+ * Number of published slots waiting for the consumer
+ */
+uint32_t mesh_ring_depth(mesh_ring_t *ring);
+
+#endif // MESH_RING_H
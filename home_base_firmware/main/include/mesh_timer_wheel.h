@@ -0,0 +1,66 @@
+#ifndef MESH_TIMER_WHEEL_H
+#define MESH_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Hashed timer wheel for per-device deadlines.
+ *
+ * Timers are intrusive: the owner embeds a mesh_timer_t and the wheel only
+ * links it into the slot for (deadline % MESH_TIMER_WHEEL_SLOTS). Arming,
+ * re-arming and cancelling are O(1); advancing by one tick only visits one
+ * slot. Deadlines further out than one revolution simply stay in their slot
+ * until their tick comes round.
+ *
+ * Ticks are caller-defined units (the device registry uses seconds) and
+ * compared wrap-safe. Not thread safe: callers hold their own lock.
+ */
+
+#define MESH_TIMER_WHEEL_SLOTS 128   // Power of two
+
+typedef struct mesh_timer {
+    struct mesh_timer *next;
+    struct mesh_timer *prev;
+    uint32_t deadline;               // Absolute tick
+} mesh_timer_t;
+
+typedef struct {
+    mesh_timer_t slots[MESH_TIMER_WHEEL_SLOTS];  // List heads
+    mesh_timer_t expired;            // Due timers not yet handed out
+    uint32_t cursor;                 // Next tick to sweep
+    uint32_t armed;                  // Timers linked into the wheel
+} mesh_timer_wheel_t;
+
+/**
+ * Empty the wheel and start sweeping at now
+ */
+void mesh_timer_wheel_init(mesh_timer_wheel_t *wheel, uint32_t now);
+
+/**
+ * (Re-)arm a timer to fire at deadline, unlinking it first if armed.
+ * Deadlines already swept fire on the next poll.
+ */
+void mesh_timer_wheel_arm(mesh_timer_wheel_t *wheel, mesh_timer_t *timer, uint32_t deadline);
+
+/**
+ * Unlink a timer if armed
+ */
+void mesh_timer_wheel_cancel(mesh_timer_wheel_t *wheel, mesh_timer_t *timer);
+
+/**
+ * True if the timer is linked into the wheel
+ */
+static inline bool mesh_timer_is_armed(const mesh_timer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+/**
+ * Sweep up to now and return one expired timer (unlinked), or NULL once
+ * nothing else is due. Call repeatedly to drain.
+ */
+mesh_timer_t *mesh_timer_wheel_poll(mesh_timer_wheel_t *wheel, uint32_t now);
+
+#endif // MESH_TIMER_WHEEL_H
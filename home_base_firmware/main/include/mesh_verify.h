@@ -0,0 +1,104 @@
+#ifndef MESH_VERIFY_H
+#define MESH_VERIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "protocol.h"
+#include "mesh_ring.h"
+
+/**
+ * Ed25519 verification of mesh frames on the home base.
+ *
+ * Device public keys are hex-decoded and validated once, when loaded, into
+ * a fixed in-RAM table keyed by device_id and persisted to NVS. Frames are
+ * checked against "{timestamp}:{payload}", the same message the backend
+ * verifies, so forged frames are dropped before they are forwarded.
+ *
+ * Requests from the backend (commands, key updates) are signed with the
+ * network key over "{timestamp}:{nonce}:{body}"; the timestamp must be
+ * within a window of the SNTP clock and each nonce is accepted once.
+ */
+
+// Clock readings before this (2024-01-01) mean SNTP has not synced yet
+#define MESH_VERIFY_CLOCK_VALID 1704067200LL
+
+typedef struct {
+    uint32_t keys;           // Device keys loaded
+    uint32_t verified;       // Frames with a valid signature
+    uint32_t forged;         // Frames whose signature did not verify
+    uint32_t unknown_key;    // Frames from devices without a loaded key
+    uint32_t unsigned_frames;// Heartbeats (not signed by devices)
+    uint32_t batches;        // Bursts checked by mesh_verify_batch()
+    uint32_t batch_frames;   // Frames checked in those bursts
+} mesh_verify_stats_t;
+
+/**
+ * Initialize the crypto library and load stored keys from NVS
+ */
+esp_err_t mesh_verify_init(void);
+
+/**
+ * Add or replace a device public key
+ * @param public_key_hex 64 hex characters (32-byte Ed25519 public key)
+ * @return ESP_ERR_INVALID_ARG if the key is malformed, ESP_ERR_NO_MEM if
+ *         the table is full, or the NVS error if it could not be persisted
+ *         (the key is still active until reboot)
+ */
+esp_err_t mesh_verify_set_key(const char *device_id, const char *public_key_hex);
+
+/**
+ * Set the network public key used to verify commands from the backend
+ * Callers must have authenticated the update (see mesh_verify_command).
+ */
+esp_err_t mesh_verify_set_network_key(const char *public_key_hex);
+
+/**
+ * Set the network key only if none is loaded yet (first provisioning)
+ * @return ESP_ERR_INVALID_STATE if a network key is already loaded
+ */
+esp_err_t mesh_verify_provision_network_key(const char *public_key_hex);
+
+/**
+ * Whether a network key is loaded
+ */
+bool mesh_verify_has_network_key(void);
+
+/**
+ * Verify a single frame
+ */
+mesh_auth_t mesh_verify_message(const mesh_message_t *msg);
+
+/**
+ * Verify a burst of frames, setting frame->auth on each
+ * Key lookups are done once per run of frames from the same device.
+ * Matches mesh_batch_verifier_t.
+ */
+void mesh_verify_batch(mesh_rx_frame_t **frames, int count);
+
+/**
+ * Verify a detached signature over message with the network key
+ * @return ESP_ERR_INVALID_STATE if no network key is loaded,
+ *         ESP_ERR_INVALID_CRC if the signature does not verify
+ */
+esp_err_t mesh_verify_network_signature(const char *message, const char *signature_hex);
+
+/**
+ * Authenticate a request from the backend
+ * Checks the network key signature over "{timestamp}:{nonce}:{body}", that
+ * timestamp is within CONFIG_MESH_VERIFY_COMMAND_WINDOW_S of now, and that
+ * the nonce has not been accepted before.
+ * @param now Current SNTP time in seconds
+ * @return As mesh_verify_network_signature, plus ESP_ERR_TIMEOUT if the
+ *         timestamp is outside the window or the clock is not synced, and
+ *         ESP_ERR_INVALID_RESPONSE if the nonce was already used
+ */
+esp_err_t mesh_verify_command(int64_t timestamp, const char *nonce, const char *body,
+                              const char *signature_hex, int64_t now);
+
+/**
+ * Snapshot the verification counters
+ */
+void mesh_verify_get_stats(mesh_verify_stats_t *stats);
+
+#endif // MESH_VERIFY_H
@@ -0,0 +1,109 @@
+#ifndef MESH_WORKER_POOL_H
+#define MESH_WORKER_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "mesh_ring.h"
+
+/**
+ * Ingress lanes, highest priority first.
+ * Motion and command lanes are served with strict priority; heartbeat and
+ * log lanes share the remaining capacity by weight. Under overload the log
+ * lane is shed first.
+ */
+typedef enum {
+    MESH_LANE_MOTION = 0,
+    MESH_LANE_COMMAND,
+    MESH_LANE_HEARTBEAT,
+    MESH_LANE_LOG,
+    MESH_LANE_COUNT
+} mesh_lane_t;
+
+/**
+ * Handler invoked by a worker for every frame, in place in its ring slot
+ */
+typedef void (*mesh_frame_handler_t)(mesh_rx_frame_t *frame);
+
+/**
+ * Called by a worker with a run of queued frames from one lane before the
+ * first of them is handled; sets frame->auth on each.
+ */
+typedef void (*mesh_batch_verifier_t)(mesh_rx_frame_t **frames, int count);
+
+/**
+ * Per-lane counters
+ */
+typedef struct {
+    uint32_t depth;          // Frames currently waiting
+    uint32_t high_water;     // Deepest backlog observed
+    uint32_t accepted;       // Frames accepted into the lane
+    uint32_t dropped;        // Frames dropped because the lane was full
+    uint32_t shed;           // Frames refused by overload shedding
+    uint32_t processed;      // Frames handed to the handler
+    uint32_t max_wait_ms;    // Longest time a frame waited before processing
+} mesh_lane_stats_t;
+
+/**
+ * Per-worker counters
+ */
+typedef struct {
+    mesh_lane_stats_t lanes[MESH_LANE_COUNT];
+    uint32_t processed;      // Frames handed to the handler
+    uint64_t busy_us;        // Total time spent inside the handler
+    uint32_t max_busy_us;    // Longest single handler call
+    int core;                // Pinned core, or -1 if unpinned
+} mesh_worker_stats_t;
+
+/**
+ * Start the worker tasks (count, priority and core affinity from Kconfig)
+ * @param handler Called for every frame on the worker that owns its device
+ */
+esp_err_t mesh_worker_pool_start(mesh_frame_handler_t handler);
+
+/**
+ * Install a batch signature verifier (call before mesh_worker_pool_start)
+ * Without one, frames reach the handler with auth == MESH_AUTH_PENDING.
+ */
+void mesh_worker_pool_set_verifier(mesh_batch_verifier_t verifier);
+
+/**
+ * Hand a received frame to the worker that owns its device_id (WiFi task only)
+ * The frame is copied once, straight into a slot of the lane for its type.
+ * Never blocks.
+ * @return false if the frame was dropped (lane full) or shed (overload)
+ */
+bool mesh_worker_pool_submit(const uint8_t *mac_addr, int8_t rssi, const mesh_message_t *msg);
+
+/**
+ * Same as mesh_worker_pool_submit() for a decoded v2 frame
+ * The fields are rendered directly into the reserved slot.
+ */
+bool mesh_worker_pool_submit_fields(const uint8_t *mac_addr, int8_t rssi, const mesh_fields_t *fields);
+
+/**
+ * Worker index that processes frames for a device_id
+ */
+int mesh_worker_pool_shard(const char *device_id);
+
+/**
+ * Lane that carries a given MSG_TYPE_* (unknown types go to the log lane)
+ */
+mesh_lane_t mesh_worker_pool_lane_for_type(uint8_t type);
+
+/**
+ * Short name of a lane ("motion", "command", "heartbeat", "log")
+ */
+const char *mesh_worker_pool_lane_name(mesh_lane_t lane);
+
+/**
+ * Number of running workers
+ */
+int mesh_worker_pool_get_worker_count(void);
+
+/**
+ * Snapshot the counters of one worker
+ */
+void mesh_worker_pool_get_stats(int worker, mesh_worker_stats_t *stats);
+
+#endif // MESH_WORKER_POOL_H
@@ -2,12 +2,15 @@
 #define PROTOCOL_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 // ESP-NOW Message Types
 #define MSG_TYPE_HEARTBEAT 0x01
 #define MSG_TYPE_MOTION    0x02
 #define MSG_TYPE_LOG       0x03
 #define MSG_TYPE_COMMAND   0x04
+#define MSG_TYPE_ACK       0x05   // v2 only: device -> home base command ack
 
 // Structure matching the requirement
 typedef struct __attribute__((packed)) {
@@ -18,4 +21,135 @@ typedef struct __attribute__((packed)) {
     uint8_t signature[64];   // 64 bytes, Ed25519 signature
 } mesh_message_t;
 
+// === Protocol v2: variable-length TLV frames ===
+//
+// Frame layout:
+//   byte 0   MESH_PROTO_V2_MARKER
+//   byte 1   message type (MSG_TYPE_*)
+//   then any number of fields, each: key = (field_id << 3) | wire_type
+//     wire_type 0: value is an unsigned LEB128 varint
+//     wire_type 2: varint length followed by that many bytes
+//
+// Unknown fields are skipped, so new fields can be added without breaking
+// older receivers. v1 frames are always exactly sizeof(mesh_message_t) bytes
+// and start with a message type, never with the marker, so both formats can
+// share the air during migration.
+//
+// Structured fields (heap, motion, ...) are rendered back into the same JSON
+// text a v1 sender puts in mesh_message_t.payload, so signatures computed over
+// "{timestamp}:{payload}" verify identically for both formats.
+
+#define MESH_PROTO_V2_MARKER   0xB2
+#define MESH_PROTO_V2_MAX_LEN  250      // ESP-NOW v1 payload limit
+
+#define MESH_WIRE_VARINT 0
+#define MESH_WIRE_BYTES  2
+
+#define MESH_FIELD_DEVICE_ID    1   // bytes
+#define MESH_FIELD_TIMESTAMP    2   // varint
+#define MESH_FIELD_SIGNATURE    3   // bytes (64)
+#define MESH_FIELD_PAYLOAD      4   // bytes, free-form JSON text
+#define MESH_FIELD_HEAP         5   // varint, heartbeat
+#define MESH_FIELD_UPTIME       6   // varint, heartbeat
+#define MESH_FIELD_MOTION       7   // varint 0/1, motion
+#define MESH_FIELD_SENSITIVITY  8   // varint, motion
+#define MESH_FIELD_COOLDOWN_MS  9   // varint, motion
+#define MESH_FIELD_SEQ         10   // varint, per-sender frame counter
+#define MESH_FIELD_BOOT_ID     11   // varint, sender boot counter (seq restarts with it)
+#define MESH_FIELD_CMD_ID      12   // varint, downlink command id (command and ack)
+#define MESH_FIELD_STATUS      13   // varint, ack status (MESH_ACK_*)
+#define MESH_FIELD_TARGETS     14   // bytes, group command target bitmap
+
+// Group commands are broadcast with this device_id. Without a TARGETS field
+// every device runs them; with one, only devices whose bit is set.
+#define MESH_BROADCAST_ID "*"
+#define MESH_TARGET_BITMAP_LEN 32   // 256 bits, bit = protocol_target_bit(device_id)
+
+// Ack status codes
+#define MESH_ACK_OK    0   // Command accepted by the device
+#define MESH_ACK_BUSY  1   // Device queue full; the home base retries
+
+// Presence bits for mesh_fields_t.present
+#define MESH_HAS(field) (1u << (field))
+
+/**
+ * Decoded (or to-be-encoded) view of a frame.
+ * When decoding, payload and signature point into the input buffer.
+ */
+typedef struct {
+    uint8_t type;
+    uint32_t present;            // MESH_HAS(MESH_FIELD_*) bits
+    char device_id[16];
+    uint32_t timestamp;
+    uint32_t heap;
+    uint32_t uptime;
+    bool motion;
+    uint8_t sensitivity;
+    uint32_t cooldown_ms;
+    uint32_t seq;
+    uint32_t boot_id;
+    uint32_t cmd_id;
+    uint8_t status;
+    const uint8_t *targets;      // MESH_TARGET_BITMAP_LEN bytes
+    const char *payload;
+    uint16_t payload_len;
+    const uint8_t *signature;    // 64 bytes
+} mesh_fields_t;
+
+/**
+ * True if the buffer carries a v2 frame
+ */
+bool protocol_is_v2(const uint8_t *data, int len);
+
+/**
+ * Encode fields into a v2 frame
+ * Only fields flagged in fields->present are written (device_id always is).
+ * @return Encoded length, or -1 if it does not fit in out_len
+ */
+int protocol_v2_encode(const mesh_fields_t *fields, uint8_t *out, size_t out_len);
+
+/**
+ * Decode a v2 frame without copying payload or signature
+ * @return false if the frame is truncated, malformed or has no device_id
+ */
+bool protocol_v2_decode(const uint8_t *data, int len, mesh_fields_t *fields);
+
+/**
+ * Render the canonical JSON payload for a set of fields
+ * This is the exact text a sender signs as "{timestamp}:{payload}".
+ * @return Length written (excluding terminator)
+ */
+int protocol_render_payload(const mesh_fields_t *fields, char *out, size_t out_len);
+
+/**
+ * True if the rendered payload carries boot_id and seq
+ * Only then does a signature over it protect them from being rewritten;
+ * the home base moves a keyed sender's replay window only on such frames.
+ */
+bool protocol_binds_seq(const mesh_fields_t *fields);
+
+/**
+ * Bit a device answers to in a group command target bitmap (FNV-1a of device_id)
+ */
+uint16_t protocol_target_bit(const char *device_id);
+
+/**
+ * True if a group command's target bitmap includes the device
+ */
+static inline bool protocol_targets_include(const uint8_t *targets, uint16_t bit)
+{
+    return (targets[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/**
+ * Convert decoded fields into the in-memory mesh_message_t form
+ */
+void protocol_fields_to_message(const mesh_fields_t *fields, mesh_message_t *msg);
+
+/**
+ * Decode a v1 or v2 frame into a mesh_message_t
+ * @return false if the buffer is neither a valid v1 nor a valid v2 frame
+ */
+bool protocol_decode_frame(const uint8_t *data, int len, mesh_message_t *msg);
+
 #endif // PROTOCOL_H
@@ -0,0 +1,283 @@
+#ifndef UNRAID_CLIENT_H
+#define UNRAID_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <cJSON.h>
+#include "esp_err.h"
+#include "protocol.h"
+#include "uplink_spool.h"
+
+/**
+ * Uplink from the home base to the Unraid backend (/logs/ingest).
+ *
+ * Workers hand messages to a queue; one uplink task owns an HTTP client per
+ * target and posts them over a keep-alive connection, so a message costs a
+ * request rather than a TCP handshake and teardown. A connection the
+ * backend dropped is reopened and the request retried once. The connection
+ * is closed after it sits idle for longer than the backend keeps it open,
+ * which avoids writing into a socket the server is about to close.
+ *
+ * Targets are tried in priority order, each behind its own circuit breaker
+ * (uplink_breaker.h): a batch goes to the first target whose breaker lets
+ * it through, and on to the next if that one does not take it. A batch
+ * holding a motion event may be hedged: if the target has not answered
+ * within the hedge budget, a second task posts the same batch to the next
+ * target, and whichever takes it first delivers it.
+ *
+ * The task batches messages into one LogIngestRequest and posts it when it
+ * reaches a byte budget or when the earliest deadline of anything in it
+ * passes. Motion events get a short deadline, routine logs a long one, so
+ * an alarm pulls the logs queued ahead of it out with it.
+ *
+ * The queue is bounded and drained motion first. When it is full, the
+ * overflow policy decides what is lost: the incoming message, the oldest
+ * queued one, or queued logs before any motion event; or the incoming
+ * message is spilled to the flash spool.
+ *
+ * Batches no target could take (no answer, 5xx or 429), and every batch
+ * while the Ethernet link is down or every breaker is holding posts off, go
+ * to the spool (uplink_spool.h). Once the backend answers again they are replayed
+ * oldest-first, one per replay interval, behind live traffic.
+ *
+ * With streaming on, batches go as frames over one WebSocket to the
+ * backend's /ws/uplink (uplink_stream.h) instead: no request headers per
+ * batch, motion events sent as they arrive and logs after a few ms. The
+ * backend acks each frame and bounds how many may be unacked; while the
+ * socket is down or that window is used up, batches are posted as above.
+ * Frames still unacked when the socket drops, or acked with a status the
+ * backend would have refused a post with, are posted (or spooled) instead.
+ */
+
+#define UNRAID_UPLINK_TARGETS_MAX 4
+#define UNRAID_UPLINK_URL_MAX 128
+#define UNRAID_UPLINK_HEDGE_MAX_MS 5000   // Same bound as the menuconfig option
+
+typedef enum {
+    UNRAID_OVERFLOW_DROP_NEWEST = 0,   // Refuse the incoming message
+    UNRAID_OVERFLOW_DROP_OLDEST,       // Evict the oldest queued message
+    UNRAID_OVERFLOW_DROP_LOGS,         // Evict the oldest log; motion only for motion
+    UNRAID_OVERFLOW_SPILL,             // Write the incoming message to the spool
+} unraid_overflow_policy_t;
+
+typedef enum {
+    UNRAID_FORMAT_JSON = 0,   // LogIngestRequest, hex signatures
+    UNRAID_FORMAT_CBOR,       // See uplink_cbor.h
+} unraid_uplink_format_t;
+
+typedef enum {
+    UNRAID_FLUSH_FULL = 0,   // Byte budget reached, or no room in the CBOR device table
+    UNRAID_FLUSH_DEADLINE,   // An entry's deadline passed
+    UNRAID_FLUSH_FORCED,     // unraid_uplink_flush()
+    UNRAID_FLUSH_REASON_COUNT
+} unraid_flush_reason_t;
+
+typedef struct {
+    uint32_t queued;         // Waiting for the uplink task now
+    uint32_t sent;           // Log entries accepted by the backend (2xx)
+    uint32_t rejected;       // Entries answered with another status
+    uint32_t failed;         // Entries not delivered even after reconnecting
+    uint32_t dropped;        // Lost to a full queue (refused or evicted)
+    uint32_t dropped_motion; // Motion events among them
+    uint32_t evicted;        // Queued messages given up for newer ones
+    uint32_t queue_high_water;
+    uint32_t oversize;       // Entries too large for a batch
+    uint32_t spooled;        // Entries written to the spool
+    uint32_t spilled;        // Messages spilled there from a full queue
+    uint32_t replayed;       // Spooled entries delivered later
+    uint32_t replay_rate;    // Entries/s over the current or last spool drain
+    uint32_t requests;       // HTTP requests attempted
+    uint32_t connects;       // TCP connections opened
+    uint32_t reused;         // Requests answered on an already open connection
+    uint32_t reconnects;     // Requests retried on a fresh connection
+    uint32_t idle_closes;    // Connections closed after sitting idle
+    int last_status;         // HTTP status of the last response, 0 if none
+    uint32_t batches;        // Batches posted
+    uint32_t batched;        // Entries posted in those batches
+    uint32_t flushes[UNRAID_FLUSH_REASON_COUNT];
+    uint32_t last_batch;     // Entries in the last batch
+    uint32_t last_batch_bytes;
+    uint32_t max_batch;      // Most entries in one batch
+    uint32_t max_hold_ms;    // Longest an entry waited in a batch
+    int breaker_state;       // uplink_breaker_state_t
+    uint32_t breaker_opens;  // Times the circuit breaker opened
+    uint32_t breaker_probes; // Posts made while half-open
+    uint32_t shed;           // Posts held back by backoff or the open breaker
+    uint32_t batch_budget;   // Current adaptive batch byte budget
+    uint32_t srtt_ms;        // Smoothed backend round-trip time
+    int active_target;       // Target that took the last batch; its breaker is shown above
+    uint32_t failovers;      // Batches moved on to the next target after a failed post
+    uint32_t hedges;         // Motion batches also posted to a second target
+    uint32_t hedge_wins;     // Hedged posts answered before the first target
+    uint32_t gzipped;        // Batches sent gzip-compressed
+    uint32_t gzip_skipped;   // Batches compressed but sent as is (no smaller)
+    uint32_t gzip_in_bytes;  // JSON bytes in the gzipped batches
+    uint32_t gzip_out_bytes; // Bytes sent for them
+    uint32_t gzip_us;        // CPU time spent compressing, all attempts
+    uint32_t last_gzip_us;
+    uint32_t max_gzip_us;
+    bool stream_up;          // Stream connected and granted a window
+    uint32_t stream_connects;
+    uint32_t streamed;       // Batches sent as stream frames
+    uint32_t stream_acked;   // Frames acked by the backend
+    uint32_t stream_resent;  // Unacked frames posted after the stream dropped
+    uint32_t stream_fallbacks; // Batches posted while streaming was on
+    uint32_t stream_in_flight; // Frames waiting for an ack now
+    uint32_t stream_window;  // Unacked frames the backend allows
+    uint32_t last_ack_ms;    // Frame sent to its ack
+    uint32_t max_ack_ms;
+    uint32_t next_seq;       // Sequence number the next entry gets
+    uint32_t unkeyed;        // Entries sent without one (NVS unavailable)
+} unraid_uplink_stats_t;
+
+typedef struct {
+    char url[UNRAID_UPLINK_URL_MAX];
+    int breaker_state;       // uplink_breaker_state_t
+    uint32_t requests;       // HTTP requests attempted
+    uint32_t answered;       // Posts it took (2xx or 4xx)
+    uint32_t failed;         // Posts it did not (no answer, 5xx or 429)
+    uint32_t hedged;         // Hedged posts sent to it
+    uint32_t opens;          // Times its breaker opened
+    uint32_t probes;         // Posts made while half-open
+    uint32_t srtt_ms;
+    uint32_t batch_budget;
+} unraid_uplink_target_stats_t;
+
+/**
+ * Create the queue and the HTTP clients for the targets in
+ * CONFIG_UNRAID_API_URL; called again, empties the queue, goes back to
+ * those targets, closes the connections and resets the counters
+ */
+esp_err_t unraid_uplink_init(void);
+
+/**
+ * Start the task that drains the queue
+ */
+esp_err_t unraid_uplink_start(void);
+
+/**
+ * Batch the next queued message, waiting up to timeout_ms for one (less if
+ * the batch deadline comes first), and post the batch if it is due
+ * @return true if a message was taken off the queue
+ */
+bool unraid_uplink_run(uint32_t timeout_ms);
+
+/**
+ * Post whatever is batched now (e.g. before a reboot)
+ * @return HTTP status, 0 if it was not delivered (it is spooled if
+ *         possible), -1 if the batch was empty
+ */
+int unraid_uplink_flush(void);
+
+/**
+ * Queue a mesh message for the backend; never blocks
+ */
+void send_log_to_unraid(mesh_message_t *msg);
+
+/**
+ * Post a ready-made logs array (takes ownership) on the shared connection
+ */
+void send_log_batch_to_unraid(cJSON *logs_array);
+
+/**
+ * Report the Ethernet link state; while down, batches go straight to the spool
+ */
+void unraid_uplink_set_link(bool up);
+
+/**
+ * Replace the targets (e.g. from device config, without reflashing)
+ * @param urls Comma-separated ingest URLs in priority order
+ * @param hedge_ms Budget before a motion batch is also posted to the next
+ *                 target, at most UNRAID_UPLINK_HEDGE_MAX_MS; 0 disables hedging
+ * @return ESP_ERR_INVALID_ARG if the list is empty, holds more than
+ *         UNRAID_UPLINK_TARGETS_MAX URLs, a URL is not http(s) or too long,
+ *         or hedge_ms is out of range.
+ *         Targets whose URL stays keep their connection and breaker.
+ */
+esp_err_t unraid_uplink_set_targets(const char *urls, uint32_t hedge_ms);
+
+uint32_t unraid_uplink_get_hedge_ms(void);
+
+/**
+ * Snapshot the per-target counters
+ * @return Number of targets written to `targets`
+ */
+int unraid_uplink_get_targets(unraid_uplink_target_stats_t *targets, int max);
+
+/**
+ * Snapshot the spool (all zero if there is no spool partition)
+ */
+void unraid_uplink_get_spool_stats(uplink_spool_stats_t *stats);
+
+/**
+ * Choose what a full queue gives up (default from Kconfig)
+ */
+void unraid_uplink_set_overflow_policy(unraid_overflow_policy_t policy);
+
+unraid_overflow_policy_t unraid_uplink_get_overflow_policy(void);
+
+/**
+ * Choose the batch body encoding (default from Kconfig); takes effect from
+ * the next batch
+ */
+void unraid_uplink_set_format(unraid_uplink_format_t format);
+
+unraid_uplink_format_t unraid_uplink_get_format(void);
+
+/**
+ * Name of a batch format for metrics
+ */
+const char *unraid_uplink_format_name(unraid_uplink_format_t format);
+
+/**
+ * Send batches of at least CONFIG_UNRAID_UPLINK_GZIP_MIN_BYTES with
+ * Content-Encoding: gzip (default from Kconfig)
+ */
+void unraid_uplink_set_gzip(bool enable);
+
+bool unraid_uplink_get_gzip(void);
+
+/**
+ * Send batches over the backend's /ws/uplink WebSocket while it is up
+ * (default from Kconfig). Turning it off posts whatever is unacked.
+ */
+esp_err_t unraid_uplink_set_stream(bool enable);
+
+bool unraid_uplink_get_stream(void);
+
+/**
+ * Send this home base's ID with every batch. Each entry carries a sequence
+ * number, and the backend stores an entry only once per (home base ID,
+ * sequence number), so batches posted twice - a lost response, a hedge, an
+ * unacked stream frame, a spool replay - are not duplicated. Numbering
+ * carries on across reboots. Batches go without an ID until this is called.
+ * @return ESP_ERR_INVALID_ARG if the ID is too long or would need escaping
+ */
+esp_err_t unraid_uplink_set_home_base_id(const char *id);
+
+/**
+ * Name of an overflow policy for metrics
+ */
+const char *unraid_overflow_policy_name(unraid_overflow_policy_t policy);
+
+/**
+ * Snapshot the counters
+ */
+void unraid_uplink_get_stats(unraid_uplink_stats_t *stats);
+
+/**
+ * Name of a flush reason for metrics
+ */
+const char *unraid_flush_reason_name(unraid_flush_reason_t reason);
+
+/**
+ * Fraction of answered requests that reused an open connection (0 before any)
+ */
+float unraid_uplink_reuse_rate(const unraid_uplink_stats_t *stats);
+
+/**
+ * JSON bytes per byte sent over all gzipped batches (0 before any)
+ */
+float unraid_uplink_gzip_ratio(const unraid_uplink_stats_t *stats);
+
+#endif // UNRAID_CLIENT_H
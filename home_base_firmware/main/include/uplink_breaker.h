@@ -0,0 +1,85 @@
+#ifndef UPLINK_BREAKER_H
+#define UPLINK_BREAKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Circuit breaker and adaptive batch sizing for the uplink.
+ *
+ * Every post reports its HTTP status and round-trip time. A post fails if
+ * nothing came back, or the backend answered 5xx or 429; any other answer
+ * means the backend is alive.
+ *
+ *   CLOSED     Posts go out. A failure holds posts off for backoff_min_ms;
+ *              failure_threshold failures in a row open the breaker.
+ *   OPEN       Nothing is posted until the backoff expires. The backoff
+ *              doubles with every failed probe, up to backoff_max_ms, with
+ *              up to 25% random jitter so a fleet does not retry in step.
+ *   HALF_OPEN  The next post is a probe: success closes the breaker and
+ *              resets the backoff, failure opens it again.
+ *
+ * The batch byte budget follows AIMD: it grows by an eighth of the maximum
+ * after each healthy post answered within rtt_target_ms, shrinks by a
+ * quarter when the answer was slower, and halves on a failure.
+ *
+ * Not thread-safe; the uplink task owns it. Times are esp_timer
+ * microseconds passed in by the caller.
+ */
+
+typedef enum {
+    UPLINK_BREAKER_CLOSED = 0,
+    UPLINK_BREAKER_OPEN,
+    UPLINK_BREAKER_HALF_OPEN,
+} uplink_breaker_state_t;
+
+typedef struct {
+    uint32_t failure_threshold;   // Consecutive failures that open the breaker
+    uint32_t backoff_min_ms;
+    uint32_t backoff_max_ms;
+    uint32_t batch_min;           // Batch byte budget bounds
+    uint32_t batch_max;
+    uint32_t rtt_target_ms;       // Slower answers shrink the batch
+} uplink_breaker_config_t;
+
+typedef struct {
+    uplink_breaker_config_t cfg;
+    uplink_breaker_state_t state;
+    uint32_t failures;            // Consecutive
+    uint32_t backoff_ms;          // Next open period, before jitter
+    int64_t retry_at_us;          // No posts before this
+    uint32_t batch_bytes;         // Current batch byte budget
+    uint32_t srtt_ms;             // Smoothed round-trip time, 0 before any
+    uint32_t last_rtt_ms;
+    int last_status;
+    uint32_t opens;               // Times the breaker opened
+    uint32_t probes;              // Posts made half-open
+    uint32_t shed;                // Posts refused while open or backing off
+} uplink_breaker_t;
+
+void uplink_breaker_init(uplink_breaker_t *b, const uplink_breaker_config_t *cfg);
+
+/**
+ * May a post go out now? Moves OPEN to HALF_OPEN once the backoff expires.
+ * Counts a refusal in `shed`.
+ */
+bool uplink_breaker_allow(uplink_breaker_t *b, int64_t now_us);
+
+/**
+ * Feed back the result of a post
+ * @param status HTTP status, 0 if nothing came back
+ * @param rtt_ms Time to the answer (ignored when status is 0)
+ */
+void uplink_breaker_record(uplink_breaker_t *b, int status, uint32_t rtt_ms, int64_t now_us);
+
+/**
+ * Skip the wait and let the next post probe (e.g. the link just came up)
+ */
+void uplink_breaker_probe_now(uplink_breaker_t *b);
+
+/**
+ * Name of a breaker state for logs and metrics
+ */
+const char *uplink_breaker_state_name(uplink_breaker_state_t state);
+
+#endif // UPLINK_BREAKER_H
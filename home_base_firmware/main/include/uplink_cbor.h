@@ -0,0 +1,57 @@
+#ifndef UPLINK_CBOR_H
+#define UPLINK_CBOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Streaming CBOR (RFC 8949) writer for uplink batch bodies.
+ *
+ * Items are written straight into a caller-owned buffer with the shortest
+ * head for each length or value. Writing past the end sets `overflow` and
+ * drops the bytes, so a sequence of puts needs a single check at the end.
+ *
+ * A batch body (Content-Type: application/cbor) is a two-entry map:
+ *
+ *   {"logs":    [_ [device, timestamp, level, category, message, signature], ...],
+ *    "devices": [device_id, ...]}
+ *
+ * `device` indexes the "devices" array, which is written when the batch is
+ * closed; "logs" is an indefinite-length array so entries can be appended
+ * as they arrive. The signature is a 64-byte byte string, not hex.
+ */
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;   // Something did not fit
+} uplink_cbor_writer_t;
+
+void uplink_cbor_init(uplink_cbor_writer_t *w, void *buf, size_t cap);
+
+/** Unsigned integer (major type 0) */
+void uplink_cbor_put_uint(uplink_cbor_writer_t *w, uint64_t value);
+
+/** UTF-8 text string (major type 3) */
+void uplink_cbor_put_text(uplink_cbor_writer_t *w, const char *text, size_t len);
+
+/** Byte string (major type 2) */
+void uplink_cbor_put_bytes(uplink_cbor_writer_t *w, const void *data, size_t len);
+
+/** Array of `count` items (major type 4) */
+void uplink_cbor_put_array(uplink_cbor_writer_t *w, size_t count);
+
+/** Map of `count` key/value pairs (major type 5) */
+void uplink_cbor_put_map(uplink_cbor_writer_t *w, size_t count);
+
+/** Array of unknown length, closed by uplink_cbor_put_break() */
+void uplink_cbor_put_indefinite_array(uplink_cbor_writer_t *w);
+
+void uplink_cbor_put_break(uplink_cbor_writer_t *w);
+
+/** Bytes a text or byte string of `len` bytes takes, head included */
+size_t uplink_cbor_string_size(size_t len);
+
+#endif // UPLINK_CBOR_H
@@ -0,0 +1,30 @@
+#ifndef UPLINK_GZIP_H
+#define UPLINK_GZIP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Fixed-memory gzip encoder for uplink batch bodies.
+ *
+ * Emits one gzip member holding a single dynamic-Huffman deflate block.
+ * Matches are found with a 4096-entry hash head table and chains over an
+ * 8 KB window (24 KB of static tables in total, no heap). The input is
+ * scanned twice, once to count symbol frequencies and once to write them,
+ * so no intermediate symbol buffer is needed. Batch bodies repeat device
+ * ids, field names, levels and categories, and hex signatures only use 16
+ * symbols, which the dynamic code tables take advantage of.
+ *
+ * Not reentrant; the uplink task is the only caller.
+ */
+
+#define UPLINK_GZIP_MAX_INPUT 65535
+
+/**
+ * Compress `len` bytes into a gzip member
+ * @return Compressed size, or 0 if the input is empty, longer than
+ *         UPLINK_GZIP_MAX_INPUT, or the result would not fit in out_cap
+ */
+size_t uplink_gzip(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap);
+
+#endif // UPLINK_GZIP_H
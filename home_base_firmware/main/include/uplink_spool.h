@@ -0,0 +1,91 @@
+#ifndef UPLINK_SPOOL_H
+#define UPLINK_SPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/**
+ * Store-and-forward spool for uplink batches the backend could not take.
+ *
+ * Records go into an append-only log on the "spool" data partition, split
+ * into fixed-size segments used strictly in ring order, so every segment is
+ * erased once per lap and wear stays even. Each segment starts with a header
+ * (sequence number, erase count, CRC); each record carries its own CRC over
+ * the header fields and payload. A delivered record is marked by programming
+ * its state word to zero, which flash allows without an erase, so nothing is
+ * rewritten on delivery.
+ *
+ * At boot the segment headers give the order, a scan of the records finds
+ * what is still pending, and appends continue in a freshly erased segment
+ * (a torn write can leave unusable bytes at the end of the last one). When
+ * the spool is full, the oldest segment is erased and its pending records
+ * are counted as lost.
+ *
+ * Not thread-safe; the uplink serializes access.
+ */
+
+#define UPLINK_SPOOL_PARTITION_LABEL "spool"
+#define UPLINK_SPOOL_PARTITION_SUBTYPE 0x40
+
+typedef struct {
+    uint32_t records;        // Batches waiting for delivery
+    uint32_t entries;        // Log entries in them
+    uint32_t bytes;          // Payload bytes in them
+    uint32_t oldest_age_s;   // Age of the oldest pending batch, 0 if none
+    uint32_t recovered;      // Pending batches found at boot
+    uint32_t appended;       // Batches written since boot
+    uint32_t delivered;      // Batches taken off since boot
+    uint32_t lost;           // Pending batches erased because the spool was full
+    uint32_t corrupt;        // Batches that failed their CRC
+    uint32_t segments;       // Segments in the partition
+    uint32_t segment_size;
+    uint32_t min_erases;     // Lowest and highest per-segment erase counts
+    uint32_t max_erases;
+} uplink_spool_stats_t;
+
+/**
+ * Mount the spool partition and recover pending records
+ * @return ESP_ERR_NOT_FOUND if there is no spool partition,
+ *         ESP_ERR_INVALID_SIZE if it holds fewer than two segments
+ */
+esp_err_t uplink_spool_init(void);
+
+/**
+ * Append one batch body
+ * @param entries Log entries in it, for the counters
+ * @return ESP_ERR_INVALID_SIZE if it can never fit in a segment
+ */
+esp_err_t uplink_spool_append(const void *data, size_t len, uint32_t entries);
+
+/**
+ * Copy the oldest pending batch into buf without removing it. Records that
+ * fail their CRC are skipped and counted.
+ * @return ESP_ERR_NOT_FOUND if the spool is empty,
+ *         ESP_ERR_INVALID_SIZE if the batch is larger than cap
+ */
+esp_err_t uplink_spool_peek(void *buf, size_t cap, size_t *len, uint32_t *entries);
+
+/**
+ * Mark the oldest pending batch delivered
+ */
+esp_err_t uplink_spool_pop(void);
+
+/**
+ * Position of the oldest pending batch; changes when it is popped, skipped
+ * or its segment is overwritten. Compare before popping a batch peeked
+ * earlier and posted without the caller's lock.
+ */
+uint64_t uplink_spool_head(void);
+
+/**
+ * Pending batches (0 if the spool is not mounted)
+ */
+uint32_t uplink_spool_pending(void);
+
+/**
+ * Snapshot the spool state and counters
+ */
+void uplink_spool_get_stats(uplink_spool_stats_t *stats);
+
+#endif // UPLINK_SPOOL_H
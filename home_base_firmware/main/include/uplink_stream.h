@@ -0,0 +1,114 @@
+#ifndef UPLINK_STREAM_H
+#define UPLINK_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * Framing and flow control for the streaming uplink (backend /ws/uplink).
+ *
+ * Each batch goes out as one binary WebSocket frame:
+ *
+ *   [0x01][flags][seq u32 BE][body]    flags bit 0: body is gzipped
+ *
+ * The body is what would otherwise be POSTed to /logs/ingest. The backend
+ * answers every batch, in order, with
+ *
+ *   [0x81][seq u32 BE][status u16 BE][window u16 BE]
+ *
+ * where status is what /logs/ingest would have returned and window is how
+ * many batches may be unacknowledged. It announces the window on connect
+ * with [0x82][window u16 BE]; nothing may be sent before that.
+ *
+ * Batches stay in a byte ring until acked, so the ones still in flight when
+ * the connection drops can be posted instead. Acks arrive in order, so the
+ * ring is a FIFO: records are written contiguously and wrap to the start
+ * when the end of the buffer is too short.
+ *
+ * Not thread-safe; the caller serializes pushes and acks. Times are
+ * esp_timer microseconds passed in by the caller.
+ */
+
+#define UPLINK_STREAM_HEADER 6   // Batch frame header
+#define UPLINK_STREAM_FRAME_BATCH 0x01
+#define UPLINK_STREAM_FRAME_ACK 0x81
+#define UPLINK_STREAM_FRAME_WINDOW 0x82
+#define UPLINK_STREAM_FLAG_GZIP 0x01
+
+typedef struct {
+    uint8_t *buf;            // In-flight batches
+    size_t size;
+    size_t head;             // Oldest record
+    size_t tail;             // Next write
+    size_t wrap_at;          // Records past head stop here and resume at 0
+    uint16_t in_flight;      // Records in the ring
+    uint16_t window;         // Granted by the backend, 0 until announced
+    uint32_t next_seq;
+    uint32_t frames;         // Batches pushed
+    uint32_t bytes;          // Body bytes pushed
+    uint32_t acked;          // Acks matched to a batch
+    uint32_t stalls;         // Pushes refused for want of window or room
+} uplink_stream_t;
+
+typedef struct {
+    uint8_t type;            // UPLINK_STREAM_FRAME_ACK or _WINDOW
+    uint32_t seq;            // Acks only
+    uint16_t status;         // Acks only
+    uint16_t window;
+    uint32_t entries;        // Log entries in the acked batch
+    int64_t pushed_us;       // When it was pushed
+} uplink_stream_ack_t;
+
+/**
+ * Use `buf` to hold in-flight batches; nothing may be sent until a window
+ * is received
+ */
+void uplink_stream_init(uplink_stream_t *s, void *buf, size_t size);
+
+/**
+ * The connection dropped: nothing may be sent until the next one announces
+ * a window. Batches in flight stay; take them off with uplink_stream_oldest.
+ */
+void uplink_stream_disconnected(uplink_stream_t *s);
+
+/**
+ * Would a batch of `len` bytes be accepted by uplink_stream_push now?
+ */
+bool uplink_stream_can_push(const uplink_stream_t *s, size_t len);
+
+/**
+ * Keep a batch until it is acked and give it a sequence number
+ * @param entries Log entries in it, reported back with its ack
+ * @param now_us  Reported back with its ack, for the round trip
+ * @return ESP_ERR_NO_MEM if the window is used up or the ring is full
+ */
+esp_err_t uplink_stream_push(uplink_stream_t *s, const void *body, size_t len, uint32_t entries,
+                             int64_t now_us, uint32_t *seq);
+
+/**
+ * Write the header of a batch frame
+ * @return UPLINK_STREAM_HEADER
+ */
+size_t uplink_stream_frame_header(uint8_t *out, uint32_t seq, bool gzip);
+
+/**
+ * Parse a frame from the backend. A window frame, and the window in an ack,
+ * replace the current window. An ack must name the oldest batch in flight;
+ * its entry count is filled in and the caller drops it with
+ * uplink_stream_drop_oldest once the status is dealt with.
+ * @return ESP_ERR_INVALID_SIZE if the frame is truncated,
+ *         ESP_ERR_INVALID_RESPONSE if it is not an ack or window, or the
+ *         ack is out of order
+ */
+esp_err_t uplink_stream_receive(uplink_stream_t *s, const uint8_t *data, size_t len, uplink_stream_ack_t *ack);
+
+/**
+ * Oldest batch in flight, NULL if none
+ */
+const void *uplink_stream_oldest(const uplink_stream_t *s, size_t *len, uint32_t *entries, uint32_t *seq);
+
+void uplink_stream_drop_oldest(uplink_stream_t *s);
+
+#endif // UPLINK_STREAM_H
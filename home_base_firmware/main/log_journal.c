@@ -0,0 +1,476 @@
+#include "log_journal.h"
+#include <string.h>
+#include <stddef.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "log_journal";
+
+#ifdef CONFIG_LOG_JOURNAL_SEGMENT_KB
+    #define JOURNAL_SEGMENT_SIZE (CONFIG_LOG_JOURNAL_SEGMENT_KB * 1024)
+#else
+    #define JOURNAL_SEGMENT_SIZE (64 * 1024)
+#endif
+
+#define JOURNAL_MAX_SEGMENTS 64
+#define JOURNAL_BUFFER_SIZE 4096          // Appends held in RAM between flash writes
+#define JOURNAL_SEG_MAGIC 0x4A474F4C      // "LOGJ"
+#define JOURNAL_ERASED 0xFFFFFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;            // One more than the segment opened before it
+    uint32_t erases;         // Times this segment has been erased
+    uint32_t crc;            // Over the fields above
+} journal_seg_hdr_t;
+
+// Follows the header; erased until the segment is full
+typedef struct {
+    uint32_t logs;           // Records of each kind in the segment
+    uint32_t motions;
+    uint32_t end;            // Offset just past the last record
+    uint32_t crc;            // Over the fields above
+} journal_seal_t;
+
+#define JOURNAL_DATA_OFFSET (sizeof(journal_seg_hdr_t) + sizeof(journal_seal_t))
+
+typedef struct {
+    uint8_t kind;            // log_journal_kind_t; 0xFF where the records end
+    uint8_t reserved;
+    uint16_t len;            // Payload bytes following the header
+    uint32_t crc;            // Over kind..len and the payload
+} journal_rec_hdr_t;
+
+// Payload: this, then the strings back to back without terminators
+typedef struct {
+    uint32_t id;
+    uint32_t timestamp;
+    uint8_t lens[4];         // Log: device_id, level, category, message
+                             // Motion: device_id, media_path
+} journal_entry_t;
+
+#define JOURNAL_MAX_PAYLOAD (sizeof(journal_entry_t) + 4 * 255)
+
+typedef struct {
+    uint32_t seq;            // 0: erased or never formatted
+    uint32_t erases;
+    uint32_t logs;
+    uint32_t motions;
+    uint32_t end;            // Records end here (appended and buffered)
+    bool sealed;
+} journal_segment_t;
+
+static const esp_partition_t *s_part = NULL;
+static journal_segment_t s_segs[JOURNAL_MAX_SEGMENTS];
+static uint32_t s_seg_count = 0;
+static uint32_t s_next_seq = 1;
+static uint32_t s_tail_seg;
+static uint32_t s_tail_off;              // Where the buffer goes in flash
+static uint8_t s_buf[JOURNAL_BUFFER_SIZE];
+static size_t s_buf_len = 0;
+static log_journal_stats_t s_stats;
+
+static inline size_t seg_addr(uint32_t seg)
+{
+    return (size_t)seg * JOURNAL_SEGMENT_SIZE;
+}
+
+static inline uint32_t record_size(size_t len)
+{
+    return sizeof(journal_rec_hdr_t) + (((uint32_t)len + 3) & ~3u);
+}
+
+static uint32_t record_crc(const journal_rec_hdr_t *hdr, const void *payload, size_t len)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)hdr, offsetof(journal_rec_hdr_t, crc));
+    return esp_rom_crc32_le(crc, payload, len);
+}
+
+static void count_segment(uint32_t seg, int sign)
+{
+    s_stats.logs += sign * (int32_t)s_segs[seg].logs;
+    s_stats.motions += sign * (int32_t)s_segs[seg].motions;
+}
+
+// Program a full segment's seal so boot need not scan it
+static void seal_segment(uint32_t seg)
+{
+    journal_segment_t *segment = &s_segs[seg];
+    if (segment->sealed || !segment->seq) {
+        return;
+    }
+    journal_seal_t seal = {.logs = segment->logs, .motions = segment->motions, .end = segment->end};
+    seal.crc = esp_rom_crc32_le(0, (const uint8_t *)&seal, offsetof(journal_seal_t, crc));
+    if (esp_partition_write(s_part, seg_addr(seg) + sizeof(journal_seg_hdr_t), &seal, sizeof(seal)) == ESP_OK) {
+        segment->sealed = true;
+    }
+}
+
+// Erase a segment and start appending to it, dropping its old records
+static esp_err_t open_segment(uint32_t seg)
+{
+    journal_segment_t *segment = &s_segs[seg];
+    count_segment(seg, -1);
+
+    journal_seg_hdr_t hdr = {
+        .magic = JOURNAL_SEG_MAGIC,
+        .seq = s_next_seq++,
+        .erases = segment->erases + 1,
+    };
+    hdr.crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr, offsetof(journal_seg_hdr_t, crc));
+    *segment = (journal_segment_t){.seq = hdr.seq, .erases = hdr.erases, .end = JOURNAL_DATA_OFFSET};
+
+    s_tail_seg = seg;
+    s_tail_off = JOURNAL_DATA_OFFSET;
+    esp_err_t err = esp_partition_erase_range(s_part, seg_addr(seg), JOURNAL_SEGMENT_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, seg_addr(seg), &hdr, sizeof(hdr));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open segment %lu: %s", (unsigned long)seg, esp_err_to_name(err));
+        s_tail_off = JOURNAL_SEGMENT_SIZE;   // Next append tries the one after
+        segment->end = JOURNAL_SEGMENT_SIZE;
+    }
+    return err;
+}
+
+typedef enum {
+    RECORD_OK,
+    RECORD_END,              // Erased: appends continue here
+    RECORD_BAD,              // Fails its CRC; the header still gives its size
+    RECORD_TORN,             // Unreadable header: nothing after it can be found
+} record_status_t;
+
+static record_status_t read_record(uint32_t seg, uint32_t off, journal_rec_hdr_t *hdr, uint8_t *payload)
+{
+    if (off + sizeof(*hdr) > JOURNAL_SEGMENT_SIZE) {
+        return RECORD_END;
+    }
+    if (esp_partition_read(s_part, seg_addr(seg) + off, hdr, sizeof(*hdr)) != ESP_OK) {
+        return RECORD_TORN;
+    }
+    if (hdr->kind == 0xFF && hdr->len == 0xFFFF && hdr->crc == JOURNAL_ERASED) {
+        return RECORD_END;
+    }
+    if (hdr->kind < LOG_JOURNAL_LOG || hdr->kind > LOG_JOURNAL_CLEAR_MOTION || hdr->len < sizeof(journal_entry_t) ||
+        hdr->len > JOURNAL_MAX_PAYLOAD || off + record_size(hdr->len) > JOURNAL_SEGMENT_SIZE) {
+        return RECORD_TORN;
+    }
+    if (esp_partition_read(s_part, seg_addr(seg) + off + sizeof(*hdr), payload, hdr->len) != ESP_OK ||
+        record_crc(hdr, payload, hdr->len) != hdr->crc) {
+        return RECORD_BAD;
+    }
+    return RECORD_OK;
+}
+
+// Count the records of a segment the seal does not describe; false if the
+// scan ended at an unreadable header
+static bool scan_segment(uint32_t seg)
+{
+    journal_segment_t *segment = &s_segs[seg];
+    journal_rec_hdr_t hdr;
+    uint8_t payload[JOURNAL_MAX_PAYLOAD];
+    uint32_t off = JOURNAL_DATA_OFFSET;
+    record_status_t status;
+    segment->logs = 0;
+    segment->motions = 0;
+    while ((status = read_record(seg, off, &hdr, payload)) == RECORD_OK || status == RECORD_BAD) {
+        if (status == RECORD_OK) {
+            segment->logs += hdr.kind == LOG_JOURNAL_LOG;
+            segment->motions += hdr.kind == LOG_JOURNAL_MOTION;
+        }
+        off += record_size(hdr.len);
+    }
+    if (status == RECORD_TORN) {
+        ESP_LOGW(TAG, "Segment %lu ends in a torn record at %lu", (unsigned long)seg, (unsigned long)off);
+        s_stats.corrupt++;
+    }
+    segment->end = off;
+    s_stats.scanned_segments++;
+    return status == RECORD_END;
+}
+
+esp_err_t log_journal_init(void)
+{
+    int64_t start_us = esp_timer_get_time();
+    s_part = NULL;
+    s_buf_len = 0;
+    memset(s_segs, 0, sizeof(s_segs));
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, LOG_JOURNAL_PARTITION_SUBTYPE,
+                                                           LOG_JOURNAL_PARTITION_LABEL);
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t count = part->size / JOURNAL_SEGMENT_SIZE;
+    if (count < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_part = part;
+    s_seg_count = count < JOURNAL_MAX_SEGMENTS ? count : JOURNAL_MAX_SEGMENTS;
+
+    // Headers give the order, seals the contents of every full segment
+    uint32_t newest = 0;
+    bool any = false;
+    for (uint32_t seg = 0; seg < s_seg_count; seg++) {
+        struct {
+            journal_seg_hdr_t hdr;
+            journal_seal_t seal;
+        } head;
+        if (esp_partition_read(s_part, seg_addr(seg), &head, sizeof(head)) != ESP_OK ||
+            head.hdr.magic != JOURNAL_SEG_MAGIC || head.hdr.seq == 0 ||
+            head.hdr.crc != esp_rom_crc32_le(0, (const uint8_t *)&head.hdr, offsetof(journal_seg_hdr_t, crc))) {
+            continue;
+        }
+        journal_segment_t *segment = &s_segs[seg];
+        segment->seq = head.hdr.seq;
+        segment->erases = head.hdr.erases;
+        if (head.seal.crc == esp_rom_crc32_le(0, (const uint8_t *)&head.seal, offsetof(journal_seal_t, crc)) &&
+            head.seal.end <= JOURNAL_SEGMENT_SIZE) {
+            segment->logs = head.seal.logs;
+            segment->motions = head.seal.motions;
+            segment->end = head.seal.end;
+            segment->sealed = true;
+        }
+        if (!any || (int32_t)(head.hdr.seq - s_segs[newest].seq) > 0) {
+            newest = seg;
+        }
+        any = true;
+    }
+
+    // Only segments cut off before their seal need their records read:
+    // normally just the newest, which appends continue in. Past a torn
+    // record nothing can be appended without an erase.
+    bool clean = true;
+    for (uint32_t seg = 0; seg < s_seg_count; seg++) {
+        if (s_segs[seg].seq && !s_segs[seg].sealed) {
+            bool ok = scan_segment(seg);
+            if (seg == newest) {
+                clean = ok;
+            } else {
+                seal_segment(seg);
+            }
+        }
+        count_segment(seg, 1);
+    }
+
+    esp_err_t err = ESP_OK;
+    if (any && clean && !s_segs[newest].sealed) {
+        s_next_seq = s_segs[newest].seq + 1;
+        s_tail_seg = newest;
+        s_tail_off = s_segs[newest].end;
+    } else {
+        s_next_seq = any ? s_segs[newest].seq + 1 : 1;
+        if (any) {
+            seal_segment(newest);
+        }
+        err = open_segment(any ? (newest + 1) % s_seg_count : 0);
+    }
+
+    s_stats.recovery_us = (uint32_t)(esp_timer_get_time() - start_us);
+    ESP_LOGI(TAG, "Log journal: %lu segments of %u KB, %lu logs and %lu motion events, indexed in %lu us",
+             (unsigned long)s_seg_count, JOURNAL_SEGMENT_SIZE / 1024, (unsigned long)s_stats.logs,
+             (unsigned long)s_stats.motions, (unsigned long)s_stats.recovery_us);
+    return err;
+}
+
+// Copy a length-prefixed string out of a payload
+static const uint8_t *take_string(const uint8_t *p, const uint8_t *end, uint8_t len, char *out, size_t cap)
+{
+    if (!p || p + len > end || len >= cap) {
+        return NULL;
+    }
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return p + len;
+}
+
+static void replay_record(const journal_rec_hdr_t *hdr, const uint8_t *payload, log_journal_replay_cb_t cb, void *ctx)
+{
+    journal_entry_t entry;
+    memcpy(&entry, payload, sizeof(entry));
+    const uint8_t *p = payload + sizeof(entry);
+    const uint8_t *end = payload + hdr->len;
+
+    if (hdr->kind == LOG_JOURNAL_LOG) {
+        device_log_t log = {.id = entry.id, .timestamp = entry.timestamp};
+        p = take_string(p, end, entry.lens[0], log.device_id, sizeof(log.device_id));
+        p = take_string(p, end, entry.lens[1], log.level, sizeof(log.level));
+        p = take_string(p, end, entry.lens[2], log.category, sizeof(log.category));
+        p = take_string(p, end, entry.lens[3], log.message, sizeof(log.message));
+        if (p) {
+            cb(LOG_JOURNAL_LOG, &log, NULL, entry.id, ctx);
+        }
+    } else if (hdr->kind == LOG_JOURNAL_MOTION) {
+        motion_event_t event = {.id = entry.id, .timestamp = entry.timestamp};
+        p = take_string(p, end, entry.lens[0], event.device_id, sizeof(event.device_id));
+        p = take_string(p, end, entry.lens[1], event.media_path, sizeof(event.media_path));
+        if (p) {
+            cb(LOG_JOURNAL_MOTION, NULL, &event, entry.id, ctx);
+        }
+    } else {
+        cb((log_journal_kind_t)hdr->kind, NULL, NULL, entry.id, ctx);
+    }
+    s_stats.recovered++;
+}
+
+esp_err_t log_journal_replay(uint32_t logs, uint32_t motions, log_journal_replay_cb_t cb, void *ctx)
+{
+    if (!s_part) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Back from the newest segment until enough records are covered
+    uint32_t first = s_tail_seg, have_logs = 0, have_motions = 0;
+    for (uint32_t i = 0; i < s_seg_count; i++) {
+        uint32_t seg = (s_tail_seg + s_seg_count - i) % s_seg_count;
+        if (!s_segs[seg].seq || (i > 0 && (int32_t)(s_segs[seg].seq - s_segs[first].seq) > 0)) {
+            break;   // Before the oldest segment
+        }
+        first = seg;
+        have_logs += s_segs[seg].logs;
+        have_motions += s_segs[seg].motions;
+        if (have_logs >= logs && have_motions >= motions) {
+            break;
+        }
+    }
+
+    journal_rec_hdr_t hdr;
+    uint8_t payload[JOURNAL_MAX_PAYLOAD];
+    for (uint32_t seg = first;; seg = (seg + 1) % s_seg_count) {
+        uint32_t off = JOURNAL_DATA_OFFSET;
+        uint32_t end = seg == s_tail_seg ? s_tail_off : s_segs[seg].end;
+        while (off < end) {
+            record_status_t status = read_record(seg, off, &hdr, payload);
+            if (status == RECORD_OK) {
+                replay_record(&hdr, payload, cb, ctx);
+            } else if (status == RECORD_BAD) {
+                s_stats.corrupt++;
+            } else {
+                break;   // Torn records were counted by the boot scan
+            }
+            off += record_size(hdr.len);
+        }
+        if (seg == s_tail_seg) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t log_journal_flush(void)
+{
+    if (!s_part || s_buf_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = esp_partition_write(s_part, seg_addr(s_tail_seg) + s_tail_off, s_buf, s_buf_len);
+    if (err != ESP_OK) {
+        // The buffered records are lost; leave the damaged spot behind
+        ESP_LOGE(TAG, "Log journal write failed: %s", esp_err_to_name(err));
+        s_tail_off = JOURNAL_SEGMENT_SIZE;
+        s_buf_len = 0;
+        return err;
+    }
+    s_tail_off += s_buf_len;
+    s_stats.flushes++;
+    s_stats.bytes_written += s_buf_len;
+    s_buf_len = 0;
+    return ESP_OK;
+}
+
+static esp_err_t append(log_journal_kind_t kind, const journal_entry_t *entry, const char *const strings[4])
+{
+    if (!s_part) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t len = sizeof(*entry);
+    for (int i = 0; i < 4; i++) {
+        len += entry->lens[i];
+    }
+    uint32_t size = record_size(len);
+
+    // Records never span segments; the buffer only ever holds the tail's
+    if (s_tail_off + s_buf_len + size > JOURNAL_SEGMENT_SIZE) {
+        log_journal_flush();
+        seal_segment(s_tail_seg);
+        esp_err_t err = open_segment((s_tail_seg + 1) % s_seg_count);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    if (s_buf_len + size > sizeof(s_buf)) {
+        esp_err_t err = log_journal_flush();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    uint8_t *rec = &s_buf[s_buf_len];
+    uint8_t *p = rec + sizeof(journal_rec_hdr_t);
+    memcpy(p, entry, sizeof(*entry));
+    p += sizeof(*entry);
+    for (int i = 0; i < 4; i++) {
+        memcpy(p, strings[i], entry->lens[i]);
+        p += entry->lens[i];
+    }
+    memset(p, 0xFF, rec + size - p);   // Padding stays erased
+
+    journal_rec_hdr_t hdr = {.kind = (uint8_t)kind, .len = (uint16_t)len};
+    hdr.crc = record_crc(&hdr, rec + sizeof(hdr), len);
+    memcpy(rec, &hdr, sizeof(hdr));
+    s_buf_len += size;
+
+    journal_segment_t *segment = &s_segs[s_tail_seg];
+    segment->logs += kind == LOG_JOURNAL_LOG;
+    segment->motions += kind == LOG_JOURNAL_MOTION;
+    segment->end = s_tail_off + s_buf_len;
+    s_stats.logs += kind == LOG_JOURNAL_LOG;
+    s_stats.motions += kind == LOG_JOURNAL_MOTION;
+    s_stats.appended++;
+    return ESP_OK;
+}
+
+esp_err_t log_journal_append_log(const device_log_t *log)
+{
+    journal_entry_t entry = {
+        .id = log->id,
+        .timestamp = (uint32_t)log->timestamp,
+        .lens = {strlen(log->device_id), strlen(log->level), strlen(log->category), strlen(log->message)},
+    };
+    const char *const strings[4] = {log->device_id, log->level, log->category, log->message};
+    return append(LOG_JOURNAL_LOG, &entry, strings);
+}
+
+esp_err_t log_journal_append_motion(const motion_event_t *event)
+{
+    journal_entry_t entry = {
+        .id = event->id,
+        .timestamp = (uint32_t)event->timestamp,
+        .lens = {strlen(event->device_id), strlen(event->media_path)},
+    };
+    const char *const strings[4] = {event->device_id, event->media_path, "", ""};
+    return append(LOG_JOURNAL_MOTION, &entry, strings);
+}
+
+esp_err_t log_journal_append_clear(log_journal_kind_t kind, uint32_t next_id)
+{
+    journal_entry_t entry = {.id = next_id};
+    const char *const strings[4] = {"", "", "", ""};
+    return append(kind, &entry, strings);
+}
+
+bool log_journal_ready(void)
+{
+    return s_part != NULL;
+}
+
+void log_journal_get_stats(log_journal_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->segments = s_part ? s_seg_count : 0;
+    stats->segment_size = JOURNAL_SEGMENT_SIZE;
+}
@@ -2,89 +2,953 @@
 #include <esp_log.h>
 #include <string.h>
 #include <cJSON.h>
-#include <nvs_flash.h>
-#include <nvs.h>
 #include <time.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "log_journal.h"
+#include "sdkconfig.h"
 
 static const char *TAG = "log_storage";
 
-// In-memory storage for logs and motion events
-static device_log_t g_logs[MAX_LOGS];
-static uint32_t g_log_count = 0;
-static uint32_t g_next_log_id = 1;
+#ifdef CONFIG_LOG_JOURNAL_FLUSH_MS
+    #define JOURNAL_FLUSH_MS CONFIG_LOG_JOURNAL_FLUSH_MS
+#else
+    #define JOURNAL_FLUSH_MS 2000
+#endif
 
-static motion_event_t g_motion_events[MAX_MOTION_EVENTS];
-static uint32_t g_motion_count = 0;
-static uint32_t g_next_motion_id = 1;
+#ifdef CONFIG_LOG_JOURNAL_FLUSH_BATCH
+    #define JOURNAL_FLUSH_BATCH CONFIG_LOG_JOURNAL_FLUSH_BATCH
+#else
+    #define JOURNAL_FLUSH_BATCH 64
+#endif
 
-// NVS handle for persistent storage
-static nvs_handle_t g_nvs_handle = 0;
+#ifdef CONFIG_LOG_STORAGE_TIER_BATCH
+    #define TIER_BATCH CONFIG_LOG_STORAGE_TIER_BATCH
+#else
+    #define TIER_BATCH 32
+#endif
+
+// In-memory storage for logs and motion events. Both are circular: entry
+// `id` lives in slot id % capacity, and when full a new entry overwrites
+// the oldest. IDs held run from first_id up to next_id - 1.
+//
+// Writers (mesh tasks, HTTP command handler, uplink) take a short spinlock
+// to claim the next ID and fill its slot. Readers (HTTP GETs) take no lock:
+// each slot carries a sequence count, odd while it is being written, and a
+// reader copies the slot out and keeps the copy only if the count was even
+// and unchanged. A dashboard poll therefore never holds up ingest.
+//
+// Log entries are stored compactly rather than as device_log_t, which
+// reserves 336 bytes mostly left empty. device_id, level and category are
+// interned: each distinct name is kept once in a small append-only table and
+// the record holds its index. The message goes into a byte arena written in
+// ring order. A full store evicts its oldest entry when a new one needs
+// either its record slot or arena bytes its message still uses. A name met
+// when its table is full is stored in the arena ahead of the message.
+typedef struct {
+    uint32_t id;
+    uint32_t timestamp;
+    uint32_t text;           // Arena position of the inline names and message
+    uint16_t text_len;
+    uint8_t device;          // Name table indexes, or NAME_INLINE
+    uint8_t level;
+    uint8_t category;
+} log_record_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    log_record_t rec;
+} log_slot_t;
+
+_Static_assert(sizeof(log_slot_t) == LOG_RECORD_SIZE, "LOG_RECORD_SIZE is out of date");
+
+// Log entries are kept in up to two tiers of that layout. The hot tier, in
+// internal SRAM, takes every add. The cold tier, in PSRAM and sized at
+// runtime, holds older entries: when the hot tier cannot take another
+// entry without evicting one, the adding task first demotes the oldest
+// TIER_BATCH hot entries to it. A tier's IDs run from its first to next - 1
+// and the cold tier's are all older than the hot tier's, so a listing walks
+// down the hot tier and carries on into the cold one. Both share the name
+// tables.
+//
+// The cold tier is only written under g_tier_lock (demotion, resize,
+// clear). Resizing swaps in a new tier and frees the old one once no reader
+// holds it (cold_acquire); entries that will not fit the hot tier's free
+// room when the cold tier is disabled are dropped, the newest promoted back
+// into it first.
+typedef struct {
+    log_slot_t *slots;
+    uint8_t *arena;
+    uint32_t slot_count;
+    uint32_t arena_size;
+    uint32_t arena_span;     // Positions wrap here: a whole number of laps
+    uint32_t budget;         // Bytes for slots and arena together
+    // Where the next text goes. Advanced before bytes are overwritten, so
+    // text at a position more than arena_size behind it may be gone.
+    _Atomic uint32_t arena_end;
+    _Atomic uint32_t first;  // Oldest entry held
+    _Atomic uint32_t next;
+} log_tier_t;
+
+#define LOG_ARENA_BYTES (LOG_STORAGE_BYTES - MAX_LOGS * LOG_RECORD_SIZE)
+#define FIELD_SIZE(field) sizeof(((device_log_t *)0)->field)
+#define LOG_TEXT_MAX (FIELD_SIZE(device_id) + FIELD_SIZE(level) + FIELD_SIZE(category) + FIELD_SIZE(message))
+
+_Static_assert(LOG_ARENA_BYTES >= 4 * LOG_TEXT_MAX, "CONFIG_LOG_STORAGE_KB leaves too small a message arena");
+
+#define NAME_INLINE 0xFF
+#define LOG_DEVICE_NAMES 64      // Powers of two, below 128
+#define LOG_LEVEL_NAMES 8
+#define LOG_CATEGORY_NAMES 32
+
+// Append-only: an entry below count never changes, so readers need no lock.
+// Writers find names through an open-addressed hash of twice the capacity.
+typedef struct {
+    char *names;             // cap entries of width bytes
+    uint8_t *hash;           // 2 * cap slots: name index + 1, 0 where empty
+    uint8_t width;
+    uint8_t cap;
+    _Atomic uint8_t count;
+} name_table_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    motion_event_t event;
+} motion_slot_t;
+
+#define SNAPSHOT_TRIES 8   // Reads of a slot before treating it as overwritten
+
+static log_slot_t g_logs[MAX_LOGS];
+static uint8_t g_arena[LOG_ARENA_BYTES];
+static log_tier_t g_hot = {
+    .slots = g_logs,
+    .arena = g_arena,
+    .slot_count = MAX_LOGS,
+    .arena_size = LOG_ARENA_BYTES,
+    .arena_span = (uint32_t)(UINT32_MAX / LOG_ARENA_BYTES * LOG_ARENA_BYTES),
+    .budget = LOG_STORAGE_BYTES,
+    .first = 1,
+    .next = 1,
+};
+static portMUX_TYPE g_log_lock = portMUX_INITIALIZER_UNLOCKED;   // Hot tier writers
+static uint32_t g_inline_names = 0;           // Under g_log_lock
+static uint32_t g_dropped = 0;                // Under g_log_lock
+
+static SemaphoreHandle_t g_tier_lock = NULL;  // Cold tier writers
+static log_tier_t *_Atomic g_cold = NULL;
+static _Atomic uint32_t g_cold_readers = 0;
+static uint32_t g_cold_bytes = LOG_STORAGE_PSRAM_BYTES;   // Under g_tier_lock
+static uint32_t g_demotions = 0;              // Under g_tier_lock
+static uint32_t g_demoted = 0;
+static uint32_t g_promoted = 0;
+
+static char g_device_names[LOG_DEVICE_NAMES][FIELD_SIZE(device_id)];
+static char g_level_names[LOG_LEVEL_NAMES][FIELD_SIZE(level)];
+static char g_category_names[LOG_CATEGORY_NAMES][FIELD_SIZE(category)];
+static uint8_t g_device_hash[2 * LOG_DEVICE_NAMES];
+static uint8_t g_level_hash[2 * LOG_LEVEL_NAMES];
+static uint8_t g_category_hash[2 * LOG_CATEGORY_NAMES];
+static name_table_t g_devices = {
+    .names = g_device_names[0], .hash = g_device_hash, .width = FIELD_SIZE(device_id), .cap = LOG_DEVICE_NAMES, .count = 0,
+};
+static name_table_t g_levels = {
+    .names = g_level_names[0], .hash = g_level_hash, .width = FIELD_SIZE(level), .cap = LOG_LEVEL_NAMES, .count = 0,
+};
+static name_table_t g_categories = {
+    .names = g_category_names[0], .hash = g_category_hash, .width = FIELD_SIZE(category), .cap = LOG_CATEGORY_NAMES, .count = 0,
+};
+
+static motion_slot_t g_motion_events[MAX_MOTION_EVENTS];
+static _Atomic uint32_t g_first_motion_id = 1;
+static _Atomic uint32_t g_next_motion_id = 1;
+static portMUX_TYPE g_motion_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Persistence (log_journal.c). The flush task copies entries added since
+// its last pass into the journal, reading them lock-free like any reader,
+// so adds never wait on flash. Entries overwritten before it gets to them
+// are counted as missed. A clear is journaled as a marker with the first ID
+// after it, so replay drops what came before.
+static SemaphoreHandle_t g_journal_lock = NULL;  // Serializes journal access
+static TaskHandle_t g_flush_task = NULL;
+static _Atomic uint32_t g_journaled_log_id = 1;  // Next entry to journal
+static _Atomic uint32_t g_journaled_motion_id = 1;
+static uint32_t g_log_clears = 0;                // Under g_log_lock
+static uint32_t g_log_cleared_at = 0;            // next ID at the last clear
+static uint32_t g_motion_clears = 0;             // Under g_motion_lock
+static uint32_t g_motion_cleared_at = 0;
+static uint32_t g_journaled_log_clears = 0;      // Under g_journal_lock
+static uint32_t g_journaled_motion_clears = 0;
+static uint32_t g_journal_missed = 0;
+
+static void slot_write_begin(_Atomic uint32_t *seq)
+{
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    // The odd count must be visible before any of the new contents
+    atomic_thread_fence(memory_order_release);
+}
+
+static void slot_write_end(_Atomic uint32_t *seq)
+{
+    atomic_fetch_add_explicit(seq, 1, memory_order_release);
+}
+
+// Copy a slot out; false if it kept changing under the reader
+static bool slot_read(_Atomic uint32_t *seq, const void *src, void *dst, size_t size)
+{
+    for (int i = 0; i < SNAPSHOT_TRIES; i++) {
+        uint32_t before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(dst, src, size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint32_t arena_add(const log_tier_t *tier, uint32_t pos, uint32_t n)
+{
+    uint32_t sum = pos + n;
+    return sum >= tier->arena_span || sum < pos ? sum - tier->arena_span : sum;
+}
+
+static inline uint32_t arena_sub(const log_tier_t *tier, uint32_t pos, uint32_t n)
+{
+    return pos >= n ? pos - n : pos + (tier->arena_span - n);
+}
+
+// Bytes from `from` up to `to`
+static inline uint32_t arena_distance(const log_tier_t *tier, uint32_t to, uint32_t from)
+{
+    return to >= from ? to - from : to + (tier->arena_span - from);
+}
+
+static void arena_write(log_tier_t *tier, uint32_t pos, const void *src, size_t len)
+{
+    size_t off = pos % tier->arena_size;
+    size_t head = len < tier->arena_size - off ? len : tier->arena_size - off;
+    memcpy(&tier->arena[off], src, head);
+    memcpy(tier->arena, (const uint8_t *)src + head, len - head);
+}
+
+static void arena_read(const log_tier_t *tier, uint32_t pos, void *dst, size_t len)
+{
+    size_t off = pos % tier->arena_size;
+    size_t head = len < tier->arena_size - off ? len : tier->arena_size - off;
+    memcpy(dst, &tier->arena[off], head);
+    memcpy((uint8_t *)dst + head, tier->arena, len - head);
+}
+
+static void tier_reset(log_tier_t *tier)
+{
+    memset(tier->slots, 0, tier->slot_count * sizeof(log_slot_t));
+    atomic_store(&tier->arena_end, 0);
+    atomic_store(&tier->first, 1);
+    atomic_store(&tier->next, 1);
+}
+
+// A PSRAM tier of `budget` bytes, split like the hot tier; NULL if there is
+// not that much PSRAM free
+static log_tier_t *tier_create(uint32_t budget)
+{
+    uint32_t slots = log_storage_capacity_for(budget, LOG_STORAGE_AVG_MESSAGE);
+    log_tier_t *tier = calloc(1, sizeof(*tier));
+    uint8_t *mem = heap_caps_malloc(budget, MALLOC_CAP_SPIRAM);
+    if (!tier || !mem) {
+        free(tier);
+        heap_caps_free(mem);
+        return NULL;
+    }
+    tier->slots = (log_slot_t *)mem;
+    tier->slot_count = slots;
+    tier->arena = mem + slots * LOG_RECORD_SIZE;
+    tier->arena_size = budget - slots * LOG_RECORD_SIZE;
+    tier->arena_span = UINT32_MAX / tier->arena_size * tier->arena_size;
+    tier->budget = budget;
+    tier_reset(tier);
+    return tier;
+}
+
+static void tier_free(log_tier_t *tier)
+{
+    if (tier) {
+        heap_caps_free(tier->slots);
+        free(tier);
+    }
+}
+
+// Entries held, as of the loads
+static uint32_t tier_count(log_tier_t *tier)
+{
+    uint32_t first = atomic_load_explicit(&tier->first, memory_order_acquire);
+    uint32_t held = atomic_load_explicit(&tier->next, memory_order_acquire) - first;
+    return held > tier->slot_count ? tier->slot_count : held;   // An insert landed between the loads
+}
+
+// The cold tier, kept allocated until the matching cold_release
+static log_tier_t *cold_acquire(void)
+{
+    atomic_fetch_add(&g_cold_readers, 1);
+    return atomic_load(&g_cold);
+}
+
+static void cold_release(void)
+{
+    atomic_fetch_sub(&g_cold_readers, 1);
+}
+
+static const char *name_at(name_table_t *table, uint8_t index)
+{
+    return &table->names[index * table->width];
+}
+
+static void name_reset(name_table_t *table)
+{
+    memset(table->hash, 0, 2 * table->cap);
+    atomic_store(&table->count, 0);
+}
+
+// Index of a name (len bytes, already truncated), adding it if new; called
+// under g_log_lock
+static uint8_t name_intern(name_table_t *table, const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    uint32_t mask = 2 * table->cap - 1;
+    for (uint32_t b = h & mask;; b = (b + 1) & mask) {
+        if (table->hash[b] == 0) {
+            uint8_t count = atomic_load_explicit(&table->count, memory_order_relaxed);
+            if (count == table->cap) {
+                g_inline_names++;
+                return NAME_INLINE;
+            }
+            char *slot = &table->names[count * table->width];
+            memcpy(slot, name, len);
+            slot[len] = '\0';
+            atomic_store_explicit(&table->count, count + 1, memory_order_release);
+            table->hash[b] = count + 1;
+            return count;
+        }
+        uint8_t index = table->hash[b] - 1;
+        const char *entry = name_at(table, index);
+        if (strncmp(entry, name, len) == 0 && entry[len] == '\0') {
+            return index;
+        }
+    }
+}
+
+// Expand a name from its table, or from the text if it is inline there
+static const uint8_t *name_expand(name_table_t *table, uint8_t index, const uint8_t *text, const uint8_t *end,
+                                  char *out)
+{
+    if (index != NAME_INLINE) {
+        if (index >= atomic_load_explicit(&table->count, memory_order_acquire)) {
+            return NULL;
+        }
+        strcpy(out, name_at(table, index));
+        return text;
+    }
+    if (!text || text >= end || text[0] >= table->width || text + 1 + text[0] > end) {
+        return NULL;
+    }
+    memcpy(out, text + 1, text[0]);
+    out[text[0]] = '\0';
+    return text + 1 + text[0];
+}
+
+// Entry `id`'s record and text (LOG_TEXT_MAX bytes) as the tier holds them
+// now; false if it no longer (or not yet) does
+static bool tier_read(log_tier_t *tier, uint32_t id, log_record_t *rec, uint8_t *text)
+{
+    log_slot_t *slot = &tier->slots[id % tier->slot_count];
+    if (!slot_read(&slot->seq, &slot->rec, rec, sizeof(*rec)) || rec->id != id || rec->text_len > LOG_TEXT_MAX) {
+        return false;
+    }
+
+    // The text is only good if no writer had claimed its bytes by the end
+    // of the copy
+    arena_read(tier, rec->text, text, rec->text_len);
+    atomic_thread_fence(memory_order_acquire);
+    return arena_distance(tier, atomic_load_explicit(&tier->arena_end, memory_order_relaxed), rec->text) <=
+           tier->arena_size;
+}
+
+static bool log_decode(const log_record_t *rec, const uint8_t *text, device_log_t *out)
+{
+    const uint8_t *end = text + rec->text_len;
+    const uint8_t *p = name_expand(&g_devices, rec->device, text, end, out->device_id);
+    p = name_expand(&g_levels, rec->level, p, end, out->level);
+    p = name_expand(&g_categories, rec->category, p, end, out->category);
+    if (!p || end - p >= (ptrdiff_t)sizeof(out->message)) {
+        return false;
+    }
+    memcpy(out->message, p, end - p);
+    out->message[end - p] = '\0';
+    out->id = rec->id;
+    out->timestamp = rec->timestamp;
+    return true;
+}
+
+// Entry `id` as it is now, from whichever tier holds it; `cold` is from
+// cold_acquire. False if it is no longer (or not yet) held.
+static bool log_read(uint32_t id, log_tier_t *cold, device_log_t *out)
+{
+    log_record_t rec;
+    uint8_t text[LOG_TEXT_MAX];
+    // Below the hot tier's first, a hot slot may still hold the entry but
+    // promotion can be rewriting its bytes: the cold tier has it
+    if (id >= atomic_load_explicit(&g_hot.first, memory_order_acquire) && tier_read(&g_hot, id, &rec, text)) {
+        return log_decode(&rec, text, out);
+    }
+    return cold && tier_read(cold, id, &rec, text) && log_decode(&rec, text, out);
+}
+
+// Oldest entry held in either tier
+static uint32_t log_first(log_tier_t *cold)
+{
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_acquire);
+    if (cold) {
+        uint32_t cold_first = atomic_load_explicit(&cold->first, memory_order_acquire);
+        if (cold_first != atomic_load_explicit(&cold->next, memory_order_acquire) && cold_first < first) {
+            first = cold_first;
+        }
+    }
+    return first;
+}
+
+static bool motion_read(uint32_t id, motion_event_t *out)
+{
+    motion_slot_t *slot = &g_motion_events[id % MAX_MOTION_EVENTS];
+    return slot_read(&slot->seq, &slot->event, out, sizeof(*out)) && out->id == id;
+}
+
+// Store entry rec->id, newer than any the tier holds, with its text,
+// evicting the oldest entries whose slot or arena bytes it takes; called
+// under the tier's writer lock
+static void tier_put(log_tier_t *tier, log_record_t *rec, const uint8_t *text)
+{
+    uint32_t id = rec->id;
+    rec->text = atomic_load_explicit(&tier->arena_end, memory_order_relaxed);
+    uint32_t text_end = arena_add(tier, rec->text, rec->text_len);
+
+    uint32_t first = atomic_load_explicit(&tier->first, memory_order_relaxed);
+    if (first == atomic_load_explicit(&tier->next, memory_order_relaxed)) {
+        first = id;   // Empty; IDs may have moved on since
+    } else if (id - first >= tier->slot_count) {
+        first = id - tier->slot_count + 1;
+    }
+    while (first != id) {
+        const log_record_t *oldest = &tier->slots[first % tier->slot_count].rec;
+        if (oldest->id == first && arena_distance(tier, text_end, oldest->text) <= tier->arena_size) {
+            break;   // Its text survives this write
+        }
+        first++;
+    }
+    atomic_store_explicit(&tier->first, first, memory_order_release);
+
+    // Claim the bytes before overwriting them (see tier_read)
+    atomic_store_explicit(&tier->arena_end, text_end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    arena_write(tier, rec->text, text, rec->text_len);
+
+    log_slot_t *slot = &tier->slots[id % tier->slot_count];
+    slot_write_begin(&slot->seq);
+    slot->rec = *rec;
+    slot_write_end(&slot->seq);
+    atomic_store_explicit(&tier->next, id + 1, memory_order_release);
+}
+
+// Store entry `id`, which must be newer than any held, in the hot tier;
+// called under g_log_lock
+static void log_put(uint32_t id, uint32_t timestamp, const char *device_id, const char *level,
+                    const char *category, const char *message)
+{
+    size_t device_len = strnlen(device_id, FIELD_SIZE(device_id) - 1);
+    size_t level_len = strnlen(level, FIELD_SIZE(level) - 1);
+    size_t category_len = strnlen(category, FIELD_SIZE(category) - 1);
+    size_t message_len = strnlen(message, FIELD_SIZE(message) - 1);
+
+    log_record_t rec = {
+        .id = id,
+        .timestamp = timestamp,
+        .device = name_intern(&g_devices, device_id, device_len),
+        .level = name_intern(&g_levels, level, level_len),
+        .category = name_intern(&g_categories, category, category_len),
+    };
+    uint8_t text[LOG_TEXT_MAX];
+    size_t len = 0;
+    const struct {
+        uint8_t index;
+        const char *name;
+        size_t len;
+    } names[] = {{rec.device, device_id, device_len}, {rec.level, level, level_len},
+                 {rec.category, category, category_len}};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (names[i].index == NAME_INLINE) {
+            text[len++] = names[i].len;
+            memcpy(&text[len], names[i].name, names[i].len);
+            len += names[i].len;
+        }
+    }
+    memcpy(&text[len], message, message_len);
+    rec.text_len = len + message_len;
+
+    // With a cold tier, anything the hot tier evicts was not demoted in time
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_relaxed);
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_relaxed);
+    tier_put(&g_hot, &rec, text);
+    if (atomic_load_explicit(&g_cold, memory_order_relaxed) && first != next) {
+        g_dropped += atomic_load_explicit(&g_hot.first, memory_order_relaxed) - first;
+    }
+}
+
+// Can the hot tier take an entry of any size without evicting one? Reads
+// the oldest record without the seqlock: only a hint.
+static bool hot_has_room(void)
+{
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_acquire);
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_acquire);
+    if (next - first >= MAX_LOGS) {
+        return false;
+    }
+    if (first == next) {
+        return true;
+    }
+    uint32_t oldest = g_logs[first % MAX_LOGS].rec.text;
+    uint32_t used = arena_distance(&g_hot, atomic_load_explicit(&g_hot.arena_end, memory_order_relaxed), oldest);
+    return used <= LOG_ARENA_BYTES - LOG_TEXT_MAX;
+}
+
+// Copy up to `count` of the oldest hot entries into the cold tier, then
+// drop them from the hot tier; called under g_tier_lock. Returns how many
+// went.
+static uint32_t demote(log_tier_t *cold, uint32_t count)
+{
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_acquire);
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_acquire);
+    if (count > next - first) {
+        count = next - first;
+    }
+    log_record_t rec;
+    uint8_t text[LOG_TEXT_MAX];
+    uint32_t id = first;
+    for (; id != first + count; id++) {
+        // One evicted meanwhile is already counted as dropped
+        if (tier_read(&g_hot, id, &rec, text)) {
+            tier_put(cold, &rec, text);
+            g_demoted++;
+        }
+    }
+
+    portENTER_CRITICAL(&g_log_lock);
+    if ((int32_t)(id - atomic_load_explicit(&g_hot.first, memory_order_relaxed)) > 0) {
+        atomic_store_explicit(&g_hot.first, id, memory_order_release);
+    }
+    portEXIT_CRITICAL(&g_log_lock);
+    g_demotions += count > 0;
+    return count;
+}
+
+// Before an add: if the hot tier is full, demote its oldest entries, a
+// batch at a time, so the add evicts nothing
+static void make_room(void)
+{
+    if (!g_tier_lock || !atomic_load_explicit(&g_cold, memory_order_relaxed) || hot_has_room()) {
+        return;
+    }
+    xSemaphoreTake(g_tier_lock, portMAX_DELAY);
+    log_tier_t *cold = atomic_load(&g_cold);   // Stays while we hold g_tier_lock
+    while (cold && !hot_has_room() && demote(cold, TIER_BATCH)) {
+    }
+    xSemaphoreGive(g_tier_lock);
+}
+
+// Put entry rec->id, just older than any the hot tier holds, in front of
+// its oldest; false if its slot or the arena bytes ahead of the oldest
+// text are in use. Called under g_log_lock.
+static bool hot_prepend(log_record_t *rec, const uint8_t *text)
+{
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_relaxed);
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_relaxed);
+    if (rec->id != first - 1 || next - rec->id > MAX_LOGS) {
+        return false;
+    }
+    uint32_t end = atomic_load_explicit(&g_hot.arena_end, memory_order_relaxed);
+    uint32_t oldest = end;
+    if (first != next) {
+        const log_record_t *rec_first = &g_logs[first % MAX_LOGS].rec;
+        if (rec_first->id != first) {
+            return false;
+        }
+        oldest = rec_first->text;
+    }
+    uint32_t pos = arena_sub(&g_hot, oldest, rec->text_len);
+    if (arena_distance(&g_hot, end, pos) > LOG_ARENA_BYTES) {
+        return false;
+    }
+
+    rec->text = pos;
+    arena_write(&g_hot, pos, text, rec->text_len);
+    log_slot_t *slot = &g_logs[rec->id % MAX_LOGS];
+    slot_write_begin(&slot->seq);
+    slot->rec = *rec;
+    slot_write_end(&slot->seq);
+    atomic_store_explicit(&g_hot.first, rec->id, memory_order_release);
+    return true;
+}
+
+// Move the newest cold entries back in front of the hot tier's oldest while
+// it has room, TIER_BATCH per hold of the spinlock; called under
+// g_tier_lock when the cold tier goes away
+static void promote(log_tier_t *cold)
+{
+    log_record_t rec;
+    uint8_t text[LOG_TEXT_MAX];
+    bool room = true;
+    while (room) {
+        portENTER_CRITICAL(&g_log_lock);
+        for (int i = 0; i < TIER_BATCH && room; i++) {
+            uint32_t id = atomic_load_explicit(&g_hot.first, memory_order_relaxed) - 1;
+            room = id >= atomic_load_explicit(&cold->first, memory_order_relaxed) &&
+                   tier_read(cold, id, &rec, text) && hot_prepend(&rec, text);
+            g_promoted += room;
+        }
+        portEXIT_CRITICAL(&g_log_lock);
+    }
+}
+
+// Copy the newest entries of one cold tier that fit into another, oldest
+// first; called under g_tier_lock
+static void migrate(log_tier_t *from, log_tier_t *to)
+{
+    uint32_t first = atomic_load(&from->first);
+    uint32_t next = atomic_load(&from->next);
+    if (next - first > to->slot_count) {
+        first = next - to->slot_count;
+    }
+    log_record_t rec;
+    uint8_t text[LOG_TEXT_MAX];
+    for (uint32_t id = first; id != next; id++) {
+        if (tier_read(from, id, &rec, text)) {
+            tier_put(to, &rec, text);
+        }
+    }
+}
+
+// Put a replayed entry back, as the newest held
+static void restore_log(const device_log_t *log)
+{
+    if (log->id < atomic_load(&g_hot.next)) {
+        return;
+    }
+    make_room();
+    portENTER_CRITICAL(&g_log_lock);
+    log_put(log->id, (uint32_t)log->timestamp, log->device_id, log->level, log->category, log->message);
+    portEXIT_CRITICAL(&g_log_lock);
+}
+
+static void restore_motion(const motion_event_t *event)
+{
+    motion_slot_t *slot = &g_motion_events[event->id % MAX_MOTION_EVENTS];
+    slot_write_begin(&slot->seq);
+    slot->event = *event;
+    slot_write_end(&slot->seq);
+    if (event->id >= atomic_load(&g_next_motion_id)) {
+        atomic_store(&g_next_motion_id, event->id + 1);
+    }
+    if (atomic_load(&g_next_motion_id) - atomic_load(&g_first_motion_id) > MAX_MOTION_EVENTS) {
+        atomic_store(&g_first_motion_id, atomic_load(&g_next_motion_id) - MAX_MOTION_EVENTS);
+    }
+}
+
+// Drop everything before `next_id`, which later IDs continue from
+static void restore_clear(_Atomic uint32_t *first, _Atomic uint32_t *next, uint32_t next_id)
+{
+    if (next_id > atomic_load(next)) {
+        atomic_store(next, next_id);
+    }
+    atomic_store(first, atomic_load(next));
+}
+
+static void replay_entry(log_journal_kind_t kind, const device_log_t *log, const motion_event_t *event,
+                         uint32_t id, void *ctx)
+{
+    (void)ctx;
+    log_tier_t *cold;
+    switch (kind) {
+    case LOG_JOURNAL_LOG:
+        restore_log(log);
+        break;
+    case LOG_JOURNAL_MOTION:
+        restore_motion(event);
+        break;
+    case LOG_JOURNAL_CLEAR_LOGS:
+        restore_clear(&g_hot.first, &g_hot.next, id);
+        cold = atomic_load(&g_cold);
+        if (cold) {
+            atomic_store(&cold->first, atomic_load(&cold->next));
+        }
+        break;
+    case LOG_JOURNAL_CLEAR_MOTION:
+        restore_clear(&g_first_motion_id, &g_next_motion_id, id);
+        break;
+    }
+}
+
+static void flush_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        // Woken early by adds once a batch is waiting
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOURNAL_FLUSH_MS));
+        log_storage_flush();
+    }
+}
 
 void log_storage_init(void)
 {
-    esp_err_t err = nvs_open("logs", NVS_READWRITE, &g_nvs_handle);
+    if (!g_tier_lock) {
+        g_tier_lock = xSemaphoreCreateMutex();
+    }
+    if (!g_journal_lock) {
+        g_journal_lock = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(g_journal_lock, portMAX_DELAY);
+
+    // Start empty, then rebuild from flash
+    xSemaphoreTake(g_tier_lock, portMAX_DELAY);
+    tier_reset(&g_hot);
+    log_tier_t *cold = atomic_load(&g_cold);
+    if (cold) {
+        tier_reset(cold);
+    } else if (g_cold_bytes) {
+        cold = tier_create(g_cold_bytes);
+        if (!cold) {
+            ESP_LOGW(TAG, "No %lu KB of PSRAM for older logs, keeping %d in SRAM only",
+                     (unsigned long)(g_cold_bytes / 1024), MAX_LOGS);
+        }
+        atomic_store(&g_cold, cold);
+    }
+    g_demotions = g_demoted = g_promoted = 0;
+    xSemaphoreGive(g_tier_lock);
+    name_reset(&g_devices);
+    name_reset(&g_levels);
+    name_reset(&g_categories);
+    g_inline_names = 0;
+    g_dropped = 0;
+    memset(g_motion_events, 0, sizeof(g_motion_events));
+    atomic_store(&g_first_motion_id, 1);
+    atomic_store(&g_next_motion_id, 1);
+    g_log_clears = g_journaled_log_clears = 0;
+    g_motion_clears = g_journaled_motion_clears = 0;
+    g_journal_missed = 0;
+
+    esp_err_t err = log_journal_init();
+    if (err == ESP_OK) {
+        err = log_journal_replay(MAX_LOGS + (cold ? cold->slot_count : 0), MAX_MOTION_EVENTS, replay_entry, NULL);
+    }
+    atomic_store(&g_journaled_log_id, atomic_load(&g_hot.next));
+    atomic_store(&g_journaled_motion_id, atomic_load(&g_next_motion_id));
+    xSemaphoreGive(g_journal_lock);
+
     if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to open NVS namespace for logs: %s", esp_err_to_name(err));
+        ESP_LOGW(TAG, "Log journal unavailable, history is lost on reboot: %s", esp_err_to_name(err));
+    } else if (!g_flush_task) {
+        xTaskCreate(flush_task, "log_flush", 4096, NULL, 3, &g_flush_task);
+    }
+
+    ESP_LOGI(TAG, "Log storage initialized: %lu logs, %lu motion events restored",
+             (unsigned long)log_storage_get_log_count(), (unsigned long)log_storage_get_motion_count());
+}
+
+esp_err_t log_storage_set_capacity(uint32_t psram_bytes)
+{
+    if (psram_bytes && psram_bytes < LOG_STORAGE_PSRAM_MIN_BYTES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!g_tier_lock) {
+        g_tier_lock = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(g_tier_lock, portMAX_DELAY);
+    log_tier_t *old = atomic_load(&g_cold);
+    if ((old ? old->budget : 0) == psram_bytes) {
+        g_cold_bytes = psram_bytes;
+        xSemaphoreGive(g_tier_lock);
+        return ESP_OK;
+    }
+
+    log_tier_t *tier = NULL;
+    if (psram_bytes) {
+        tier = tier_create(psram_bytes);
+        if (!tier) {
+            xSemaphoreGive(g_tier_lock);
+            ESP_LOGE(TAG, "No %lu KB of PSRAM for older logs", (unsigned long)(psram_bytes / 1024));
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (old && tier) {
+        migrate(old, tier);
+    } else if (old) {
+        promote(old);
+    }
+    atomic_store(&g_cold, tier);
+    g_cold_bytes = psram_bytes;
+    xSemaphoreGive(g_tier_lock);
+
+    // Free the old tier once no listing is still walking it
+    if (old) {
+        while (atomic_load(&g_cold_readers)) {
+            vTaskDelay(1);
+        }
+        tier_free(old);
+    }
+    ESP_LOGI(TAG, "Log store: %d entries in SRAM, %lu in %lu KB of PSRAM", MAX_LOGS,
+             (unsigned long)(tier ? tier->slot_count : 0), (unsigned long)(psram_bytes / 1024));
+    return ESP_OK;
+}
+
+// Where the flush task resumes; IDs already overwritten count as missed
+static uint32_t journal_start(_Atomic uint32_t *journaled, uint32_t first)
+{
+    uint32_t id = atomic_load_explicit(journaled, memory_order_relaxed);
+    if ((int32_t)(first - id) > 0) {
+        g_journal_missed += first - id;
+        id = first;
+    }
+    return id;
+}
+
+static void journal_new_logs(void)
+{
+    log_tier_t *cold = cold_acquire();
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_acquire);
+    uint32_t id = journal_start(&g_journaled_log_id, log_first(cold));
+    device_log_t copy;
+    for (; id != next; id++) {
+        if (!log_read(id, cold, &copy)) {
+            g_journal_missed++;
+        } else if (log_journal_append_log(&copy) != ESP_OK) {
+            break;   // Retried on the next flush
+        }
+    }
+    cold_release();
+    atomic_store_explicit(&g_journaled_log_id, id, memory_order_relaxed);
+}
+
+static void journal_new_motions(void)
+{
+    uint32_t next = atomic_load_explicit(&g_next_motion_id, memory_order_acquire);
+    uint32_t id = journal_start(&g_journaled_motion_id, atomic_load_explicit(&g_first_motion_id, memory_order_acquire));
+    motion_event_t copy;
+    for (; id != next; id++) {
+        if (!motion_read(id, &copy)) {
+            g_journal_missed++;
+        } else if (log_journal_append_motion(&copy) != ESP_OK) {
+            break;
+        }
+    }
+    atomic_store_explicit(&g_journaled_motion_id, id, memory_order_relaxed);
+}
+
+void log_storage_flush(void)
+{
+    if (!g_journal_lock || !log_journal_ready()) {
         return;
     }
+    xSemaphoreTake(g_journal_lock, portMAX_DELAY);
+
+    // Clears first: what they dropped is not journaled
+    portENTER_CRITICAL(&g_log_lock);
+    uint32_t log_clears = g_log_clears, log_cleared_at = g_log_cleared_at;
+    portEXIT_CRITICAL(&g_log_lock);
+    if (log_clears != g_journaled_log_clears &&
+        log_journal_append_clear(LOG_JOURNAL_CLEAR_LOGS, log_cleared_at) == ESP_OK) {
+        g_journaled_log_clears = log_clears;
+        if ((int32_t)(log_cleared_at - atomic_load(&g_journaled_log_id)) > 0) {
+            atomic_store(&g_journaled_log_id, log_cleared_at);
+        }
+    }
+    portENTER_CRITICAL(&g_motion_lock);
+    uint32_t motion_clears = g_motion_clears, motion_cleared_at = g_motion_cleared_at;
+    portEXIT_CRITICAL(&g_motion_lock);
+    if (motion_clears != g_journaled_motion_clears &&
+        log_journal_append_clear(LOG_JOURNAL_CLEAR_MOTION, motion_cleared_at) == ESP_OK) {
+        g_journaled_motion_clears = motion_clears;
+        if ((int32_t)(motion_cleared_at - atomic_load(&g_journaled_motion_id)) > 0) {
+            atomic_store(&g_journaled_motion_id, motion_cleared_at);
+        }
+    }
 
-    // Try to restore logs from NVS
-    // For now, we'll use in-memory storage as primary (faster)
-    // NVS is used for persistence across reboots
-    
-    ESP_LOGI(TAG, "Log storage initialized");
+    journal_new_logs();
+    journal_new_motions();
+    log_journal_flush();
+    xSemaphoreGive(g_journal_lock);
+}
+
+void log_storage_get_journal_stats(log_journal_stats_t *stats, uint32_t *missed)
+{
+    if (g_journal_lock) {
+        xSemaphoreTake(g_journal_lock, portMAX_DELAY);
+    }
+    log_journal_get_stats(stats);
+    *missed = g_journal_missed;
+    if (g_journal_lock) {
+        xSemaphoreGive(g_journal_lock);
+    }
+}
+
+// Wake the flush task when an add completes a batch
+static inline void journal_added(uint32_t next, _Atomic uint32_t *journaled)
+{
+    if (g_flush_task && next - atomic_load_explicit(journaled, memory_order_relaxed) == JOURNAL_FLUSH_BATCH) {
+        xTaskNotifyGive(g_flush_task);
+    }
 }
 
-void log_storage_add_log(const char *device_id, const char *level, 
+void log_storage_add_log(const char *device_id, const char *level,
                          const char *category, const char *message)
 {
-    if (g_log_count >= MAX_LOGS) {
-        // FIFO: shift all logs down by 1
-        memmove(&g_logs[0], &g_logs[1], (MAX_LOGS - 1) * sizeof(device_log_t));
-        g_log_count--;
-    }
-
-    device_log_t *log = &g_logs[g_log_count];
-    log->id = g_next_log_id++;
-    
-    strncpy(log->device_id, device_id, sizeof(log->device_id) - 1);
-    log->device_id[sizeof(log->device_id) - 1] = '\0';
-    
-    log->timestamp = time(NULL);
-    
-    strncpy(log->level, level, sizeof(log->level) - 1);
-    log->level[sizeof(log->level) - 1] = '\0';
-    
-    strncpy(log->category, category, sizeof(log->category) - 1);
-    log->category[sizeof(log->category) - 1] = '\0';
-    
-    strncpy(log->message, message, sizeof(log->message) - 1);
-    log->message[sizeof(log->message) - 1] = '\0';
-
-    g_log_count++;
-    
-    // Persist to NVS (periodically, not every log)
-    // This is done on a background task to avoid blocking
+    uint64_t now = time(NULL);
+
+    make_room();
+    portENTER_CRITICAL(&g_log_lock);
+    uint32_t id = atomic_load_explicit(&g_hot.next, memory_order_relaxed);
+    log_put(id, (uint32_t)now, device_id, level, category, message);
+    portEXIT_CRITICAL(&g_log_lock);
+
+    journal_added(id + 1, &g_journaled_log_id);
 }
 
 void log_storage_add_motion_event(const char *device_id, const char *media_path)
 {
-    if (g_motion_count >= MAX_MOTION_EVENTS) {
-        // FIFO: shift all events down by 1
-        memmove(&g_motion_events[0], &g_motion_events[1], 
-                (MAX_MOTION_EVENTS - 1) * sizeof(motion_event_t));
-        g_motion_count--;
+    uint64_t now = time(NULL);
+
+    portENTER_CRITICAL(&g_motion_lock);
+    uint32_t id = atomic_load_explicit(&g_next_motion_id, memory_order_relaxed);
+    if (id - atomic_load_explicit(&g_first_motion_id, memory_order_relaxed) >= MAX_MOTION_EVENTS) {
+        // Full: this one overwrites the oldest
+        atomic_store_explicit(&g_first_motion_id, id - MAX_MOTION_EVENTS + 1, memory_order_release);
     }
 
-    motion_event_t *event = &g_motion_events[g_motion_count];
-    event->id = g_next_motion_id++;
-    
+    motion_slot_t *slot = &g_motion_events[id % MAX_MOTION_EVENTS];
+    motion_event_t *event = &slot->event;
+    slot_write_begin(&slot->seq);
+    event->id = id;
+
     strncpy(event->device_id, device_id, sizeof(event->device_id) - 1);
     event->device_id[sizeof(event->device_id) - 1] = '\0';
-    
-    event->timestamp = time(NULL);
-    
+
+    event->timestamp = now;
+
     if (media_path) {
         strncpy(event->media_path, media_path, sizeof(event->media_path) - 1);
         event->media_path[sizeof(event->media_path) - 1] = '\0';
@@ -92,23 +956,41 @@ void log_storage_add_motion_event(const char *device_id, const char *media_path)
         event->media_path[0] = '\0';
     }
 
-    g_motion_count++;
+    slot_write_end(&slot->seq);
+    atomic_store_explicit(&g_next_motion_id, id + 1, memory_order_release);
+    portEXIT_CRITICAL(&g_motion_lock);
+
+    journal_added(id + 1, &g_journaled_motion_id);
 }
 
 char* log_storage_get_logs_json(const char *device_id, int limit)
 {
     cJSON *root = cJSON_CreateArray();
-    
-    // Iterate in reverse order (newest first)
+
+    // Newest first, from the entries held when the listing started, down
+    // the hot tier and on into the cold one. Writers may overwrite the
+    // oldest of those meanwhile; the listing stops there. An ID missing
+    // from the middle (lost at power failure before it was journaled, or
+    // evicted before it could be demoted) is skipped.
+    log_tier_t *cold = cold_acquire();
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_acquire);
+    uint32_t first = log_first(cold);
     int count = 0;
-    for (int i = (int)g_log_count - 1; i >= 0 && count < limit; i--) {
-        device_log_t *log = &g_logs[i];
-        
+    device_log_t copy;
+    device_log_t *log = &copy;
+    for (uint32_t id = next; id-- > first && count < limit;) {
+        if (!log_read(id, cold, &copy)) {
+            if (id < log_first(cold)) {
+                break;
+            }
+            continue;
+        }
+
         // Filter by device_id if specified
         if (device_id && strcmp(log->device_id, device_id) != 0) {
             continue;
         }
-        
+
         cJSON *item = cJSON_CreateObject();
         cJSON_AddNumberToObject(item, "id", log->id);
         cJSON_AddStringToObject(item, "device_id", log->device_id);
@@ -116,11 +998,12 @@ char* log_storage_get_logs_json(const char *device_id, int limit)
         cJSON_AddStringToObject(item, "level", log->level);
         cJSON_AddStringToObject(item, "category", log->category);
         cJSON_AddStringToObject(item, "message", log->message);
-        
+
         cJSON_AddItemToArray(root, item);
         count++;
     }
-    
+    cold_release();
+
     char *json_str = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
     return json_str;
@@ -129,17 +1012,26 @@ char* log_storage_get_logs_json(const char *device_id, int limit)
 char* log_storage_get_motion_json(const char *device_id, int limit)
 {
     cJSON *root = cJSON_CreateArray();
-    
-    // Iterate in reverse order (newest first)
+
+    // Newest first (see log_storage_get_logs_json)
+    uint32_t next = atomic_load_explicit(&g_next_motion_id, memory_order_acquire);
+    uint32_t first = atomic_load_explicit(&g_first_motion_id, memory_order_acquire);
     int count = 0;
-    for (int i = (int)g_motion_count - 1; i >= 0 && count < limit; i--) {
-        motion_event_t *event = &g_motion_events[i];
-        
+    motion_event_t copy;
+    motion_event_t *event = &copy;
+    for (uint32_t id = next; id-- > first && count < limit;) {
+        if (!motion_read(id, &copy)) {
+            if (id < atomic_load_explicit(&g_first_motion_id, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+
         // Filter by device_id if specified
         if (device_id && strcmp(event->device_id, device_id) != 0) {
             continue;
         }
-        
+
         cJSON *item = cJSON_CreateObject();
         cJSON_AddNumberToObject(item, "id", event->id);
         cJSON_AddStringToObject(item, "device_id", event->device_id);
@@ -147,38 +1039,151 @@ char* log_storage_get_motion_json(const char *device_id, int limit)
         if (strlen(event->media_path) > 0) {
             cJSON_AddStringToObject(item, "media_path", event->media_path);
         }
-        
+
         cJSON_AddItemToArray(root, item);
         count++;
     }
-    
+
     char *json_str = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
     return json_str;
 }
 
+bool log_storage_get_log(uint32_t id, device_log_t *out)
+{
+    log_tier_t *cold = cold_acquire();
+    bool found = id >= log_first(cold) && log_read(id, cold, out);
+    cold_release();
+    return found;
+}
+
+bool log_storage_get_motion_event(uint32_t id, motion_event_t *out)
+{
+    if (id < atomic_load_explicit(&g_first_motion_id, memory_order_acquire)) {
+        return false;
+    }
+    return motion_read(id, out);
+}
+
+// Cold entries below the hot tier's first; a batch being demoted is in both
+static uint32_t cold_count(log_tier_t *cold)
+{
+    uint32_t hot_first = atomic_load_explicit(&g_hot.first, memory_order_acquire);
+    uint32_t first = atomic_load_explicit(&cold->first, memory_order_acquire);
+    uint32_t next = atomic_load_explicit(&cold->next, memory_order_acquire);
+    if ((int32_t)(next - hot_first) > 0) {
+        next = hot_first;
+    }
+    if ((int32_t)(next - first) <= 0) {
+        return 0;
+    }
+    return next - first > cold->slot_count ? cold->slot_count : next - first;
+}
+
 uint32_t log_storage_get_log_count(void)
 {
-    return g_log_count;
+    log_tier_t *cold = cold_acquire();
+    uint32_t count = (cold ? cold_count(cold) : 0) + tier_count(&g_hot);
+    cold_release();
+    return count;
+}
+
+void log_storage_get_memory(log_storage_memory_t *mem)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->budget = LOG_STORAGE_BYTES;
+    mem->record_size = LOG_RECORD_SIZE;
+    mem->arena_size = LOG_ARENA_BYTES;
+    mem->names_size = sizeof(g_device_names) + sizeof(g_level_names) + sizeof(g_category_names);
+    mem->devices = atomic_load(&g_devices.count);
+    mem->levels = atomic_load(&g_levels.count);
+    mem->categories = atomic_load(&g_categories.count);
+
+    portENTER_CRITICAL(&g_log_lock);
+    uint32_t first = atomic_load_explicit(&g_hot.first, memory_order_relaxed);
+    uint32_t next = atomic_load_explicit(&g_hot.next, memory_order_relaxed);
+    for (uint32_t id = first; id != next; id++) {
+        const log_record_t *rec = &g_logs[id % MAX_LOGS].rec;
+        if (rec->id == id) {
+            mem->text_bytes = arena_distance(&g_hot, atomic_load_explicit(&g_hot.arena_end, memory_order_relaxed),
+                                             rec->text);
+            break;
+        }
+    }
+    mem->inline_names = g_inline_names;
+    mem->dropped = g_dropped;
+    portEXIT_CRITICAL(&g_log_lock);
+
+    mem->entries = tier_count(&g_hot);
+    if (mem->entries) {
+        uint32_t text = mem->text_bytes / mem->entries;
+        mem->bytes_per_entry = LOG_RECORD_SIZE + text;
+        mem->max_entries = text ? LOG_ARENA_BYTES / text : MAX_LOGS;
+        if (mem->max_entries > MAX_LOGS) {
+            mem->max_entries = MAX_LOGS;
+        }
+    } else {
+        mem->max_entries = MAX_LOGS;
+    }
+
+    if (g_tier_lock) {
+        xSemaphoreTake(g_tier_lock, portMAX_DELAY);
+    }
+    log_tier_t *cold = atomic_load(&g_cold);
+    if (cold) {
+        mem->psram_budget = cold->budget;
+        mem->psram_entries = cold_count(cold);
+        mem->psram_max_entries = cold->slot_count;
+    }
+    mem->demotions = g_demotions;
+    mem->demoted = g_demoted;
+    mem->promoted = g_promoted;
+    if (g_tier_lock) {
+        xSemaphoreGive(g_tier_lock);
+    }
+}
+
+uint32_t log_storage_capacity_for(uint32_t budget, uint32_t message_bytes)
+{
+    return budget / (LOG_RECORD_SIZE + message_bytes);
 }
 
 uint32_t log_storage_get_motion_count(void)
 {
-    return g_motion_count;
+    uint32_t first = atomic_load_explicit(&g_first_motion_id, memory_order_acquire);
+    uint32_t held = atomic_load_explicit(&g_next_motion_id, memory_order_acquire) - first;
+    return held > MAX_MOTION_EVENTS ? MAX_MOTION_EVENTS : held;   // An insert landed between the loads
 }
 
 void log_storage_clear_logs(void)
 {
-    g_log_count = 0;
-    g_next_log_id = 1;
-    memset(g_logs, 0, sizeof(g_logs));
+    // IDs keep counting so none is ever reused; the slots are left for
+    // writers to overwrite, as a reader may be copying one. g_tier_lock
+    // keeps a demotion from landing in the cold tier after it is cleared.
+    if (g_tier_lock) {
+        xSemaphoreTake(g_tier_lock, portMAX_DELAY);
+    }
+    portENTER_CRITICAL(&g_log_lock);
+    g_log_cleared_at = atomic_load_explicit(&g_hot.next, memory_order_relaxed);
+    g_log_clears++;
+    atomic_store_explicit(&g_hot.first, g_log_cleared_at, memory_order_release);
+    portEXIT_CRITICAL(&g_log_lock);
+    log_tier_t *cold = atomic_load(&g_cold);
+    if (cold) {
+        atomic_store(&cold->first, atomic_load(&cold->next));
+    }
+    if (g_tier_lock) {
+        xSemaphoreGive(g_tier_lock);
+    }
     ESP_LOGI(TAG, "Logs cleared");
 }
 
 void log_storage_clear_motion(void)
 {
-    g_motion_count = 0;
-    g_next_motion_id = 1;
-    memset(g_motion_events, 0, sizeof(g_motion_events));
+    portENTER_CRITICAL(&g_motion_lock);
+    g_motion_cleared_at = atomic_load_explicit(&g_next_motion_id, memory_order_relaxed);
+    g_motion_clears++;
+    atomic_store_explicit(&g_first_motion_id, g_motion_cleared_at, memory_order_release);
+    portEXIT_CRITICAL(&g_motion_lock);
     ESP_LOGI(TAG, "Motion events cleared");
 }
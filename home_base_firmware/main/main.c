@@ -6,6 +6,7 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_netif_sntp.h"
 #include "esp_wifi.h"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
@@ -13,6 +14,8 @@
 #include "protocol.h"
 #include "device_config.h"
 #include "log_storage.h"
+#include "unraid_client.h"
+#include "sdkconfig.h"
 
 // Function prototypes
 void init_ethernet(void);
@@ -21,6 +24,12 @@ void init_esp_now(void);
 void init_wifi_ap_mode(void);
 void init_wifi_sta_mode(const char *ssid, const char *password);
 
+#ifdef CONFIG_HOME_BASE_SNTP_SERVER
+    #define HOME_BASE_SNTP_SERVER CONFIG_HOME_BASE_SNTP_SERVER
+#else
+    #define HOME_BASE_SNTP_SERVER "pool.ntp.org"
+#endif
+
 static const char *TAG = "home_base";
 static esp_netif_t *eth_netif = NULL;
 
@@ -36,10 +45,12 @@ static void eth_event_handler(void *arg, esp_event_base_t event_base,
         case ETHERNET_EVENT_CONNECTED:
             ESP_LOGI(TAG, "Ethernet Link Up");
             g_ethernet_connected = true;
+            unraid_uplink_set_link(true);
             break;
         case ETHERNET_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "Ethernet Link Down");
             g_ethernet_connected = false;
+            unraid_uplink_set_link(false);   // Spool until it comes back
             break;
         case ETHERNET_EVENT_START:
             ESP_LOGI(TAG, "Ethernet Started");
@@ -60,6 +71,7 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "Ethernet Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
         g_ethernet_connected = true;
+        unraid_uplink_set_link(true);
     }
 }
 
@@ -82,16 +94,39 @@ void app_main(void)
     // 3. Initialize Ethernet (primary interface)
     init_ethernet();
 
-    // 4. Initialize log storage
+    // SNTP syncs once the link is up; signed backend requests are checked against it
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(HOME_BASE_SNTP_SERVER);
+    if (esp_netif_sntp_init(&sntp_config) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start SNTP; signed commands will be refused");
+    }
+
+    // 4. Initialize log storage, its PSRAM tier sized by the device config if set
+    if (device_config_get()->log_psram_kb >= 0 &&
+        log_storage_set_capacity((uint32_t)device_config_get()->log_psram_kb * 1024) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring log_psram_kb in device config; using the build default");
+    }
     log_storage_init();
 
-    // 5. Initialize ESP-NOW mesh
+    // 5. Start the Unraid uplink; mesh workers queue messages for it
+    if (unraid_uplink_init() != ESP_OK || unraid_uplink_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start Unraid uplink");
+    } else if (device_config_get()->uplink_urls[0] != '\0' &&
+               unraid_uplink_set_targets(device_config_get()->uplink_urls,
+                                         device_config_get()->uplink_hedge_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring uplink targets in device config; using the build default");
+    }
+    if (device_config_is_configured()) {
+        // Lets the backend drop entries it has already stored
+        unraid_uplink_set_home_base_id(device_config_get()->device_id);
+    }
+
+    // 6. Initialize ESP-NOW mesh
     init_esp_now();
 
-    // 6. Start HTTP Server (serves both config portal and API endpoints)
+    // 7. Start HTTP Server (serves both config portal and API endpoints)
     start_webserver();
 
-    // 6. Check if device is configured
+    // 8. Check if device is configured
     const device_config_t *config = device_config_get();
     if (!device_config_is_configured()) {
         ESP_LOGW(TAG, "Device not configured. Starting AP mode for setup...");
@@ -0,0 +1,221 @@
+#include "mesh_dedup.h"
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "protocol.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_MESH_DEDUP_PEERS
+    #define MESH_DEDUP_PEERS CONFIG_MESH_DEDUP_PEERS
+#else
+    #define MESH_DEDUP_PEERS 64
+#endif
+
+#ifdef CONFIG_MESH_DEDUP_RESYNC_GAP
+    #define MESH_DEDUP_RESYNC_GAP CONFIG_MESH_DEDUP_RESYNC_GAP
+#else
+    #define MESH_DEDUP_RESYNC_GAP 1024
+#endif
+
+#define MESH_DEDUP_ID_LEN sizeof(((mesh_message_t *)0)->device_id)
+
+typedef struct {
+    char device_id[MESH_DEDUP_ID_LEN];
+    bool used;
+    uint32_t boot_id;
+    uint32_t highest;        // Highest seq accepted in this boot
+    uint64_t window;         // Bit n set: seq (highest - n) already seen
+    uint32_t last_used;      // For least-recently-seen eviction
+} mesh_dedup_peer_t;
+
+// Open-addressed by device_id with linear probing. Peers are never removed,
+// only replaced in place, so probe chains stay intact.
+static mesh_dedup_peer_t s_peers[MESH_DEDUP_PEERS];
+static uint32_t s_clock = 0;
+static mesh_dedup_stats_t s_stats;
+// The WiFi task peeks while workers record
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t mesh_dedup_hash(const char *device_id)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < MESH_DEDUP_ID_LEN && device_id[i]; i++) {
+        hash ^= (uint8_t)device_id[i];
+        hash *= 16777619u;
+    }
+    return hash % MESH_DEDUP_PEERS;
+}
+
+// Peer tracking device_id, or NULL (lock held)
+static mesh_dedup_peer_t *mesh_dedup_lookup(const char *device_id)
+{
+    uint32_t start = mesh_dedup_hash(device_id);
+
+    for (uint32_t i = 0; i < MESH_DEDUP_PEERS; i++) {
+        mesh_dedup_peer_t *peer = &s_peers[(start + i) % MESH_DEDUP_PEERS];
+        if (!peer->used) {
+            return NULL;
+        }
+        if (strncmp(peer->device_id, device_id, MESH_DEDUP_ID_LEN) == 0) {
+            return peer;
+        }
+    }
+    return NULL;
+}
+
+// Peer tracking device_id, added if new (lock held)
+static mesh_dedup_peer_t *mesh_dedup_find(const char *device_id, bool *created)
+{
+    uint32_t start = mesh_dedup_hash(device_id);
+    mesh_dedup_peer_t *lru = NULL;
+
+    for (uint32_t i = 0; i < MESH_DEDUP_PEERS; i++) {
+        mesh_dedup_peer_t *peer = &s_peers[(start + i) % MESH_DEDUP_PEERS];
+        if (!peer->used) {
+            memset(peer, 0, sizeof(*peer));
+            strncpy(peer->device_id, device_id, MESH_DEDUP_ID_LEN - 1);
+            peer->used = true;
+            s_stats.peers++;
+            *created = true;
+            return peer;
+        }
+        if (strncmp(peer->device_id, device_id, MESH_DEDUP_ID_LEN) == 0) {
+            *created = false;
+            return peer;
+        }
+        if (!lru || (int32_t)(peer->last_used - lru->last_used) < 0) {
+            lru = peer;
+        }
+    }
+
+    // Table full: reuse the peer heard from least recently
+    memset(lru, 0, sizeof(*lru));
+    strncpy(lru->device_id, device_id, MESH_DEDUP_ID_LEN - 1);
+    lru->used = true;
+    s_stats.evictions++;
+    *created = true;
+    return lru;
+}
+
+static void mesh_dedup_restart(mesh_dedup_peer_t *peer, uint32_t boot_id, uint32_t seq)
+{
+    peer->boot_id = boot_id;
+    peer->highest = seq;
+    peer->window = 1;
+}
+
+// Where (boot_id, seq) falls relative to a peer's window (lock held).
+// Returns ACCEPT for a new frame and sets *restart if it opens a new window.
+static mesh_dedup_result_t mesh_dedup_classify(const mesh_dedup_peer_t *peer, uint32_t boot_id,
+                                               uint32_t seq, bool *restart)
+{
+    *restart = false;
+
+    if (boot_id != peer->boot_id) {
+        // A boot_id a few boots back is a replay; one far away is a sender
+        // that lost its NVS counter and fell back to a random boot_id
+        uint32_t back = peer->boot_id - boot_id;
+        if ((int32_t)back > 0 && back < MESH_DEDUP_RESYNC_GAP) {
+            return MESH_DEDUP_REPLAY;
+        }
+        *restart = true;
+        return MESH_DEDUP_ACCEPT;
+    }
+
+    int32_t ahead = (int32_t)(seq - peer->highest);
+    if (ahead > 0) {
+        return MESH_DEDUP_ACCEPT;
+    }
+
+    // seq never goes backwards within one boot: anything older than the
+    // window is a replay, however far back
+    uint32_t behind = (uint32_t)(-ahead);
+    if (behind >= MESH_DEDUP_WINDOW) {
+        return MESH_DEDUP_REPLAY;
+    }
+    return (peer->window & (1ULL << behind)) ? MESH_DEDUP_DUPLICATE : MESH_DEDUP_ACCEPT;
+}
+
+static void mesh_dedup_count(mesh_dedup_result_t result)
+{
+    if (result == MESH_DEDUP_DUPLICATE) {
+        s_stats.duplicates++;
+    } else if (result == MESH_DEDUP_REPLAY) {
+        s_stats.replays++;
+    }
+}
+
+void mesh_dedup_init(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_peers, 0, sizeof(s_peers));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_clock = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+mesh_dedup_result_t mesh_dedup_peek(const char *device_id, uint32_t boot_id, uint32_t seq)
+{
+    mesh_dedup_result_t result = MESH_DEDUP_ACCEPT;
+    bool restart;
+
+    portENTER_CRITICAL(&s_lock);
+    const mesh_dedup_peer_t *peer = mesh_dedup_lookup(device_id);
+    if (peer) {
+        result = mesh_dedup_classify(peer, boot_id, seq, &restart);
+        mesh_dedup_count(result);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return result;
+}
+
+mesh_dedup_result_t mesh_dedup_check(const char *device_id, uint32_t boot_id, uint32_t seq)
+{
+    mesh_dedup_result_t result = MESH_DEDUP_ACCEPT;
+    bool created, restart;
+
+    portENTER_CRITICAL(&s_lock);
+    mesh_dedup_peer_t *peer = mesh_dedup_find(device_id, &created);
+    peer->last_used = ++s_clock;
+
+    if (created) {
+        mesh_dedup_restart(peer, boot_id, seq);
+    } else {
+        result = mesh_dedup_classify(peer, boot_id, seq, &restart);
+        if (result == MESH_DEDUP_ACCEPT && restart) {
+            if ((int32_t)(peer->boot_id - boot_id) > 0) {
+                s_stats.resyncs++;
+            } else {
+                s_stats.restarts++;
+            }
+            mesh_dedup_restart(peer, boot_id, seq);
+        } else if (result == MESH_DEDUP_ACCEPT) {
+            int32_t ahead = (int32_t)(seq - peer->highest);
+            if (ahead > 0) {
+                // Newer than anything seen: slide the window forward
+                peer->window = ahead >= MESH_DEDUP_WINDOW ? 1 : (peer->window << ahead) | 1;
+                peer->highest = seq;
+            } else {
+                // Late but not yet seen (reordered)
+                peer->window |= 1ULL << (uint32_t)(-ahead);
+            }
+        }
+    }
+
+    if (result == MESH_DEDUP_ACCEPT) {
+        s_stats.accepted++;
+    } else {
+        mesh_dedup_count(result);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return result;
+}
+
+void mesh_dedup_get_stats(mesh_dedup_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
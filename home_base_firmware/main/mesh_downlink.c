@@ -0,0 +1,837 @@
+#include "mesh_downlink.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "protocol.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mesh_downlink";
+
+#ifdef CONFIG_MESH_DOWNLINK_SLOTS
+    #define MESH_DOWNLINK_SLOTS CONFIG_MESH_DOWNLINK_SLOTS
+#else
+    #define MESH_DOWNLINK_SLOTS 128
+#endif
+
+#ifdef CONFIG_MESH_DOWNLINK_INFLIGHT
+    #define MESH_DOWNLINK_INFLIGHT CONFIG_MESH_DOWNLINK_INFLIGHT
+#else
+    #define MESH_DOWNLINK_INFLIGHT 8
+#endif
+
+#ifdef CONFIG_MESH_DOWNLINK_ACK_TIMEOUT_MS
+    #define MESH_DOWNLINK_ACK_TIMEOUT_MS CONFIG_MESH_DOWNLINK_ACK_TIMEOUT_MS
+#else
+    #define MESH_DOWNLINK_ACK_TIMEOUT_MS 50
+#endif
+
+#ifdef CONFIG_MESH_DOWNLINK_RETRY_MS
+    #define MESH_DOWNLINK_RETRY_MS CONFIG_MESH_DOWNLINK_RETRY_MS
+#else
+    #define MESH_DOWNLINK_RETRY_MS 20
+#endif
+
+#ifdef CONFIG_MESH_DOWNLINK_MAX_ATTEMPTS
+    #define MESH_DOWNLINK_MAX_ATTEMPTS CONFIG_MESH_DOWNLINK_MAX_ATTEMPTS
+#else
+    #define MESH_DOWNLINK_MAX_ATTEMPTS 5
+#endif
+
+#ifdef CONFIG_MESH_DOWNLINK_GROUPS
+    #define MESH_DOWNLINK_GROUPS CONFIG_MESH_DOWNLINK_GROUPS
+#else
+    #define MESH_DOWNLINK_GROUPS 4
+#endif
+
+// ESP-NOW allows 20 peers and every in-flight device is a temporary peer
+#define MESH_DOWNLINK_INFLIGHT_LIMIT 16
+#define MESH_DOWNLINK_SEND_TIMEOUT_MS 100   // Send callback never came
+#define MESH_DOWNLINK_MAX_BACKOFF_MS 1000
+#define MESH_DOWNLINK_IDLE_MS 1000
+#define MESH_DOWNLINK_GROUP_ACK_MS 2        // Extra ack window per group member; acks share the channel
+
+// MAC index over s_devices, kept at most half full. Linear probing with
+// backward-shift deletion, so releasing a device never needs a rebuild.
+#define MESH_DOWNLINK_INDEX_SIZE (2 * MESH_DOWNLINK_SLOTS)
+#define MESH_DOWNLINK_INDEX_EMPTY -1
+
+#define MESH_DOWNLINK_SCAN_CHUNK 16         // Devices run() looks at per critical section
+
+#define MESH_DOWNLINK_STACK_SIZE 4096
+#define MESH_DOWNLINK_PRIORITY 6            // Above the mesh workers; sends are short
+
+typedef struct {
+    mesh_downlink_entry_t info;
+    char payload[sizeof(((mesh_message_t *)0)->payload)];
+    int16_t next;            // Next command for the same device, -1 at the tail
+    uint32_t deadline_ms;    // QUEUED: earliest send, SENDING/WAIT_ACK: timeout
+} downlink_slot_t;
+
+// Per-device FIFO of slot indices
+typedef struct {
+    bool used;
+    bool awaiting_cb;        // A send callback is outstanding for this MAC
+    uint8_t mac[6];
+    int16_t head;
+    int16_t tail;
+    int16_t index_pos;       // Position in s_index
+} downlink_device_t;
+
+// A group broadcast waiting to go out or for its ack window to close
+typedef struct {
+    bool active;
+    bool sent;
+    bool has_targets;
+    uint32_t id;
+    uint16_t members;
+    uint32_t deadline_ms;    // Ack window end; silent members get unicast repair
+    uint8_t targets[MESH_TARGET_BITMAP_LEN];
+    char payload[sizeof(((mesh_message_t *)0)->payload)];
+    int16_t member_slots[MESH_DOWNLINK_SLOTS];   // Slots that rode the broadcast
+} downlink_group_t;
+
+static const uint8_t s_broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static downlink_slot_t s_slots[MESH_DOWNLINK_SLOTS];
+static downlink_group_t s_groups[MESH_DOWNLINK_GROUPS];
+static downlink_device_t s_devices[MESH_DOWNLINK_SLOTS];
+static int16_t s_index[MESH_DOWNLINK_INDEX_SIZE];
+
+// Unused device entries and slots are stacks; finished slots queue up in
+// completion order so the oldest is reused first. All O(1) under the lock.
+static int16_t s_free_devices[MESH_DOWNLINK_SLOTS];
+static int s_free_device_count = 0;
+static int16_t s_free_slots[MESH_DOWNLINK_SLOTS];
+static int s_free_slot_count = 0;
+static int16_t s_done[MESH_DOWNLINK_SLOTS];
+static int s_done_head = 0;
+static int s_done_count = 0;
+static mesh_downlink_stats_t s_stats;
+static mesh_downlink_send_t s_send = NULL;
+static int s_max_inflight = MESH_DOWNLINK_INFLIGHT;
+static uint32_t s_next_id = 1;
+static int s_rr = 0;
+static TaskHandle_t s_task = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Frames claimed under the lock, then encoded and sent after it. Each keeps
+// a copy of what it sends, as an ack may free the slot meanwhile. run() has
+// one caller, so this needs no lock of its own.
+typedef struct {
+    uint8_t mac[6];
+    uint32_t id;
+    int16_t slot;            // Unicast slot, -1 for a group broadcast
+    int8_t group;            // Group broadcast, -1 for a unicast
+    bool has_targets;
+    char device_id[sizeof(((mesh_fields_t *)0)->device_id)];
+    uint8_t targets[MESH_TARGET_BITMAP_LEN];
+    char payload[sizeof(((mesh_message_t *)0)->payload)];
+    int len;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+} downlink_tx_t;
+
+static downlink_tx_t s_tx[MESH_DOWNLINK_INFLIGHT_LIMIT + MESH_DOWNLINK_GROUPS];
+
+static inline bool time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+static void mesh_downlink_wake(void)
+{
+    if (s_task) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    // Low MAC bytes vary most between devices of the same vendor
+    uint32_t h = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h % MESH_DOWNLINK_INDEX_SIZE;
+}
+
+// Lock held for everything below until the public API
+
+// Index position holding mac, or the empty one it would go in
+static int index_probe(const uint8_t *mac)
+{
+    int pos = (int)mac_hash(mac);
+    while (s_index[pos] != MESH_DOWNLINK_INDEX_EMPTY &&
+           memcmp(s_devices[s_index[pos]].mac, mac, sizeof(s_devices[0].mac)) != 0) {
+        pos = (pos + 1) % MESH_DOWNLINK_INDEX_SIZE;   // Ends: the index is at most half full
+    }
+    return pos;
+}
+
+// Empty a position, shifting later entries of its probe run back into the
+// hole so lookups never stop short. Costs the length of that run.
+static void index_remove(int pos)
+{
+    int hole = pos;
+    for (int next = (pos + 1) % MESH_DOWNLINK_INDEX_SIZE; s_index[next] != MESH_DOWNLINK_INDEX_EMPTY;
+         next = (next + 1) % MESH_DOWNLINK_INDEX_SIZE) {
+        int16_t d = s_index[next];
+        int home = (int)mac_hash(s_devices[d].mac);
+        // Movable unless its home lies cyclically in (hole, next]
+        bool stays = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!stays) {
+            s_index[hole] = d;
+            s_devices[d].index_pos = (int16_t)hole;
+            hole = next;
+        }
+    }
+    s_index[hole] = MESH_DOWNLINK_INDEX_EMPTY;
+}
+
+static downlink_device_t *device_find(const uint8_t *mac, bool create)
+{
+    int pos = index_probe(mac);
+    if (s_index[pos] >= 0) {
+        return &s_devices[s_index[pos]];
+    }
+    if (!create || s_free_device_count == 0) {
+        return NULL;
+    }
+
+    int16_t d = s_free_devices[--s_free_device_count];
+    downlink_device_t *dev = &s_devices[d];
+    memset(dev, 0, sizeof(*dev));
+    dev->used = true;
+    memcpy(dev->mac, mac, sizeof(dev->mac));
+    dev->head = -1;
+    dev->tail = -1;
+    dev->index_pos = (int16_t)pos;
+    s_index[pos] = d;
+    return dev;
+}
+
+static void device_release_if_idle(downlink_device_t *dev)
+{
+    if (dev->head >= 0 || dev->awaiting_cb) {
+        return;
+    }
+    dev->used = false;
+    index_remove(dev->index_pos);
+    s_free_devices[s_free_device_count++] = (int16_t)(dev - s_devices);
+}
+
+// Finish the device's head command and move on to the next one
+static void complete_head(downlink_device_t *dev, mesh_downlink_state_t state, uint32_t now_ms)
+{
+    downlink_slot_t *slot = &s_slots[dev->head];
+    slot->info.state = state;
+    slot->info.done_ms = now_ms;
+    s_stats.pending--;
+    if (state == MESH_DL_ACKED) {
+        s_stats.acked++;
+    } else {
+        s_stats.failed++;
+    }
+
+    // Finished slots are reused oldest first
+    s_done[(s_done_head + s_done_count) % MESH_DOWNLINK_SLOTS] = dev->head;
+    s_done_count++;
+
+    dev->head = slot->next;
+    if (dev->head < 0) {
+        dev->tail = -1;
+    } else {
+        // Next command may go out immediately
+        s_slots[dev->head].deadline_ms = now_ms;
+    }
+    device_release_if_idle(dev);
+}
+
+static void retry_or_fail(downlink_device_t *dev, uint32_t now_ms)
+{
+    downlink_slot_t *slot = &s_slots[dev->head];
+    if (slot->info.attempts >= MESH_DOWNLINK_MAX_ATTEMPTS) {
+        ESP_LOGW(TAG, "Command %lu to %s failed after %d attempts",
+                 (unsigned long)slot->info.id, slot->info.device_id, slot->info.attempts);
+        complete_head(dev, MESH_DL_FAILED, now_ms);
+        return;
+    }
+
+    uint32_t backoff = MESH_DOWNLINK_RETRY_MS << (slot->info.attempts - 1);
+    slot->info.state = MESH_DL_QUEUED;
+    slot->deadline_ms = now_ms + (backoff < MESH_DOWNLINK_MAX_BACKOFF_MS ? backoff : MESH_DOWNLINK_MAX_BACKOFF_MS);
+    s_stats.retransmits++;
+}
+
+static downlink_slot_t *slot_alloc(void)
+{
+    if (s_free_slot_count > 0) {
+        return &s_slots[s_free_slots[--s_free_slot_count]];
+    }
+    if (s_done_count > 0) {
+        // Reuse the command that finished longest ago
+        downlink_slot_t *slot = &s_slots[s_done[s_done_head]];
+        s_done_head = (s_done_head + 1) % MESH_DOWNLINK_SLOTS;
+        s_done_count--;
+        return slot;
+    }
+    return NULL;
+}
+
+static inline void wait_until(uint32_t *wait_ms, uint32_t now_ms, uint32_t deadline_ms)
+{
+    uint32_t left = deadline_ms - now_ms;
+    *wait_ms = left < *wait_ms ? left : *wait_ms;
+}
+
+// Timeouts for one device; returns whether it still has a command on the air
+static bool device_check(downlink_device_t *dev, uint32_t now_ms)
+{
+    downlink_slot_t *slot = &s_slots[dev->head];
+    if (slot->info.state == MESH_DL_SENDING && time_reached(now_ms, slot->deadline_ms)) {
+        dev->awaiting_cb = false;
+        s_stats.link_failures++;
+        retry_or_fail(dev, now_ms);
+    } else if (slot->info.state == MESH_DL_WAIT_ACK && time_reached(now_ms, slot->deadline_ms)) {
+        s_stats.ack_timeouts++;
+        retry_or_fail(dev, now_ms);
+    }
+    return dev->used && (dev->awaiting_cb || (dev->head >= 0 &&
+           (s_slots[dev->head].info.state == MESH_DL_SENDING || s_slots[dev->head].info.state == MESH_DL_WAIT_ACK)));
+}
+
+// Append a new command to a device's FIFO
+static downlink_slot_t *enqueue(downlink_device_t *dev, downlink_slot_t *slot, uint32_t id, const uint8_t *mac,
+                                const char *device_id, const char *command, const char *payload, uint32_t now_ms)
+{
+    memset(slot, 0, sizeof(*slot));
+    slot->info.id = id;
+    memcpy(slot->info.mac, mac, sizeof(slot->info.mac));
+    strncpy(slot->info.device_id, device_id, sizeof(slot->info.device_id) - 1);
+    strncpy(slot->info.command, command, sizeof(slot->info.command) - 1);
+    strcpy(slot->payload, payload);
+    slot->info.state = MESH_DL_QUEUED;
+    slot->info.queued_ms = now_ms;
+    slot->deadline_ms = now_ms;
+    slot->next = -1;
+
+    int16_t index = (int16_t)(slot - s_slots);
+    if (dev->tail >= 0) {
+        s_slots[dev->tail].next = index;
+    } else {
+        dev->head = index;
+    }
+    dev->tail = index;
+
+    s_stats.submitted++;
+    s_stats.pending++;
+    return slot;
+}
+
+esp_err_t mesh_downlink_init(mesh_downlink_send_t send, int max_inflight)
+{
+    if (!send || max_inflight < 0 || max_inflight > MESH_DOWNLINK_INFLIGHT_LIMIT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(s_devices, 0, sizeof(s_devices));
+    memset(s_groups, 0, sizeof(s_groups));
+    memset(&s_stats, 0, sizeof(s_stats));
+    // Stacks pop from the top, so entry 0 is handed out first
+    for (int i = 0; i < MESH_DOWNLINK_SLOTS; i++) {
+        s_free_devices[i] = (int16_t)(MESH_DOWNLINK_SLOTS - 1 - i);
+        s_free_slots[i] = (int16_t)(MESH_DOWNLINK_SLOTS - 1 - i);
+    }
+    s_free_device_count = MESH_DOWNLINK_SLOTS;
+    s_free_slot_count = MESH_DOWNLINK_SLOTS;
+    s_done_head = 0;
+    s_done_count = 0;
+    for (int i = 0; i < MESH_DOWNLINK_INDEX_SIZE; i++) {
+        s_index[i] = MESH_DOWNLINK_INDEX_EMPTY;
+    }
+    s_send = send;
+    s_max_inflight = max_inflight ? max_inflight : MESH_DOWNLINK_INFLIGHT;
+    s_rr = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    // Random start so a rebooted home base does not reuse ids devices just acked
+    s_next_id = (esp_random() & 0x7FFFFFFF) | 1;
+    return ESP_OK;
+}
+
+static void mesh_downlink_task(void *arg)
+{
+    while (1) {
+        uint32_t wait_ms = mesh_downlink_run((uint32_t)(esp_timer_get_time() / 1000));
+        TickType_t ticks = pdMS_TO_TICKS(wait_ms);
+        ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+    }
+}
+
+esp_err_t mesh_downlink_start(void)
+{
+    if (s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!s_send) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(mesh_downlink_task, "mesh_dl", MESH_DOWNLINK_STACK_SIZE, NULL,
+                    MESH_DOWNLINK_PRIORITY, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Downlink started (%d slots, %d devices in flight, %d attempts)",
+             MESH_DOWNLINK_SLOTS, s_max_inflight, MESH_DOWNLINK_MAX_ATTEMPTS);
+    return ESP_OK;
+}
+
+esp_err_t mesh_downlink_submit(const uint8_t *mac, const char *device_id, const char *command,
+                               const char *payload, uint32_t now_ms, uint32_t *id_out)
+{
+    if (strlen(payload) >= sizeof(s_slots[0].payload)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    downlink_device_t *dev = s_free_slot_count + s_done_count > 0 ? device_find(mac, true) : NULL;
+    if (!dev) {
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    downlink_slot_t *slot = enqueue(dev, slot_alloc(), s_next_id++, mac, device_id, command, payload, now_ms);
+    if (id_out) {
+        *id_out = slot->info.id;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    mesh_downlink_wake();
+    return ESP_OK;
+}
+
+esp_err_t mesh_downlink_submit_group(const mesh_downlink_target_t *targets, int count, const char *command,
+                                     const char *payload, uint32_t now_ms, uint32_t *id_out, int *covered_out)
+{
+    if (count <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(payload) >= sizeof(s_slots[0].payload)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Plan outside the lock: each target's bit in the broadcast bitmap
+    uint16_t *bits = malloc(count * sizeof(*bits));
+    if (!bits) {
+        return ESP_ERR_NO_MEM;
+    }
+    int selected = 0;
+    for (int t = 0; t < count; t++) {
+        bits[t] = protocol_target_bit(targets[t].device_id);
+        selected += targets[t].selected;
+    }
+    if (selected == 0) {
+        free(bits);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+
+    // All or nothing: one slot per target, one device entry per new device
+    int new_devices = 0;
+    for (int t = 0; t < count; t++) {
+        if (targets[t].selected) {
+            new_devices += device_find(targets[t].mac, false) == NULL;
+        }
+    }
+    if (s_free_slot_count + s_done_count < selected || s_free_device_count < new_devices) {
+        portEXIT_CRITICAL(&s_lock);
+        free(bits);
+        return ESP_ERR_NO_MEM;
+    }
+
+    downlink_group_t *group = NULL;
+    for (int g = 0; g < MESH_DOWNLINK_GROUPS && !group; g++) {
+        if (!s_groups[g].active) {
+            group = &s_groups[g];
+        }
+    }
+
+    // Bits the broadcast must leave clear: devices outside the group and
+    // targets that have to wait behind earlier commands
+    uint8_t blocked[MESH_TARGET_BITMAP_LEN] = {0};
+    for (int t = 0; t < count; t++) {
+        downlink_device_t *dev = device_find(targets[t].mac, false);
+        if (!targets[t].selected || (dev && dev->head >= 0)) {
+            blocked[bits[t] >> 3] |= (uint8_t)(1 << (bits[t] & 7));
+        }
+    }
+
+    uint32_t id = s_next_id++;
+    int covered = 0;
+    if (group) {
+        memset(group, 0, sizeof(*group));
+    }
+    for (int t = 0; t < count; t++) {
+        if (!targets[t].selected) {
+            continue;
+        }
+        downlink_device_t *dev = device_find(targets[t].mac, true);
+        bool idle = dev->head < 0;
+        downlink_slot_t *slot = enqueue(dev, slot_alloc(), id, targets[t].mac, targets[t].device_id,
+                                        command, payload, now_ms);
+        uint16_t bit = bits[t];
+        if (group && idle && !protocol_targets_include(blocked, bit)) {
+            slot->info.state = MESH_DL_BROADCAST;
+            slot->info.broadcast = true;
+            group->targets[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+            group->member_slots[covered++] = (int16_t)(slot - s_slots);
+        }
+    }
+
+    if (covered > 0) {
+        group->active = true;
+        group->id = id;
+        group->members = (uint16_t)covered;
+        // A bitmap is only needed when some known device must sit this one out
+        group->has_targets = covered < count;
+        strcpy(group->payload, payload);
+    }
+
+    if (id_out) {
+        *id_out = id;
+    }
+    if (covered_out) {
+        *covered_out = covered;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    free(bits);
+
+    mesh_downlink_wake();
+    return ESP_OK;
+}
+
+void mesh_downlink_on_sent(const uint8_t *mac, bool delivered, uint32_t now_ms)
+{
+    portENTER_CRITICAL(&s_lock);
+    downlink_device_t *dev = device_find(mac, false);
+    if (dev) {
+        dev->awaiting_cb = false;
+        // The ack may already have completed the command
+        if (dev->head >= 0 && s_slots[dev->head].info.state == MESH_DL_SENDING) {
+            downlink_slot_t *slot = &s_slots[dev->head];
+            if (delivered) {
+                slot->info.state = MESH_DL_WAIT_ACK;
+                slot->deadline_ms = now_ms + MESH_DOWNLINK_ACK_TIMEOUT_MS;
+            } else {
+                s_stats.link_failures++;
+                retry_or_fail(dev, now_ms);
+            }
+        }
+        device_release_if_idle(dev);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    mesh_downlink_wake();
+}
+
+void mesh_downlink_on_ack(const uint8_t *mac, const char *device_id, uint32_t id, uint8_t status, uint32_t now_ms)
+{
+    portENTER_CRITICAL(&s_lock);
+    downlink_device_t *dev = device_find(mac, false);
+    // Only the head can be on the air; acks for older ids are duplicates.
+    // An ack can also land after its timeout scheduled a retry (QUEUED).
+    // Group members share an id, so the signer must be the addressed device.
+    if (dev && dev->head >= 0 && s_slots[dev->head].info.id == id &&
+        s_slots[dev->head].info.attempts > 0 &&
+        strncmp(s_slots[dev->head].info.device_id, device_id, sizeof(s_slots[dev->head].info.device_id)) == 0) {
+        if (status == MESH_ACK_OK) {
+            complete_head(dev, MESH_DL_ACKED, now_ms);
+        } else if (s_slots[dev->head].info.state != MESH_DL_QUEUED) {
+            retry_or_fail(dev, now_ms);
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    mesh_downlink_wake();
+}
+
+// No lock: works on run()'s own copy
+static void tx_encode(downlink_tx_t *tx)
+{
+    mesh_fields_t fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.type = MSG_TYPE_COMMAND;
+    memcpy(fields.device_id, tx->device_id, sizeof(fields.device_id));
+    fields.cmd_id = tx->id;
+    fields.payload = tx->payload;
+    fields.payload_len = (uint16_t)strlen(tx->payload);
+    fields.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_PAYLOAD);
+    if (tx->has_targets) {
+        fields.targets = tx->targets;
+        fields.present |= MESH_HAS(MESH_FIELD_TARGETS);
+    }
+    tx->len = protocol_v2_encode(&fields, tx->frame, sizeof(tx->frame));
+}
+
+uint32_t mesh_downlink_run(uint32_t now_ms)
+{
+    uint32_t wait_ms = MESH_DOWNLINK_IDLE_MS;
+    int sends = 0;
+
+    // Group broadcasts go out first. Copy the unsent ones, encode them
+    // outside the lock, then mark them sent; only run() sends or closes a
+    // group, so the copies stay current. Groups submitted meanwhile wait for
+    // the next pass.
+    bool planned[MESH_DOWNLINK_GROUPS] = {false};
+    portENTER_CRITICAL(&s_lock);
+    for (int g = 0; g < MESH_DOWNLINK_GROUPS; g++) {
+        downlink_group_t *group = &s_groups[g];
+        planned[g] = group->active;
+        if (group->active && !group->sent) {
+            downlink_tx_t *tx = &s_tx[sends++];
+            memcpy(tx->mac, s_broadcast_mac, sizeof(s_broadcast_mac));
+            tx->id = group->id;
+            tx->slot = -1;
+            tx->group = (int8_t)g;
+            tx->has_targets = group->has_targets;
+            strcpy(tx->device_id, MESH_BROADCAST_ID);
+            memcpy(tx->targets, group->targets, sizeof(tx->targets));
+            strcpy(tx->payload, group->payload);
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    for (int i = 0; i < sends; i++) {
+        tx_encode(&s_tx[i]);
+    }
+
+    // When a window closes, members that did not ack join the unicast queue.
+    // This walks each group's members, not every slot.
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0, g = 0; g < MESH_DOWNLINK_GROUPS; g++) {
+        downlink_group_t *group = &s_groups[g];
+        if (!planned[g]) {
+            continue;
+        }
+        int len = -1;
+        if (i < sends && s_tx[i].group == g) {
+            len = s_tx[i++].len;
+        }
+        if (len > 0) {
+            group->sent = true;
+            group->deadline_ms = now_ms + MESH_DOWNLINK_ACK_TIMEOUT_MS + group->members * MESH_DOWNLINK_GROUP_ACK_MS;
+            s_stats.broadcasts++;
+        }
+
+        bool closing = !group->sent || time_reached(now_ms, group->deadline_ms);
+        for (int m = 0; m < group->members; m++) {
+            // Members that acked may already have been reused
+            downlink_slot_t *slot = &s_slots[group->member_slots[m]];
+            if (slot->info.state != MESH_DL_BROADCAST || slot->info.id != group->id) {
+                continue;
+            }
+            if (len > 0) {
+                slot->info.attempts = 1;
+            } else if (closing) {
+                slot->info.state = MESH_DL_QUEUED;
+                slot->deadline_ms = now_ms;
+                s_stats.repairs++;
+            }
+        }
+        if (closing) {
+            group->active = false;
+        } else {
+            wait_until(&wait_ms, now_ms, group->deadline_ms);
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    // Broadcasts that failed to encode are dropped; their members went unicast
+    int kept = 0;
+    for (int i = 0; i < sends; i++) {
+        if (s_tx[i].len > 0) {
+            s_tx[kept++] = s_tx[i];
+        }
+    }
+    sends = kept;
+
+    // Timeouts next, counting what is still on the air and noting due heads
+    // in round-robin order so none is starved. The lock is taken per chunk
+    // of devices, so a sender or callback never waits on the whole table.
+    int inflight = 0;
+    int16_t due[MESH_DOWNLINK_SLOTS];
+    int due_count = 0;
+    int start = s_rr;
+    for (int n = 0; n < MESH_DOWNLINK_SLOTS; n += MESH_DOWNLINK_SCAN_CHUNK) {
+        portENTER_CRITICAL(&s_lock);
+        for (int k = n; k < n + MESH_DOWNLINK_SCAN_CHUNK && k < MESH_DOWNLINK_SLOTS; k++) {
+            int i = (start + k) % MESH_DOWNLINK_SLOTS;
+            downlink_device_t *dev = &s_devices[i];
+            if (!dev->used || dev->head < 0) {
+                continue;
+            }
+            if (device_check(dev, now_ms)) {
+                inflight++;
+                if (dev->head >= 0 && !dev->awaiting_cb) {
+                    wait_until(&wait_ms, now_ms, s_slots[dev->head].deadline_ms);
+                }
+                continue;
+            }
+            if (dev->head < 0 || s_slots[dev->head].info.state != MESH_DL_QUEUED) {
+                continue;
+            }
+            if (time_reached(now_ms, s_slots[dev->head].deadline_ms)) {
+                due[due_count++] = (int16_t)i;
+            } else {
+                wait_until(&wait_ms, now_ms, s_slots[dev->head].deadline_ms);
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    // Claim due heads up to the in-flight limit; one device per critical
+    // section, rechecked since the scan released the lock
+    for (int d = 0; d < due_count && inflight < s_max_inflight; d++) {
+        portENTER_CRITICAL(&s_lock);
+        downlink_device_t *dev = &s_devices[due[d]];
+        downlink_slot_t *slot = dev->head >= 0 ? &s_slots[dev->head] : NULL;
+        if (dev->used && slot && !dev->awaiting_cb && slot->info.state == MESH_DL_QUEUED &&
+            time_reached(now_ms, slot->deadline_ms)) {
+            downlink_tx_t *tx = &s_tx[sends++];
+            memcpy(tx->mac, dev->mac, sizeof(dev->mac));
+            tx->id = slot->info.id;
+            tx->slot = dev->head;
+            tx->group = -1;
+            tx->has_targets = false;
+            memcpy(tx->device_id, slot->info.device_id, sizeof(tx->device_id));
+            strcpy(tx->payload, slot->payload);
+
+            slot->info.state = MESH_DL_SENDING;
+            slot->info.attempts++;
+            slot->deadline_ms = now_ms + MESH_DOWNLINK_SEND_TIMEOUT_MS;
+            dev->awaiting_cb = true;
+            inflight++;
+            s_rr = (due[d] + 1) % MESH_DOWNLINK_SLOTS;
+            wait_ms = MESH_DOWNLINK_SEND_TIMEOUT_MS < wait_ms ? MESH_DOWNLINK_SEND_TIMEOUT_MS : wait_ms;
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    for (int i = 0; i < sends; i++) {
+        downlink_tx_t *tx = &s_tx[i];
+        if (tx->slot >= 0) {
+            tx_encode(tx);
+        }
+        if (tx->len < 0) {
+            // Cannot be encoded, so retrying will not help
+            portENTER_CRITICAL(&s_lock);
+            downlink_device_t *dev = device_find(tx->mac, false);
+            if (dev && dev->head == tx->slot && s_slots[dev->head].info.id == tx->id) {
+                dev->awaiting_cb = false;
+                s_slots[dev->head].info.attempts = MESH_DOWNLINK_MAX_ATTEMPTS;
+                complete_head(dev, MESH_DL_FAILED, now_ms);
+            }
+            portEXIT_CRITICAL(&s_lock);
+            continue;
+        }
+        esp_err_t err = s_send(tx->mac, tx->frame, (size_t)tx->len);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "Send of command %lu failed: %s", (unsigned long)tx->id, esp_err_to_name(err));
+            // No callback will follow
+            mesh_downlink_on_sent(tx->mac, false, now_ms);
+        }
+    }
+
+    return wait_ms;
+}
+
+bool mesh_downlink_next(int *cursor, mesh_downlink_entry_t *entry)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    while (*cursor < MESH_DOWNLINK_SLOTS && !found) {
+        downlink_slot_t *slot = &s_slots[(*cursor)++];
+        if (slot->info.state != MESH_DL_FREE) {
+            *entry = slot->info;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+bool mesh_downlink_find(uint32_t id, mesh_downlink_entry_t *entry)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < MESH_DOWNLINK_SLOTS && !found; i++) {
+        if (s_slots[i].info.state != MESH_DL_FREE && s_slots[i].info.id == id) {
+            *entry = s_slots[i].info;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+void mesh_downlink_get_stats(mesh_downlink_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+const char *mesh_downlink_state_name(mesh_downlink_state_t state)
+{
+    switch (state) {
+        case MESH_DL_QUEUED:   return "queued";
+        case MESH_DL_BROADCAST: return "broadcast";
+        case MESH_DL_SENDING:  return "sending";
+        case MESH_DL_WAIT_ACK: return "awaiting_ack";
+        case MESH_DL_ACKED:    return "acked";
+        case MESH_DL_FAILED:   return "failed";
+        default:               return "free";
+    }
+}
+
+size_t mesh_downlink_format_json(const mesh_downlink_entry_t *entry, uint32_t now_ms, char *buf, size_t len)
+{
+    // device_id and command come from the network; keep them inside the JSON strings
+    char device_id[sizeof(entry->device_id)];
+    char command[sizeof(entry->command)];
+    const struct { const char *in; char *out; size_t size; } fields[] = {
+        { entry->device_id, device_id, sizeof(device_id) },
+        { entry->command, command, sizeof(command) },
+    };
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        size_t n = 0;
+        for (size_t i = 0; i < fields[f].size - 1 && fields[f].in[i]; i++) {
+            char c = fields[f].in[i];
+            fields[f].out[n++] = (c == '"' || c == '\\' || (unsigned char)c < 0x20) ? '_' : c;
+        }
+        fields[f].out[n] = '\0';
+    }
+
+    bool done = entry->state == MESH_DL_ACKED || entry->state == MESH_DL_FAILED;
+    char latency[16] = "null";
+    if (done) {
+        snprintf(latency, sizeof(latency), "%lu", (unsigned long)(entry->done_ms - entry->queued_ms));
+    }
+
+    int written = snprintf(buf, len,
+        "{\"id\":%lu,\"device\":\"%s\",\"command\":\"%s\",\"state\":\"%s\",\"attempts\":%d,"
+        "\"broadcast\":%s,\"age_ms\":%lu,\"latency_ms\":%s}",
+        (unsigned long)entry->id, device_id, command, mesh_downlink_state_name(entry->state),
+        entry->attempts, entry->broadcast ? "true" : "false", (unsigned long)(now_ms - entry->queued_ms), latency);
+
+    return (written > 0 && (size_t)written < len) ? (size_t)written : 0;
+}
@@ -0,0 +1,85 @@
+#include "mesh_ring.h"
+#include <stddef.h>
+
+bool mesh_ring_init(mesh_ring_t *ring, mesh_rx_frame_t *slots, uint32_t capacity)
+{
+    if (!ring || !slots || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+
+    ring->slots = slots;
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->accepted, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->high_water, 0);
+    return true;
+}
+
+mesh_rx_frame_t *mesh_ring_reserve(mesh_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    // Indices are free-running; the difference is the occupancy
+    if (head - tail > ring->mask) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    return &ring->slots[head & ring->mask];
+}
+
+void mesh_ring_commit(mesh_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + 1;
+    uint32_t depth = head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // Release ordering makes the slot contents visible before the new head
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    atomic_fetch_add_explicit(&ring->accepted, 1, memory_order_relaxed);
+
+    if (depth > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, depth, memory_order_relaxed);
+    }
+}
+
+mesh_rx_frame_t *mesh_ring_peek(mesh_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail) {
+        return NULL;
+    }
+
+    return &ring->slots[tail & ring->mask];
+}
+
+mesh_rx_frame_t *mesh_ring_peek_at(mesh_ring_t *ring, uint32_t n)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head - tail <= n) {
+        return NULL;
+    }
+
+    return &ring->slots[(tail + n) & ring->mask];
+}
+
+void mesh_ring_release(mesh_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // Release ordering: the consumer is done with the slot before the producer may reuse it
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+uint32_t mesh_ring_depth(mesh_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,95 @@
+#include "mesh_timer_wheel.h"
+
+#define SLOT_MASK (MESH_TIMER_WHEEL_SLOTS - 1)
+
+_Static_assert((MESH_TIMER_WHEEL_SLOTS & SLOT_MASK) == 0, "MESH_TIMER_WHEEL_SLOTS must be a power of two");
+
+// Wrap-safe a <= b
+static inline bool tick_before_eq(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) <= 0;
+}
+
+static void list_init(mesh_timer_t *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_append(mesh_timer_t *head, mesh_timer_t *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void list_unlink(mesh_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+void mesh_timer_wheel_init(mesh_timer_wheel_t *wheel, uint32_t now)
+{
+    for (int i = 0; i < MESH_TIMER_WHEEL_SLOTS; i++) {
+        list_init(&wheel->slots[i]);
+    }
+    list_init(&wheel->expired);
+    wheel->cursor = now;
+    wheel->armed = 0;
+}
+
+void mesh_timer_wheel_arm(mesh_timer_wheel_t *wheel, mesh_timer_t *timer, uint32_t deadline)
+{
+    if (mesh_timer_is_armed(timer)) {
+        list_unlink(timer);
+    } else {
+        wheel->armed++;
+    }
+
+    timer->deadline = deadline;
+    if (tick_before_eq(wheel->cursor, deadline)) {
+        list_append(&wheel->slots[deadline & SLOT_MASK], timer);
+    } else {
+        // Its slot was already swept
+        list_append(&wheel->expired, timer);
+    }
+}
+
+void mesh_timer_wheel_cancel(mesh_timer_wheel_t *wheel, mesh_timer_t *timer)
+{
+    if (mesh_timer_is_armed(timer)) {
+        list_unlink(timer);
+        wheel->armed--;
+    }
+}
+
+mesh_timer_t *mesh_timer_wheel_poll(mesh_timer_wheel_t *wheel, uint32_t now)
+{
+    while (wheel->expired.next == &wheel->expired) {
+        if (!tick_before_eq(wheel->cursor, now)) {
+            return NULL;
+        }
+
+        // Move what is due this tick; later revolutions stay put
+        mesh_timer_t *head = &wheel->slots[wheel->cursor & SLOT_MASK];
+        mesh_timer_t *timer = head->next;
+        while (timer != head) {
+            mesh_timer_t *next = timer->next;
+            if (tick_before_eq(timer->deadline, wheel->cursor)) {
+                list_unlink(timer);
+                list_append(&wheel->expired, timer);
+            }
+            timer = next;
+        }
+        wheel->cursor++;
+    }
+
+    mesh_timer_t *timer = wheel->expired.next;
+    list_unlink(timer);
+    wheel->armed--;
+    return timer;
+}
@@ -0,0 +1,412 @@
+#include "mesh_verify.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "sodium.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mesh_verify";
+
+#ifdef CONFIG_MESH_VERIFY_MAX_KEYS
+    #define MESH_VERIFY_MAX_KEYS CONFIG_MESH_VERIFY_MAX_KEYS
+#else
+    #define MESH_VERIFY_MAX_KEYS 64
+#endif
+
+#ifdef CONFIG_MESH_VERIFY_COMMAND_WINDOW_S
+    #define MESH_VERIFY_COMMAND_WINDOW_S CONFIG_MESH_VERIFY_COMMAND_WINDOW_S
+#else
+    #define MESH_VERIFY_COMMAND_WINDOW_S 60
+#endif
+
+#ifdef CONFIG_MESH_VERIFY_NONCES
+    #define MESH_VERIFY_NONCES CONFIG_MESH_VERIFY_NONCES
+#else
+    #define MESH_VERIFY_NONCES 32
+#endif
+
+// Nonces longer than this are refused; the backend sends 32 hex chars
+#define MESH_VERIFY_NONCE_LEN 64
+
+#define MESH_VERIFY_NVS_NAMESPACE "mesh_keys"
+#define MESH_VERIFY_DEVICE_ID_LEN sizeof(((mesh_message_t *)0)->device_id)
+
+// "{timestamp}:{payload}" with a full payload
+#define MESH_VERIFY_MESSAGE_LEN (10 + 1 + sizeof(((mesh_message_t *)0)->payload))
+
+typedef struct {
+    char device_id[MESH_VERIFY_DEVICE_ID_LEN];
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+} mesh_key_entry_t;
+
+// Open-addressed by device_id; entries are replaced in place, never removed
+static mesh_key_entry_t s_keys[MESH_VERIFY_MAX_KEYS];
+static uint8_t s_network_key[crypto_sign_PUBLICKEYBYTES];
+static bool s_network_key_loaded = false;
+static mesh_verify_stats_t s_stats;
+
+// Nonces of recently accepted backend requests, with their timestamps.
+// Anything older than the window is refused anyway, so expired entries
+// are free for reuse.
+typedef struct {
+    char nonce[MESH_VERIFY_NONCE_LEN + 1];
+    int64_t timestamp;
+} mesh_nonce_entry_t;
+
+static mesh_nonce_entry_t s_nonces[MESH_VERIFY_NONCES];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t mesh_verify_hash(const char *device_id)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < MESH_VERIFY_DEVICE_ID_LEN && device_id[i]; i++) {
+        hash ^= (uint8_t)device_id[i];
+        hash *= 16777619u;
+    }
+    return hash % MESH_VERIFY_MAX_KEYS;
+}
+
+// Slot holding device_id, or the empty slot it would go in (lock held)
+static mesh_key_entry_t *mesh_verify_slot(const char *device_id)
+{
+    uint32_t start = mesh_verify_hash(device_id);
+    for (uint32_t i = 0; i < MESH_VERIFY_MAX_KEYS; i++) {
+        mesh_key_entry_t *entry = &s_keys[(start + i) % MESH_VERIFY_MAX_KEYS];
+        if (entry->device_id[0] == '\0' ||
+            strncmp(entry->device_id, device_id, MESH_VERIFY_DEVICE_ID_LEN) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Copy out a device's key so verification runs without the lock
+static bool mesh_verify_lookup(const char *device_id, uint8_t *public_key)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    mesh_key_entry_t *entry = mesh_verify_slot(device_id);
+    if (entry && entry->device_id[0] != '\0') {
+        memcpy(public_key, entry->public_key, crypto_sign_PUBLICKEYBYTES);
+        found = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return found;
+}
+
+static bool mesh_verify_decode_key(const char *hex, uint8_t *public_key)
+{
+    size_t len = 0;
+    if (!hex || strlen(hex) != 2 * crypto_sign_PUBLICKEYBYTES) {
+        return false;
+    }
+    if (sodium_hex2bin(public_key, crypto_sign_PUBLICKEYBYTES, hex, strlen(hex), NULL, &len, NULL) != 0 ||
+        len != crypto_sign_PUBLICKEYBYTES) {
+        return false;
+    }
+    return crypto_core_ed25519_is_valid_point(public_key) == 1;
+}
+
+// Persist a snapshot of the key table; NVS writes run without the lock
+static esp_err_t mesh_verify_save(void)
+{
+    mesh_key_entry_t *keys = malloc(sizeof(s_keys));
+    uint8_t network_key[crypto_sign_PUBLICKEYBYTES];
+    if (!keys) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    memcpy(keys, s_keys, sizeof(s_keys));
+    memcpy(network_key, s_network_key, sizeof(network_key));
+    bool network_loaded = s_network_key_loaded;
+    portEXIT_CRITICAL(&s_lock);
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(MESH_VERIFY_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs_handle, "devices", keys, sizeof(s_keys));
+        if (err == ESP_OK && network_loaded) {
+            err = nvs_set_blob(nvs_handle, "network", network_key, sizeof(network_key));
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    free(keys);
+    return err;
+}
+
+esp_err_t mesh_verify_init(void)
+{
+    if (sodium_init() < 0) {
+        ESP_LOGE(TAG, "Failed to initialize libsodium");
+        return ESP_FAIL;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(MESH_VERIFY_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        ESP_LOGW(TAG, "No stored keys; frames from unknown devices are not verified");
+        return ESP_OK;
+    }
+
+    size_t len = sizeof(s_keys);
+    if (nvs_get_blob(nvs_handle, "devices", s_keys, &len) != ESP_OK || len != sizeof(s_keys)) {
+        // Missing, or stored with a different CONFIG_MESH_VERIFY_MAX_KEYS
+        memset(s_keys, 0, sizeof(s_keys));
+    }
+    len = sizeof(s_network_key);
+    s_network_key_loaded = nvs_get_blob(nvs_handle, "network", s_network_key, &len) == ESP_OK &&
+                           len == sizeof(s_network_key);
+    nvs_close(nvs_handle);
+
+    s_stats.keys = 0;
+    for (int i = 0; i < MESH_VERIFY_MAX_KEYS; i++) {
+        if (s_keys[i].device_id[0] != '\0') {
+            s_stats.keys++;
+        }
+    }
+
+    ESP_LOGI(TAG, "Loaded %lu device keys%s", (unsigned long)s_stats.keys,
+             s_network_key_loaded ? " and network key" : "");
+    return ESP_OK;
+}
+
+esp_err_t mesh_verify_set_key(const char *device_id, const char *public_key_hex)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    if (!device_id || device_id[0] == '\0' || strlen(device_id) >= MESH_VERIFY_DEVICE_ID_LEN ||
+        !mesh_verify_decode_key(public_key_hex, public_key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    mesh_key_entry_t *entry = mesh_verify_slot(device_id);
+    if (entry) {
+        if (entry->device_id[0] == '\0') {
+            strncpy(entry->device_id, device_id, sizeof(entry->device_id) - 1);
+            s_stats.keys++;
+        }
+        memcpy(entry->public_key, public_key, sizeof(public_key));
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!entry) {
+        ESP_LOGE(TAG, "Key table full (%d), cannot add %s", MESH_VERIFY_MAX_KEYS, device_id);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Public key set for %s", device_id);
+    return mesh_verify_save();
+}
+
+esp_err_t mesh_verify_set_network_key(const char *public_key_hex)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    if (!mesh_verify_decode_key(public_key_hex, public_key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    memcpy(s_network_key, public_key, sizeof(s_network_key));
+    s_network_key_loaded = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Network key set");
+    return mesh_verify_save();
+}
+
+esp_err_t mesh_verify_provision_network_key(const char *public_key_hex)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    if (!mesh_verify_decode_key(public_key_hex, public_key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    bool provisioned = !s_network_key_loaded;
+    if (provisioned) {
+        memcpy(s_network_key, public_key, sizeof(s_network_key));
+        s_network_key_loaded = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!provisioned) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(TAG, "Network key provisioned");
+    return mesh_verify_save();
+}
+
+bool mesh_verify_has_network_key(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool loaded = s_network_key_loaded;
+    portEXIT_CRITICAL(&s_lock);
+    return loaded;
+}
+
+static bool mesh_verify_signature(const mesh_message_t *msg, const uint8_t *public_key)
+{
+    char message[MESH_VERIFY_MESSAGE_LEN];
+    int len = snprintf(message, sizeof(message), "%lu:%.*s", (unsigned long)msg->timestamp,
+                       (int)sizeof(msg->payload), msg->payload);
+
+    return crypto_sign_verify_detached(msg->signature, (const unsigned char *)message,
+                                       (unsigned long long)len, public_key) == 0;
+}
+
+mesh_auth_t mesh_verify_message(const mesh_message_t *msg)
+{
+    mesh_rx_frame_t frame;
+    mesh_rx_frame_t *frames[1] = { &frame };
+
+    memcpy(&frame.msg, msg, sizeof(frame.msg));
+    frame.auth = MESH_AUTH_PENDING;
+    mesh_verify_batch(frames, 1);
+    return (mesh_auth_t)frame.auth;
+}
+
+void mesh_verify_batch(mesh_rx_frame_t **frames, int count)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    const char *key_owner = NULL;
+    bool have_key = false;
+    uint32_t verified = 0, forged = 0, unknown = 0, unsigned_frames = 0;
+
+    for (int i = 0; i < count; i++) {
+        mesh_message_t *msg = &frames[i]->msg;
+
+        if (msg->type == MSG_TYPE_HEARTBEAT) {
+            frames[i]->auth = MESH_AUTH_UNSIGNED;
+            unsigned_frames++;
+            continue;
+        }
+
+        // Bursts are mostly one chatty device; look its key up once
+        if (!key_owner || strncmp(key_owner, msg->device_id, MESH_VERIFY_DEVICE_ID_LEN) != 0) {
+            have_key = mesh_verify_lookup(msg->device_id, public_key);
+            key_owner = msg->device_id;
+        }
+
+        if (!have_key) {
+            frames[i]->auth = MESH_AUTH_UNKNOWN_KEY;
+            unknown++;
+        } else if (mesh_verify_signature(msg, public_key)) {
+            frames[i]->auth = MESH_AUTH_VERIFIED;
+            verified++;
+        } else {
+            frames[i]->auth = MESH_AUTH_FORGED;
+            forged++;
+        }
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.verified += verified;
+    s_stats.forged += forged;
+    s_stats.unknown_key += unknown;
+    s_stats.unsigned_frames += unsigned_frames;
+    if (count > 1) {
+        s_stats.batches++;
+        s_stats.batch_frames += count;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t mesh_verify_network_signature(const char *message, const char *signature_hex)
+{
+    uint8_t public_key[crypto_sign_PUBLICKEYBYTES];
+    uint8_t signature[crypto_sign_BYTES];
+    size_t len = 0;
+
+    portENTER_CRITICAL(&s_lock);
+    bool loaded = s_network_key_loaded;
+    memcpy(public_key, s_network_key, sizeof(public_key));
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!loaded) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!signature_hex || strlen(signature_hex) != 2 * crypto_sign_BYTES ||
+        sodium_hex2bin(signature, sizeof(signature), signature_hex, strlen(signature_hex), NULL, &len, NULL) != 0 ||
+        len != sizeof(signature)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (crypto_sign_verify_detached(signature, (const unsigned char *)message, strlen(message), public_key) != 0) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+// Record nonce unless it was already used inside the window (lock held)
+static bool mesh_verify_claim_nonce(const char *nonce, int64_t timestamp, int64_t now)
+{
+    mesh_nonce_entry_t *slot = NULL;
+    bool slot_free = false;
+
+    for (int i = 0; i < MESH_VERIFY_NONCES; i++) {
+        mesh_nonce_entry_t *entry = &s_nonces[i];
+        bool expired = entry->nonce[0] == '\0' ||
+                       entry->timestamp < now - MESH_VERIFY_COMMAND_WINDOW_S;
+        if (expired) {
+            if (!slot_free) {
+                slot = entry;
+                slot_free = true;
+            }
+        } else if (strcmp(entry->nonce, nonce) == 0) {
+            return false;
+        } else if (!slot_free && (!slot || entry->timestamp < slot->timestamp)) {
+            // No free slot yet: evict the oldest live nonce
+            slot = entry;
+        }
+    }
+
+    strcpy(slot->nonce, nonce);
+    slot->timestamp = timestamp;
+    return true;
+}
+
+esp_err_t mesh_verify_command(int64_t timestamp, const char *nonce, const char *body,
+                              const char *signature_hex, int64_t now)
+{
+    if (!nonce || nonce[0] == '\0' || strlen(nonce) > MESH_VERIFY_NONCE_LEN || !body) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (now < MESH_VERIFY_CLOCK_VALID || timestamp < now - MESH_VERIFY_COMMAND_WINDOW_S ||
+        timestamp > now + MESH_VERIFY_COMMAND_WINDOW_S) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    size_t message_len = strlen(nonce) + strlen(body) + 24;
+    char *message = malloc(message_len);
+    if (!message) {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(message, message_len, "%lld:%s:%s", (long long)timestamp, nonce, body);
+    esp_err_t err = mesh_verify_network_signature(message, signature_hex);
+    free(message);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Only signed requests reach the cache, so it can't be flooded
+    portENTER_CRITICAL(&s_lock);
+    bool fresh = mesh_verify_claim_nonce(nonce, timestamp, now);
+    portEXIT_CRITICAL(&s_lock);
+    return fresh ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+void mesh_verify_get_stats(mesh_verify_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,399 @@
+#include "mesh_worker_pool.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mesh_pool";
+
+#ifdef CONFIG_MESH_WORKER_COUNT
+    #define MESH_WORKER_COUNT CONFIG_MESH_WORKER_COUNT
+#else
+    #define MESH_WORKER_COUNT 2
+#endif
+
+#ifdef CONFIG_MESH_WORKER_PRIORITY
+    #define MESH_WORKER_PRIORITY CONFIG_MESH_WORKER_PRIORITY
+#else
+    #define MESH_WORKER_PRIORITY 5
+#endif
+
+#ifdef CONFIG_MESH_RING_SLOTS
+    #define MESH_RING_SLOTS CONFIG_MESH_RING_SLOTS
+#else
+    #define MESH_RING_SLOTS 32
+#endif
+
+#ifdef CONFIG_MESH_PRIORITY_LANE_SLOTS
+    #define MESH_PRIORITY_LANE_SLOTS CONFIG_MESH_PRIORITY_LANE_SLOTS
+#else
+    #define MESH_PRIORITY_LANE_SLOTS 16
+#endif
+
+#ifdef CONFIG_MESH_LANE_HEARTBEAT_WEIGHT
+    #define MESH_LANE_HEARTBEAT_WEIGHT CONFIG_MESH_LANE_HEARTBEAT_WEIGHT
+#else
+    #define MESH_LANE_HEARTBEAT_WEIGHT 2
+#endif
+
+#ifdef CONFIG_MESH_LANE_LOG_WEIGHT
+    #define MESH_LANE_LOG_WEIGHT CONFIG_MESH_LANE_LOG_WEIGHT
+#else
+    #define MESH_LANE_LOG_WEIGHT 1
+#endif
+
+#ifdef CONFIG_MESH_LOG_SHED_PERCENT
+    #define MESH_LOG_SHED_PERCENT CONFIG_MESH_LOG_SHED_PERCENT
+#else
+    #define MESH_LOG_SHED_PERCENT 75
+#endif
+
+#ifdef CONFIG_MESH_VERIFY_BATCH
+    #define MESH_VERIFY_BATCH CONFIG_MESH_VERIFY_BATCH
+#else
+    #define MESH_VERIFY_BATCH 8
+#endif
+
+#define MESH_WORKER_STACK_SIZE 4096
+
+// New log frames are shed once the log lane, or the lanes logs would hold
+// up (motion, command, heartbeat), reach MESH_LOG_SHED_PERCENT of their
+// slots. Measured against all lanes together, the threshold sat above
+// what the log lane alone can hold, so a flood of logs overflowed it
+// before shedding began.
+#define MESH_PROTECTED_SLOTS (2 * MESH_PRIORITY_LANE_SLOTS + MESH_RING_SLOTS)
+#define MESH_LOG_SHED_DEPTH ((MESH_RING_SLOTS * MESH_LOG_SHED_PERCENT) / 100)
+#define MESH_PROTECTED_SHED_DEPTH ((MESH_PROTECTED_SLOTS * MESH_LOG_SHED_PERCENT) / 100)
+
+typedef struct {
+    mesh_ring_t lanes[MESH_LANE_COUNT];
+    TaskHandle_t task;
+    uint32_t shed;           // Written by the producer only
+    portMUX_TYPE lock;       // Guards the counters below
+    uint32_t lane_processed[MESH_LANE_COUNT];
+    uint32_t lane_max_wait_ms[MESH_LANE_COUNT];
+    uint32_t processed;
+    uint64_t busy_us;
+    uint32_t max_busy_us;
+    int core;
+    // Weighted round-robin credits for the heartbeat and log lanes
+    uint8_t heartbeat_credit;
+    uint8_t log_credit;
+} mesh_worker_t;
+
+// Every lane of every worker is a private SPSC ring; the WiFi task is the only producer
+static mesh_rx_frame_t s_priority_slots[MESH_WORKER_COUNT][2][MESH_PRIORITY_LANE_SLOTS];
+static mesh_rx_frame_t s_bulk_slots[MESH_WORKER_COUNT][2][MESH_RING_SLOTS];
+static mesh_worker_t s_workers[MESH_WORKER_COUNT];
+static mesh_frame_handler_t s_handler = NULL;
+static mesh_batch_verifier_t s_verifier = NULL;
+static bool s_started = false;
+
+static const char *s_lane_names[MESH_LANE_COUNT] = {
+    [MESH_LANE_MOTION] = "motion",
+    [MESH_LANE_COMMAND] = "command",
+    [MESH_LANE_HEARTBEAT] = "heartbeat",
+    [MESH_LANE_LOG] = "log",
+};
+
+mesh_lane_t mesh_worker_pool_lane_for_type(uint8_t type)
+{
+    switch (type) {
+        case MSG_TYPE_MOTION:
+            return MESH_LANE_MOTION;
+        case MSG_TYPE_COMMAND:
+        case MSG_TYPE_ACK:          // Never shed with the logs
+            return MESH_LANE_COMMAND;
+        case MSG_TYPE_HEARTBEAT:
+            return MESH_LANE_HEARTBEAT;
+        default:
+            return MESH_LANE_LOG;
+    }
+}
+
+const char *mesh_worker_pool_lane_name(mesh_lane_t lane)
+{
+    return (lane < MESH_LANE_COUNT) ? s_lane_names[lane] : "unknown";
+}
+
+int mesh_worker_pool_shard(const char *device_id)
+{
+    // FNV-1a over the bounded device_id field
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(((mesh_message_t *)0)->device_id) && device_id[i]; i++) {
+        hash ^= (uint8_t)device_id[i];
+        hash *= 16777619u;
+    }
+    return (int)(hash % MESH_WORKER_COUNT);
+}
+
+// Frames queued in the lanes served ahead of logs
+static uint32_t mesh_worker_protected_backlog(mesh_worker_t *worker)
+{
+    uint32_t total = 0;
+    for (int lane = 0; lane < MESH_LANE_COUNT; lane++) {
+        if (lane != MESH_LANE_LOG) {
+            total += mesh_ring_depth(&worker->lanes[lane]);
+        }
+    }
+    return total;
+}
+
+static bool mesh_worker_should_shed_log(mesh_worker_t *worker)
+{
+    return mesh_ring_depth(&worker->lanes[MESH_LANE_LOG]) >= MESH_LOG_SHED_DEPTH ||
+           mesh_worker_protected_backlog(worker) >= MESH_PROTECTED_SHED_DEPTH;
+}
+
+// Pick the next lane to serve: strict priority first, then weighted round-robin
+static int mesh_worker_next_lane(mesh_worker_t *worker)
+{
+    if (mesh_ring_depth(&worker->lanes[MESH_LANE_MOTION]) > 0) {
+        return MESH_LANE_MOTION;
+    }
+    if (mesh_ring_depth(&worker->lanes[MESH_LANE_COMMAND]) > 0) {
+        return MESH_LANE_COMMAND;
+    }
+
+    bool heartbeat_ready = mesh_ring_depth(&worker->lanes[MESH_LANE_HEARTBEAT]) > 0;
+    bool log_ready = mesh_ring_depth(&worker->lanes[MESH_LANE_LOG]) > 0;
+    if (!heartbeat_ready && !log_ready) {
+        return -1;
+    }
+
+    // Start a new round once no ready lane has credit left
+    if ((!heartbeat_ready || worker->heartbeat_credit == 0) &&
+        (!log_ready || worker->log_credit == 0)) {
+        worker->heartbeat_credit = MESH_LANE_HEARTBEAT_WEIGHT;
+        worker->log_credit = MESH_LANE_LOG_WEIGHT;
+    }
+
+    if (heartbeat_ready && worker->heartbeat_credit > 0) {
+        worker->heartbeat_credit--;
+        return MESH_LANE_HEARTBEAT;
+    }
+    worker->log_credit--;
+    return MESH_LANE_LOG;
+}
+
+// Verify the frames already waiting in a lane as one burst
+static void mesh_worker_verify_burst(mesh_ring_t *ring)
+{
+    mesh_rx_frame_t *frames[MESH_VERIFY_BATCH];
+    int count = 0;
+
+    while (count < MESH_VERIFY_BATCH) {
+        mesh_rx_frame_t *frame = mesh_ring_peek_at(ring, count);
+        if (!frame || frame->auth != MESH_AUTH_PENDING) {
+            break;
+        }
+        frames[count++] = frame;
+    }
+
+    s_verifier(frames, count);
+}
+
+static void mesh_worker_task(void *pvParameters)
+{
+    mesh_worker_t *worker = (mesh_worker_t *)pvParameters;
+
+    while (1) {
+        int lane = mesh_worker_next_lane(worker);
+        if (lane < 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        // One frame per pick, so a new alarm waits for at most one handler call
+        mesh_ring_t *ring = &worker->lanes[lane];
+        mesh_rx_frame_t *frame = mesh_ring_peek(ring);
+
+        int64_t start = esp_timer_get_time();
+        uint32_t wait_ms = (uint32_t)(start / 1000) - frame->rx_time_ms;
+        if (s_verifier && frame->auth == MESH_AUTH_PENDING) {
+            mesh_worker_verify_burst(ring);
+        }
+        s_handler(frame);
+        uint32_t busy = (uint32_t)(esp_timer_get_time() - start);
+
+        mesh_ring_release(ring);
+
+        portENTER_CRITICAL(&worker->lock);
+        worker->processed++;
+        worker->lane_processed[lane]++;
+        if (wait_ms > worker->lane_max_wait_ms[lane]) {
+            worker->lane_max_wait_ms[lane] = wait_ms;
+        }
+        worker->busy_us += busy;
+        if (busy > worker->max_busy_us) {
+            worker->max_busy_us = busy;
+        }
+        portEXIT_CRITICAL(&worker->lock);
+    }
+}
+
+void mesh_worker_pool_set_verifier(mesh_batch_verifier_t verifier)
+{
+    s_verifier = verifier;
+}
+
+esp_err_t mesh_worker_pool_start(mesh_frame_handler_t handler)
+{
+    if (!handler) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_handler = handler;
+
+    for (int i = 0; i < MESH_WORKER_COUNT; i++) {
+        mesh_worker_t *worker = &s_workers[i];
+        memset(worker, 0, sizeof(*worker));
+        portMUX_INITIALIZE(&worker->lock);
+
+        bool lanes_ok =
+            mesh_ring_init(&worker->lanes[MESH_LANE_MOTION], s_priority_slots[i][0], MESH_PRIORITY_LANE_SLOTS) &&
+            mesh_ring_init(&worker->lanes[MESH_LANE_COMMAND], s_priority_slots[i][1], MESH_PRIORITY_LANE_SLOTS) &&
+            mesh_ring_init(&worker->lanes[MESH_LANE_HEARTBEAT], s_bulk_slots[i][0], MESH_RING_SLOTS) &&
+            mesh_ring_init(&worker->lanes[MESH_LANE_LOG], s_bulk_slots[i][1], MESH_RING_SLOTS);
+        if (!lanes_ok) {
+            ESP_LOGE(TAG, "Lane sizes (%d, %d) must be powers of two", MESH_PRIORITY_LANE_SLOTS, MESH_RING_SLOTS);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "mesh_w%d", i);
+
+#ifdef CONFIG_MESH_WORKER_PIN_CORES
+        worker->core = i % portNUM_PROCESSORS;
+        BaseType_t ok = xTaskCreatePinnedToCore(mesh_worker_task, name, MESH_WORKER_STACK_SIZE, worker,
+                                                MESH_WORKER_PRIORITY, &worker->task, worker->core);
+#else
+        worker->core = -1;
+        BaseType_t ok = xTaskCreate(mesh_worker_task, name, MESH_WORKER_STACK_SIZE, worker,
+                                    MESH_WORKER_PRIORITY, &worker->task);
+#endif
+        if (ok != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_started = true;
+    ESP_LOGI(TAG, "Started %d mesh workers (%d priority / %d bulk slots per lane, logs shed at %d queued logs "
+             "or %d other frames)", MESH_WORKER_COUNT, MESH_PRIORITY_LANE_SLOTS, MESH_RING_SLOTS,
+             MESH_LOG_SHED_DEPTH, MESH_PROTECTED_SHED_DEPTH);
+    return ESP_OK;
+}
+
+// Pick the owning worker and lane for a frame and reserve a slot in it
+static mesh_rx_frame_t *mesh_worker_reserve(const char *device_id, uint8_t type,
+                                            mesh_worker_t **worker_out, mesh_ring_t **ring_out)
+{
+    if (!s_started) {
+        return NULL;
+    }
+
+    mesh_worker_t *worker = &s_workers[mesh_worker_pool_shard(device_id)];
+    mesh_lane_t lane = mesh_worker_pool_lane_for_type(type);
+
+    // Shed the lowest lane first: refuse logs once the worker is overloaded
+    if (lane == MESH_LANE_LOG && mesh_worker_should_shed_log(worker)) {
+        worker->shed++;
+        return NULL;
+    }
+
+    *worker_out = worker;
+    *ring_out = &worker->lanes[lane];
+    return mesh_ring_reserve(*ring_out);
+}
+
+static void mesh_worker_publish(mesh_worker_t *worker, mesh_ring_t *ring,
+                                mesh_rx_frame_t *frame, const uint8_t *mac_addr, int8_t rssi)
+{
+    memcpy(frame->src_mac, mac_addr, sizeof(frame->src_mac));
+    frame->rssi = rssi;
+    frame->auth = MESH_AUTH_PENDING;
+    frame->rx_time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    mesh_ring_commit(ring);
+
+    xTaskNotifyGive(worker->task);
+}
+
+bool mesh_worker_pool_submit(const uint8_t *mac_addr, int8_t rssi, const mesh_message_t *msg)
+{
+    mesh_worker_t *worker;
+    mesh_ring_t *ring;
+    mesh_rx_frame_t *frame = mesh_worker_reserve(msg->device_id, msg->type, &worker, &ring);
+    if (!frame) {
+        return false;
+    }
+
+    memcpy(&frame->msg, msg, sizeof(mesh_message_t));
+    frame->has_seq = false;
+    frame->seq_bound = false;
+    frame->cmd_id = 0;
+    frame->status = 0;
+    mesh_worker_publish(worker, ring, frame, mac_addr, rssi);
+    return true;
+}
+
+bool mesh_worker_pool_submit_fields(const uint8_t *mac_addr, int8_t rssi, const mesh_fields_t *fields)
+{
+    mesh_worker_t *worker;
+    mesh_ring_t *ring;
+    mesh_rx_frame_t *frame = mesh_worker_reserve(fields->device_id, fields->type, &worker, &ring);
+    if (!frame) {
+        return false;
+    }
+
+    // Render straight into the slot; no intermediate mesh_message_t
+    protocol_fields_to_message(fields, &frame->msg);
+    frame->has_seq = (fields->present & MESH_HAS(MESH_FIELD_SEQ)) != 0;
+    frame->seq_bound = protocol_binds_seq(fields);
+    frame->boot_id = fields->boot_id;
+    frame->seq = fields->seq;
+    frame->cmd_id = fields->cmd_id;
+    frame->status = fields->status;
+    mesh_worker_publish(worker, ring, frame, mac_addr, rssi);
+    return true;
+}
+
+int mesh_worker_pool_get_worker_count(void)
+{
+    return MESH_WORKER_COUNT;
+}
+
+void mesh_worker_pool_get_stats(int worker_index, mesh_worker_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (worker_index < 0 || worker_index >= MESH_WORKER_COUNT) {
+        return;
+    }
+
+    mesh_worker_t *worker = &s_workers[worker_index];
+    for (int lane = 0; lane < MESH_LANE_COUNT; lane++) {
+        mesh_ring_t *ring = &worker->lanes[lane];
+        stats->lanes[lane].depth = mesh_ring_depth(ring);
+        stats->lanes[lane].high_water = atomic_load(&ring->high_water);
+        stats->lanes[lane].accepted = atomic_load(&ring->accepted);
+        stats->lanes[lane].dropped = atomic_load(&ring->dropped);
+    }
+    stats->lanes[MESH_LANE_LOG].shed = worker->shed;
+    stats->core = worker->core;
+
+    portENTER_CRITICAL(&worker->lock);
+    for (int lane = 0; lane < MESH_LANE_COUNT; lane++) {
+        stats->lanes[lane].processed = worker->lane_processed[lane];
+        stats->lanes[lane].max_wait_ms = worker->lane_max_wait_ms[lane];
+    }
+    stats->processed = worker->processed;
+    stats->busy_us = worker->busy_us;
+    stats->max_busy_us = worker->max_busy_us;
+    portEXIT_CRITICAL(&worker->lock);
+}
@@ -0,0 +1,311 @@
+#include "protocol.h"
+#include <stdio.h>
+#include <string.h>
+
+// Shared ESP-NOW frame codec, compiled into both the home base and the
+// sensor firmware so the two sides can never disagree on the wire format.
+
+#define MESH_SIGNATURE_LEN 64
+
+// === Encoding ===
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} frame_writer_t;
+
+static void put_byte(frame_writer_t *w, uint8_t b)
+{
+    if (w->len < w->cap) {
+        w->buf[w->len++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static void put_varint(frame_writer_t *w, uint32_t value)
+{
+    while (value >= 0x80) {
+        put_byte(w, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    put_byte(w, (uint8_t)value);
+}
+
+static void put_varint_field(frame_writer_t *w, uint8_t field, uint32_t value)
+{
+    put_byte(w, (uint8_t)((field << 3) | MESH_WIRE_VARINT));
+    put_varint(w, value);
+}
+
+static void put_bytes_field(frame_writer_t *w, uint8_t field, const void *data, size_t len)
+{
+    put_byte(w, (uint8_t)((field << 3) | MESH_WIRE_BYTES));
+    put_varint(w, (uint32_t)len);
+    if (w->len + len <= w->cap) {
+        memcpy(&w->buf[w->len], data, len);
+        w->len += len;
+    } else {
+        w->overflow = true;
+    }
+}
+
+bool protocol_is_v2(const uint8_t *data, int len)
+{
+    return data && len >= 2 && data[0] == MESH_PROTO_V2_MARKER;
+}
+
+int protocol_v2_encode(const mesh_fields_t *f, uint8_t *out, size_t out_len)
+{
+    frame_writer_t w = { .buf = out, .cap = out_len };
+
+    put_byte(&w, MESH_PROTO_V2_MARKER);
+    put_byte(&w, f->type);
+    put_bytes_field(&w, MESH_FIELD_DEVICE_ID, f->device_id, strnlen(f->device_id, sizeof(f->device_id)));
+
+    if (f->present & MESH_HAS(MESH_FIELD_TIMESTAMP)) {
+        put_varint_field(&w, MESH_FIELD_TIMESTAMP, f->timestamp);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_BOOT_ID)) {
+        put_varint_field(&w, MESH_FIELD_BOOT_ID, f->boot_id);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_SEQ)) {
+        put_varint_field(&w, MESH_FIELD_SEQ, f->seq);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_CMD_ID)) {
+        put_varint_field(&w, MESH_FIELD_CMD_ID, f->cmd_id);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_STATUS)) {
+        put_varint_field(&w, MESH_FIELD_STATUS, f->status);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_HEAP)) {
+        put_varint_field(&w, MESH_FIELD_HEAP, f->heap);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_UPTIME)) {
+        put_varint_field(&w, MESH_FIELD_UPTIME, f->uptime);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_MOTION)) {
+        put_varint_field(&w, MESH_FIELD_MOTION, f->motion ? 1 : 0);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_SENSITIVITY)) {
+        put_varint_field(&w, MESH_FIELD_SENSITIVITY, f->sensitivity);
+    }
+    if (f->present & MESH_HAS(MESH_FIELD_COOLDOWN_MS)) {
+        put_varint_field(&w, MESH_FIELD_COOLDOWN_MS, f->cooldown_ms);
+    }
+    if ((f->present & MESH_HAS(MESH_FIELD_PAYLOAD)) && f->payload) {
+        put_bytes_field(&w, MESH_FIELD_PAYLOAD, f->payload, f->payload_len);
+    }
+    if ((f->present & MESH_HAS(MESH_FIELD_SIGNATURE)) && f->signature) {
+        put_bytes_field(&w, MESH_FIELD_SIGNATURE, f->signature, MESH_SIGNATURE_LEN);
+    }
+    if ((f->present & MESH_HAS(MESH_FIELD_TARGETS)) && f->targets) {
+        put_bytes_field(&w, MESH_FIELD_TARGETS, f->targets, MESH_TARGET_BITMAP_LEN);
+    }
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+// === Decoding ===
+
+static bool get_varint(const uint8_t *data, int len, int *pos, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) {
+            return false;
+        }
+        uint8_t b = data[(*pos)++];
+        result |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool protocol_v2_decode(const uint8_t *data, int len, mesh_fields_t *f)
+{
+    if (!protocol_is_v2(data, len)) {
+        return false;
+    }
+
+    memset(f, 0, sizeof(*f));
+    f->type = data[1];
+
+    int pos = 2;
+    while (pos < len) {
+        uint8_t key = data[pos++];
+        uint8_t field = key >> 3;
+        uint8_t wire = key & 0x07;
+        uint32_t value;
+
+        if (!get_varint(data, len, &pos, &value)) {
+            return false;
+        }
+
+        if (wire == MESH_WIRE_BYTES) {
+            if (value > (uint32_t)(len - pos)) {
+                return false;
+            }
+            const uint8_t *bytes = &data[pos];
+            pos += (int)value;
+
+            switch (field) {
+                case MESH_FIELD_DEVICE_ID:
+                    if (value >= sizeof(f->device_id)) {
+                        return false;
+                    }
+                    memcpy(f->device_id, bytes, value);
+                    f->device_id[value] = '\0';
+                    break;
+                case MESH_FIELD_PAYLOAD:
+                    f->payload = (const char *)bytes;
+                    f->payload_len = (uint16_t)value;
+                    break;
+                case MESH_FIELD_SIGNATURE:
+                    if (value != MESH_SIGNATURE_LEN) {
+                        return false;
+                    }
+                    f->signature = bytes;
+                    break;
+                case MESH_FIELD_TARGETS:
+                    if (value != MESH_TARGET_BITMAP_LEN) {
+                        return false;
+                    }
+                    f->targets = bytes;
+                    break;
+                default:
+                    continue;   // Unknown field: skip
+            }
+        } else if (wire == MESH_WIRE_VARINT) {
+            switch (field) {
+                case MESH_FIELD_TIMESTAMP:   f->timestamp = value; break;
+                case MESH_FIELD_HEAP:        f->heap = value; break;
+                case MESH_FIELD_UPTIME:      f->uptime = value; break;
+                case MESH_FIELD_MOTION:      f->motion = value != 0; break;
+                case MESH_FIELD_SENSITIVITY: f->sensitivity = (uint8_t)value; break;
+                case MESH_FIELD_COOLDOWN_MS: f->cooldown_ms = value; break;
+                case MESH_FIELD_SEQ:         f->seq = value; break;
+                case MESH_FIELD_BOOT_ID:     f->boot_id = value; break;
+                case MESH_FIELD_CMD_ID:      f->cmd_id = value; break;
+                case MESH_FIELD_STATUS:      f->status = (uint8_t)value; break;
+                default:
+                    continue;   // Unknown field: skip
+            }
+        } else {
+            return false;   // Unknown wire type: cannot skip safely
+        }
+
+        if (field < 32) {
+            f->present |= MESH_HAS(field);
+        }
+    }
+
+    return (f->present & MESH_HAS(MESH_FIELD_DEVICE_ID)) && f->device_id[0] != '\0';
+}
+
+// === Conversion to mesh_message_t ===
+
+uint16_t protocol_target_bit(const char *device_id)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = device_id; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+    return (uint16_t)(hash % (MESH_TARGET_BITMAP_LEN * 8));
+}
+
+bool protocol_binds_seq(const mesh_fields_t *f)
+{
+    const uint32_t both = MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+    bool structured = (f->type == MSG_TYPE_MOTION && (f->present & MESH_HAS(MESH_FIELD_MOTION))) ||
+                      (f->type == MSG_TYPE_ACK && (f->present & MESH_HAS(MESH_FIELD_CMD_ID)));
+    return structured && (f->present & both) == both;
+}
+
+int protocol_render_payload(const mesh_fields_t *f, char *out, size_t out_len)
+{
+    int written;
+
+    // Keep these formats identical to what v1 senders put in the payload
+    if (f->type == MSG_TYPE_HEARTBEAT &&
+        (f->present & (MESH_HAS(MESH_FIELD_HEAP) | MESH_HAS(MESH_FIELD_UPTIME)))) {
+        written = snprintf(out, out_len, "{\"heap\":%lu,\"uptime\":%lu}",
+                           (unsigned long)f->heap, (unsigned long)f->uptime);
+    } else if (f->type == MSG_TYPE_MOTION && (f->present & MESH_HAS(MESH_FIELD_MOTION))) {
+        if (protocol_binds_seq(f)) {
+            // boot_id/seq inside the signed text, so a replay can't renumber it
+            written = snprintf(out, out_len,
+                               "{\"motion\":%s,\"sensitivity\":%d,\"cooldown\":%d,\"boot_id\":%lu,\"seq\":%lu}",
+                               f->motion ? "true" : "false", f->sensitivity, (int)f->cooldown_ms,
+                               (unsigned long)f->boot_id, (unsigned long)f->seq);
+        } else {
+            written = snprintf(out, out_len, "{\"motion\":%s,\"sensitivity\":%d,\"cooldown\":%d}",
+                               f->motion ? "true" : "false", f->sensitivity, (int)f->cooldown_ms);
+        }
+    } else if (f->type == MSG_TYPE_ACK && (f->present & MESH_HAS(MESH_FIELD_CMD_ID))) {
+        // v2 only, so no v1 text to match; signed like a motion event
+        if (protocol_binds_seq(f)) {
+            written = snprintf(out, out_len, "{\"cmd_id\":%lu,\"status\":%u,\"boot_id\":%lu,\"seq\":%lu}",
+                               (unsigned long)f->cmd_id, f->status,
+                               (unsigned long)f->boot_id, (unsigned long)f->seq);
+        } else {
+            written = snprintf(out, out_len, "{\"cmd_id\":%lu,\"status\":%u}",
+                               (unsigned long)f->cmd_id, f->status);
+        }
+    } else if (f->payload) {
+        size_t n = f->payload_len < out_len - 1 ? f->payload_len : out_len - 1;
+        memcpy(out, f->payload, n);
+        out[n] = '\0';
+        written = (int)n;
+    } else {
+        out[0] = '\0';
+        written = 0;
+    }
+
+    if (written < 0) {
+        out[0] = '\0';
+        return 0;
+    }
+    return written < (int)out_len ? written : (int)out_len - 1;
+}
+
+void protocol_fields_to_message(const mesh_fields_t *f, mesh_message_t *msg)
+{
+    msg->type = f->type;
+    memcpy(msg->device_id, f->device_id, sizeof(msg->device_id));
+    msg->timestamp = f->timestamp;
+    protocol_render_payload(f, msg->payload, sizeof(msg->payload));
+
+    if (f->signature) {
+        memcpy(msg->signature, f->signature, sizeof(msg->signature));
+    } else {
+        memset(msg->signature, 0, sizeof(msg->signature));
+    }
+}
+
+bool protocol_decode_frame(const uint8_t *data, int len, mesh_message_t *msg)
+{
+    if (protocol_is_v2(data, len)) {
+        mesh_fields_t fields;
+        if (!protocol_v2_decode(data, len, &fields)) {
+            return false;
+        }
+        protocol_fields_to_message(&fields, msg);
+        return true;
+    }
+
+    if (len == sizeof(mesh_message_t)) {
+        memcpy(msg, data, sizeof(mesh_message_t));
+        msg->device_id[sizeof(msg->device_id) - 1] = '\0';
+        msg->payload[sizeof(msg->payload) - 1] = '\0';
+        return true;
+    }
+
+    return false;
+}
@@ -1,30 +1,331 @@
 #include <esp_http_client.h>
+#include <esp_websocket_client.h>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "unraid_client.h"
+#include "uplink_spool.h"
+#include "uplink_gzip.h"
+#include "uplink_cbor.h"
+#include "uplink_breaker.h"
+#include "uplink_stream.h"
+#include "log_storage.h"
 #include "protocol.h"
 #include "device_config.h"
 #include "sdkconfig.h"
 
 static const char *TAG = "unraid_client";
 
-// Use Kconfig value if available, else default (user should configure this in menuconfig)
+// Use Kconfig value if available, else default (user should configure this in menuconfig).
+// A comma-separated list names several targets in priority order.
 #ifdef CONFIG_UNRAID_API_URL
     #define UNRAID_API_URL CONFIG_UNRAID_API_URL
 #else
     #define UNRAID_API_URL "http://192.168.1.100:8000/logs/ingest"
 #endif
 
-// Event handler for HTTP client
+// A motion batch its target has not answered within this many ms is also
+// posted to the next target; 0 disables hedging
+#ifdef CONFIG_UNRAID_UPLINK_HEDGE_MS
+    #define UNRAID_UPLINK_HEDGE_MS CONFIG_UNRAID_UPLINK_HEDGE_MS
+#else
+    #define UNRAID_UPLINK_HEDGE_MS 0
+#endif
+
+#ifdef CONFIG_UNRAID_UPLINK_QUEUE_LEN
+    #define UNRAID_UPLINK_QUEUE_LEN CONFIG_UNRAID_UPLINK_QUEUE_LEN
+#else
+    #define UNRAID_UPLINK_QUEUE_LEN 32
+#endif
+
+// Close the connection before the backend does (uvicorn keeps it 5 s)
+#ifdef CONFIG_UNRAID_UPLINK_IDLE_MS
+    #define UNRAID_UPLINK_IDLE_MS CONFIG_UNRAID_UPLINK_IDLE_MS
+#else
+    #define UNRAID_UPLINK_IDLE_MS 4000
+#endif
+
+// Batches flush when they reach the byte budget or when their earliest
+// deadline passes: short for motion alarms, long for routine logs. The
+// budget adapts between these bounds to the backend's health.
+#ifdef CONFIG_UNRAID_BATCH_BYTES
+    #define UNRAID_BATCH_BYTES CONFIG_UNRAID_BATCH_BYTES
+#else
+    #define UNRAID_BATCH_BYTES 4096
+#endif
+
+#ifdef CONFIG_UNRAID_BATCH_MIN_BYTES
+    #define UNRAID_BATCH_MIN_BYTES CONFIG_UNRAID_BATCH_MIN_BYTES
+#else
+    #define UNRAID_BATCH_MIN_BYTES 1024
+#endif
+
+// Answers slower than this shrink the batch budget
+#ifdef CONFIG_UNRAID_UPLINK_RTT_TARGET_MS
+    #define UNRAID_UPLINK_RTT_TARGET_MS CONFIG_UNRAID_UPLINK_RTT_TARGET_MS
+#else
+    #define UNRAID_UPLINK_RTT_TARGET_MS 500
+#endif
+
+// Circuit breaker: consecutive failures that open it, and the longest wait
+// between probes once open
+#ifdef CONFIG_UNRAID_BREAKER_FAILURES
+    #define UNRAID_BREAKER_FAILURES CONFIG_UNRAID_BREAKER_FAILURES
+#else
+    #define UNRAID_BREAKER_FAILURES 3
+#endif
+
+#ifdef CONFIG_UNRAID_BREAKER_BACKOFF_MAX_MS
+    #define UNRAID_BREAKER_BACKOFF_MAX_MS CONFIG_UNRAID_BREAKER_BACKOFF_MAX_MS
+#else
+    #define UNRAID_BREAKER_BACKOFF_MAX_MS 60000
+#endif
+
+#ifdef CONFIG_UNRAID_BATCH_MOTION_MS
+    #define UNRAID_BATCH_MOTION_MS CONFIG_UNRAID_BATCH_MOTION_MS
+#else
+    #define UNRAID_BATCH_MOTION_MS 50
+#endif
+
+#ifdef CONFIG_UNRAID_BATCH_LOG_MS
+    #define UNRAID_BATCH_LOG_MS CONFIG_UNRAID_BATCH_LOG_MS
+#else
+    #define UNRAID_BATCH_LOG_MS 2000
+#endif
+
+// What send_log_to_unraid gives up when the queue is full
+#if defined(CONFIG_UNRAID_OVERFLOW_DROP_NEWEST)
+    #define UNRAID_OVERFLOW_DEFAULT UNRAID_OVERFLOW_DROP_NEWEST
+#elif defined(CONFIG_UNRAID_OVERFLOW_DROP_OLDEST)
+    #define UNRAID_OVERFLOW_DEFAULT UNRAID_OVERFLOW_DROP_OLDEST
+#elif defined(CONFIG_UNRAID_OVERFLOW_SPILL)
+    #define UNRAID_OVERFLOW_DEFAULT UNRAID_OVERFLOW_SPILL
+#else
+    #define UNRAID_OVERFLOW_DEFAULT UNRAID_OVERFLOW_DROP_LOGS
+#endif
+
+// Batch body encoding
+#ifdef CONFIG_UNRAID_UPLINK_FORMAT_CBOR
+    #define UNRAID_UPLINK_FORMAT_DEFAULT UNRAID_FORMAT_CBOR
+#else
+    #define UNRAID_UPLINK_FORMAT_DEFAULT UNRAID_FORMAT_JSON
+#endif
+
+// Spooled batches are replayed one per interval once the backend is back
+#ifdef CONFIG_UNRAID_SPOOL_REPLAY_MS
+    #define UNRAID_SPOOL_REPLAY_MS CONFIG_UNRAID_SPOOL_REPLAY_MS
+#else
+    #define UNRAID_SPOOL_REPLAY_MS 200
+#endif
+
+// Batches at least this large are sent gzip-compressed when enabled
+#ifdef CONFIG_UNRAID_UPLINK_GZIP
+    #define UNRAID_UPLINK_GZIP_DEFAULT true
+#else
+    #define UNRAID_UPLINK_GZIP_DEFAULT false
+#endif
+
+#ifdef CONFIG_UNRAID_UPLINK_GZIP_MIN_BYTES
+    #define UNRAID_UPLINK_GZIP_MIN_BYTES CONFIG_UNRAID_UPLINK_GZIP_MIN_BYTES
+#else
+    #define UNRAID_UPLINK_GZIP_MIN_BYTES 512
+#endif
+
+// Batches go over the /ws/uplink WebSocket while it is up
+#ifdef CONFIG_UNRAID_UPLINK_STREAM
+    #define UNRAID_UPLINK_STREAM_DEFAULT true
+#else
+    #define UNRAID_UPLINK_STREAM_DEFAULT false
+#endif
+
+#ifdef CONFIG_UNRAID_UPLINK_STREAM_URL
+    #define UNRAID_UPLINK_STREAM_URL CONFIG_UNRAID_UPLINK_STREAM_URL
+#else
+    #define UNRAID_UPLINK_STREAM_URL ""
+#endif
+
+#ifdef CONFIG_UNRAID_UPLINK_STREAM_HOLD_MS
+    #define UNRAID_UPLINK_STREAM_HOLD_MS CONFIG_UNRAID_UPLINK_STREAM_HOLD_MS
+#else
+    #define UNRAID_UPLINK_STREAM_HOLD_MS 20
+#endif
+
+#ifdef CONFIG_UNRAID_UPLINK_STREAM_RING_BYTES
+    #define UNRAID_UPLINK_STREAM_RING_BYTES CONFIG_UNRAID_UPLINK_STREAM_RING_BYTES
+#else
+    #define UNRAID_UPLINK_STREAM_RING_BYTES 8192
+#endif
+
+// Largest rendered entry: 200 payload bytes all escaped as \u00XX, plus
+// the signature and the other fields
+#define UNRAID_BATCH_ITEM_MAX 1536
+#define UNRAID_BATCH_PREFIX "{\"logs\":["
+#define UNRAID_BATCH_DEVICES_MAX 32   // Distinct senders in one CBOR batch
+
+#define UNRAID_UPLINK_TIMEOUT_MS 5000
+#define UNRAID_UPLINK_RETRY_DELAY_MS 1000   // After a failed post, batches go straight to the spool; doubles once the breaker opens
+#define UNRAID_UPLINK_STACK_SIZE 6144
+#define UNRAID_UPLINK_PRIORITY 4            // Below the mesh workers that feed it
+#define UNRAID_HEDGE_STACK_SIZE 4096
+#define UNRAID_STREAM_PATH "/ws/uplink"
+#define UNRAID_SEQ_BLOCK 1024               // Sequence numbers reserved per NVS write
+#define UNRAID_SEQ_NVS_NAMESPACE "uplink"
+#define UNRAID_STREAM_RECONNECT_MS 2000
+
+// Uplink queue: a pool of message slots and a FIFO of slot indices per lane,
+// so the overflow policy can evict from either lane without moving messages.
+// The uplink task drains motion before everything else.
+enum {
+    UPLINK_LANE_MOTION = 0,
+    UPLINK_LANE_BULK,        // Logs, heartbeats, status
+    UPLINK_LANE_COUNT
+};
+
+typedef struct {
+    uint8_t slots[UNRAID_UPLINK_QUEUE_LEN];   // Pool indices, oldest at head
+    uint16_t head;
+    uint16_t count;
+} uplink_lane_t;
+
+static mesh_message_t s_pool[UNRAID_UPLINK_QUEUE_LEN];
+static uint32_t s_pool_seq[UNRAID_UPLINK_QUEUE_LEN];   // Enqueue order, for drop-oldest
+static uint8_t s_free[UNRAID_UPLINK_QUEUE_LEN];
+static uint16_t s_free_count = 0;
+static uplink_lane_t s_lanes[UPLINK_LANE_COUNT];
+static uint32_t s_enqueue_seq = 0;
+static portMUX_TYPE s_queue_lock = portMUX_INITIALIZER_UNLOCKED;   // Guards the queue above
+static SemaphoreHandle_t s_queue_ready = NULL;                     // Given on every enqueue
+static volatile unraid_overflow_policy_t s_policy = UNRAID_OVERFLOW_DEFAULT;
+
+// One HTTP client and circuit breaker per target, in priority order
+typedef struct {
+    esp_http_client_handle_t client;
+    bool connected;
+    int64_t last_request_us;
+    uplink_breaker_t breaker;
+    unraid_uplink_target_stats_t stats;   // Counters under s_stats_lock; holds the URL
+} uplink_target_t;
+
+static SemaphoreHandle_t s_client_lock = NULL;   // Guards the targets, the batch and the fields below
+static uplink_target_t s_targets[UNRAID_UPLINK_TARGETS_MAX];
+static int s_target_count = 0;
+static int s_active = 0;                         // Took the last batch; sets the batch budget
+static TaskHandle_t s_task = NULL;
+
+// Hedged motion posts. The uplink task hands the second target to the hedge
+// task and posts to the first; the hedge task posts too unless the first
+// answered within the budget. The uplink task waits for it before going on,
+// so each target is only ever used by one task at a time.
+typedef struct {
+    int target;
+    const char *body;
+    size_t len;
+    size_t gz_len;
+    int status;              // -1 if it did not post
+    int64_t answered_us;
+} uplink_hedge_t;
+
+static volatile uint32_t s_hedge_ms = UNRAID_UPLINK_HEDGE_MS;
+static TaskHandle_t s_hedge_task = NULL;
+static SemaphoreHandle_t s_hedge_start = NULL;
+static SemaphoreHandle_t s_hedge_cancel = NULL;   // The first target answered in time
+static SemaphoreHandle_t s_hedge_done = NULL;
+static uplink_hedge_t s_hedge;
+
+// Request body under construction: prefix, comma-separated entries, and
+// room for one more entry and the closing "]}" once past the byte budget
+static char s_batch[UNRAID_BATCH_BYTES + UNRAID_BATCH_ITEM_MAX + 4];
+static size_t s_batch_used = 0;
+static uint32_t s_batch_entries = 0;
+static bool s_batch_motion = false;              // Holds a motion event: may be hedged
+static int64_t s_batch_first_us = 0;
+static int64_t s_batch_deadline_us = 0;
+static unraid_uplink_format_t s_batch_format = UNRAID_UPLINK_FORMAT_DEFAULT;
+static volatile unraid_uplink_format_t s_format = UNRAID_UPLINK_FORMAT_DEFAULT;
+
+// CBOR batches name each sender once, in a table written when the batch is
+// closed; entries carry its index. s_batch_tail is what closing will add.
+static char s_batch_devices[UNRAID_BATCH_DEVICES_MAX][sizeof(((mesh_message_t *)0)->device_id)];
+static uint8_t s_batch_device_count = 0;
+static size_t s_batch_tail = 0;
+
+// Idempotency keys: entries carry (home base ID, sequence number) and the
+// backend skips keys it has stored. Numbers are reserved in NVS a block at
+// a time, so after a reboot numbering resumes past every number handed out
+// before it, spooled entries included. 0 means no key. The home base ID is
+// written under both s_client_lock and s_seq_lock, so either guards a read.
+static char s_home_base_id[sizeof(((device_config_t *)0)->device_id)];
+static char s_batch_home_base_id[sizeof(s_home_base_id)];   // As of batch_reset
+static uint32_t s_seq_next = 1;
+static uint32_t s_seq_reserved = 1;              // Numbers below this are reserved
+static portMUX_TYPE s_seq_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Compressed copy of the body being posted; only kept if smaller
+static uint8_t s_gzip[sizeof(s_batch)];
+static volatile bool s_gzip_enabled = UNRAID_UPLINK_GZIP_DEFAULT;
+
+// Store-and-forward for batches the backend could not take. The uplink task
+// writes and replays; workers spill into it only if it is free.
+static SemaphoreHandle_t s_spool_lock = NULL;    // Guards the spool
+static bool s_spool_ok = false;                  // Spool partition mounted
+static char s_replay[sizeof(s_batch)];           // Spooled batch being replayed
+static int64_t s_last_replay_us = 0;
+static int64_t s_replay_started_us = 0;          // Start of the current drain, 0 if idle
+static uint32_t s_replay_entries = 0;            // Entries replayed in it
+static volatile bool s_link_up = true;
+static volatile bool s_probe_now = false;        // Link came up: skip the backoff
+
+// Streaming uplink: the WebSocket client's task hands acks to stream_event;
+// the uplink task sends frames and posts what the stream could not deliver
+static esp_websocket_client_handle_t s_ws = NULL;
+static SemaphoreHandle_t s_stream_lock = NULL;   // Guards s_stream and s_stream_broken
+static uplink_stream_t s_stream;
+static uint8_t s_stream_ring[UNRAID_UPLINK_STREAM_RING_BYTES];
+static uint8_t s_frame[UPLINK_STREAM_HEADER + sizeof(s_batch)];
+static char s_stream_url[UNRAID_UPLINK_URL_MAX + 16];
+static volatile bool s_stream_enabled = UNRAID_UPLINK_STREAM_DEFAULT;
+static volatile bool s_stream_broken = false;    // Unacked frames have to be posted
+
+static unraid_uplink_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define STAT_INC(field) do { \
+    portENTER_CRITICAL(&s_stats_lock); \
+    s_stats.field++; \
+    portEXIT_CRITICAL(&s_stats_lock); \
+} while (0)
+
+static uplink_target_t *target_of(esp_http_client_handle_t client)
+{
+    for (int i = 0; i < s_target_count; i++) {
+        if (s_targets[i].client == client) {
+            return &s_targets[i];
+        }
+    }
+    return NULL;
+}
+
+// Event handler for HTTP client (runs in the posting task)
 static esp_err_t http_event_handle(esp_http_client_event_t *evt)
 {
+    uplink_target_t *t = target_of(evt->client);
     switch (evt->event_id) {
         case HTTP_EVENT_ERROR:
             ESP_LOGW(TAG, "HTTP_EVENT_ERROR");
             break;
         case HTTP_EVENT_ON_CONNECTED:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
+            if (t) {
+                t->connected = true;
+            }
+            STAT_INC(connects);
             break;
         case HTTP_EVENT_HEADER_SENT:
             ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
@@ -40,6 +341,9 @@ static esp_err_t http_event_handle(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_DISCONNECTED:
             ESP_LOGD(TAG, "HTTP_EVENT_DISCONNECTED");
+            if (t) {
+                t->connected = false;
+            }
             break;
         default:
             break;
@@ -47,35 +351,309 @@ static esp_err_t http_event_handle(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-void send_log_to_unraid(mesh_message_t *msg) {
-    if (!msg) {
+// Client lock held for the helpers below
+
+static void close_if_idle(uplink_target_t *t)
+{
+    int64_t idle_us = esp_timer_get_time() - t->last_request_us;
+    if (t->connected && idle_us > (int64_t)UNRAID_UPLINK_IDLE_MS * 1000) {
+        ESP_LOGD(TAG, "Closing idle connection to %s (%lld ms)", t->stats.url, (long long)(idle_us / 1000));
+        esp_http_client_close(t->client);
+        t->connected = false;
+        STAT_INC(idle_closes);
+    }
+}
+
+// Mirror a target's breaker into the counters, and log a state change to
+// the local log store so an outage can be pieced together afterwards
+static void breaker_changed(uplink_target_t *t, uplink_breaker_state_t before)
+{
+    const uplink_breaker_t *b = &t->breaker;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.breaker_opens += b->opens - t->stats.opens;
+    s_stats.breaker_probes += b->probes - t->stats.probes;
+    t->stats.breaker_state = b->state;
+    t->stats.opens = b->opens;
+    t->stats.probes = b->probes;
+    t->stats.srtt_ms = b->srtt_ms;
+    t->stats.batch_budget = b->batch_bytes;
+    if (t == &s_targets[s_active]) {
+        s_stats.active_target = s_active;
+        s_stats.breaker_state = b->state;
+        s_stats.batch_budget = b->batch_bytes;
+        s_stats.srtt_ms = b->srtt_ms;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    if (b->state == before) {
         return;
     }
 
-    // Get device config for network context
-    const device_config_t *config = device_config_get();
+    char message[256];
+    if (b->state == UPLINK_BREAKER_OPEN) {
+        int64_t wait_ms = (b->retry_at_us - esp_timer_get_time()) / 1000;
+        snprintf(message, sizeof(message), "Uplink breaker %s -> open after %lu failures (last status %d), retry in %lld ms: %s",
+                 uplink_breaker_state_name(before), (unsigned long)b->failures, b->last_status,
+                 (long long)(wait_ms > 0 ? wait_ms : 0), t->stats.url);
+    } else if (b->state == UPLINK_BREAKER_CLOSED) {
+        snprintf(message, sizeof(message), "Uplink breaker %s -> closed, backend answered %d in %lu ms: %s",
+                 uplink_breaker_state_name(before), b->last_status, (unsigned long)b->last_rtt_ms, t->stats.url);
+    } else {
+        snprintf(message, sizeof(message), "Uplink breaker %s -> %s, probing the backend: %s",
+                 uplink_breaker_state_name(before), uplink_breaker_state_name(b->state), t->stats.url);
+    }
+    ESP_LOGW(TAG, "%s", message);
+    log_storage_add_log("home_base", b->state == UPLINK_BREAKER_OPEN ? "error" : "warning", "uplink", message);
+}
 
-    // 1. Serialize message to JSON matching LogIngestRequest
-    cJSON *root = cJSON_CreateObject();
-    cJSON *logs = cJSON_CreateArray();
-    cJSON_AddItemToObject(root, "logs", logs);
+static void breaker_reset(uplink_target_t *t)
+{
+    const uplink_breaker_config_t config = {
+        .failure_threshold = UNRAID_BREAKER_FAILURES,
+        .backoff_min_ms = UNRAID_UPLINK_RETRY_DELAY_MS,
+        .backoff_max_ms = UNRAID_BREAKER_BACKOFF_MAX_MS,
+        .batch_min = UNRAID_BATCH_MIN_BYTES,
+        .batch_max = UNRAID_BATCH_BYTES,
+        .rtt_target_ms = UNRAID_UPLINK_RTT_TARGET_MS,
+    };
+    uplink_breaker_init(&t->breaker, &config);
+    breaker_changed(t, t->breaker.state);
+}
+
+// May this target take a post now? Moves an open breaker to half-open once
+// its backoff is over.
+static bool target_allow(uplink_target_t *t, int64_t now_us)
+{
+    uplink_breaker_state_t before = t->breaker.state;
+    bool allowed = uplink_breaker_allow(&t->breaker, now_us);
+    breaker_changed(t, before);
+    return allowed;
+}
+
+// 429 means try later, like a 5xx
+static inline bool undelivered(int status)
+{
+    return status == 0 || status == 429 || status >= 500;
+}
+
+// POST a prepared body to one target, reopening its connection once if the
+// backend dropped it. Returns the HTTP status, or 0 if nothing came back.
+static int target_post(uplink_target_t *t, const char *body, size_t len, size_t gz_len)
+{
+    close_if_idle(t);
+
+    // Spooled bodies keep the format they were batched in
+    esp_http_client_set_header(t->client, "Content-Type", body[0] == '{' ? "application/json" : "application/cbor");
+    if (gz_len) {
+        esp_http_client_set_header(t->client, "Content-Encoding", "gzip");
+        esp_http_client_set_post_field(t->client, (const char *)s_gzip, (int)gz_len);
+    } else {
+        esp_http_client_delete_header(t->client, "Content-Encoding");
+        esp_http_client_set_post_field(t->client, body, (int)len);
+    }
+
+    esp_err_t err = ESP_FAIL;
+    int64_t started_us = 0;
+    uint32_t requests = 0;
+    for (int attempt = 0; attempt < 2 && err != ESP_OK; attempt++) {
+        if (attempt > 0) {
+            // A stale keep-alive connection fails on first use; a fresh one should not
+            STAT_INC(reconnects);
+        }
+        STAT_INC(requests);
+        requests++;
+        bool was_connected = t->connected;
+        started_us = esp_timer_get_time();
+        err = esp_http_client_perform(t->client);
+        if (err == ESP_OK && was_connected && t->connected) {
+            STAT_INC(reused);
+        } else if (err != ESP_OK) {
+            esp_http_client_close(t->client);
+            t->connected = false;
+        }
+    }
+    t->last_request_us = esp_timer_get_time();
+
+    int status = err == ESP_OK ? esp_http_client_get_status_code(t->client) : 0;
+    uplink_breaker_state_t before = t->breaker.state;
+    uplink_breaker_record(&t->breaker, status, (uint32_t)((t->last_request_us - started_us) / 1000), t->last_request_us);
+    breaker_changed(t, before);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to reach %s: %s", t->stats.url, esp_err_to_name(err));
+    } else if (status < 200 || status >= 300) {
+        ESP_LOGW(TAG, "%s answered %d", t->stats.url, status);
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    t->stats.requests += requests;
+    if (undelivered(status)) {
+        t->stats.failed++;
+    } else {
+        t->stats.answered++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    return status;
+}
+
+// Post the hedge unless the first target answers within the budget
+static void uplink_hedge_task(void *arg)
+{
+    while (1) {
+        xSemaphoreTake(s_hedge_start, portMAX_DELAY);
+        uplink_hedge_t *h = &s_hedge;
+        h->status = -1;
+        if (xSemaphoreTake(s_hedge_cancel, pdMS_TO_TICKS(s_hedge_ms)) != pdTRUE) {
+            uplink_target_t *t = &s_targets[h->target];
+            if (target_allow(t, esp_timer_get_time())) {
+                portENTER_CRITICAL(&s_stats_lock);
+                s_stats.hedges++;
+                t->stats.hedged++;
+                portEXIT_CRITICAL(&s_stats_lock);
+                h->status = target_post(t, h->body, h->len, h->gz_len);
+                h->answered_us = esp_timer_get_time();
+            }
+        }
+        xSemaphoreGive(s_hedge_done);
+    }
+}
+
+// Next target after `first` whose breaker would let a post through now,
+// -1 if there is none
+static int hedge_target(int first, int64_t now_us)
+{
+    for (int i = first + 1; i < s_target_count; i++) {
+        if (now_us >= s_targets[i].breaker.retry_at_us) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Post to target `first`, racing it against `second` once the hedge budget
+// passes. Sets *by to the target whose answer counts.
+static int target_post_hedged(int first, int second, const char *body, size_t len, size_t gz_len, int *by)
+{
+    s_hedge = (uplink_hedge_t){.target = second, .body = body, .len = len, .gz_len = gz_len};
+    xSemaphoreTake(s_hedge_cancel, 0);   // Left over from a hedge that fired
+    xSemaphoreGive(s_hedge_start);
+
+    int status = target_post(&s_targets[first], body, len, gz_len);
+    int64_t answered_us = esp_timer_get_time();
+    xSemaphoreGive(s_hedge_cancel);
+    xSemaphoreTake(s_hedge_done, portMAX_DELAY);
+
+    *by = first;
+    if (s_hedge.status < 0 || undelivered(s_hedge.status)) {
+        return status;
+    }
+    if (undelivered(status) || s_hedge.answered_us < answered_us) {
+        STAT_INC(hedge_wins);
+    }
+    if (undelivered(status)) {
+        *by = second;
+        return s_hedge.status;
+    }
+    return status;
+}
+
+// Compress a body into s_gzip; returns its compressed length, 0 to send it as is
+static size_t compress_body(const char *body, size_t len)
+{
+    size_t gz_len = 0;
+    if (s_gzip_enabled && len >= UNRAID_UPLINK_GZIP_MIN_BYTES) {
+        int64_t start_us = esp_timer_get_time();
+        gz_len = uplink_gzip((const uint8_t *)body, len, s_gzip, len - 1);
+        uint32_t cpu_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.gzip_us += cpu_us;
+        s_stats.last_gzip_us = cpu_us;
+        s_stats.max_gzip_us = cpu_us > s_stats.max_gzip_us ? cpu_us : s_stats.max_gzip_us;
+        if (gz_len) {
+            s_stats.gzipped++;
+            s_stats.gzip_in_bytes += len;
+            s_stats.gzip_out_bytes += gz_len;
+        } else {
+            s_stats.gzip_skipped++;
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    return gz_len;
+}
+
+// POST one body of `entries` logs to the first target that will take it,
+// failing over down the list; a motion batch may be hedged on the next
+// target as well. Returns the HTTP status, 0 if no target took it, or -1 if
+// every target is holding posts off.
+static int uplink_post(const char *body, size_t len, uint32_t entries, bool hedge)
+{
+    size_t gz_len = compress_body(body, len);
+    int status = -1;
+    int hedged = -1;   // Target the hedge already posted to
+    for (int i = 0; i < s_target_count && (status < 0 || undelivered(status)); i++) {
+        int64_t now_us = esp_timer_get_time();
+        if (i == hedged || !target_allow(&s_targets[i], now_us)) {
+            continue;
+        }
+        if (status >= 0) {
+            STAT_INC(failovers);
+            ESP_LOGW(TAG, "Failing over to %s", s_targets[i].stats.url);
+        }
+
+        int by = i;
+        int second = hedge && s_hedge_ms && s_hedge_task ? hedge_target(i, now_us) : -1;
+        if (second >= 0) {
+            status = target_post_hedged(i, second, body, len, gz_len, &by);
+            hedged = s_hedge.status >= 0 ? second : -1;
+        } else {
+            status = target_post(&s_targets[i], body, len, gz_len);
+        }
+        if (!undelivered(status) && by != s_active) {
+            s_active = by;
+            breaker_changed(&s_targets[by], s_targets[by].breaker.state);
+        }
+    }
+    if (status < 0) {
+        STAT_INC(shed);
+        return -1;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (status == 0) {
+        s_stats.failed += entries;
+    } else if (status >= 200 && status < 300) {
+        s_stats.sent += entries;
+    } else {
+        s_stats.rejected += entries;
+    }
+    s_stats.last_status = status;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return status;
+}
+
+// Parse message type to determine level and category
+static void log_level_category(const mesh_message_t *msg, const char **level, const char **category)
+{
+    *level = "INFO";
+    *category = "system";
 
-    cJSON *item = cJSON_CreateObject();
-    cJSON_AddStringToObject(item, "device_id", msg->device_id);
-    cJSON_AddNumberToObject(item, "timestamp", (double)msg->timestamp);
-    
-    // Parse message type to determine level and category
-    const char *level = "INFO";
-    const char *category = "system";
-    
     if (msg->type == MSG_TYPE_MOTION) {
-        level = "NOTICE";
-        category = "motion";
+        *level = "NOTICE";
+        *category = "motion";
     } else if (msg->type == MSG_TYPE_LOG) {
-        level = "INFO";
-        category = "system";
+        *level = "INFO";
+        *category = "system";
     }
-    
+}
+
+// One entry of a LogIngestRequest
+static cJSON *log_item_from_message(const mesh_message_t *msg, uint32_t seq)
+{
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "device_id", msg->device_id);
+    cJSON_AddNumberToObject(item, "timestamp", (double)msg->timestamp);
+
+    const char *level, *category;
+    log_level_category(msg, &level, &category);
     cJSON_AddStringToObject(item, "level", level);
     cJSON_AddStringToObject(item, "category", category);
     cJSON_AddStringToObject(item, "message", msg->payload);
@@ -87,104 +665,1303 @@ void send_log_to_unraid(mesh_message_t *msg) {
     }
     signature_hex[128] = '\0';
     cJSON_AddStringToObject(item, "signature", signature_hex);
+    if (seq) {
+        cJSON_AddNumberToObject(item, "seq", seq);
+    }
+    return item;
+}
 
-    cJSON_AddItemToArray(logs, item);
+// Next sequence number, 0 if the reserved block is used up (NVS failing)
+static uint32_t seq_take(void)
+{
+    uint32_t seq = 0;
+    portENTER_CRITICAL(&s_seq_lock);
+    if (s_seq_next < s_seq_reserved) {
+        seq = s_seq_next++;
+    }
+    portEXIT_CRITICAL(&s_seq_lock);
+    if (!seq) {
+        STAT_INC(unkeyed);
+    }
+    return seq;
+}
 
-    char *json_str = cJSON_PrintUnformatted(root);
-    if (!json_str) {
-        ESP_LOGE(TAG, "Failed to serialize JSON");
-        cJSON_Delete(root);
+// Reserve the next block in NVS once half the current one is used
+static void seq_reserve(void)
+{
+    portENTER_CRITICAL(&s_seq_lock);
+    uint32_t next = s_seq_next;
+    uint32_t reserved = s_seq_reserved;
+    portEXIT_CRITICAL(&s_seq_lock);
+    if (reserved - next >= UNRAID_SEQ_BLOCK / 2) {
         return;
     }
 
-    // 2. Create HTTP request
-    esp_http_client_config_t http_config = {
-        .url = UNRAID_API_URL,
-        .event_handler = http_event_handle,
-        .transport_type = HTTP_TRANSPORT_OVER_TCP,
-        .timeout_ms = 5000,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&http_config);
-    if (!client) {
-        ESP_LOGE(TAG, "Failed to create HTTP client");
-        free(json_str);
-        cJSON_Delete(root);
+    uint32_t ceiling = (reserved > next ? reserved : next) + UNRAID_SEQ_BLOCK;
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(UNRAID_SEQ_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u32(nvs_handle, "seq", ceiling);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not reserve uplink sequence numbers: %s", esp_err_to_name(err));
         return;
     }
+    portENTER_CRITICAL(&s_seq_lock);
+    s_seq_reserved = ceiling;
+    portEXIT_CRITICAL(&s_seq_lock);
+}
 
-    // 3. Send POST request
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, json_str, strlen(json_str));
+// Resume numbering at the end of the last reserved block
+static void seq_load(void)
+{
+    uint32_t next = 1;
+    nvs_handle_t nvs_handle;
+    if (nvs_open(UNRAID_SEQ_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        nvs_get_u32(nvs_handle, "seq", &next);
+        nvs_close(nvs_handle);
+    }
+    portENTER_CRITICAL(&s_seq_lock);
+    s_seq_next = next ? next : 1;
+    s_seq_reserved = s_seq_next;
+    portEXIT_CRITICAL(&s_seq_lock);
+    seq_reserve();
+    ESP_LOGI(TAG, "Uplink sequence numbers resume at %lu", (unsigned long)s_seq_next);
+}
 
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "Log sent to Unraid: %d bytes, response: %d", strlen(json_str), status_code);
-    } else {
-        ESP_LOGE(TAG, "Failed to send log to Unraid: %s", esp_err_to_name(err));
+// Link up; applies a probe requested by unraid_uplink_set_link
+static bool uplink_online(void)
+{
+    if (!s_link_up) {
+        return false;
+    }
+    if (s_probe_now) {
+        s_probe_now = false;
+        for (int i = 0; i < s_target_count; i++) {
+            uplink_breaker_probe_now(&s_targets[i].breaker);
+        }
     }
+    return true;
+}
 
-    esp_http_client_cleanup(client);
-    free(json_str);
-    cJSON_Delete(root);
+// Earliest time any target will take a post
+static int64_t uplink_retry_at(void)
+{
+    int64_t retry_at_us = INT64_MAX;
+    for (int i = 0; i < s_target_count; i++) {
+        int64_t at = s_targets[i].breaker.retry_at_us;
+        retry_at_us = at < retry_at_us ? at : retry_at_us;
+    }
+    return retry_at_us;
 }
 
-// Batch logging function (for future use with message buffering)
-void send_log_batch_to_unraid(cJSON *logs_array) {
-    if (!logs_array) {
-        return;
+// Write a body to the spool, waiting up to `wait` for it
+static bool spool_body(const char *body, size_t len, uint32_t entries, TickType_t wait)
+{
+    if (!s_spool_ok || xSemaphoreTake(s_spool_lock, wait) != pdTRUE) {
+        return false;
+    }
+    esp_err_t err = uplink_spool_append(body, len, entries);
+    xSemaphoreGive(s_spool_lock);
+    if (err != ESP_OK) {
+        return false;
     }
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddItemToObject(root, "logs", logs_array);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.spooled += entries;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return true;
+}
 
-    char *json_str = cJSON_PrintUnformatted(root);
-    if (!json_str) {
-        ESP_LOGE(TAG, "Failed to serialize batch JSON");
-        cJSON_Delete(root);
-        return;
+// Post a body unless the uplink is offline, spooling it if no target could
+// take it. Returns the HTTP status, 0 if it was not delivered.
+static int deliver(const char *body, size_t len, uint32_t entries, bool hedge)
+{
+    // A failure holds further posts off; replay picks up once a target answers
+    int status = uplink_online() ? uplink_post(body, len, entries, hedge) : -1;
+    bool posted = status >= 0;
+    status = posted ? status : 0;
+
+    if (undelivered(status) && !spool_body(body, len, entries, portMAX_DELAY)) {
+        if (!posted) {
+            // uplink_post counts its own failures
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.failed += entries;
+            portEXIT_CRITICAL(&s_stats_lock);
+        }
+        if (s_spool_ok) {
+            ESP_LOGW(TAG, "Could not spool %lu undelivered logs", (unsigned long)entries);
+        }
     }
+    return status;
+}
 
-    esp_http_client_config_t http_config = {
-        .url = UNRAID_API_URL,
-        .event_handler = http_event_handle,
-        .transport_type = HTTP_TRANSPORT_OVER_TCP,
-        .timeout_ms = 5000,
-    };
+// Frames can go out: connected, granted a window and nothing left to repost
+static inline bool stream_live(void)
+{
+    return s_ws && !s_stream_broken && s_stream.window > 0;
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&http_config);
-    if (!client) {
-        ESP_LOGE(TAG, "Failed to create HTTP client");
-        free(json_str);
-        cJSON_Delete(root);
+// Settle the oldest frame with its ack (stream lock held)
+static void stream_ack(const uplink_stream_ack_t *ack)
+{
+    if (undelivered(ack->status)) {
+        // Like a failed post: it goes by POST, or to the spool
+        ESP_LOGW(TAG, "Stream frame %lu answered %u", (unsigned long)ack->seq, ack->status);
+        s_stream_broken = true;
         return;
     }
+    uplink_stream_drop_oldest(&s_stream);
+    uint32_t ack_ms = (uint32_t)((esp_timer_get_time() - ack->pushed_us) / 1000);
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, json_str, strlen(json_str));
-
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "Log batch sent to Unraid: response code %d", status_code);
+    portENTER_CRITICAL(&s_stats_lock);
+    if (ack->status >= 200 && ack->status < 300) {
+        s_stats.sent += ack->entries;
     } else {
-        ESP_LOGE(TAG, "Failed to send log batch: %s", esp_err_to_name(err));
+        s_stats.rejected += ack->entries;
     }
+    s_stats.last_status = ack->status;
+    s_stats.stream_acked++;
+    s_stats.last_ack_ms = ack_ms;
+    s_stats.max_ack_ms = ack_ms > s_stats.max_ack_ms ? ack_ms : s_stats.max_ack_ms;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
 
-    esp_http_client_cleanup(client);
-    free(json_str);
-    cJSON_Delete(root);
+// WebSocket events (runs in the WebSocket client's task)
+static void stream_event(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_websocket_event_data_t *data = event_data;
+    switch (event_id) {
+        case WEBSOCKET_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Stream connected to %s", s_stream_url);
+            STAT_INC(stream_connects);
+            break;
+        case WEBSOCKET_EVENT_DISCONNECTED:
+        case WEBSOCKET_EVENT_CLOSED:
+            xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+            uplink_stream_disconnected(&s_stream);
+            if (s_stream.in_flight) {
+                s_stream_broken = true;
+                xSemaphoreGive(s_queue_ready);   // Wake the uplink task to post them
+            }
+            xSemaphoreGive(s_stream_lock);
+            ESP_LOGW(TAG, "Stream to %s dropped", s_stream_url);
+            break;
+        case WEBSOCKET_EVENT_DATA: {
+            // Acks and windows are small; a fragment is not one of them
+            if (data->op_code != 0x2 || data->payload_offset != 0 || data->data_len != data->payload_len) {
+                break;
+            }
+            const uint8_t *frame = (const uint8_t *)data->data_ptr;
+            uplink_stream_ack_t ack;
+            xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+            if (s_stream_broken && data->data_len > 0 && frame[0] == UPLINK_STREAM_FRAME_ACK) {
+                xSemaphoreGive(s_stream_lock);   // Those frames are being posted instead
+                break;
+            }
+            esp_err_t err = uplink_stream_receive(&s_stream, frame, (size_t)data->data_len, &ack);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Unexpected stream frame: %s", esp_err_to_name(err));
+                s_stream_broken = true;
+            } else if (ack.type == UPLINK_STREAM_FRAME_ACK) {
+                stream_ack(&ack);
+            }
+            bool wake = s_stream_broken;
+            xSemaphoreGive(s_stream_lock);
+            if (wake) {
+                xSemaphoreGive(s_queue_ready);
+            }
+            break;
+        }
+        default:
+            break;
+    }
 }
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Log sent, status = %d", esp_http_client_get_status_code(client));
+
+// Send a body as a stream frame. Returns 202 once it is in flight (its ack
+// settles it), -1 if it has to be posted.
+static int stream_send(const char *body, size_t len, uint32_t entries)
+{
+    if (!s_ws) {
+        return -1;
+    }
+    uint32_t seq = 0;
+    xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+    bool pushed = !s_stream_broken && s_stream.window > 0 &&
+                  uplink_stream_push(&s_stream, body, len, entries, esp_timer_get_time(), &seq) == ESP_OK;
+    xSemaphoreGive(s_stream_lock);
+    if (!pushed) {
+        STAT_INC(stream_fallbacks);
+        return -1;
+    }
+
+    size_t gz_len = compress_body(body, len);
+    size_t frame_len = uplink_stream_frame_header(s_frame, seq, gz_len != 0);
+    memcpy(&s_frame[frame_len], gz_len ? (const void *)s_gzip : body, gz_len ? gz_len : len);
+    frame_len += gz_len ? gz_len : len;
+    if (esp_websocket_client_send_bin(s_ws, (const char *)s_frame, (int)frame_len,
+                                      pdMS_TO_TICKS(UNRAID_UPLINK_TIMEOUT_MS)) < 0) {
+        // Kept until acked, so it is posted with the rest once the stream restarts
+        ESP_LOGW(TAG, "Stream send failed");
+        xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+        s_stream_broken = true;
+        xSemaphoreGive(s_stream_lock);
+    }
+    STAT_INC(streamed);
+    return 202;
+}
+
+// Post every unacked frame, oldest first; the stream carries on once they are out
+static void stream_repost(void)
+{
+    while (1) {
+        size_t len = 0;
+        uint32_t entries = 0;
+        xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+        const void *body = uplink_stream_oldest(&s_stream, &len, &entries, NULL);
+        if (body) {
+            memcpy(s_replay, body, len);
+            uplink_stream_drop_oldest(&s_stream);
+        } else {
+            s_stream_broken = false;
+        }
+        xSemaphoreGive(s_stream_lock);
+        if (!body) {
+            return;
+        }
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.stream_resent++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        deliver(s_replay, len, entries, false);
+    }
+}
+
+// Deal with a stream that lost step with the backend: a connection that is
+// still up is restarted, so no stale ack lands on a new frame, and whatever
+// was unacked is posted
+static void stream_recover(void)
+{
+    if (!s_ws || !s_stream_broken) {
+        return;
+    }
+    if (esp_websocket_client_is_connected(s_ws)) {
+        esp_websocket_client_stop(s_ws);
+        xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+        uplink_stream_disconnected(&s_stream);
+        xSemaphoreGive(s_stream_lock);
+        esp_websocket_client_start(s_ws);
+    }
+    stream_repost();
+}
+
+// /ws/uplink on the host of an http(s) ingest URL
+static void stream_url_from(const char *url, char *out, size_t size)
+{
+    bool tls = strncmp(url, "https://", 8) == 0;
+    const char *host = url + (tls ? 8 : 7);
+    int host_len = (int)strcspn(host, "/");
+    snprintf(out, size, "%s://%.*s" UNRAID_STREAM_PATH, tls ? "wss" : "ws", host_len, host);
+}
+
+static void stream_stop(void)
+{
+    if (!s_ws) {
+        return;
+    }
+    esp_websocket_client_stop(s_ws);
+    esp_websocket_client_destroy(s_ws);
+    s_ws = NULL;
+    xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+    uplink_stream_disconnected(&s_stream);
+    xSemaphoreGive(s_stream_lock);
+    stream_repost();
+}
+
+static esp_err_t stream_start(void)
+{
+    if (s_ws) {
+        return ESP_OK;
+    }
+    if (UNRAID_UPLINK_STREAM_URL[0]) {
+        snprintf(s_stream_url, sizeof(s_stream_url), "%s", UNRAID_UPLINK_STREAM_URL);
     } else {
-        ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+        stream_url_from(s_targets[0].stats.url, s_stream_url, sizeof(s_stream_url));
     }
 
-    esp_http_client_cleanup(client);
-    cJSON_Delete(root);
-    free(json_str);
+    esp_websocket_client_config_t ws_config = {
+        .uri = s_stream_url,
+        .reconnect_timeout_ms = UNRAID_STREAM_RECONNECT_MS,
+        .network_timeout_ms = UNRAID_UPLINK_TIMEOUT_MS,
+    };
+    s_ws = esp_websocket_client_init(&ws_config);
+    if (!s_ws) {
+        ESP_LOGE(TAG, "Failed to create WebSocket client for %s", s_stream_url);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_websocket_register_events(s_ws, WEBSOCKET_EVENT_ANY, stream_event, NULL);
+    esp_err_t err = esp_websocket_client_start(s_ws);
+    if (err != ESP_OK) {
+        esp_websocket_client_destroy(s_ws);
+        s_ws = NULL;
+        return err;
+    }
+    ESP_LOGI(TAG, "Streaming to %s", s_stream_url);
+    return ESP_OK;
+}
+
+// Follow the first target when the stream URL is derived from it
+static void stream_retarget(void)
+{
+    char url[sizeof(s_stream_url)];
+    if (!s_ws || UNRAID_UPLINK_STREAM_URL[0]) {
+        return;
+    }
+    stream_url_from(s_targets[0].stats.url, url, sizeof(url));
+    if (strcmp(url, s_stream_url) != 0) {
+        stream_stop();
+        stream_start();
+    }
+}
+
+// Post the oldest spooled batch. Delivered or rejected, it leaves the spool;
+// undelivered, it stays and the uplink backs off.
+static void spool_replay(int64_t now_us)
+{
+    size_t len = 0;
+    uint32_t entries = 0;
+    s_last_replay_us = now_us;
+
+    // Copy the batch out and post it without the lock, so spilling senders
+    // are not held up behind the network
+    xSemaphoreTake(s_spool_lock, portMAX_DELAY);
+    esp_err_t err = uplink_spool_peek(s_replay, sizeof(s_replay), &len, &entries);
+    uint64_t head = uplink_spool_head();
+    xSemaphoreGive(s_spool_lock);
+    if (err != ESP_OK) {
+        return;
+    }
+
+    int status = uplink_post(s_replay, len, entries, false);
+
+    // A full spool may have overwritten the batch meanwhile; pop only if it
+    // is still the oldest
+    xSemaphoreTake(s_spool_lock, portMAX_DELAY);
+    if (status >= 0 && !undelivered(status) && uplink_spool_head() == head) {
+        uplink_spool_pop();
+    }
+    bool drained = uplink_spool_pending() == 0;
+    xSemaphoreGive(s_spool_lock);
+
+    if (status < 0 || undelivered(status)) {
+        return;
+    }
+
+    // Throughput over the current drain
+    if (s_replay_started_us == 0) {
+        s_replay_started_us = now_us;
+        s_replay_entries = 0;
+    }
+    s_replay_entries += entries;
+    int64_t elapsed_us = esp_timer_get_time() - s_replay_started_us;
+    uint32_t rate = elapsed_us > 0 ? (uint32_t)((int64_t)s_replay_entries * 1000000 / elapsed_us) : s_replay_entries;
+    if (drained) {
+        s_replay_started_us = 0;
+        ESP_LOGI(TAG, "Spool drained (%lu logs replayed)", (unsigned long)s_replay_entries);
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (status >= 200 && status < 300) {
+        s_stats.replayed += entries;
+    }
+    s_stats.replay_rate = rate;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Milliseconds until the next replay is due, or -1 if there is nothing to replay
+static int64_t replay_wait_ms(int64_t now_us)
+{
+    if (!s_spool_ok || !s_link_up) {
+        return -1;
+    }
+    xSemaphoreTake(s_spool_lock, portMAX_DELAY);
+    uint32_t pending = uplink_spool_pending();
+    xSemaphoreGive(s_spool_lock);
+    if (pending == 0) {
+        return -1;
+    }
+    int64_t due_us = s_last_replay_us + (int64_t)UNRAID_SPOOL_REPLAY_MS * 1000;
+    int64_t retry_at_us = s_probe_now ? 0 : uplink_retry_at();
+    due_us = due_us > retry_at_us ? due_us : retry_at_us;
+    return due_us > now_us ? (due_us - now_us + 999) / 1000 : 0;
+}
+
+static void batch_reset(void)
+{
+    s_batch_format = s_format;
+    s_batch_entries = 0;
+    s_batch_motion = false;
+    s_batch_device_count = 0;
+    strcpy(s_batch_home_base_id, s_home_base_id);
+    size_t id_len = strlen(s_batch_home_base_id);
+    if (s_batch_format == UNRAID_FORMAT_CBOR) {
+        // {"logs": [_ ... (the device table and home base ID follow on close)
+        uplink_cbor_writer_t w;
+        uplink_cbor_init(&w, s_batch, sizeof(s_batch));
+        uplink_cbor_put_map(&w, id_len ? 3 : 2);
+        uplink_cbor_put_text(&w, "logs", 4);
+        uplink_cbor_put_indefinite_array(&w);
+        s_batch_used = w.len;
+        s_batch_tail = 1 + uplink_cbor_string_size(7) + 2;   // Break, "devices", array head
+        if (id_len) {
+            s_batch_tail += uplink_cbor_string_size(12) + uplink_cbor_string_size(id_len);
+        }
+    } else {
+        strcpy(s_batch, UNRAID_BATCH_PREFIX);
+        s_batch_used = strlen(UNRAID_BATCH_PREFIX);
+        s_batch_tail = 2;   // "]}"
+        if (id_len) {
+            s_batch_tail += strlen(",\"home_base_id\":\"\"") + id_len;
+        }
+    }
+}
+
+// End the entries and, for CBOR, write the device table
+static void batch_close(void)
+{
+    size_t id_len = strlen(s_batch_home_base_id);
+    if (s_batch_format == UNRAID_FORMAT_JSON) {
+        s_batch[s_batch_used++] = ']';
+        if (id_len) {
+            s_batch_used += sprintf(&s_batch[s_batch_used], ",\"home_base_id\":\"%s\"", s_batch_home_base_id);
+        }
+        s_batch[s_batch_used++] = '}';
+        return;
+    }
+    uplink_cbor_writer_t w;
+    uplink_cbor_init(&w, &s_batch[s_batch_used], sizeof(s_batch) - s_batch_used);
+    uplink_cbor_put_break(&w);
+    uplink_cbor_put_text(&w, "devices", 7);
+    uplink_cbor_put_array(&w, s_batch_device_count);
+    for (int i = 0; i < s_batch_device_count; i++) {
+        uplink_cbor_put_text(&w, s_batch_devices[i], strlen(s_batch_devices[i]));
+    }
+    if (id_len) {
+        uplink_cbor_put_text(&w, "home_base_id", 12);
+        uplink_cbor_put_text(&w, s_batch_home_base_id, id_len);
+    }
+    s_batch_used += w.len;
+}
+
+// Close and post the batch. Returns the HTTP status, 0 if it was not
+// delivered (spooled if possible), -1 if there was nothing to send.
+static int batch_flush(unraid_flush_reason_t reason, int64_t now_us)
+{
+    if (s_batch_entries == 0) {
+        return -1;
+    }
+
+    batch_close();
+    uint32_t entries = s_batch_entries;
+    uint32_t hold_ms = (uint32_t)((now_us - s_batch_first_us) / 1000);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.batches++;
+    s_stats.batched += entries;
+    s_stats.flushes[reason]++;
+    s_stats.max_batch = entries > s_stats.max_batch ? entries : s_stats.max_batch;
+    s_stats.last_batch = entries;
+    s_stats.last_batch_bytes = (uint32_t)s_batch_used;
+    s_stats.max_hold_ms = hold_ms > s_stats.max_hold_ms ? hold_ms : s_stats.max_hold_ms;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    int status = stream_send(s_batch, s_batch_used, entries);
+    status = status < 0 ? deliver(s_batch, s_batch_used, entries, s_batch_motion) : status;
+    ESP_LOGD(TAG, "Flushed %lu logs (%u bytes, %s): %d", (unsigned long)entries, (unsigned)s_batch_used,
+             unraid_flush_reason_name(reason), status);
+    batch_reset();
+    return status;
+}
+
+// Append a rendered JSON entry, keeping room for the closing "]}"
+static bool batch_render_json(const mesh_message_t *msg)
+{
+    cJSON *item = log_item_from_message(msg, seq_take());
+    size_t comma = s_batch_entries ? 1 : 0;
+    size_t room = sizeof(s_batch) - s_batch_used - comma - s_batch_tail;
+    char *dst = &s_batch[s_batch_used + comma];
+    bool fits = cJSON_PrintPreallocated(item, dst, (int)room, false);
+    cJSON_Delete(item);
+    if (!fits) {
+        return false;
+    }
+
+    if (s_batch_entries) {
+        s_batch[s_batch_used++] = ',';
+    }
+    s_batch_used += strlen(dst);
+    return true;
+}
+
+// Index of a sender in the CBOR device table, -1 if it is not there yet
+static int batch_device_index(const char *device_id)
+{
+    for (int i = 0; i < s_batch_device_count; i++) {
+        if (strcmp(s_batch_devices[i], device_id) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Encode a CBOR entry in place, keeping room for the device table
+static bool batch_render_cbor(const mesh_message_t *msg, const char *device_id)
+{
+    int device = batch_device_index(device_id);
+    size_t tail = s_batch_tail;
+    if (device < 0) {
+        device = s_batch_device_count;
+        tail += uplink_cbor_string_size(strlen(device_id));
+    }
+
+    const char *level, *category;
+    log_level_category(msg, &level, &category);
+
+    uplink_cbor_writer_t w;
+    uplink_cbor_init(&w, &s_batch[s_batch_used], sizeof(s_batch) - s_batch_used - tail);
+    uint32_t seq = seq_take();
+    uplink_cbor_put_array(&w, seq ? 7 : 6);
+    uplink_cbor_put_uint(&w, (uint64_t)device);
+    uplink_cbor_put_uint(&w, msg->timestamp);
+    uplink_cbor_put_text(&w, level, strlen(level));
+    uplink_cbor_put_text(&w, category, strlen(category));
+    uplink_cbor_put_text(&w, msg->payload, strnlen(msg->payload, sizeof(msg->payload)));
+    uplink_cbor_put_bytes(&w, msg->signature, sizeof(msg->signature));
+    if (seq) {
+        uplink_cbor_put_uint(&w, seq);
+    }
+    if (w.overflow) {
+        return false;
+    }
+
+    if (device == s_batch_device_count) {
+        strcpy(s_batch_devices[s_batch_device_count++], device_id);
+    }
+    s_batch_used += w.len;
+    s_batch_tail = tail;
+    return true;
+}
+
+// Render a message into the batch; flushes when the byte budget is reached.
+// Returns the status of that flush, or -1 if none happened.
+static int batch_add(const mesh_message_t *msg, int64_t now_us)
+{
+    int status = -1;
+    if (s_batch_entries == 0 && s_batch_format != s_format) {
+        batch_reset();   // Format changed since the last flush
+    }
+
+    char device_id[sizeof(msg->device_id)];
+    strncpy(device_id, msg->device_id, sizeof(device_id) - 1);
+    device_id[sizeof(device_id) - 1] = '\0';
+    if (s_batch_format == UNRAID_FORMAT_CBOR &&
+        s_batch_device_count == UNRAID_BATCH_DEVICES_MAX && batch_device_index(device_id) < 0) {
+        status = batch_flush(UNRAID_FLUSH_FULL, now_us);   // Device table full
+    }
+
+    // Dispatch after the flush: the reset may have picked up a new format
+    bool fits;
+    if (s_batch_format == UNRAID_FORMAT_CBOR) {
+        fits = batch_render_cbor(msg, device_id);
+    } else {
+        fits = batch_render_json(msg);
+    }
+    if (!fits) {
+        ESP_LOGW(TAG, "Log from %s too large for a batch, dropped", msg->device_id);
+        STAT_INC(oversize);
+        return status;
+    }
+
+    // The batch goes out by the earliest deadline of anything in it; a live
+    // stream costs little per frame, so nothing waits long for company
+    uint32_t hold_ms = msg->type == MSG_TYPE_MOTION ? UNRAID_BATCH_MOTION_MS : UNRAID_BATCH_LOG_MS;
+    if (stream_live()) {
+        hold_ms = msg->type == MSG_TYPE_MOTION ? 0 : UNRAID_UPLINK_STREAM_HOLD_MS;
+    }
+    int64_t hold_us = (int64_t)hold_ms * 1000;
+    s_batch_motion |= msg->type == MSG_TYPE_MOTION;
+    if (s_batch_entries++ == 0) {
+        s_batch_first_us = now_us;
+        s_batch_deadline_us = now_us + hold_us;
+    } else if (now_us + hold_us < s_batch_deadline_us) {
+        s_batch_deadline_us = now_us + hold_us;
+    }
+
+    if (s_batch_used >= s_targets[s_active].breaker.batch_bytes) {
+        return batch_flush(UNRAID_FLUSH_FULL, now_us);
+    }
+    return status;
+}
+
+// Serialize {"logs": [...]} (takes ownership of logs) and post it
+static int post_logs(cJSON *logs)
+{
+    uint32_t entries = (uint32_t)cJSON_GetArraySize(logs);
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "logs", logs);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_str) {
+        ESP_LOGE(TAG, "Failed to serialize JSON");
+        return 0;
+    }
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    int status = deliver(json_str, strlen(json_str), entries, false);
+    xSemaphoreGive(s_client_lock);
+
+    free(json_str);
+    return status;
+}
+
+static void queue_reset(void)
+{
+    portENTER_CRITICAL(&s_queue_lock);
+    for (int i = 0; i < UNRAID_UPLINK_QUEUE_LEN; i++) {
+        s_free[i] = (uint8_t)(UNRAID_UPLINK_QUEUE_LEN - 1 - i);
+    }
+    s_free_count = UNRAID_UPLINK_QUEUE_LEN;
+    memset(s_lanes, 0, sizeof(s_lanes));
+    portEXIT_CRITICAL(&s_queue_lock);
+}
+
+static int lane_pop(uplink_lane_t *lane)
+{
+    int idx = lane->slots[lane->head];
+    lane->head = (lane->head + 1) % UNRAID_UPLINK_QUEUE_LEN;
+    lane->count--;
+    return idx;
+}
+
+static void lane_push(uplink_lane_t *lane, int idx)
+{
+    lane->slots[(lane->head + lane->count) % UNRAID_UPLINK_QUEUE_LEN] = (uint8_t)idx;
+    lane->count++;
+}
+
+// Lane to evict from so a message for `lane` fits in a full queue, or -1 to
+// drop the incoming message instead. Called with s_queue_lock held.
+static int queue_victim(int lane)
+{
+    const uplink_lane_t *motion = &s_lanes[UPLINK_LANE_MOTION];
+    const uplink_lane_t *bulk = &s_lanes[UPLINK_LANE_BULK];
+
+    switch (s_policy) {
+        case UNRAID_OVERFLOW_DROP_OLDEST:
+            if (motion->count == 0 || bulk->count == 0) {
+                return motion->count ? UPLINK_LANE_MOTION : UPLINK_LANE_BULK;
+            }
+            return (int32_t)(s_pool_seq[motion->slots[motion->head]] - s_pool_seq[bulk->slots[bulk->head]]) < 0
+                       ? UPLINK_LANE_MOTION : UPLINK_LANE_BULK;
+        case UNRAID_OVERFLOW_DROP_LOGS:
+            // Motion only ever displaces motion once no logs are left
+            if (bulk->count) {
+                return UPLINK_LANE_BULK;
+            }
+            return lane == UPLINK_LANE_MOTION ? UPLINK_LANE_MOTION : -1;
+        default:
+            return -1;
+    }
+}
+
+// Take the next message, motion first; false if the queue is empty
+static bool queue_take(mesh_message_t *out)
+{
+    bool taken = false;
+    portENTER_CRITICAL(&s_queue_lock);
+    for (int lane = 0; lane < UPLINK_LANE_COUNT; lane++) {
+        if (s_lanes[lane].count) {
+            int idx = lane_pop(&s_lanes[lane]);
+            *out = s_pool[idx];
+            s_free[s_free_count++] = (uint8_t)idx;
+            taken = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_queue_lock);
+    return taken;
+}
+
+// Mount the spool and forget replay and link state
+static void uplink_reset_spool(void)
+{
+    xSemaphoreTake(s_spool_lock, portMAX_DELAY);
+    esp_err_t err = uplink_spool_init();
+    s_spool_ok = err == ESP_OK;
+    xSemaphoreGive(s_spool_lock);
+    if (!s_spool_ok) {
+        ESP_LOGW(TAG, "No uplink spool (%s); undeliverable logs will be dropped", esp_err_to_name(err));
+    }
+    s_last_replay_us = 0;
+    s_replay_started_us = 0;
+    s_link_up = true;
+}
+
+// Split a comma-separated URL list; returns how many there are, or -1 if
+// there are too many or one is too long or not http(s)
+static int parse_targets(const char *list, char urls[][UNRAID_UPLINK_URL_MAX])
+{
+    int count = 0;
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        const char *end = strchr(p, ',');
+        end = end ? end : p + strlen(p);
+        size_t n = (size_t)(end - p);
+        while (n && p[n - 1] == ' ') {
+            n--;
+        }
+        if (count == UNRAID_UPLINK_TARGETS_MAX || n >= UNRAID_UPLINK_URL_MAX ||
+            (strncmp(p, "http://", 7) != 0 && strncmp(p, "https://", 8) != 0)) {
+            return -1;
+        }
+        memcpy(urls[count], p, n);
+        urls[count++][n] = '\0';
+        p = end;
+    }
+    return count;
+}
+
+// One client per target for as long as it is configured; method and
+// headers stick to it
+static esp_http_client_handle_t target_client(const char *url)
+{
+    esp_http_client_config_t http_config = {
+        .url = url,
+        .event_handler = http_event_handle,
+        .transport_type = HTTP_TRANSPORT_OVER_TCP,
+        .timeout_ms = UNRAID_UPLINK_TIMEOUT_MS,
+        .keep_alive_enable = true,      // TCP keep-alive probes spot a dead backend
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (client) {
+        esp_http_client_set_method(client, HTTP_METHOD_POST);
+    }
+    return client;
+}
+
+esp_err_t unraid_uplink_set_targets(const char *urls, uint32_t hedge_ms)
+{
+    char parsed[UNRAID_UPLINK_TARGETS_MAX][UNRAID_UPLINK_URL_MAX];
+    int count = urls ? parse_targets(urls, parsed) : 0;
+    if (count <= 0) {
+        ESP_LOGE(TAG, "Invalid uplink targets \"%s\"", urls ? urls : "");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hedge_ms > UNRAID_UPLINK_HEDGE_MAX_MS) {
+        ESP_LOGE(TAG, "Hedge budget %lu ms out of range", (unsigned long)hedge_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_client_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Built aside, then swapped in; a URL already configured keeps its
+    // client, connection, breaker and counters
+    static uplink_target_t next[UNRAID_UPLINK_TARGETS_MAX];
+    bool kept[UNRAID_UPLINK_TARGETS_MAX] = {false};
+    bool fresh[UNRAID_UPLINK_TARGETS_MAX] = {false};
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    memset(next, 0, sizeof(next));
+    for (int i = 0; i < count && err == ESP_OK; i++) {
+        int j = 0;
+        while (j < s_target_count && (kept[j] || strcmp(s_targets[j].stats.url, parsed[i]) != 0)) {
+            j++;
+        }
+        if (j < s_target_count) {
+            next[i] = s_targets[j];
+            kept[j] = true;
+            continue;
+        }
+        next[i].client = target_client(parsed[i]);
+        if (!next[i].client) {
+            ESP_LOGE(TAG, "Failed to create HTTP client for %s", parsed[i]);
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        fresh[i] = true;
+        strcpy(next[i].stats.url, parsed[i]);
+        breaker_reset(&next[i]);
+    }
+    if (err != ESP_OK) {
+        for (int i = 0; i < count; i++) {
+            if (fresh[i]) {
+                esp_http_client_cleanup(next[i].client);
+            }
+        }
+        xSemaphoreGive(s_client_lock);
+        return err;
+    }
+
+    for (int j = 0; j < s_target_count; j++) {
+        if (!kept[j]) {
+            esp_http_client_cleanup(s_targets[j].client);
+        }
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    memcpy(s_targets, next, sizeof(s_targets));
+    s_target_count = count;
+    portEXIT_CRITICAL(&s_stats_lock);
+    s_active = 0;
+    s_hedge_ms = hedge_ms;
+    breaker_changed(&s_targets[0], s_targets[0].breaker.state);
+    stream_retarget();
+    xSemaphoreGive(s_client_lock);
+
+    ESP_LOGI(TAG, "%d uplink target(s), first %s, hedge %lu ms", count, parsed[0], (unsigned long)hedge_ms);
+    return ESP_OK;
+}
+
+uint32_t unraid_uplink_get_hedge_ms(void)
+{
+    return s_hedge_ms;
+}
+
+int unraid_uplink_get_targets(unraid_uplink_target_stats_t *targets, int max)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    int count = s_target_count < max ? s_target_count : max;
+    for (int i = 0; i < count; i++) {
+        targets[i] = s_targets[i].stats;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    return count;
+}
+
+esp_err_t unraid_uplink_init(void)
+{
+    if (s_client_lock) {
+        // Already up: start over with an empty queue, the built-in targets
+        // and fresh counters
+        queue_reset();
+        xSemaphoreTake(s_queue_ready, 0);
+        esp_err_t err = unraid_uplink_set_targets(UNRAID_API_URL, UNRAID_UPLINK_HEDGE_MS);
+        xSemaphoreTake(s_client_lock, portMAX_DELAY);
+        memset(&s_stats, 0, sizeof(s_stats));
+        for (int i = 0; i < s_target_count; i++) {
+            uplink_target_t *t = &s_targets[i];
+            esp_http_client_close(t->client);
+            t->connected = false;
+            t->last_request_us = 0;
+            unraid_uplink_target_stats_t fresh = {0};
+            strcpy(fresh.url, t->stats.url);
+            portENTER_CRITICAL(&s_stats_lock);
+            t->stats = fresh;
+            portEXIT_CRITICAL(&s_stats_lock);
+            breaker_reset(t);
+        }
+        s_probe_now = false;
+        portENTER_CRITICAL(&s_seq_lock);
+        s_home_base_id[0] = '\0';
+        portEXIT_CRITICAL(&s_seq_lock);
+        batch_reset();
+        uplink_reset_spool();
+        if (s_ws) {
+            esp_websocket_client_stop(s_ws);
+            esp_websocket_client_destroy(s_ws);
+            s_ws = NULL;
+        }
+        uplink_stream_init(&s_stream, s_stream_ring, sizeof(s_stream_ring));
+        s_stream_broken = false;
+        s_stream_enabled = UNRAID_UPLINK_STREAM_DEFAULT;
+        seq_load();
+        xSemaphoreGive(s_client_lock);
+        return err;
+    }
+
+    s_queue_ready = xSemaphoreCreateBinary();
+    s_client_lock = xSemaphoreCreateMutex();
+    s_spool_lock = xSemaphoreCreateMutex();
+    s_hedge_start = xSemaphoreCreateBinary();
+    s_hedge_cancel = xSemaphoreCreateBinary();
+    s_hedge_done = xSemaphoreCreateBinary();
+    s_stream_lock = xSemaphoreCreateMutex();
+    if (!s_queue_ready || !s_client_lock || !s_spool_lock || !s_hedge_start || !s_hedge_cancel || !s_hedge_done ||
+        !s_stream_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    queue_reset();
+    uplink_reset_spool();
+    uplink_stream_init(&s_stream, s_stream_ring, sizeof(s_stream_ring));
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    seq_load();
+    esp_err_t err = unraid_uplink_set_targets(UNRAID_API_URL, UNRAID_UPLINK_HEDGE_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    batch_reset();
+
+    // Idle until a motion batch is hedged
+    if (xTaskCreate(uplink_hedge_task, "unraid_hedge", UNRAID_HEDGE_STACK_SIZE, NULL,
+                    UNRAID_UPLINK_PRIORITY, &s_hedge_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool unraid_uplink_run(uint32_t timeout_ms)
+{
+    // Wake for the batch deadline or the next replay if either comes first
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+    if (s_batch_entries) {
+        int64_t left_ms = (s_batch_deadline_us - now_us) / 1000;
+        left_ms = left_ms > 0 ? left_ms : 0;
+        timeout_ms = (uint32_t)left_ms < timeout_ms ? (uint32_t)left_ms : timeout_ms;
+    }
+    int64_t replay_ms = replay_wait_ms(now_us);
+    if (replay_ms >= 0 && (uint32_t)replay_ms < timeout_ms) {
+        timeout_ms = (uint32_t)replay_ms;
+    }
+    xSemaphoreGive(s_client_lock);
+
+    mesh_message_t msg;
+    bool received = queue_take(&msg);
+    if (!received && timeout_ms > 0 && xSemaphoreTake(s_queue_ready, pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        received = queue_take(&msg);
+    }
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    stream_recover();
+    seq_reserve();
+    now_us = esp_timer_get_time();
+    if (received) {
+        batch_add(&msg, now_us);
+    }
+    if (s_batch_entries && now_us >= s_batch_deadline_us) {
+        batch_flush(UNRAID_FLUSH_DEADLINE, now_us);
+    }
+
+    // Live traffic first; spooled batches trickle out at the replay rate
+    now_us = esp_timer_get_time();
+    if (replay_wait_ms(now_us) == 0 && uplink_online()) {
+        spool_replay(now_us);
+    } else if (!received && !s_batch_entries) {
+        // Nothing to send: let idle connections go rather than find them dead later
+        for (int i = 0; i < s_target_count; i++) {
+            close_if_idle(&s_targets[i]);
+        }
+    }
+    xSemaphoreGive(s_client_lock);
+    return received;
+}
+
+int unraid_uplink_flush(void)
+{
+    if (s_target_count == 0) {
+        return -1;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    int status = batch_flush(UNRAID_FLUSH_FORCED, esp_timer_get_time());
+    xSemaphoreGive(s_client_lock);
+    return status;
+}
+
+static void unraid_uplink_task(void *arg)
+{
+    while (1) {
+        unraid_uplink_run(UNRAID_UPLINK_IDLE_MS);
+    }
+}
+
+esp_err_t unraid_uplink_start(void)
+{
+    if (s_target_count == 0 || s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(unraid_uplink_task, "unraid_up", UNRAID_UPLINK_STACK_SIZE, NULL,
+                    UNRAID_UPLINK_PRIORITY, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_stream_enabled) {
+        // Batches are posted until it connects
+        xSemaphoreTake(s_client_lock, portMAX_DELAY);
+        stream_start();
+        xSemaphoreGive(s_client_lock);
+    }
+    ESP_LOGI(TAG, "Uplink to %s started (%d target(s), queue %d, overflow %s)", s_targets[0].stats.url,
+             s_target_count, UNRAID_UPLINK_QUEUE_LEN, unraid_overflow_policy_name(s_policy));
+    return ESP_OK;
+}
+
+// Write a message that does not fit in the queue straight to the spool,
+// unless the uplink is using it right now
+static bool spill_message(const mesh_message_t *msg)
+{
+    if (!s_spool_ok) {
+        return false;
+    }
+    // Keyed like a batch, so a replay the backend already stored is skipped
+    char home_base_id[sizeof(s_home_base_id)];
+    portENTER_CRITICAL(&s_seq_lock);
+    strcpy(home_base_id, s_home_base_id);
+    portEXIT_CRITICAL(&s_seq_lock);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *logs = cJSON_AddArrayToObject(root, "logs");
+    cJSON_AddItemToArray(logs, log_item_from_message(msg, seq_take()));
+    if (home_base_id[0]) {
+        cJSON_AddStringToObject(root, "home_base_id", home_base_id);
+    }
+    char *body = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    bool spilled = body && spool_body(body, strlen(body), 1, 0);
+    free(body);
+    if (spilled) {
+        STAT_INC(spilled);
+    }
+    return spilled;
+}
+
+void send_log_to_unraid(mesh_message_t *msg) {
+    if (!msg) {
+        return;
+    }
+
+    // Workers must never wait on the network: a full queue gives up a
+    // message per the overflow policy instead
+    int lane = msg->type == MSG_TYPE_MOTION ? UPLINK_LANE_MOTION : UPLINK_LANE_BULK;
+    int idx = -1;
+    int lost_type = -1;
+    uint16_t depth = 0;
+
+    portENTER_CRITICAL(&s_queue_lock);
+    if (s_queue_ready) {
+        if (s_free_count) {
+            idx = s_free[--s_free_count];
+        } else {
+            int victim = queue_victim(lane);
+            if (victim >= 0) {
+                idx = lane_pop(&s_lanes[victim]);
+                lost_type = s_pool[idx].type;
+            }
+        }
+        if (idx >= 0) {
+            s_pool[idx] = *msg;
+            s_pool_seq[idx] = s_enqueue_seq++;
+            lane_push(&s_lanes[lane], idx);
+        }
+        depth = s_lanes[UPLINK_LANE_MOTION].count + s_lanes[UPLINK_LANE_BULK].count;
+    }
+    portEXIT_CRITICAL(&s_queue_lock);
+
+    if (idx >= 0) {
+        xSemaphoreGive(s_queue_ready);
+    } else if (s_policy == UNRAID_OVERFLOW_SPILL && spill_message(msg)) {
+        return;
+    } else {
+        lost_type = msg->type;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.queue_high_water = depth > s_stats.queue_high_water ? depth : s_stats.queue_high_water;
+    uint32_t dropped = s_stats.dropped;
+    if (lost_type >= 0) {
+        dropped = ++s_stats.dropped;
+        s_stats.evicted += idx >= 0 ? 1 : 0;
+        s_stats.dropped_motion += lost_type == MSG_TYPE_MOTION ? 1 : 0;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (lost_type >= 0 && (dropped & 0x3F) == 1) {
+        ESP_LOGW(TAG, "Uplink queue full, dropping %s (%lu dropped so far)",
+                 lost_type == MSG_TYPE_MOTION ? "motion events" : "logs", (unsigned long)dropped);
+    }
+}
+
+// Post a logs array built elsewhere; the uplink task batches on its own
+void send_log_batch_to_unraid(cJSON *logs_array) {
+    if (!logs_array) {
+        return;
+    }
+    if (s_target_count == 0) {
+        cJSON_Delete(logs_array);
+        return;
+    }
+
+    int status = post_logs(logs_array);
+    if (status != 0) {
+        ESP_LOGI(TAG, "Log batch sent to Unraid: response code %d", status);
+    }
+}
+
+void unraid_uplink_get_stats(unraid_uplink_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    portENTER_CRITICAL(&s_queue_lock);
+    stats->queued = s_lanes[UPLINK_LANE_MOTION].count + s_lanes[UPLINK_LANE_BULK].count;
+    portEXIT_CRITICAL(&s_queue_lock);
+    if (s_stream_lock) {
+        xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+        stats->stream_up = stream_live();
+        stats->stream_in_flight = s_stream.in_flight;
+        stats->stream_window = s_stream.window;
+        xSemaphoreGive(s_stream_lock);
+    }
+    portENTER_CRITICAL(&s_seq_lock);
+    stats->next_seq = s_seq_next;
+    portEXIT_CRITICAL(&s_seq_lock);
+}
+
+void unraid_uplink_set_link(bool up)
+{
+    s_link_up = up;
+    if (up) {
+        s_probe_now = true;   // Applied by the uplink task, which owns the breaker
+    }
+}
+
+void unraid_uplink_get_spool_stats(uplink_spool_stats_t *stats)
+{
+    if (!s_spool_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_spool_lock, portMAX_DELAY);
+    uplink_spool_get_stats(stats);
+    xSemaphoreGive(s_spool_lock);
+}
+
+void unraid_uplink_set_overflow_policy(unraid_overflow_policy_t policy)
+{
+    s_policy = policy;
+}
+
+unraid_overflow_policy_t unraid_uplink_get_overflow_policy(void)
+{
+    return s_policy;
+}
+
+void unraid_uplink_set_format(unraid_uplink_format_t format)
+{
+    s_format = format;
+}
+
+unraid_uplink_format_t unraid_uplink_get_format(void)
+{
+    return s_format;
+}
+
+const char *unraid_uplink_format_name(unraid_uplink_format_t format)
+{
+    switch (format) {
+        case UNRAID_FORMAT_JSON: return "json";
+        case UNRAID_FORMAT_CBOR: return "cbor";
+        default:                 return "unknown";
+    }
+}
+
+void unraid_uplink_set_gzip(bool enable)
+{
+    s_gzip_enabled = enable;
+}
+
+bool unraid_uplink_get_gzip(void)
+{
+    return s_gzip_enabled;
+}
+
+esp_err_t unraid_uplink_set_stream(bool enable)
+{
+    if (s_target_count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    s_stream_enabled = enable;
+    esp_err_t err = ESP_OK;
+    if (enable) {
+        err = stream_start();
+    } else {
+        stream_stop();
+    }
+    xSemaphoreGive(s_client_lock);
+    return err;
+}
+
+esp_err_t unraid_uplink_set_home_base_id(const char *id)
+{
+    if (!s_client_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!id || strlen(id) >= sizeof(s_home_base_id)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Written into batches as is, so nothing that needs escaping
+    for (const char *p = id; *p; p++) {
+        if (*p < 0x20 || *p == '"' || *p == '\\' || *p > 0x7E) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&s_seq_lock);
+    strcpy(s_home_base_id, id);
+    portEXIT_CRITICAL(&s_seq_lock);
+    if (!s_batch_entries) {
+        batch_reset();   // Otherwise the next batch carries it
+    }
+    xSemaphoreGive(s_client_lock);
+    return ESP_OK;
+}
+
+bool unraid_uplink_get_stream(void)
+{
+    return s_stream_enabled;
+}
+
+const char *unraid_overflow_policy_name(unraid_overflow_policy_t policy)
+{
+    switch (policy) {
+        case UNRAID_OVERFLOW_DROP_NEWEST: return "drop_newest";
+        case UNRAID_OVERFLOW_DROP_OLDEST: return "drop_oldest";
+        case UNRAID_OVERFLOW_DROP_LOGS:   return "drop_logs";
+        case UNRAID_OVERFLOW_SPILL:       return "spill";
+        default:                          return "unknown";
+    }
+}
+
+const char *unraid_flush_reason_name(unraid_flush_reason_t reason)
+{
+    switch (reason) {
+        case UNRAID_FLUSH_FULL:     return "full";
+        case UNRAID_FLUSH_DEADLINE: return "deadline";
+        case UNRAID_FLUSH_FORCED:   return "forced";
+        default:                    return "unknown";
+    }
+}
+
+float unraid_uplink_reuse_rate(const unraid_uplink_stats_t *stats)
+{
+    uint32_t answered = stats->sent + stats->rejected;
+    return answered ? (float)stats->reused / (float)answered : 0.0f;
+}
+
+float unraid_uplink_gzip_ratio(const unraid_uplink_stats_t *stats)
+{
+    return stats->gzip_out_bytes ? (float)stats->gzip_in_bytes / (float)stats->gzip_out_bytes : 0.0f;
 }
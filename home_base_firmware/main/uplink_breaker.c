@@ -0,0 +1,101 @@
+#include "uplink_breaker.h"
+#include <string.h>
+#include "esp_random.h"
+
+#define BREAKER_JITTER_DIV 4   // Up to a quarter of the backoff is added at random
+#define RTT_GAIN 8             // Smoothed RTT moves an eighth of the way per sample
+
+static inline bool failed(int status)
+{
+    return status == 0 || status == 429 || status >= 500;
+}
+
+static void open_breaker(uplink_breaker_t *b, int64_t now_us)
+{
+    uint32_t jitter = esp_random() % (b->backoff_ms / BREAKER_JITTER_DIV + 1);
+    b->state = UPLINK_BREAKER_OPEN;
+    b->retry_at_us = now_us + (int64_t)(b->backoff_ms + jitter) * 1000;
+    b->opens++;
+
+    // The next failed probe waits twice as long
+    b->backoff_ms = b->backoff_ms > b->cfg.backoff_max_ms / 2 ? b->cfg.backoff_max_ms : b->backoff_ms * 2;
+}
+
+static void resize_batch(uplink_breaker_t *b, int status, uint32_t rtt_ms)
+{
+    uint32_t size = b->batch_bytes;
+    if (failed(status)) {
+        size /= 2;
+    } else if (rtt_ms > b->cfg.rtt_target_ms) {
+        size -= size / 4;
+    } else {
+        size += b->cfg.batch_max / 8;
+    }
+    size = size < b->cfg.batch_min ? b->cfg.batch_min : size;
+    b->batch_bytes = size > b->cfg.batch_max ? b->cfg.batch_max : size;
+}
+
+void uplink_breaker_init(uplink_breaker_t *b, const uplink_breaker_config_t *cfg)
+{
+    memset(b, 0, sizeof(*b));
+    b->cfg = *cfg;
+    b->state = UPLINK_BREAKER_CLOSED;
+    b->backoff_ms = cfg->backoff_min_ms;
+    b->batch_bytes = cfg->batch_max;   // Start large; trouble shrinks it
+}
+
+bool uplink_breaker_allow(uplink_breaker_t *b, int64_t now_us)
+{
+    if (now_us < b->retry_at_us) {
+        b->shed++;
+        return false;
+    }
+    if (b->state == UPLINK_BREAKER_OPEN) {
+        b->state = UPLINK_BREAKER_HALF_OPEN;
+    }
+    return true;
+}
+
+void uplink_breaker_record(uplink_breaker_t *b, int status, uint32_t rtt_ms, int64_t now_us)
+{
+    b->last_status = status;
+    if (status != 0) {
+        b->last_rtt_ms = rtt_ms;
+        b->srtt_ms = b->srtt_ms == 0 ? rtt_ms
+                   : (uint32_t)((int32_t)b->srtt_ms + ((int32_t)rtt_ms - (int32_t)b->srtt_ms) / RTT_GAIN);
+    }
+    resize_batch(b, status, rtt_ms);
+
+    if (b->state == UPLINK_BREAKER_HALF_OPEN) {
+        b->probes++;
+    }
+    if (!failed(status)) {
+        b->state = UPLINK_BREAKER_CLOSED;
+        b->failures = 0;
+        b->backoff_ms = b->cfg.backoff_min_ms;
+        b->retry_at_us = 0;
+        return;
+    }
+
+    b->failures++;
+    if (b->state == UPLINK_BREAKER_HALF_OPEN || b->failures >= b->cfg.failure_threshold) {
+        open_breaker(b, now_us);
+    } else {
+        b->retry_at_us = now_us + (int64_t)b->cfg.backoff_min_ms * 1000;
+    }
+}
+
+void uplink_breaker_probe_now(uplink_breaker_t *b)
+{
+    b->retry_at_us = 0;
+}
+
+const char *uplink_breaker_state_name(uplink_breaker_state_t state)
+{
+    switch (state) {
+        case UPLINK_BREAKER_CLOSED:    return "closed";
+        case UPLINK_BREAKER_OPEN:      return "open";
+        case UPLINK_BREAKER_HALF_OPEN: return "half_open";
+        default:                       return "unknown";
+    }
+}
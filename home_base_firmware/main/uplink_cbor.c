@@ -0,0 +1,101 @@
+#include "uplink_cbor.h"
+#include <string.h>
+
+#define CBOR_UINT 0
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK 0xFF
+
+static void put_raw(uplink_cbor_writer_t *w, const void *data, size_t len)
+{
+    if (w->overflow || len > w->cap - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(&w->buf[w->len], data, len);
+    w->len += len;
+}
+
+// Major type and argument, in the fewest bytes that hold it
+static void put_head(uplink_cbor_writer_t *w, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t n;
+    if (value < 24) {
+        head[0] = (uint8_t)(major << 5 | value);
+        n = 1;
+    } else if (value <= 0xFF) {
+        head[0] = (uint8_t)(major << 5 | 24);
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = (uint8_t)(major << 5 | 25);
+        n = 3;
+    } else if (value <= 0xFFFFFFFF) {
+        head[0] = (uint8_t)(major << 5 | 26);
+        n = 5;
+    } else {
+        head[0] = (uint8_t)(major << 5 | 27);
+        n = 9;
+    }
+    // Big-endian argument after the initial byte
+    for (size_t i = 1; i < n; i++) {
+        head[i] = (uint8_t)(value >> (8 * (n - 1 - i)));
+    }
+    put_raw(w, head, n);
+}
+
+void uplink_cbor_init(uplink_cbor_writer_t *w, void *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+}
+
+void uplink_cbor_put_uint(uplink_cbor_writer_t *w, uint64_t value)
+{
+    put_head(w, CBOR_UINT, value);
+}
+
+void uplink_cbor_put_text(uplink_cbor_writer_t *w, const char *text, size_t len)
+{
+    put_head(w, CBOR_TEXT, len);
+    put_raw(w, text, len);
+}
+
+void uplink_cbor_put_bytes(uplink_cbor_writer_t *w, const void *data, size_t len)
+{
+    put_head(w, CBOR_BYTES, len);
+    put_raw(w, data, len);
+}
+
+void uplink_cbor_put_array(uplink_cbor_writer_t *w, size_t count)
+{
+    put_head(w, CBOR_ARRAY, count);
+}
+
+void uplink_cbor_put_map(uplink_cbor_writer_t *w, size_t count)
+{
+    put_head(w, CBOR_MAP, count);
+}
+
+void uplink_cbor_put_indefinite_array(uplink_cbor_writer_t *w)
+{
+    uint8_t head = CBOR_ARRAY << 5 | CBOR_INDEFINITE;
+    put_raw(w, &head, 1);
+}
+
+void uplink_cbor_put_break(uplink_cbor_writer_t *w)
+{
+    uint8_t brk = CBOR_BREAK;
+    put_raw(w, &brk, 1);
+}
+
+size_t uplink_cbor_string_size(size_t len)
+{
+    size_t head = len < 24 ? 1 : len <= 0xFF ? 2 : len <= 0xFFFF ? 3 : 5;
+    return head + len;
+}
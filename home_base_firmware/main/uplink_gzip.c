@@ -0,0 +1,428 @@
+#include "uplink_gzip.h"
+#include <string.h>
+#include <stdbool.h>
+#include "esp_rom_crc.h"
+
+#define GZ_HASH_BITS 12
+#define GZ_HASH_SIZE (1 << GZ_HASH_BITS)
+#define GZ_WINDOW 8192             // Longest match distance; s_prev is indexed modulo this
+#define GZ_MIN_MATCH 3
+#define GZ_MAX_MATCH 258
+#define GZ_MAX_CHAIN 32            // Candidates tried per position
+#define GZ_GOOD_MATCH 32           // Stop searching once a match is this long
+
+#define GZ_LITLEN_CODES 286
+#define GZ_DIST_CODES 30
+#define GZ_CL_CODES 19
+#define GZ_MAX_BITS 15
+#define GZ_CL_MAX_BITS 7
+#define GZ_END_OF_BLOCK 256
+
+static const uint16_t s_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t s_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t s_dist_base[GZ_DIST_CODES] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t s_dist_extra[GZ_DIST_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+// Order the code length code lengths are sent in (RFC 1951 3.2.7)
+static const uint8_t s_cl_order[GZ_CL_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// Match finder: position + 1 of the latest and previous occurrences of
+// each 3-byte hash, 0 for none
+static uint16_t s_head[GZ_HASH_SIZE];
+static uint16_t s_prev[GZ_WINDOW];
+
+typedef struct {
+    uint8_t *out;
+    size_t cap;
+    size_t len;
+    uint32_t bits;
+    int count;
+    bool overflow;
+} gz_writer_t;
+
+typedef struct {
+    gz_writer_t *w;                          // NULL on the counting pass
+    uint32_t lit_freq[GZ_LITLEN_CODES];
+    uint32_t dist_freq[GZ_DIST_CODES];
+    uint8_t lit_len[GZ_LITLEN_CODES];
+    uint8_t dist_len[GZ_DIST_CODES];
+    uint16_t lit_code[GZ_LITLEN_CODES];
+    uint16_t dist_code[GZ_DIST_CODES];
+} gz_block_t;
+
+static void put_bits(gz_writer_t *w, uint32_t value, int n)
+{
+    w->bits |= value << w->count;
+    w->count += n;
+    while (w->count >= 8) {
+        if (w->len < w->cap) {
+            w->out[w->len++] = (uint8_t)w->bits;
+        } else {
+            w->overflow = true;
+        }
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+static void put_byte(gz_writer_t *w, uint8_t byte)
+{
+    put_bits(w, byte, 8);
+}
+
+static void put_le32(gz_writer_t *w, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        put_byte(w, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static int code_index(const uint16_t *base, int count, uint32_t value)
+{
+    int i = count - 1;
+    while (base[i] > value) {
+        i--;
+    }
+    return i;
+}
+
+static void emit_literal(gz_block_t *blk, uint8_t c)
+{
+    if (!blk->w) {
+        blk->lit_freq[c]++;
+        return;
+    }
+    put_bits(blk->w, blk->lit_code[c], blk->lit_len[c]);
+}
+
+static void emit_match(gz_block_t *blk, uint32_t len, uint32_t dist)
+{
+    int lc = code_index(s_len_base, 29, len);
+    int dc = code_index(s_dist_base, GZ_DIST_CODES, dist);
+    if (!blk->w) {
+        blk->lit_freq[257 + lc]++;
+        blk->dist_freq[dc]++;
+        return;
+    }
+    put_bits(blk->w, blk->lit_code[257 + lc], blk->lit_len[257 + lc]);
+    put_bits(blk->w, len - s_len_base[lc], s_len_extra[lc]);
+    put_bits(blk->w, blk->dist_code[dc], blk->dist_len[dc]);
+    put_bits(blk->w, dist - s_dist_base[dc], s_dist_extra[dc]);
+}
+
+static inline uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - GZ_HASH_BITS);
+}
+
+static inline void insert(const uint8_t *in, size_t len, size_t pos)
+{
+    if (pos + GZ_MIN_MATCH <= len) {
+        uint32_t h = hash3(&in[pos]);
+        s_prev[pos % GZ_WINDOW] = s_head[h];
+        s_head[h] = (uint16_t)(pos + 1);
+    }
+}
+
+// Greedy LZ77 over the whole input; the same matches come out on both passes
+static void lz_scan(gz_block_t *blk, const uint8_t *in, size_t len)
+{
+    memset(s_head, 0, sizeof(s_head));
+    memset(s_prev, 0, sizeof(s_prev));
+
+    size_t pos = 0;
+    while (pos < len) {
+        uint32_t best_len = 0, best_dist = 0;
+        if (pos + GZ_MIN_MATCH <= len) {
+            uint32_t limit = len - pos < GZ_MAX_MATCH ? (uint32_t)(len - pos) : GZ_MAX_MATCH;
+            uint32_t cand = s_head[hash3(&in[pos])];
+            for (int chain = 0; cand && chain < GZ_MAX_CHAIN; chain++) {
+                size_t at = cand - 1;
+                if (at >= pos || pos - at >= GZ_WINDOW) {
+                    break;   // Slot reused by a newer position
+                }
+                if (in[at + best_len] == in[pos + best_len] && in[at] == in[pos]) {
+                    uint32_t n = 0;
+                    while (n < limit && in[at + n] == in[pos + n]) {
+                        n++;
+                    }
+                    if (n > best_len) {
+                        best_len = n;
+                        best_dist = (uint32_t)(pos - at);
+                        if (n >= GZ_GOOD_MATCH || n == limit) {
+                            break;
+                        }
+                    }
+                }
+                cand = s_prev[at % GZ_WINDOW];
+            }
+        }
+
+        if (best_len >= GZ_MIN_MATCH) {
+            emit_match(blk, best_len, best_dist);
+            for (uint32_t i = 0; i < best_len; i++) {
+                insert(in, len, pos + i);
+            }
+            pos += best_len;
+        } else {
+            emit_literal(blk, in[pos]);
+            insert(in, len, pos);
+            pos++;
+        }
+    }
+}
+
+// Huffman code lengths no longer than max_bits. Frequencies are halved and
+// the tree rebuilt until it fits, which only happens on skewed inputs.
+static void build_lengths(const uint32_t *freq, int n, int max_bits, uint8_t *lengths)
+{
+    uint16_t sym[GZ_LITLEN_CODES];
+    uint32_t weight[2 * GZ_LITLEN_CODES];
+    int16_t parent[2 * GZ_LITLEN_CODES];
+    uint32_t f[GZ_LITLEN_CODES];
+
+    memcpy(f, freq, n * sizeof(f[0]));
+    while (1) {
+        memset(lengths, 0, n);
+
+        // Used symbols sorted by frequency
+        int leaves = 0;
+        for (int i = 0; i < n; i++) {
+            if (f[i] == 0) {
+                continue;
+            }
+            int j = leaves++;
+            while (j > 0 && f[sym[j - 1]] > f[i]) {
+                sym[j] = sym[j - 1];
+                j--;
+            }
+            sym[j] = (uint16_t)i;
+        }
+        if (leaves == 0) {
+            return;
+        }
+        if (leaves == 1) {
+            lengths[sym[0]] = 1;
+            return;
+        }
+
+        // Two-queue construction: leaves in order, then internal nodes in
+        // creation order, which is also weight order
+        for (int i = 0; i < leaves; i++) {
+            weight[i] = f[sym[i]];
+        }
+        int next_leaf = 0, next_node = leaves, nodes = leaves;
+        while (nodes < 2 * leaves - 1) {
+            int pick[2];
+            for (int k = 0; k < 2; k++) {
+                if (next_leaf < leaves && (next_node >= nodes || weight[next_leaf] <= weight[next_node])) {
+                    pick[k] = next_leaf++;
+                } else {
+                    pick[k] = next_node++;
+                }
+            }
+            weight[nodes] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = (int16_t)nodes;
+            nodes++;
+        }
+        parent[nodes - 1] = -1;
+
+        int longest = 0;
+        for (int i = 0; i < leaves; i++) {
+            int depth = 0;
+            for (int node = i; parent[node] >= 0; node = parent[node]) {
+                depth++;
+            }
+            lengths[sym[i]] = (uint8_t)depth;
+            longest = depth > longest ? depth : longest;
+        }
+        if (longest <= max_bits) {
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            f[i] = f[i] ? (f[i] + 1) / 2 : 0;
+        }
+    }
+}
+
+// Canonical codes, bit-reversed because deflate sends them MSB first
+static void build_codes(const uint8_t *lengths, int n, uint16_t *codes)
+{
+    uint16_t bl_count[GZ_MAX_BITS + 1] = {0};
+    uint16_t next[GZ_MAX_BITS + 1];
+    for (int i = 0; i < n; i++) {
+        bl_count[lengths[i]]++;
+    }
+    bl_count[0] = 0;
+
+    uint16_t code = 0;
+    for (int bits = 1; bits <= GZ_MAX_BITS; bits++) {
+        code = (uint16_t)((code + bl_count[bits - 1]) << 1);
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (len == 0) {
+            continue;
+        }
+        uint16_t c = next[len]++, r = 0;
+        for (int b = 0; b < len; b++) {
+            r = (uint16_t)((r << 1) | ((c >> b) & 1));
+        }
+        codes[i] = r;
+    }
+}
+
+// Dynamic block header: both code length tables, run-length encoded with
+// symbols 16 (repeat previous), 17 and 18 (runs of zeros)
+static void write_tables(gz_writer_t *w, const gz_block_t *blk)
+{
+    int hlit = GZ_LITLEN_CODES, hdist = GZ_DIST_CODES;
+    while (hlit > 257 && blk->lit_len[hlit - 1] == 0) {
+        hlit--;
+    }
+    while (hdist > 1 && blk->dist_len[hdist - 1] == 0) {
+        hdist--;
+    }
+
+    uint8_t all[GZ_LITLEN_CODES + GZ_DIST_CODES];
+    memcpy(all, blk->lit_len, hlit);
+    memcpy(all + hlit, blk->dist_len, hdist);
+    int total = hlit + hdist;
+
+    uint8_t rle_sym[GZ_LITLEN_CODES + GZ_DIST_CODES];
+    uint8_t rle_extra[GZ_LITLEN_CODES + GZ_DIST_CODES];
+    uint32_t cl_freq[GZ_CL_CODES] = {0};
+    int rle = 0;
+    for (int i = 0; i < total; ) {
+        int run = 1;
+        while (i + run < total && all[i + run] == all[i]) {
+            run++;
+        }
+        if (all[i] == 0 && run >= 11) {
+            run = run > 138 ? 138 : run;
+            rle_sym[rle] = 18;
+            rle_extra[rle++] = (uint8_t)(run - 11);
+        } else if (all[i] == 0 && run >= 3) {
+            rle_sym[rle] = 17;
+            rle_extra[rle++] = (uint8_t)(run - 3);
+        } else if (all[i] != 0 && run >= 4) {
+            // The length itself, then repeats of it
+            run = run > 7 ? 7 : run;
+            rle_sym[rle] = all[i];
+            rle_extra[rle++] = 0;
+            rle_sym[rle] = 16;
+            rle_extra[rle++] = (uint8_t)(run - 4);
+        } else {
+            run = 1;
+            rle_sym[rle] = all[i];
+            rle_extra[rle++] = 0;
+        }
+        i += run;
+    }
+    for (int i = 0; i < rle; i++) {
+        cl_freq[rle_sym[i]]++;
+    }
+
+    // Keep the code length code complete even if only one symbol is used
+    int used = 0;
+    for (int i = 0; i < GZ_CL_CODES; i++) {
+        used += cl_freq[i] ? 1 : 0;
+    }
+    for (int i = 0; used < 2; i++) {
+        if (!cl_freq[i]) {
+            cl_freq[i] = 1;
+            used++;
+        }
+    }
+
+    uint8_t cl_len[GZ_CL_CODES];
+    uint16_t cl_code[GZ_CL_CODES];
+    build_lengths(cl_freq, GZ_CL_CODES, GZ_CL_MAX_BITS, cl_len);
+    build_codes(cl_len, GZ_CL_CODES, cl_code);
+
+    int hclen = GZ_CL_CODES;
+    while (hclen > 4 && cl_len[s_cl_order[hclen - 1]] == 0) {
+        hclen--;
+    }
+
+    put_bits(w, hlit - 257, 5);
+    put_bits(w, hdist - 1, 5);
+    put_bits(w, hclen - 4, 4);
+    for (int i = 0; i < hclen; i++) {
+        put_bits(w, cl_len[s_cl_order[i]], 3);
+    }
+    for (int i = 0; i < rle; i++) {
+        uint8_t s = rle_sym[i];
+        put_bits(w, cl_code[s], cl_len[s]);
+        if (s == 16) {
+            put_bits(w, rle_extra[i], 2);
+        } else if (s == 17) {
+            put_bits(w, rle_extra[i], 3);
+        } else if (s == 18) {
+            put_bits(w, rle_extra[i], 7);
+        }
+    }
+}
+
+size_t uplink_gzip(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap)
+{
+    if (len == 0 || len > UPLINK_GZIP_MAX_INPUT) {
+        return 0;
+    }
+
+    // Pass 1: symbol frequencies
+    static gz_block_t blk;
+    memset(&blk, 0, sizeof(blk));
+    lz_scan(&blk, in, len);
+    blk.lit_freq[GZ_END_OF_BLOCK] = 1;
+
+    // At least two distance codes keep the tree complete for strict decoders
+    for (int i = 0, used = 0; i < GZ_DIST_CODES && used < 2; i++) {
+        if (!blk.dist_freq[i]) {
+            blk.dist_freq[i] = 1;
+        }
+        used++;
+    }
+
+    build_lengths(blk.lit_freq, GZ_LITLEN_CODES, GZ_MAX_BITS, blk.lit_len);
+    build_lengths(blk.dist_freq, GZ_DIST_CODES, GZ_MAX_BITS, blk.dist_len);
+    build_codes(blk.lit_len, GZ_LITLEN_CODES, blk.lit_code);
+    build_codes(blk.dist_len, GZ_DIST_CODES, blk.dist_code);
+
+    // Pass 2: gzip header (no name, no mtime, unknown OS), one final
+    // dynamic block, CRC-32 and length
+    gz_writer_t w = {.out = out, .cap = out_cap};
+    static const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for (int i = 0; i < 10; i++) {
+        put_byte(&w, header[i]);
+    }
+    put_bits(&w, 1, 1);   // BFINAL
+    put_bits(&w, 2, 2);   // BTYPE: dynamic Huffman
+    write_tables(&w, &blk);
+
+    blk.w = &w;
+    lz_scan(&blk, in, len);
+    put_bits(&w, blk.lit_code[GZ_END_OF_BLOCK], blk.lit_len[GZ_END_OF_BLOCK]);
+    if (w.count > 0) {
+        put_bits(&w, 0, 8 - w.count);   // Pad to a byte boundary
+    }
+
+    put_le32(&w, esp_rom_crc32_le(0, in, (uint32_t)len));
+    put_le32(&w, (uint32_t)len);
+    return w.overflow ? 0 : w.len;
+}
@@ -0,0 +1,385 @@
+#include "uplink_spool.h"
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "uplink_spool";
+
+#ifdef CONFIG_UNRAID_SPOOL_SEGMENT_KB
+    #define SPOOL_SEGMENT_SIZE (CONFIG_UNRAID_SPOOL_SEGMENT_KB * 1024)
+#else
+    #define SPOOL_SEGMENT_SIZE (64 * 1024)
+#endif
+
+#define SPOOL_MAX_SEGMENTS 256
+#define SPOOL_SEG_MAGIC 0x4C4F5053   // "SPOL"
+#define SPOOL_REC_MAGIC 0x5053       // "SP"
+#define SPOOL_PENDING 0xFFFFFFFF     // Record state as written (erased flash)
+#define SPOOL_DELIVERED 0x00000000   // Programmed over it once delivered
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;            // One more than the segment opened before it
+    uint32_t erases;         // Times this segment has been erased
+    uint32_t crc;            // Over the fields above
+} spool_seg_hdr_t;
+
+typedef struct {
+    uint32_t state;          // SPOOL_PENDING until delivered; not in the CRC
+    uint16_t magic;
+    uint16_t len;            // Payload bytes following the header
+    uint32_t entries;        // Log entries in the payload
+    uint32_t written;        // Wall clock (s) when spooled
+    uint32_t crc;            // Over magic..written and the payload
+} spool_rec_hdr_t;
+
+typedef struct {
+    uint32_t seq;            // 0: erased or never formatted
+    uint32_t erases;
+    uint32_t records;        // Pending records in this segment
+    uint32_t entries;
+    uint32_t bytes;
+} spool_segment_t;
+
+static const esp_partition_t *s_part = NULL;
+static spool_segment_t s_segs[SPOOL_MAX_SEGMENTS];
+static uint32_t s_seg_count = 0;
+static uint32_t s_next_seq = 1;
+static uint32_t s_head_seg, s_head_off;   // Oldest pending record, or the tail if none
+static uint32_t s_tail_seg, s_tail_off;   // Where the next record goes
+static uint32_t s_oldest_written = 0;
+static uplink_spool_stats_t s_stats;
+
+static inline size_t seg_addr(uint32_t seg)
+{
+    return (size_t)seg * SPOOL_SEGMENT_SIZE;
+}
+
+static inline uint32_t record_size(size_t len)
+{
+    return sizeof(spool_rec_hdr_t) + (((uint32_t)len + 3) & ~3u);
+}
+
+static uint32_t seg_header_crc(const spool_seg_hdr_t *hdr)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)hdr, offsetof(spool_seg_hdr_t, crc));
+}
+
+static uint32_t record_crc(const spool_rec_hdr_t *hdr, const void *payload, size_t len)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->magic,
+                                    offsetof(spool_rec_hdr_t, crc) - offsetof(spool_rec_hdr_t, magic));
+    return esp_rom_crc32_le(crc, payload, len);
+}
+
+// Read a record header; false where the segment's records end
+static bool read_header(uint32_t seg, uint32_t off, spool_rec_hdr_t *hdr)
+{
+    if (off + sizeof(*hdr) > SPOOL_SEGMENT_SIZE ||
+        esp_partition_read(s_part, seg_addr(seg) + off, hdr, sizeof(*hdr)) != ESP_OK) {
+        return false;
+    }
+    return hdr->magic == SPOOL_REC_MAGIC && hdr->len > 0 && off + record_size(hdr->len) <= SPOOL_SEGMENT_SIZE;
+}
+
+// Check a record's CRC against the payload in flash
+static bool check_record(uint32_t seg, uint32_t off, const spool_rec_hdr_t *hdr)
+{
+    uint8_t chunk[128];
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->magic,
+                                    offsetof(spool_rec_hdr_t, crc) - offsetof(spool_rec_hdr_t, magic));
+    size_t addr = seg_addr(seg) + off + sizeof(*hdr);
+    for (size_t done = 0; done < hdr->len; ) {
+        size_t n = hdr->len - done < sizeof(chunk) ? hdr->len - done : sizeof(chunk);
+        if (esp_partition_read(s_part, addr + done, chunk, n) != ESP_OK) {
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, chunk, n);
+        done += n;
+    }
+    return crc == hdr->crc;
+}
+
+static void count_pending(uint32_t seg, const spool_rec_hdr_t *hdr, int sign)
+{
+    s_segs[seg].records += sign;
+    s_segs[seg].entries += sign * (int32_t)hdr->entries;
+    s_segs[seg].bytes += sign * (int32_t)hdr->len;
+    s_stats.records += sign;
+    s_stats.entries += sign * (int32_t)hdr->entries;
+    s_stats.bytes += sign * (int32_t)hdr->len;
+}
+
+// Move the head forward to the next pending record, skipping delivered
+// records and segments with nothing pending, stopping at the tail
+static void seek_head(void)
+{
+    spool_rec_hdr_t hdr;
+    while (s_head_seg != s_tail_seg || s_head_off < s_tail_off) {
+        if (s_segs[s_head_seg].records && read_header(s_head_seg, s_head_off, &hdr)) {
+            if (hdr.state == SPOOL_PENDING) {
+                s_oldest_written = hdr.written;
+                return;
+            }
+            s_head_off += record_size(hdr.len);
+        } else {
+            s_head_seg = (s_head_seg + 1) % s_seg_count;
+            s_head_off = sizeof(spool_seg_hdr_t);
+        }
+    }
+    s_head_off = s_tail_off;
+    s_oldest_written = 0;
+}
+
+// Erase a segment and start appending to it. Pending records still in it
+// are lost: the spool has wrapped onto its oldest data.
+static esp_err_t open_segment(uint32_t seg)
+{
+    spool_segment_t *segment = &s_segs[seg];
+    if (segment->records) {
+        ESP_LOGW(TAG, "Spool full, dropping %lu oldest batches", (unsigned long)segment->records);
+        s_stats.lost += segment->records;
+        s_stats.records -= segment->records;
+        s_stats.entries -= segment->entries;
+        s_stats.bytes -= segment->bytes;
+    }
+    if (s_head_seg == seg) {
+        s_head_seg = (seg + 1) % s_seg_count;
+        s_head_off = sizeof(spool_seg_hdr_t);
+    }
+
+    spool_seg_hdr_t hdr = {
+        .magic = SPOOL_SEG_MAGIC,
+        .seq = s_next_seq++,
+        .erases = segment->erases + 1,
+    };
+    hdr.crc = seg_header_crc(&hdr);
+    *segment = (spool_segment_t){.seq = hdr.seq, .erases = hdr.erases};
+
+    s_tail_seg = seg;
+    s_tail_off = sizeof(spool_seg_hdr_t);
+    esp_err_t err = esp_partition_erase_range(s_part, seg_addr(seg), SPOOL_SEGMENT_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, seg_addr(seg), &hdr, sizeof(hdr));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open segment %lu: %s", (unsigned long)seg, esp_err_to_name(err));
+        s_tail_off = SPOOL_SEGMENT_SIZE;   // Next append tries the one after
+    }
+    seek_head();
+    return err;
+}
+
+// Count the pending records of a segment found at boot
+static void recover_segment(uint32_t seg)
+{
+    spool_rec_hdr_t hdr;
+    uint32_t off = sizeof(spool_seg_hdr_t);
+    while (read_header(seg, off, &hdr)) {
+        if (!check_record(seg, off, &hdr)) {
+            // Torn write or worn flash: nothing after it is trusted
+            s_stats.corrupt++;
+            break;
+        }
+        if (hdr.state == SPOOL_PENDING) {
+            count_pending(seg, &hdr, 1);
+            s_stats.recovered++;
+        }
+        off += record_size(hdr.len);
+    }
+}
+
+esp_err_t uplink_spool_init(void)
+{
+    s_part = NULL;
+    memset(s_segs, 0, sizeof(s_segs));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_oldest_written = 0;
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, UPLINK_SPOOL_PARTITION_SUBTYPE,
+                                                           UPLINK_SPOOL_PARTITION_LABEL);
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t count = part->size / SPOOL_SEGMENT_SIZE;
+    if (count < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_part = part;
+    s_seg_count = count < SPOOL_MAX_SEGMENTS ? count : SPOOL_MAX_SEGMENTS;
+
+    // Segments were opened in ring order with consecutive sequence numbers,
+    // so the lowest valid one holds the oldest records
+    uint32_t oldest = 0, newest = 0;
+    bool any = false;
+    for (uint32_t seg = 0; seg < s_seg_count; seg++) {
+        spool_seg_hdr_t hdr;
+        if (esp_partition_read(s_part, seg_addr(seg), &hdr, sizeof(hdr)) != ESP_OK ||
+            hdr.magic != SPOOL_SEG_MAGIC || hdr.crc != seg_header_crc(&hdr) || hdr.seq == 0) {
+            continue;
+        }
+        s_segs[seg].seq = hdr.seq;
+        s_segs[seg].erases = hdr.erases;
+        if (!any || (int32_t)(hdr.seq - s_segs[oldest].seq) < 0) {
+            oldest = seg;
+        }
+        if (!any || (int32_t)(hdr.seq - s_segs[newest].seq) > 0) {
+            newest = seg;
+        }
+        any = true;
+    }
+
+    if (any) {
+        for (uint32_t i = 0; i < s_seg_count; i++) {
+            uint32_t seg = (oldest + i) % s_seg_count;
+            if (s_segs[seg].seq) {
+                recover_segment(seg);
+            }
+        }
+        s_next_seq = s_segs[newest].seq + 1;
+    } else {
+        s_next_seq = 1;
+    }
+
+    // Appends resume in a fresh segment after the newest one
+    s_head_seg = oldest;
+    s_head_off = sizeof(spool_seg_hdr_t);
+    s_tail_seg = s_head_seg;
+    s_tail_off = SPOOL_SEGMENT_SIZE;
+    esp_err_t err = open_segment(any ? (newest + 1) % s_seg_count : 0);
+
+    ESP_LOGI(TAG, "Spool: %lu segments of %u KB, %lu batches pending", (unsigned long)s_seg_count,
+             SPOOL_SEGMENT_SIZE / 1024, (unsigned long)s_stats.records);
+    return err;
+}
+
+esp_err_t uplink_spool_append(const void *data, size_t len, uint32_t entries)
+{
+    if (!s_part) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len == 0 || len > UINT16_MAX || record_size(len) > SPOOL_SEGMENT_SIZE - sizeof(spool_seg_hdr_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (s_tail_off + record_size(len) > SPOOL_SEGMENT_SIZE) {
+        esp_err_t err = open_segment((s_tail_seg + 1) % s_seg_count);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    spool_rec_hdr_t hdr = {
+        .state = SPOOL_PENDING,
+        .magic = SPOOL_REC_MAGIC,
+        .len = (uint16_t)len,
+        .entries = entries,
+        .written = (uint32_t)time(NULL),
+    };
+    hdr.crc = record_crc(&hdr, data, len);
+
+    // Payload first, so a header in flash always has its payload behind it
+    size_t addr = seg_addr(s_tail_seg) + s_tail_off;
+    esp_err_t err = esp_partition_write(s_part, addr + sizeof(hdr), data, len);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, addr, &hdr, sizeof(hdr));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Spool write failed: %s", esp_err_to_name(err));
+        s_tail_off = SPOOL_SEGMENT_SIZE;   // Leave the damaged spot behind
+        return err;
+    }
+
+    if (s_stats.records == 0) {
+        s_head_seg = s_tail_seg;
+        s_head_off = s_tail_off;
+        s_oldest_written = hdr.written;
+    }
+    s_tail_off += record_size(len);
+    count_pending(s_tail_seg, &hdr, 1);
+    s_stats.appended++;
+    return ESP_OK;
+}
+
+// Mark the head record done and move on to the next pending one
+static esp_err_t retire_head(const spool_rec_hdr_t *hdr)
+{
+    const uint32_t delivered = SPOOL_DELIVERED;
+    esp_err_t err = esp_partition_write(s_part, seg_addr(s_head_seg) + s_head_off, &delivered, sizeof(delivered));
+    count_pending(s_head_seg, hdr, -1);
+    s_head_off += record_size(hdr->len);
+    seek_head();
+    return err;
+}
+
+esp_err_t uplink_spool_peek(void *buf, size_t cap, size_t *len, uint32_t *entries)
+{
+    spool_rec_hdr_t hdr;
+    while (s_part && s_stats.records) {
+        if (!read_header(s_head_seg, s_head_off, &hdr)) {
+            return ESP_FAIL;
+        }
+        if (hdr.len > cap) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        esp_err_t err = esp_partition_read(s_part, seg_addr(s_head_seg) + s_head_off + sizeof(hdr), buf, hdr.len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (record_crc(&hdr, buf, hdr.len) == hdr.crc) {
+            *len = hdr.len;
+            *entries = hdr.entries;
+            return ESP_OK;
+        }
+
+        // Went bad in flash since it was written: skip it
+        ESP_LOGW(TAG, "Spooled batch failed its CRC, skipping");
+        s_stats.corrupt++;
+        retire_head(&hdr);
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t uplink_spool_pop(void)
+{
+    spool_rec_hdr_t hdr;
+    if (!s_part || !s_stats.records || !read_header(s_head_seg, s_head_off, &hdr)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_stats.delivered++;
+    return retire_head(&hdr);
+}
+
+uint64_t uplink_spool_head(void)
+{
+    // Segment sequence numbers are never reused, so this never repeats
+    return s_part ? ((uint64_t)s_segs[s_head_seg].seq << 32) | s_head_off : 0;
+}
+
+uint32_t uplink_spool_pending(void)
+{
+    return s_part ? s_stats.records : 0;
+}
+
+void uplink_spool_get_stats(uplink_spool_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->segments = s_part ? s_seg_count : 0;
+    stats->segment_size = SPOOL_SEGMENT_SIZE;
+
+    uint32_t now = (uint32_t)time(NULL);
+    stats->oldest_age_s = s_stats.records && now > s_oldest_written ? now - s_oldest_written : 0;
+
+    stats->min_erases = UINT32_MAX;
+    stats->max_erases = 0;
+    for (uint32_t seg = 0; seg < stats->segments; seg++) {
+        stats->min_erases = s_segs[seg].erases < stats->min_erases ? s_segs[seg].erases : stats->min_erases;
+        stats->max_erases = s_segs[seg].erases > stats->max_erases ? s_segs[seg].erases : stats->max_erases;
+    }
+    if (stats->min_erases == UINT32_MAX) {
+        stats->min_erases = 0;
+    }
+}
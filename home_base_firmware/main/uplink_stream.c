@@ -0,0 +1,182 @@
+#include "uplink_stream.h"
+#include <string.h>
+
+// Ring record: header, then the body padded to keep headers aligned
+typedef struct {
+    uint32_t seq;
+    uint32_t len;
+    uint32_t entries;
+    uint32_t reserved;
+    int64_t pushed_us;
+} record_t;
+
+#define RECORD_ALIGN 8
+
+static inline size_t record_size(size_t len)
+{
+    return sizeof(record_t) + ((len + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1));
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// Where a record of `need` bytes would go, or -1 if it does not fit
+static long record_place(const uplink_stream_t *s, size_t need, bool *wraps)
+{
+    *wraps = false;
+    if (s->in_flight == 0) {
+        return need <= s->size ? 0 : -1;
+    }
+    if (s->tail > s->head) {
+        if (need <= s->size - s->tail) {
+            return (long)s->tail;
+        }
+        *wraps = true;
+        return need <= s->head ? 0 : -1;
+    }
+    // Wrapped: free space runs from tail up to head
+    return need <= s->head - s->tail ? (long)s->tail : -1;
+}
+
+void uplink_stream_init(uplink_stream_t *s, void *buf, size_t size)
+{
+    memset(s, 0, sizeof(*s));
+    s->buf = buf;
+    s->size = size & ~(size_t)(RECORD_ALIGN - 1);
+    s->wrap_at = s->size;
+}
+
+void uplink_stream_disconnected(uplink_stream_t *s)
+{
+    s->window = 0;
+}
+
+bool uplink_stream_can_push(const uplink_stream_t *s, size_t len)
+{
+    bool wraps;
+    return s->in_flight < s->window && record_place(s, record_size(len), &wraps) >= 0;
+}
+
+esp_err_t uplink_stream_push(uplink_stream_t *s, const void *body, size_t len, uint32_t entries,
+                             int64_t now_us, uint32_t *seq)
+{
+    bool wraps;
+    size_t need = record_size(len);
+    long at = s->in_flight < s->window ? record_place(s, need, &wraps) : -1;
+    if (at < 0) {
+        s->stalls++;
+        return ESP_ERR_NO_MEM;
+    }
+    if (s->in_flight == 0) {
+        s->head = 0;
+        s->wrap_at = s->size;
+    } else if (wraps) {
+        s->wrap_at = s->tail;
+    }
+
+    record_t rec = {.seq = s->next_seq++, .len = (uint32_t)len, .entries = entries, .pushed_us = now_us};
+    memcpy(&s->buf[at], &rec, sizeof(rec));
+    memcpy(&s->buf[at + sizeof(rec)], body, len);
+    s->tail = (size_t)at + need;
+    s->in_flight++;
+    s->frames++;
+    s->bytes += (uint32_t)len;
+    *seq = rec.seq;
+    return ESP_OK;
+}
+
+size_t uplink_stream_frame_header(uint8_t *out, uint32_t seq, bool gzip)
+{
+    out[0] = UPLINK_STREAM_FRAME_BATCH;
+    out[1] = gzip ? UPLINK_STREAM_FLAG_GZIP : 0;
+    out[2] = (uint8_t)(seq >> 24);
+    out[3] = (uint8_t)(seq >> 16);
+    out[4] = (uint8_t)(seq >> 8);
+    out[5] = (uint8_t)seq;
+    return UPLINK_STREAM_HEADER;
+}
+
+esp_err_t uplink_stream_receive(uplink_stream_t *s, const uint8_t *data, size_t len, uplink_stream_ack_t *ack)
+{
+    memset(ack, 0, sizeof(*ack));
+    if (len < 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ack->type = data[0];
+    if (ack->type == UPLINK_STREAM_FRAME_WINDOW) {
+        if (len < 3) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        ack->window = get_be16(&data[1]);
+        s->window = ack->window;
+        return ESP_OK;
+    }
+    if (ack->type != UPLINK_STREAM_FRAME_ACK) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (len < 9) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ack->seq = get_be32(&data[1]);
+    ack->status = get_be16(&data[5]);
+    ack->window = get_be16(&data[7]);
+    record_t rec;
+    if (s->in_flight == 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    memcpy(&rec, &s->buf[s->head], sizeof(rec));
+    if (rec.seq != ack->seq) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    ack->entries = rec.entries;
+    ack->pushed_us = rec.pushed_us;
+    s->window = ack->window;
+    s->acked++;
+    return ESP_OK;
+}
+
+const void *uplink_stream_oldest(const uplink_stream_t *s, size_t *len, uint32_t *entries, uint32_t *seq)
+{
+    if (s->in_flight == 0) {
+        return NULL;
+    }
+    record_t rec;
+    memcpy(&rec, &s->buf[s->head], sizeof(rec));
+    if (len) {
+        *len = rec.len;
+    }
+    if (entries) {
+        *entries = rec.entries;
+    }
+    if (seq) {
+        *seq = rec.seq;
+    }
+    return &s->buf[s->head + sizeof(rec)];
+}
+
+void uplink_stream_drop_oldest(uplink_stream_t *s)
+{
+    if (s->in_flight == 0) {
+        return;
+    }
+    record_t rec;
+    memcpy(&rec, &s->buf[s->head], sizeof(rec));
+    s->head += record_size(rec.len);
+    if (s->head == s->wrap_at) {
+        s->head = 0;
+        s->wrap_at = s->size;
+    }
+    if (--s->in_flight == 0) {
+        s->head = 0;
+        s->tail = 0;
+        s->wrap_at = s->size;
+    }
+}
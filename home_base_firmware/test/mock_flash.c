@@ -0,0 +1,131 @@
+/*
+ * RAM-backed esp_partition for host tests (see mock_flash.h)
+ *
+ * Linked with -Wl,--wrap=esp_partition_* (test/CMakeLists.txt): the spool
+ * and log partitions are always served from RAM (missing while the mock is
+ * removed) so tests never touch their real contents; any other partition
+ * goes to the real esp_partition driver through __real_*.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "mock_flash.h"
+#include "uplink_spool.h"
+#include "log_journal.h"
+
+#define MOCK_SECTOR 4096
+
+static uint8_t *s_flash = NULL;
+static esp_partition_t s_part;
+static long s_fail_after = -1;
+static uint32_t s_erases = 0;
+
+static bool mock_owns(const char *label)
+{
+    return strcmp(label, UPLINK_SPOOL_PARTITION_LABEL) == 0 ||
+           strcmp(label, LOG_JOURNAL_PARTITION_LABEL) == 0 ||
+           strcmp(label, s_part.label) == 0;
+}
+
+void mock_flash_init(size_t size)
+{
+    free(s_flash);
+    s_flash = size ? malloc(size) : NULL;
+    if (s_flash) {
+        memset(s_flash, 0xFF, size);
+    }
+    memset(&s_part, 0, sizeof(s_part));
+    s_part.type = ESP_PARTITION_TYPE_DATA;
+    s_part.subtype = UPLINK_SPOOL_PARTITION_SUBTYPE;
+    s_part.size = size;
+    s_part.erase_size = MOCK_SECTOR;
+    strcpy(s_part.label, UPLINK_SPOOL_PARTITION_LABEL);
+    s_fail_after = -1;
+    s_erases = 0;
+}
+
+void mock_flash_set_partition(const char *label, uint8_t subtype)
+{
+    s_part.subtype = subtype;
+    strncpy(s_part.label, label, sizeof(s_part.label) - 1);
+}
+
+void mock_flash_fail_after(long n)
+{
+    s_fail_after = n;
+}
+
+void mock_flash_flip(size_t offset)
+{
+    s_flash[offset] ^= 0x01;
+}
+
+uint32_t mock_flash_erases(void)
+{
+    return s_erases;
+}
+
+const esp_partition_t *__real_esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                       const char *label);
+esp_err_t __real_esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size);
+esp_err_t __real_esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size);
+esp_err_t __real_esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size);
+
+const esp_partition_t *__wrap_esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                       const char *label)
+{
+    if (!label || !mock_owns(label)) {
+        return __real_esp_partition_find_first(type, subtype, label);
+    }
+    if (!s_flash || type != s_part.type || subtype != s_part.subtype || strcmp(label, s_part.label) != 0) {
+        return NULL;
+    }
+    return &s_part;
+}
+
+esp_err_t __wrap_esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (part != &s_part) {
+        return __real_esp_partition_read(part, offset, dst, size);
+    }
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t __wrap_esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (part != &s_part) {
+        return __real_esp_partition_write(part, offset, src, size);
+    }
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        if (s_fail_after == 0) {
+            return ESP_FAIL;
+        }
+        if (s_fail_after > 0) {
+            s_fail_after--;
+        }
+        s_flash[offset + i] &= bytes[i];   // Programming only clears bits
+    }
+    return ESP_OK;
+}
+
+esp_err_t __wrap_esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (part != &s_part) {
+        return __real_esp_partition_erase_range(part, offset, size);
+    }
+    if (offset % MOCK_SECTOR || size % MOCK_SECTOR || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(s_flash + offset, 0xFF, size);
+    s_erases += size / MOCK_SECTOR;
+    return ESP_OK;
+}
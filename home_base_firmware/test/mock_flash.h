@@ -0,0 +1,40 @@
+#ifndef MOCK_FLASH_H
+#define MOCK_FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * RAM-backed data partition (by default the "spool" one) for host tests of code using esp_partition.
+ * Writes can only clear bits and erases set whole 4 KB sectors back to 0xFF,
+ * as on NOR flash, so code that rewrites without erasing shows up as
+ * corrupt data.
+ */
+
+/**
+ * (Re)create the partition, erased; size 0 removes it
+ */
+void mock_flash_init(size_t size);
+
+/**
+ * Present the partition under another label and subtype
+ */
+void mock_flash_set_partition(const char *label, uint8_t subtype);
+
+/**
+ * Fail every write after the next n bytes, keeping the bytes written up to
+ * that point (a torn write at power loss); -1 to stop failing
+ */
+void mock_flash_fail_after(long n);
+
+/**
+ * Flip one bit in place, like a worn cell
+ */
+void mock_flash_flip(size_t offset);
+
+/**
+ * Sector erases since mock_flash_init
+ */
+uint32_t mock_flash_erases(void);
+
+#endif // MOCK_FLASH_H
@@ -0,0 +1,178 @@
+/*
+ * Tests for the in-memory device registry (device_registry.c)
+ *
+ * Validates per-device counters, heartbeat health parsing, RSSI tracking,
+ * offline detection, behaviour when the table is full and the JSON
+ * produced for /api/v1/devices.
+ *
+ * The [perf] case reports the cost of one update and of serializing a
+ * full registry.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "protocol.h"
+#include "device_registry.h"
+
+static void make_frame(mesh_rx_frame_t *frame, uint16_t device, uint8_t type, int8_t rssi)
+{
+    memset(frame, 0, sizeof(*frame));
+    uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x00, (uint8_t)(device >> 8), (uint8_t)device};
+    memcpy(frame->src_mac, mac, sizeof(mac));
+    frame->rssi = rssi;
+    frame->msg.type = type;
+    snprintf(frame->msg.device_id, sizeof(frame->msg.device_id), "ESP32-%u", device);
+    if (type == MSG_TYPE_HEARTBEAT) {
+        snprintf(frame->msg.payload, sizeof(frame->msg.payload), "{\"heap\":%lu,\"uptime\":%lu}",
+                 200000ul + device, 3600ul);
+    }
+}
+
+TEST_CASE("device_registry counts frames per device", "[registry]") {
+    device_registry_init();
+    mesh_rx_frame_t frame;
+
+    make_frame(&frame, 1, MSG_TYPE_HEARTBEAT, -50);
+    TEST_ASSERT_TRUE(device_registry_update(&frame));
+    make_frame(&frame, 1, MSG_TYPE_MOTION, -70);
+    TEST_ASSERT_TRUE(device_registry_update(&frame));
+    make_frame(&frame, 1, MSG_TYPE_LOG, -70);
+    TEST_ASSERT_TRUE(device_registry_update(&frame));
+    make_frame(&frame, 2, MSG_TYPE_LOG, -40);
+    TEST_ASSERT_TRUE(device_registry_update(&frame));
+
+    TEST_ASSERT_EQUAL(2, device_registry_count());
+
+    device_registry_entry_t entry;
+    TEST_ASSERT_TRUE(device_registry_find(frame.src_mac, &entry));
+    TEST_ASSERT_EQUAL_STRING("ESP32-2", entry.device_id);
+    TEST_ASSERT_EQUAL_UINT32(1, entry.logs);
+
+    make_frame(&frame, 1, MSG_TYPE_LOG, 0);
+    TEST_ASSERT_TRUE(device_registry_find(frame.src_mac, &entry));
+    TEST_ASSERT_EQUAL_UINT32(3, entry.frames);
+    TEST_ASSERT_EQUAL_UINT32(1, entry.heartbeats);
+    TEST_ASSERT_EQUAL_UINT32(1, entry.motion_events);
+    TEST_ASSERT_EQUAL_UINT32(200001, entry.heap);
+    TEST_ASSERT_EQUAL_UINT32(3600, entry.uptime);
+    TEST_ASSERT_EQUAL(-70, entry.rssi);
+    TEST_ASSERT_TRUE(entry.rssi_avg < -50 && entry.rssi_avg > -70);
+    TEST_ASSERT_TRUE(device_registry_is_online(&entry, entry.last_seen_ms + 1000));
+    TEST_ASSERT_FALSE(device_registry_is_online(&entry, entry.last_seen_ms + 3600 * 1000));
+}
+
+TEST_CASE("device_registry refuses new devices when full", "[registry]") {
+    device_registry_init();
+    mesh_rx_frame_t frame;
+
+    int accepted = 0;
+    for (int d = 0; d < 2048; d++) {
+        make_frame(&frame, (uint16_t)d, MSG_TYPE_LOG, -60);
+        accepted += device_registry_update(&frame) ? 1 : 0;
+    }
+
+    TEST_ASSERT_EQUAL(accepted, device_registry_count());
+    TEST_ASSERT_EQUAL_UINT32(2048 - accepted, device_registry_overflows());
+
+    // Known devices keep updating while full
+    make_frame(&frame, 0, MSG_TYPE_LOG, -60);
+    TEST_ASSERT_TRUE(device_registry_update(&frame));
+}
+
+TEST_CASE("device_registry reports silent devices offline once", "[registry]") {
+    device_registry_init();
+    mesh_rx_frame_t frame;
+    device_registry_entry_t entry;
+
+    make_frame(&frame, 4, MSG_TYPE_HEARTBEAT, -50);
+    device_registry_update(&frame);
+    TEST_ASSERT_TRUE(device_registry_find(frame.src_mac, &entry));
+    uint32_t heard_ms = entry.last_seen_ms;
+
+    TEST_ASSERT_FALSE(device_registry_poll_offline(heard_ms + 89 * 1000, &entry));
+
+    uint32_t now_ms = heard_ms + 92 * 1000;
+    TEST_ASSERT_TRUE(device_registry_poll_offline(now_ms, &entry));
+    TEST_ASSERT_EQUAL_STRING("ESP32-4", entry.device_id);
+    TEST_ASSERT_TRUE(entry.offline);
+    TEST_ASSERT_EQUAL_UINT32(1, entry.outages);
+    TEST_ASSERT_FALSE(device_registry_is_online(&entry, now_ms));
+    TEST_ASSERT_EQUAL(1, device_registry_offline_count());
+
+    // Only once per silence, and a new frame brings it back
+    TEST_ASSERT_FALSE(device_registry_poll_offline(now_ms + 1000, &entry));
+    make_frame(&frame, 4, MSG_TYPE_LOG, -50);
+    device_registry_update(&frame);
+    TEST_ASSERT_EQUAL(0, device_registry_offline_count());
+    TEST_ASSERT_TRUE(device_registry_find(frame.src_mac, &entry));
+    TEST_ASSERT_FALSE(entry.offline);
+}
+
+TEST_CASE("device_registry formats valid JSON", "[registry]") {
+    device_registry_init();
+    mesh_rx_frame_t frame;
+    make_frame(&frame, 7, MSG_TYPE_HEARTBEAT, -55);
+    strcpy(frame.msg.device_id, "bad\"id\\x");
+    device_registry_update(&frame);
+
+    device_registry_entry_t entry;
+    TEST_ASSERT_TRUE(device_registry_find(frame.src_mac, &entry));
+
+    char buf[320];
+    size_t len = device_registry_format_json(&entry, entry.last_seen_ms, buf, sizeof(buf));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL(0, device_registry_format_json(&entry, entry.last_seen_ms, buf, 16));
+
+    len = device_registry_format_json(&entry, entry.last_seen_ms, buf, sizeof(buf));
+    cJSON *root = cJSON_Parse(buf);
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_EQUAL_STRING("bad_id_x", cJSON_GetStringValue(cJSON_GetObjectItem(root, "device_id")));
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(root, "online")));
+    TEST_ASSERT_EQUAL(-55, (int)cJSON_GetNumberValue(cJSON_GetObjectItem(root, "rssi")));
+    const char *last_seen = cJSON_GetStringValue(cJSON_GetObjectItem(root, "last_seen"));
+    TEST_ASSERT_NOT_NULL(last_seen);
+    TEST_ASSERT_EQUAL(20, strlen(last_seen));
+    TEST_ASSERT_EQUAL('Z', last_seen[19]);
+    TEST_ASSERT_EQUAL_STRING("24:6F:28:00:00:07", cJSON_GetStringValue(cJSON_GetObjectItem(root, "mac")));
+    cJSON_Delete(root);
+
+    // Widest possible entry still fits the handler's item buffer
+    memset(entry.device_id, 'W', sizeof(entry.device_id) - 1);
+    entry.frames = entry.heartbeats = entry.motion_events = entry.logs = UINT32_MAX;
+    entry.heap = entry.uptime = entry.outages = UINT32_MAX;
+    entry.rssi = entry.rssi_avg = -128;
+    TEST_ASSERT_GREATER_THAN(0, device_registry_format_json(&entry, entry.last_seen_ms - 1, buf, sizeof(buf)));
+}
+
+TEST_CASE("device_registry update and serialize benchmark", "[registry][perf]") {
+    device_registry_init();
+    mesh_rx_frame_t frame;
+    const int devices = 100, rounds = 1000;
+
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        for (int d = 0; d < devices; d++) {
+            make_frame(&frame, (uint16_t)d, (r & 1) ? MSG_TYPE_HEARTBEAT : MSG_TYPE_LOG, -60);
+            device_registry_update(&frame);
+        }
+    }
+    int64_t update_us = esp_timer_get_time() - start;
+
+    char item[320];
+    size_t bytes = 0;
+    start = esp_timer_get_time();
+    for (int r = 0; r < 100; r++) {
+        int cursor = 0;
+        device_registry_entry_t entry;
+        while (device_registry_next(&cursor, &entry)) {
+            bytes += device_registry_format_json(&entry, entry.last_seen_ms, item, sizeof(item));
+        }
+    }
+    int64_t serialize_us = (esp_timer_get_time() - start) / 100;
+
+    printf("\n%d devices: update %.2f us/frame (incl. frame setup), full serialize %lld us, %u bytes\n",
+           devices, (double)update_us / (devices * rounds), (long long)serialize_us, (unsigned)(bytes / 100));
+}
@@ -21,7 +21,14 @@ static int pending_log_count = 0;
 static mesh_message_t pending_logs[10];
 
 // Forward declaration (from esp_now_mesh.c)
-extern void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
+extern void OnDataRecv(const esp_now_recv_info_t *recv_info, const uint8_t *incomingData, int len);
+
+// Wrap the sender MAC the way the ESP-NOW driver does
+static void deliver(uint8_t *mac_addr, const uint8_t *data, int len) {
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -60};
+    esp_now_recv_info_t info = {.src_addr = mac_addr, .rx_ctrl = &rx_ctrl};
+    OnDataRecv(&info, data, len);
+}
 
 // Mock implementation of send_log_to_unraid
 void send_log_to_unraid(mesh_message_t *msg) {
@@ -36,7 +43,7 @@ TEST_CASE("OnDataRecv rejects wrong message size", "[esp_now]") {
     uint8_t mac_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     
     pending_log_count = 0;
-    OnDataRecv(mac_addr, bad_data, 100);
+    deliver(mac_addr, bad_data, 100);
     
     // Message should be rejected, no logs queued
     TEST_ASSERT_EQUAL(0, pending_log_count);
@@ -54,7 +61,7 @@ TEST_CASE("OnDataRecv accepts valid MSG_TYPE_LOG", "[esp_now]") {
     uint8_t mac_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     
     pending_log_count = 0;
-    OnDataRecv(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
     
     // Log should be queued for sending to Unraid
     TEST_ASSERT_EQUAL(1, pending_log_count);
@@ -73,7 +80,7 @@ TEST_CASE("OnDataRecv accepts valid MSG_TYPE_MOTION", "[esp_now]") {
     uint8_t mac_addr[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
     
     pending_log_count = 0;
-    OnDataRecv(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
     
     // Motion events should be queued
     TEST_ASSERT_EQUAL(1, pending_log_count);
@@ -92,7 +99,7 @@ TEST_CASE("OnDataRecv ignores MSG_TYPE_HEARTBEAT", "[esp_now]") {
     uint8_t mac_addr[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
     
     pending_log_count = 0;
-    OnDataRecv(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
     
     // Heartbeats are not forwarded to Unraid (handled locally)
     TEST_ASSERT_EQUAL(0, pending_log_count);
@@ -111,7 +118,7 @@ TEST_CASE("OnDataRecv handles batch of mixed message types", "[esp_now]") {
         .payload = "{\"message\":\"test\"}",
         .signature = {0}
     };
-    OnDataRecv(mac_addr, (uint8_t*)&log_msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&log_msg, sizeof(mesh_message_t));
     
     // Send HEARTBEAT (should be ignored)
     mesh_message_t hb_msg = {
@@ -121,7 +128,7 @@ TEST_CASE("OnDataRecv handles batch of mixed message types", "[esp_now]") {
         .payload = "{\"rssi\":-50}",
         .signature = {0}
     };
-    OnDataRecv(mac_addr, (uint8_t*)&hb_msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&hb_msg, sizeof(mesh_message_t));
     
     // Send MOTION message
     mesh_message_t motion_msg = {
@@ -131,7 +138,7 @@ TEST_CASE("OnDataRecv handles batch of mixed message types", "[esp_now]") {
         .payload = "{\"area\":\"kitchen\"}",
         .signature = {0}
     };
-    OnDataRecv(mac_addr, (uint8_t*)&motion_msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&motion_msg, sizeof(mesh_message_t));
     
     // Only LOG and MOTION should be queued
     TEST_ASSERT_EQUAL(2, pending_log_count);
@@ -151,7 +158,7 @@ TEST_CASE("OnDataRecv preserves device_id and timestamp", "[esp_now]") {
     uint8_t mac_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     
     pending_log_count = 0;
-    OnDataRecv(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
+    deliver(mac_addr, (uint8_t*)&msg, sizeof(mesh_message_t));
     
     TEST_ASSERT_EQUAL(1, pending_log_count);
     TEST_ASSERT_EQUAL_STRING("ESP32-TEST123", pending_logs[0].device_id);
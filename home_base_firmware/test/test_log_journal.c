@@ -0,0 +1,260 @@
+/*
+ * Tests for the flash log journal (log_journal.c)
+ *
+ * Validates that records come back oldest-first after a reboot with their
+ * contents intact, that appends continue in the segment they left off in,
+ * that only flushed records survive, that torn writes and flipped bits are
+ * caught by the CRC, that a full partition gives up its oldest segment, and
+ * that boot reads segment headers rather than every record. Flash is the
+ * RAM-backed partition from mock_flash.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "mock_flash.h"
+#include "log_journal.h"
+
+#define SEGMENT (64 * 1024)
+#define MAX_REPLAY 2000
+
+typedef struct {
+    log_journal_kind_t kind;
+    uint32_t id;
+    device_log_t log;
+    motion_event_t event;
+} replayed_t;
+
+static replayed_t s_replayed[MAX_REPLAY];
+static int s_count;
+
+static void collect(log_journal_kind_t kind, const device_log_t *log, const motion_event_t *event,
+                    uint32_t id, void *ctx)
+{
+    TEST_ASSERT_LESS_THAN(MAX_REPLAY, s_count);
+    replayed_t *r = &s_replayed[s_count++];
+    memset(r, 0, sizeof(*r));
+    r->kind = kind;
+    r->id = id;
+    if (log) {
+        r->log = *log;
+    }
+    if (event) {
+        r->event = *event;
+    }
+}
+
+// Remount, as after a reboot, and replay up to `logs` and `motions` records
+static void reboot_and_replay(uint32_t logs, uint32_t motions)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_init());
+    s_count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_replay(logs, motions, collect, NULL));
+}
+
+static void format(size_t size)
+{
+    mock_flash_init(size);
+    mock_flash_set_partition(LOG_JOURNAL_PARTITION_LABEL, LOG_JOURNAL_PARTITION_SUBTYPE);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_init());
+}
+
+static void append_log(uint32_t id, const char *message)
+{
+    device_log_t log = {.id = id, .timestamp = 1700000000 + id};
+    strcpy(log.device_id, "ESP32-CAM-01");
+    strcpy(log.level, "info");
+    strcpy(log.category, "sensor");
+    snprintf(log.message, sizeof(log.message), "%s %lu", message, (unsigned long)id);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_append_log(&log));
+}
+
+static void append_logs(uint32_t from, uint32_t to)
+{
+    for (uint32_t id = from; id < to; id++) {
+        append_log(id, "entry");
+    }
+}
+
+// Log IDs replayed must be exactly from..to-1, in order
+static void assert_log_ids(uint32_t from, uint32_t to)
+{
+    int n = 0;
+    for (int i = 0; i < s_count; i++) {
+        if (s_replayed[i].kind == LOG_JOURNAL_LOG) {
+            TEST_ASSERT_EQUAL_UINT32(from + n, s_replayed[i].id);
+            n++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(to - from, n);
+}
+
+TEST_CASE("log_journal replays records oldest first after a reboot", "[log_journal]") {
+    format(4 * SEGMENT);
+    append_logs(1, 11);
+    motion_event_t event = {.id = 1, .timestamp = 1700000100};
+    strcpy(event.device_id, "ESP32-CAM-02");
+    strcpy(event.media_path, "/sdcard/motion/0001.jpg");
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_append_motion(&event));
+    event.id = 2;
+    event.media_path[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_append_motion(&event));
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+
+    // One flash write for the whole burst
+    log_journal_stats_t stats;
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(12, stats.appended);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.flushes);
+
+    reboot_and_replay(500, 100);
+    TEST_ASSERT_EQUAL(12, s_count);
+    assert_log_ids(1, 11);
+    device_log_t *log = &s_replayed[4].log;
+    TEST_ASSERT_EQUAL_UINT32(5, log->id);
+    TEST_ASSERT_EQUAL_UINT64(1700000005, log->timestamp);
+    TEST_ASSERT_EQUAL_STRING("ESP32-CAM-01", log->device_id);
+    TEST_ASSERT_EQUAL_STRING("info", log->level);
+    TEST_ASSERT_EQUAL_STRING("sensor", log->category);
+    TEST_ASSERT_EQUAL_STRING("entry 5", log->message);
+    TEST_ASSERT_EQUAL(LOG_JOURNAL_MOTION, s_replayed[10].kind);
+    TEST_ASSERT_EQUAL_STRING("ESP32-CAM-02", s_replayed[10].event.device_id);
+    TEST_ASSERT_EQUAL_STRING("/sdcard/motion/0001.jpg", s_replayed[10].event.media_path);
+    TEST_ASSERT_EQUAL_UINT32(2, s_replayed[11].id);
+    TEST_ASSERT_EQUAL_STRING("", s_replayed[11].event.media_path);
+
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.logs);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.motions);
+    TEST_ASSERT_EQUAL_UINT32(12, stats.recovered);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.corrupt);
+}
+
+TEST_CASE("log_journal appends after a reboot in the same segment", "[log_journal]") {
+    format(4 * SEGMENT);
+    uint32_t erases = mock_flash_erases();
+    append_logs(1, 6);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+
+    reboot_and_replay(500, 0);
+    append_logs(6, 9);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+    TEST_ASSERT_EQUAL_UINT32(erases, mock_flash_erases());
+
+    reboot_and_replay(500, 0);
+    assert_log_ids(1, 9);
+}
+
+TEST_CASE("log_journal loses only records not yet flushed", "[log_journal]") {
+    format(4 * SEGMENT);
+    append_logs(1, 4);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+    append_logs(4, 7);
+
+    reboot_and_replay(500, 0);
+    assert_log_ids(1, 4);
+}
+
+TEST_CASE("log_journal replays clear markers in place", "[log_journal]") {
+    format(4 * SEGMENT);
+    append_logs(1, 4);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_append_clear(LOG_JOURNAL_CLEAR_LOGS, 4));
+    append_logs(4, 6);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+
+    reboot_and_replay(500, 100);
+    TEST_ASSERT_EQUAL(6, s_count);
+    TEST_ASSERT_EQUAL(LOG_JOURNAL_CLEAR_LOGS, s_replayed[3].kind);
+    TEST_ASSERT_EQUAL_UINT32(4, s_replayed[3].id);
+    TEST_ASSERT_EQUAL_UINT32(5, s_replayed[5].id);
+}
+
+TEST_CASE("log_journal drops a torn write and a corrupted record", "[log_journal]") {
+    format(4 * SEGMENT);
+    append_logs(1, 6);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+
+    // Power fails a few bytes into the next flush
+    append_logs(6, 9);
+    mock_flash_fail_after(3);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, log_journal_flush());
+    mock_flash_fail_after(-1);
+
+    reboot_and_replay(500, 0);
+    assert_log_ids(1, 6);
+    log_journal_stats_t stats;
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.corrupt);
+
+    // Appends move past the torn record to a fresh segment
+    append_logs(9, 12);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+    reboot_and_replay(500, 0);
+    TEST_ASSERT_EQUAL(8, s_count);
+    TEST_ASSERT_EQUAL_UINT32(5, s_replayed[4].id);
+    TEST_ASSERT_EQUAL_UINT32(9, s_replayed[5].id);
+
+    // A flipped bit in the second record's message fails only that record
+    format(4 * SEGMENT);
+    append_logs(1, 4);
+    TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+    size_t record = 32 + 8 + 12 + strlen("ESP32-CAM-01") + strlen("info") + strlen("sensor") + strlen("entry 1");
+    record = (record + 3) & ~(size_t)3;
+    mock_flash_flip(record + 30);
+
+    reboot_and_replay(500, 0);
+    TEST_ASSERT_EQUAL(2, s_count);
+    TEST_ASSERT_EQUAL_UINT32(1, s_replayed[0].id);
+    TEST_ASSERT_EQUAL_UINT32(3, s_replayed[1].id);
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.corrupt);
+}
+
+TEST_CASE("log_journal overwrites the oldest segment when full", "[log_journal]") {
+    format(3 * SEGMENT);
+    char message[200];
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+    for (uint32_t id = 1; id <= 1000; id++) {
+        append_log(id, message);
+        if (id % 50 == 0) {
+            TEST_ASSERT_EQUAL(ESP_OK, log_journal_flush());
+        }
+    }
+
+    // About 280 of these fit a segment: the first few hundred are gone
+    log_journal_stats_t stats;
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_LESS_THAN_UINT32(1000, stats.logs);
+    TEST_ASSERT_GREATER_THAN_UINT32(500, stats.logs);
+
+    reboot_and_replay(500, 0);
+    uint32_t first = s_replayed[0].id;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(501, first);
+    assert_log_ids(first, 1001);
+
+    // Full segments are known from their seals; only the newest is scanned
+    log_journal_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.scanned_segments);
+    TEST_ASSERT_EQUAL_UINT32(1000 - first + 1, stats.logs);
+
+    // Asking for fewer reads fewer segments
+    reboot_and_replay(10, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(10, s_count);
+    TEST_ASSERT_LESS_THAN(500, s_count);
+    TEST_ASSERT_EQUAL_UINT32(1000, s_replayed[s_count - 1].id);
+}
+
+TEST_CASE("log_journal without a partition", "[log_journal]") {
+    mock_flash_init(0);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, log_journal_init());
+    TEST_ASSERT_FALSE(log_journal_ready());
+    device_log_t log = {.id = 1};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, log_journal_append_log(&log));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, log_journal_replay(500, 100, collect, NULL));
+
+    // One segment is not enough to rotate
+    mock_flash_init(SEGMENT);
+    mock_flash_set_partition(LOG_JOURNAL_PARTITION_LABEL, LOG_JOURNAL_PARTITION_SUBTYPE);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, log_journal_init());
+}
@@ -0,0 +1,618 @@
+/*
+ * Tests and benchmark for the in-memory log and motion stores (log_storage.c)
+ *
+ * Functional cases cover newest-first order across wrap-around, eviction of
+ * the oldest entry when full (by count or by message bytes), ID lookup and
+ * IDs surviving a clear, name interning and its overflow, readers listing
+ * the store while a writer task keeps adding to it, and entries, IDs and
+ * clears surviving a reboot through the flash journal, and the PSRAM tier:
+ * demotion from SRAM, listings and lookups spanning both tiers, resizing
+ * and disabling it at runtime, and restoring both tiers after a reboot.
+ * The [perf] cases compare sustained inserts into a full store against the
+ * previous memmove FIFO, which shifted every entry down one slot per insert,
+ * report memory per entry and entries per RAM budget against fixed-size
+ * entries, measure insert latency with and without readers polling, and
+ * compare inserts and listings with and without the PSRAM tier.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cJSON.h"
+#include "log_storage.h"
+#include "log_journal.h"
+#include "mock_flash.h"
+
+static void add_logs(int from, int to)
+{
+    char message[32];
+    for (int i = from; i < to; i++) {
+        snprintf(message, sizeof(message), "entry %d", i);
+        log_storage_add_log(i % 2 ? "ESP32-ODD" : "ESP32-EVEN", "info", "sensor", message);
+    }
+}
+
+// IDs in a JSON listing, in order
+static int listed_ids(char *json, uint32_t *ids, int max)
+{
+    cJSON *root = cJSON_Parse(json);
+    free(json);
+    TEST_ASSERT_NOT_NULL(root);
+    int n = 0;
+    cJSON *item;
+    cJSON_ArrayForEach(item, root) {
+        if (n < max) {
+            ids[n++] = (uint32_t)cJSON_GetObjectItem(item, "id")->valuedouble;
+        }
+    }
+    cJSON_Delete(root);
+    return n;
+}
+
+TEST_CASE("log_storage lists newest first across the wrap", "[log_storage]") {
+    log_storage_clear_logs();
+    uint32_t first = 0;
+    device_log_t log;
+    add_logs(0, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, log_storage_get_log_count());
+    uint32_t ids[8];
+    TEST_ASSERT_EQUAL(1, listed_ids(log_storage_get_logs_json(NULL, 8), ids, 8));
+    first = ids[0];
+
+    // Fill past capacity: the oldest are overwritten
+    add_logs(1, MAX_LOGS + 150);
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS, log_storage_get_log_count());
+    TEST_ASSERT_EQUAL(8, listed_ids(log_storage_get_logs_json(NULL, 8), ids, 8));
+    uint32_t newest = first + MAX_LOGS + 149;
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT32(newest - i, ids[i]);
+    }
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - MAX_LOGS, &log));
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - MAX_LOGS + 1, &log));
+    TEST_ASSERT_EQUAL_STRING("entry 150", log.message);
+
+    // The filter skips the other device; the limit counts matches
+    TEST_ASSERT_EQUAL(4, listed_ids(log_storage_get_logs_json("ESP32-EVEN", 4), ids, 8));
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(log_storage_get_log(ids[i], &log));
+        TEST_ASSERT_EQUAL_STRING("ESP32-EVEN", log.device_id);
+        TEST_ASSERT_EQUAL_UINT32(ids[0] - 2 * i, ids[i]);
+    }
+}
+
+TEST_CASE("log_storage finds entries by ID", "[log_storage]") {
+    log_storage_clear_logs();
+    add_logs(0, 3);
+    uint32_t ids[3];
+    TEST_ASSERT_EQUAL(3, listed_ids(log_storage_get_logs_json(NULL, 3), ids, 3));
+
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(ids[2], &log));
+    TEST_ASSERT_EQUAL_UINT32(ids[2], log.id);
+    TEST_ASSERT_EQUAL_STRING("entry 0", log.message);
+    TEST_ASSERT_TRUE(log_storage_get_log(ids[0], &log));
+    TEST_ASSERT_EQUAL_STRING("entry 2", log.message);
+    TEST_ASSERT_FALSE(log_storage_get_log(ids[0] + 1, &log));
+    TEST_ASSERT_FALSE(log_storage_get_log(0, &log));
+
+    // A clear empties the store but IDs keep counting
+    log_storage_clear_logs();
+    TEST_ASSERT_EQUAL_UINT32(0, log_storage_get_log_count());
+    TEST_ASSERT_FALSE(log_storage_get_log(ids[0], &log));
+    add_logs(3, 4);
+    uint32_t after;
+    TEST_ASSERT_EQUAL(1, listed_ids(log_storage_get_logs_json(NULL, 1), &after, 1));
+    TEST_ASSERT_EQUAL_UINT32(ids[0] + 1, after);
+}
+
+TEST_CASE("log_storage motion store wraps and finds events by ID", "[log_storage]") {
+    log_storage_clear_motion();
+    char path[32];
+    for (int i = 0; i < MAX_MOTION_EVENTS + 20; i++) {
+        snprintf(path, sizeof(path), "/media/%d.jpg", i);
+        log_storage_add_motion_event("ESP32-CAM", i % 10 ? path : NULL);
+    }
+    TEST_ASSERT_EQUAL_UINT32(MAX_MOTION_EVENTS, log_storage_get_motion_count());
+
+    uint32_t ids[3];
+    TEST_ASSERT_EQUAL(3, listed_ids(log_storage_get_motion_json(NULL, 3), ids, 3));
+    TEST_ASSERT_EQUAL_UINT32(ids[0] - 1, ids[1]);
+    motion_event_t event;
+    TEST_ASSERT_TRUE(log_storage_get_motion_event(ids[0], &event));
+    TEST_ASSERT_EQUAL_STRING("/media/119.jpg", event.media_path);
+    TEST_ASSERT_TRUE(log_storage_get_motion_event(ids[0] - (MAX_MOTION_EVENTS - 1), &event));
+    TEST_ASSERT_EQUAL_STRING("", event.media_path);   // Event 20 had no media
+    TEST_ASSERT_FALSE(log_storage_get_motion_event(ids[0] - MAX_MOTION_EVENTS, &event));
+}
+
+TEST_CASE("log_storage evicts by bytes when messages are long", "[log_storage]") {
+    log_storage_clear_logs();
+    char message[256];
+    for (int i = 0; i < MAX_LOGS; i++) {
+        snprintf(message, sizeof(message), "%0250d%05d", 0, i);   // 255 characters
+        log_storage_add_log("ESP32-LONG", "info", "sensor", message);
+    }
+
+    // The arena runs out before the record slots do
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    uint32_t fit = mem.arena_size / 255;
+    TEST_ASSERT_LESS_THAN(MAX_LOGS, fit);
+    TEST_ASSERT_EQUAL_UINT32(fit, log_storage_get_log_count());
+    TEST_ASSERT_EQUAL_UINT32(fit, mem.entries);
+    TEST_ASSERT_EQUAL_UINT32(LOG_RECORD_SIZE + 255, mem.bytes_per_entry);
+    TEST_ASSERT_EQUAL_UINT32(fit, mem.max_entries);
+
+    uint32_t ids[MAX_LOGS];
+    int n = listed_ids(log_storage_get_logs_json(NULL, MAX_LOGS), ids, MAX_LOGS);
+    TEST_ASSERT_EQUAL(fit, n);
+    device_log_t log;
+    for (int i = 0; i < n; i++) {
+        TEST_ASSERT_TRUE(log_storage_get_log(ids[i], &log));
+        TEST_ASSERT_EQUAL(255, strlen(log.message));
+        TEST_ASSERT_EQUAL(MAX_LOGS - 1 - i, atoi(log.message + 250));
+    }
+    TEST_ASSERT_FALSE(log_storage_get_log(ids[n - 1] - 1, &log));
+}
+
+TEST_CASE("log_storage interns names and keeps overflow with the message", "[log_storage]") {
+    mock_flash_init(0);
+    log_storage_init();
+    char device[40], category[40], message[32];
+    for (int i = 0; i < 100; i++) {
+        snprintf(device, sizeof(device), "ESP32-%03d", i);
+        snprintf(category, sizeof(category), "category-%02d", i % 40);
+        snprintf(message, sizeof(message), "entry %d", i);
+        log_storage_add_log(device, "info", category, message);
+    }
+    // Too long for the field: truncated, whether interned or not
+    log_storage_add_log("ESP32-0123456789012345678901234567890", "info", "sensor", "long name");
+
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    TEST_ASSERT_EQUAL_UINT32(64, mem.devices);
+    TEST_ASSERT_EQUAL_UINT32(1, mem.levels);
+    TEST_ASSERT_EQUAL_UINT32(32, mem.categories);
+    // Every add of an uninterned name counts: 36 devices, categories 32-39
+    // twice each, and the last add's device ID and category
+    TEST_ASSERT_EQUAL_UINT32(36 + 16 + 2, mem.inline_names);
+
+    uint32_t ids[101];
+    TEST_ASSERT_EQUAL(101, listed_ids(log_storage_get_logs_json(NULL, 101), ids, 101));
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(ids[0], &log));
+    TEST_ASSERT_EQUAL_STRING("ESP32-0123456789012345678901234", log.device_id);
+    TEST_ASSERT_EQUAL_STRING("long name", log.message);
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(log_storage_get_log(ids[100 - i], &log));
+        snprintf(device, sizeof(device), "ESP32-%03d", i);
+        snprintf(category, sizeof(category), "category-%02d", i % 40);
+        snprintf(message, sizeof(message), "entry %d", i);
+        TEST_ASSERT_EQUAL_STRING(device, log.device_id);
+        TEST_ASSERT_EQUAL_STRING("info", log.level);
+        TEST_ASSERT_EQUAL_STRING(category, log.category);
+        TEST_ASSERT_EQUAL_STRING(message, log.message);
+    }
+
+    // The device filter matches inline names too
+    TEST_ASSERT_EQUAL(1, listed_ids(log_storage_get_logs_json("ESP32-099", 10), ids, 10));
+}
+
+// === Concurrent readers ===
+
+static volatile bool writer_done;
+static _Atomic int readers_running;
+static _Atomic uint32_t reader_listings;
+static uint32_t writer_slow;     // Inserts that took over 100 us
+
+// Writes entries whose device_id and message carry the same number, so a
+// torn copy would show two different numbers
+static void writer_task(void *arg)
+{
+    int64_t *max_us = arg;
+    char device[32], message[32];
+    for (int i = 0; i < 50000; i++) {
+        snprintf(device, sizeof(device), "ESP32-%d", i);
+        snprintf(message, sizeof(message), "entry %d", i);
+        int64_t start = esp_timer_get_time();
+        log_storage_add_log(device, "info", "sensor", message);
+        int64_t spent = esp_timer_get_time() - start;
+        if (max_us && spent > *max_us) {
+            *max_us = spent;
+        }
+        if (spent > 100) {
+            writer_slow++;
+        }
+    }
+    writer_done = true;
+    vTaskDelete(NULL);
+}
+
+static void check_listing(char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    free(json);
+    TEST_ASSERT_NOT_NULL(root);
+    uint32_t last_id = 0;
+    cJSON *item;
+    cJSON_ArrayForEach(item, root) {
+        uint32_t id = (uint32_t)cJSON_GetObjectItem(item, "id")->valuedouble;
+        int device = atoi(cJSON_GetObjectItem(item, "device_id")->valuestring + strlen("ESP32-"));
+        int message = atoi(cJSON_GetObjectItem(item, "message")->valuestring + strlen("entry "));
+        TEST_ASSERT_EQUAL(device, message);
+        if (last_id) {
+            TEST_ASSERT_EQUAL_UINT32(last_id - 1, id);   // Consecutive, newest first
+        }
+        last_id = id;
+    }
+    cJSON_Delete(root);
+}
+
+static void reader_task(void *arg)
+{
+    while (!writer_done) {
+        check_listing(log_storage_get_logs_json(NULL, MAX_LOGS));
+        TEST_ASSERT_TRUE(log_storage_get_log_count() <= MAX_LOGS);
+        reader_listings++;
+    }
+    readers_running--;
+    vTaskDelete(NULL);
+}
+
+static void run_concurrent(int readers, int64_t *writer_max_us)
+{
+    log_storage_clear_logs();
+    writer_done = false;
+    readers_running = readers;
+    reader_listings = 0;
+    writer_slow = 0;
+    for (int i = 0; i < readers; i++) {
+        xTaskCreate(reader_task, "log_reader", 4096, NULL, 5, NULL);
+    }
+    xTaskCreate(writer_task, "log_writer", 4096, writer_max_us, 5, NULL);
+    while (!writer_done || readers_running) {
+        vTaskDelay(1);
+    }
+}
+
+TEST_CASE("log_storage readers see whole entries while a writer adds", "[log_storage]") {
+    run_concurrent(2, NULL);
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS, log_storage_get_log_count());
+    check_listing(log_storage_get_logs_json(NULL, MAX_LOGS));
+    TEST_ASSERT_TRUE(reader_listings > 0);
+}
+
+// === Persistence ===
+
+TEST_CASE("log_storage restores flushed entries after a reboot", "[log_storage]") {
+    mock_flash_init(5 * 64 * 1024);
+    mock_flash_set_partition(LOG_JOURNAL_PARTITION_LABEL, LOG_JOURNAL_PARTITION_SUBTYPE);
+    log_storage_init();
+    TEST_ASSERT_EQUAL_UINT32(0, log_storage_get_log_count());
+
+    add_logs(0, 30);
+    log_storage_add_motion_event("ESP32-CAM", "/media/1.jpg");
+    log_storage_flush();
+    uint32_t ids[2];
+    TEST_ASSERT_EQUAL(1, listed_ids(log_storage_get_logs_json(NULL, 1), ids, 1));
+    uint32_t newest = ids[0];
+
+    // Reboot: RAM is rebuilt from flash, and IDs carry on
+    log_storage_init();
+    TEST_ASSERT_EQUAL_UINT32(30, log_storage_get_log_count());
+    TEST_ASSERT_EQUAL_UINT32(1, log_storage_get_motion_count());
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(newest, &log));
+    TEST_ASSERT_EQUAL_STRING("entry 29", log.message);
+    TEST_ASSERT_EQUAL_STRING("ESP32-ODD", log.device_id);
+    add_logs(30, 31);
+    TEST_ASSERT_EQUAL(2, listed_ids(log_storage_get_logs_json(NULL, 2), ids, 2));
+    TEST_ASSERT_EQUAL_UINT32(newest + 1, ids[0]);
+    TEST_ASSERT_EQUAL_UINT32(newest, ids[1]);
+
+    // A clear survives too, and IDs still are not reused
+    log_storage_clear_logs();
+    add_logs(31, 33);
+    log_storage_flush();
+    log_storage_init();
+    TEST_ASSERT_EQUAL_UINT32(2, log_storage_get_log_count());
+    TEST_ASSERT_EQUAL(2, listed_ids(log_storage_get_logs_json(NULL, 2), ids, 2));
+    TEST_ASSERT_EQUAL_UINT32(newest + 3, ids[0]);
+    TEST_ASSERT_TRUE(log_storage_get_log(ids[1], &log));
+    TEST_ASSERT_EQUAL_STRING("entry 31", log.message);
+
+    log_journal_stats_t stats;
+    uint32_t missed;
+    log_storage_get_journal_stats(&stats, &missed);
+    TEST_ASSERT_EQUAL_UINT32(0, missed);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.corrupt);
+
+    // Back to RAM only for the benchmarks
+    mock_flash_init(0);
+    log_storage_init();
+}
+
+// === PSRAM tier ===
+
+// The newest `n` entries must list newest first with no ID missing
+static void check_consecutive(int n)
+{
+    static uint32_t ids[1000];
+    TEST_ASSERT_EQUAL(n, listed_ids(log_storage_get_logs_json(NULL, n), ids, n));
+    for (int i = 1; i < n; i++) {
+        TEST_ASSERT_EQUAL_UINT32(ids[0] - i, ids[i]);
+    }
+}
+
+static uint32_t newest_id(void)
+{
+    uint32_t id;
+    TEST_ASSERT_EQUAL(1, listed_ids(log_storage_get_logs_json(NULL, 1), &id, 1));
+    return id;
+}
+
+TEST_CASE("log_storage demotes to the PSRAM tier and lists across both", "[log_storage]") {
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, log_storage_set_capacity(LOG_STORAGE_PSRAM_MIN_BYTES - 1));
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(256 * 1024));
+    log_storage_clear_logs();
+    add_logs(0, 3000);
+
+    // Everything fits the two tiers; SRAM keeps only the newest
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    TEST_ASSERT_EQUAL_UINT32(3000, log_storage_get_log_count());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(MAX_LOGS, mem.entries);
+    TEST_ASSERT_EQUAL_UINT32(3000, mem.entries + mem.psram_entries);
+    TEST_ASSERT_EQUAL_UINT32(256 * 1024, mem.psram_budget);
+    TEST_ASSERT_EQUAL_UINT32(log_storage_capacity_for(256 * 1024, LOG_STORAGE_AVG_MESSAGE), mem.psram_max_entries);
+    TEST_ASSERT_EQUAL_UINT32(mem.psram_entries, mem.demoted);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(mem.demoted / 16, mem.demotions);   // In batches
+    TEST_ASSERT_EQUAL_UINT32(0, mem.dropped);
+
+    // Listings and lookups run from SRAM on into PSRAM
+    check_consecutive(1000);
+    uint32_t newest = newest_id();
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - 2999, &log));
+    TEST_ASSERT_EQUAL_STRING("entry 0", log.message);
+    TEST_ASSERT_EQUAL_STRING("ESP32-EVEN", log.device_id);
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - 3000, &log));
+
+    // Past both: the PSRAM tier gives up its oldest
+    add_logs(3000, 5000);
+    log_storage_get_memory(&mem);
+    TEST_ASSERT_EQUAL_UINT32(mem.psram_max_entries, mem.psram_entries);
+    uint32_t count = log_storage_get_log_count();
+    TEST_ASSERT_EQUAL_UINT32(mem.entries + mem.psram_entries, count);
+    newest = newest_id();
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - count + 1, &log));
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - count, &log));
+    check_consecutive(1000);
+
+    // A clear empties both
+    log_storage_clear_logs();
+    TEST_ASSERT_EQUAL_UINT32(0, log_storage_get_log_count());
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - count + 1, &log));
+    add_logs(0, 10);
+    TEST_ASSERT_EQUAL_UINT32(10, log_storage_get_log_count());
+    check_consecutive(10);
+
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(0));
+}
+
+TEST_CASE("log_storage resizes the PSRAM tier at runtime", "[log_storage]") {
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(256 * 1024));
+    log_storage_clear_logs();
+    add_logs(0, 3000);
+    uint32_t newest = newest_id();
+
+    // Shrinking keeps the newest entries that fit
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(64 * 1024));
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    uint32_t count = log_storage_get_log_count();
+    TEST_ASSERT_EQUAL_UINT32(log_storage_capacity_for(64 * 1024, LOG_STORAGE_AVG_MESSAGE), mem.psram_entries);
+    TEST_ASSERT_EQUAL_UINT32(mem.entries + mem.psram_entries, count);
+    TEST_ASSERT_EQUAL_UINT32(newest, newest_id());
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - count + 1, &log));
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - count, &log));
+    check_consecutive(count < 1000 ? count : 1000);
+
+    // Growing loses nothing
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(128 * 1024));
+    TEST_ASSERT_EQUAL_UINT32(count, log_storage_get_log_count());
+    add_logs(3000, 3100);
+    TEST_ASSERT_EQUAL_UINT32(count + 100, log_storage_get_log_count());
+
+    // Disabling moves what fits back into SRAM, newest first
+    log_storage_get_memory(&mem);
+    uint32_t free_slots = MAX_LOGS - mem.entries;
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(0));
+    log_storage_get_memory(&mem);
+    TEST_ASSERT_EQUAL_UINT32(0, mem.psram_budget);
+    TEST_ASSERT_EQUAL_UINT32(free_slots, mem.promoted);
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS, log_storage_get_log_count());
+    check_consecutive(MAX_LOGS);
+    newest = newest_id();
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - MAX_LOGS + 1, &log));
+    TEST_ASSERT_FALSE(log_storage_get_log(newest - MAX_LOGS, &log));
+
+    // SRAM alone again: the oldest are overwritten
+    add_logs(3100, 3200);
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS, log_storage_get_log_count());
+}
+
+TEST_CASE("log_storage restores both tiers after a reboot", "[log_storage]") {
+    mock_flash_init(5 * 64 * 1024);
+    mock_flash_set_partition(LOG_JOURNAL_PARTITION_LABEL, LOG_JOURNAL_PARTITION_SUBTYPE);
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(256 * 1024));
+    log_storage_init();
+    add_logs(0, 2000);
+    log_storage_flush();
+    uint32_t newest = newest_id();
+
+    log_storage_init();
+    TEST_ASSERT_EQUAL_UINT32(2000, log_storage_get_log_count());
+    TEST_ASSERT_EQUAL_UINT32(newest, newest_id());
+    device_log_t log;
+    TEST_ASSERT_TRUE(log_storage_get_log(newest - 1999, &log));
+    TEST_ASSERT_EQUAL_STRING("entry 0", log.message);
+    check_consecutive(1000);
+
+    mock_flash_init(0);
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(0));
+    log_storage_init();
+}
+
+// === Benchmark ===
+
+#define BENCH_INSERTS 20000
+
+// The previous insert: shift everything down one slot once full
+static device_log_t bench_fifo[MAX_LOGS];
+static uint32_t bench_fifo_count;
+
+static void fifo_add_log(uint32_t id, const char *message)
+{
+    if (bench_fifo_count >= MAX_LOGS) {
+        memmove(&bench_fifo[0], &bench_fifo[1], (MAX_LOGS - 1) * sizeof(device_log_t));
+        bench_fifo_count--;
+    }
+    device_log_t *log = &bench_fifo[bench_fifo_count++];
+    log->id = id;
+    strcpy(log->device_id, "ESP32-BENCH");
+    strcpy(log->level, "info");
+    strcpy(log->category, "sensor");
+    strncpy(log->message, message, sizeof(log->message) - 1);
+}
+
+TEST_CASE("log_storage ring vs memmove FIFO insert benchmark", "[log_storage][perf]") {
+    char message[64];
+    strcpy(message, "PIR zone 3 triggered, battery 3.71 V, rssi -67 dBm");
+
+    bench_fifo_count = 0;
+    for (uint32_t i = 0; i < MAX_LOGS; i++) {
+        fifo_add_log(i, message);
+    }
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_INSERTS; i++) {
+        fifo_add_log(MAX_LOGS + i, message);
+    }
+    int64_t fifo_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS + BENCH_INSERTS - 1, bench_fifo[MAX_LOGS - 1].id);
+
+    log_storage_clear_logs();
+    for (int i = 0; i < MAX_LOGS; i++) {
+        log_storage_add_log("ESP32-BENCH", "info", "sensor", message);
+    }
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_INSERTS; i++) {
+        log_storage_add_log("ESP32-BENCH", "info", "sensor", message);
+    }
+    int64_t ring_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL_UINT32(MAX_LOGS, log_storage_get_log_count());
+
+    printf("\n%d inserts into a full %d-entry store\n", BENCH_INSERTS, MAX_LOGS);
+    printf("%-14s %12s %10s\n", "store", "inserts/s", "us/insert");
+    printf("%-14s %12.0f %10.3f\n", "memmove FIFO", BENCH_INSERTS * 1e6 / (double)fifo_us,
+           (double)fifo_us / BENCH_INSERTS);
+    printf("%-14s %12.0f %10.3f\n", "ring", BENCH_INSERTS * 1e6 / (double)ring_us,
+           (double)ring_us / BENCH_INSERTS);
+}
+
+TEST_CASE("log_storage memory per entry and capacity by budget", "[log_storage][perf]") {
+    // The previous store: a fixed device_log_t per entry, plus its seqlock count
+    uint32_t fixed = sizeof(device_log_t) + sizeof(uint32_t);
+    printf("\nBytes per log entry by message length\n");
+    printf("%-10s %10s %10s\n", "message", "fixed", "compact");
+    const uint32_t lengths[] = {16, 40, 64, 128, 255};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        printf("%-10lu %10lu %10lu\n", (unsigned long)lengths[i], (unsigned long)fixed,
+               (unsigned long)(LOG_RECORD_SIZE + lengths[i]));
+    }
+
+    printf("\nEntries held by RAM budget, 64-byte messages\n");
+    printf("%-10s %10s %10s\n", "budget", "fixed", "compact");
+    const uint32_t budgets_kb[] = {16, 48, 128, 176};
+    for (size_t i = 0; i < sizeof(budgets_kb) / sizeof(budgets_kb[0]); i++) {
+        uint32_t budget = budgets_kb[i] * 1024;
+        printf("%-7lu KB %10lu %10lu\n", (unsigned long)budgets_kb[i], (unsigned long)(budget / fixed),
+               (unsigned long)log_storage_capacity_for(budget, 64));
+    }
+
+    // As measured on the store itself
+    log_storage_clear_logs();
+    char message[65];
+    memset(message, 'm', 64);
+    message[64] = '\0';
+    for (int i = 0; i < 2 * MAX_LOGS; i++) {
+        log_storage_add_log("ESP32-CAM-01", "info", "sensor", message);
+    }
+    log_storage_memory_t mem;
+    log_storage_get_memory(&mem);
+    TEST_ASSERT_EQUAL_UINT32(LOG_RECORD_SIZE + 64, mem.bytes_per_entry);
+    printf("\nThis build: %lu KB budget (%lu-byte records, %lu KB arena) + %lu bytes of name tables\n",
+           (unsigned long)mem.budget / 1024, (unsigned long)mem.record_size, (unsigned long)mem.arena_size / 1024,
+           (unsigned long)mem.names_size);
+    printf("holding %lu entries of %lu bytes, up to %lu (fixed entries: %lu)\n", (unsigned long)mem.entries,
+           (unsigned long)mem.bytes_per_entry, (unsigned long)mem.max_entries,
+           (unsigned long)(mem.budget / fixed));
+}
+
+TEST_CASE("log_storage insert latency with readers polling", "[log_storage][perf]") {
+    // On a single-core host the writer also loses time slices to the readers;
+    // the slow-insert count shows whether it ever waited on them beyond that
+    printf("\n50000 inserts, readers listing all %d entries in a loop\n", MAX_LOGS);
+    printf("%-10s %12s %14s %12s %10s\n", "readers", "inserts/s", "max us/insert", ">100 us", "listings");
+    for (int readers = 0; readers <= 2; readers++) {
+        int64_t max_us = 0;
+        int64_t start = esp_timer_get_time();
+        run_concurrent(readers, &max_us);
+        int64_t us = esp_timer_get_time() - start;
+        printf("%-10d %12.0f %14lld %12lu %10lu\n", readers, 50000 * 1e6 / (double)us, (long long)max_us,
+               (unsigned long)writer_slow, (unsigned long)reader_listings);
+    }
+}
+
+TEST_CASE("log_storage inserts and listings with a PSRAM tier", "[log_storage][perf]") {
+    // Host heap stands in for PSRAM, so this shows the cost of demotion and
+    // of listing across tiers, not PSRAM's slower access
+    char message[65];
+    memset(message, 'm', 40);
+    message[40] = '\0';
+    printf("\n50000 inserts of 40-byte messages, then the newest 1000 listed\n");
+    printf("%-10s %10s %12s %14s %12s %10s\n", "psram", "held", "inserts/s", "max us/insert", "list 1000 us",
+           "demotions");
+    const uint32_t budgets_kb[] = {0, 256, 2048};
+    for (size_t i = 0; i < sizeof(budgets_kb) / sizeof(budgets_kb[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(budgets_kb[i] * 1024));
+        log_storage_clear_logs();
+        int64_t max_us = 0;
+        int64_t start = esp_timer_get_time();
+        for (int n = 0; n < 50000; n++) {
+            int64_t t = esp_timer_get_time();
+            log_storage_add_log("ESP32-BENCH", "info", "sensor", message);
+            t = esp_timer_get_time() - t;
+            max_us = t > max_us ? t : max_us;
+        }
+        int64_t insert_us = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        char *json = log_storage_get_logs_json(NULL, 1000);
+        int64_t list_us = esp_timer_get_time() - start;
+        free(json);
+
+        log_storage_memory_t mem;
+        log_storage_get_memory(&mem);
+        printf("%-7lu KB %10lu %12.0f %14lld %12lld %10lu\n", (unsigned long)budgets_kb[i],
+               (unsigned long)log_storage_get_log_count(), 50000 * 1e6 / (double)insert_us, (long long)max_us,
+               (long long)list_us, (unsigned long)mem.demotions);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, log_storage_set_capacity(0));
+}
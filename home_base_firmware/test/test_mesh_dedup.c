@@ -0,0 +1,148 @@
+/*
+ * Tests for the per-peer duplicate / replay filter (mesh_dedup.c)
+ *
+ * Validates that each (boot_id, seq) is accepted exactly once, that
+ * reordered frames inside the window still get through, that frames older
+ * than the window or from an earlier boot are refused, that a reboot
+ * starts a fresh window, and that peeking never moves a window.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "mesh_dedup.h"
+
+static const char *peer_a = "ESP32-C6-000001";
+static const char *peer_b = "ESP32-C6-000002";
+
+TEST_CASE("mesh_dedup drops retransmitted frames", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 1));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_check(peer_a, 1, 1));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_check(peer_a, 1, 0));
+
+    // Same seq from a different sender is unrelated
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_b, 1, 1));
+
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.peers);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.accepted);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.duplicates);
+}
+
+TEST_CASE("mesh_dedup accepts reordered frames inside the window", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 10));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 13));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 12));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 11));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_check(peer_a, 1, 12));
+
+    // Far jump ahead clears the window; the old range is now too old
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 13 + MESH_DEDUP_WINDOW + 5));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_check(peer_a, 1, 13));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, 13 + 10));
+}
+
+TEST_CASE("mesh_dedup handles sender reboots", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    for (uint32_t seq = 0; seq < 100; seq++) {
+        TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 7, seq));
+    }
+
+    // Reboot: seq restarts at 0 under a higher boot_id
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 8, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_check(peer_a, 8, 0));
+
+    // A captured frame from the previous boot is a replay
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_check(peer_a, 7, 99));
+
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.replays);
+}
+
+TEST_CASE("mesh_dedup evicts the least recently heard peer when full", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    char device_id[16];
+    for (int i = 0; i < 2048; i++) {
+        snprintf(device_id, sizeof(device_id), "ESP32-C6-1%05X", i);
+        TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(device_id, 1, 0));
+        // peer_a stays active throughout and must never be forgotten
+        TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 1, (uint32_t)i));
+    }
+
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_GREATER_THAN(0, stats.evictions);
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_check(peer_a, 1, 2047));
+}
+
+TEST_CASE("mesh_dedup rejects an old frame after a gap", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    for (uint32_t seq = 0; seq < 2000; seq++) {
+        TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 0, seq));
+    }
+
+    // seq never restarts within a boot: a frame from far back is a replay
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_check(peer_a, 0, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_check(peer_a, 0, 1));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_peek(peer_a, 0, 1));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 0, 2000));
+
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.resyncs);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.replays);
+}
+
+TEST_CASE("mesh_dedup re-syncs after a large backwards boot_id jump", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    // Rebooted onto a random boot_id far behind the last one
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_b, 0x90000000u, 50));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_b, 0x20000000u, 0));
+    // Then back to the persisted counter a few boots ahead of that
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_b, 0x20000002u, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_REPLAY, mesh_dedup_check(peer_b, 0x20000000u, 1));
+
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.resyncs);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.replays);
+}
+
+TEST_CASE("mesh_dedup forged frame does not advance the window", "[mesh_dedup]") {
+    mesh_dedup_init();
+
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 7, 10));
+
+    // Unverified frames are only peeked: a spoofed far-ahead seq, a new boot
+    // and a re-sync boot_id all look new but leave the window where it was
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_peek(peer_a, 7, 100000));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_peek(peer_a, 8, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_peek(peer_a, 0x90000000u, 0));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_DUPLICATE, mesh_dedup_peek(peer_a, 7, 10));
+
+    // The genuine sender carries on: 9 is still inside the window
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 7, 9));
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_check(peer_a, 7, 11));
+
+    // Nor does peeking at an unknown sender take a peer slot
+    TEST_ASSERT_EQUAL(MESH_DEDUP_ACCEPT, mesh_dedup_peek(peer_b, 1, 0));
+    mesh_dedup_stats_t stats;
+    mesh_dedup_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.peers);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.restarts);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.resyncs);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.accepted);
+}
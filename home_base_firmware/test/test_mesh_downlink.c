@@ -0,0 +1,611 @@
+/*
+ * Tests for the command downlink (mesh_downlink.c)
+ *
+ * Validates the ack handshake, in-order delivery per device, retransmission
+ * with backoff after link failures and ack timeouts, duplicate acks, acks
+ * from the wrong device, the in-flight limit, and slot and device reuse as devices come and go. Group commands go out as one broadcast with a target
+ * bitmap that leaves out other devices, and silent members get a unicast
+ * repair when the ack window closes.
+ *
+ * The [perf] cases simulate "disarm all" over a shared channel with frame
+ * and ack loss: 100 devices pipelined versus one device at a time, and time
+ * to full delivery by fleet size for unicast fan-out versus broadcast.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "protocol.h"
+#include "mesh_downlink.h"
+
+#define MAX_SENT 4096
+
+typedef struct {
+    uint8_t mac[6];
+    char device_id[16];
+    uint32_t cmd_id;
+    char payload[200];
+    bool has_targets;
+    uint8_t targets[MESH_TARGET_BITMAP_LEN];
+} sent_frame_t;
+
+static sent_frame_t sent[MAX_SENT];
+static int sent_count;
+
+static esp_err_t record_send(const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+    mesh_fields_t fields;
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, (int)len, &fields));
+    TEST_ASSERT_EQUAL(MSG_TYPE_COMMAND, fields.type);
+    if (sent_count < MAX_SENT) {
+        memcpy(sent[sent_count].mac, mac, 6);
+        memcpy(sent[sent_count].device_id, fields.device_id, sizeof(fields.device_id));
+        sent[sent_count].cmd_id = fields.cmd_id;
+        sent[sent_count].has_targets = (fields.present & MESH_HAS(MESH_FIELD_TARGETS)) != 0;
+        if (sent[sent_count].has_targets) {
+            memcpy(sent[sent_count].targets, fields.targets, MESH_TARGET_BITMAP_LEN);
+        }
+        memcpy(sent[sent_count].payload, fields.payload, fields.payload_len);
+        sent[sent_count].payload[fields.payload_len] = '\0';
+    }
+    sent_count++;
+    return ESP_OK;
+}
+
+static void make_mac(uint8_t *mac, int device)
+{
+    uint8_t m[6] = {0x24, 0x6F, 0x28, 0x10, (uint8_t)(device >> 8), (uint8_t)device};
+    memcpy(mac, m, 6);
+}
+
+static void make_device_id(char *device_id, int device)
+{
+    snprintf(device_id, 16, "ESP32-%u", (uint16_t)device);
+}
+
+static uint32_t submit(int device, const char *command, uint32_t now)
+{
+    uint8_t mac[6];
+    char device_id[16];
+    uint32_t id = 0;
+    make_mac(mac, device);
+    make_device_id(device_id, device);
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_submit(mac, device_id, command, "{\"command\":\"x\"}", now, &id));
+    return id;
+}
+
+// Ack signed by the device behind mac (see make_mac)
+static void ack(const uint8_t *mac, uint32_t id, uint32_t now)
+{
+    char device_id[16];
+    make_device_id(device_id, (mac[4] << 8) | mac[5]);
+    mesh_downlink_on_ack(mac, device_id, id, MESH_ACK_OK, now);
+}
+
+static mesh_downlink_target_t group[MESH_TARGET_BITMAP_LEN * 8];
+
+// Devices 0..count-1 as group candidates, all selected
+static void make_group(int count)
+{
+    for (int d = 0; d < count; d++) {
+        make_mac(group[d].mac, d);
+        make_device_id(group[d].device_id, d);
+        group[d].selected = true;
+    }
+}
+
+static bool is_broadcast(const uint8_t *mac)
+{
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    return memcmp(mac, broadcast, 6) == 0;
+}
+
+static mesh_downlink_state_t state_for(int device)
+{
+    int cursor = 0;
+    mesh_downlink_entry_t entry, last = {0};
+    char device_id[16];
+    make_device_id(device_id, device);
+    while (mesh_downlink_next(&cursor, &entry)) {
+        if (strcmp(entry.device_id, device_id) == 0) {
+            last = entry;
+        }
+    }
+    return last.state;
+}
+
+static mesh_downlink_state_t state_of(uint32_t id)
+{
+    mesh_downlink_entry_t entry;
+    TEST_ASSERT_TRUE(mesh_downlink_find(id, &entry));
+    return entry.state;
+}
+
+TEST_CASE("mesh_downlink delivers a command once acked", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+
+    uint32_t id = submit(1, "disarm", 0);
+    mesh_downlink_run(0);
+    TEST_ASSERT_EQUAL(1, sent_count);
+    TEST_ASSERT_EQUAL_UINT32(id, sent[0].cmd_id);
+    TEST_ASSERT_EQUAL_STRING("{\"command\":\"x\"}", sent[0].payload);
+    TEST_ASSERT_EQUAL(MESH_DL_SENDING, state_of(id));
+
+    mesh_downlink_on_sent(sent[0].mac, true, 2);
+    TEST_ASSERT_EQUAL(MESH_DL_WAIT_ACK, state_of(id));
+    ack(sent[0].mac, id, 5);
+
+    mesh_downlink_entry_t entry;
+    TEST_ASSERT_TRUE(mesh_downlink_find(id, &entry));
+    TEST_ASSERT_EQUAL(MESH_DL_ACKED, entry.state);
+    TEST_ASSERT_EQUAL(1, entry.attempts);
+    TEST_ASSERT_EQUAL_UINT32(5, entry.done_ms);
+
+    // A duplicate ack changes nothing
+    ack(sent[0].mac, id, 6);
+    mesh_downlink_stats_t stats;
+    mesh_downlink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.acked);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.pending);
+
+    char json[256];
+    TEST_ASSERT_GREATER_THAN(0, mesh_downlink_format_json(&entry, 10, json, sizeof(json)));
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"state\":\"acked\""));
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"latency_ms\":5"));
+}
+
+TEST_CASE("mesh_downlink keeps per-device order and pipelines devices", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+
+    uint32_t first = submit(1, "arm", 0);
+    uint32_t second = submit(1, "disarm", 0);
+    uint32_t other = submit(2, "arm", 0);
+    mesh_downlink_run(0);
+
+    // One command per device on the air
+    TEST_ASSERT_EQUAL(2, sent_count);
+    TEST_ASSERT_EQUAL(MESH_DL_QUEUED, state_of(second));
+    TEST_ASSERT_EQUAL(MESH_DL_SENDING, state_of(other));
+
+    mesh_downlink_on_sent(sent[0].mac, true, 1);
+    ack(sent[0].mac, first, 2);
+    mesh_downlink_run(2);
+    TEST_ASSERT_EQUAL(3, sent_count);
+    TEST_ASSERT_EQUAL_UINT32(second, sent[2].cmd_id);
+}
+
+TEST_CASE("mesh_downlink retransmits with backoff then fails", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+
+    uint32_t id = submit(3, "disarm", 0);
+    uint32_t now = 0;
+    uint32_t last_gap = 0, last_send = 0;
+    for (int i = 0; i < 200 && state_of(id) != MESH_DL_FAILED; i++) {
+        int before = sent_count;
+        uint32_t wait = mesh_downlink_run(now);
+        if (sent_count > before) {
+            if (before > 0) {
+                uint32_t gap = now - last_send;
+                TEST_ASSERT_TRUE(gap >= last_gap);   // Backoff never shrinks
+                last_gap = gap;
+            }
+            last_send = now;
+            // Radio failures first, then a device that never acks
+            if (sent_count <= 2) {
+                mesh_downlink_on_sent(sent[0].mac, false, now);
+            } else {
+                mesh_downlink_on_sent(sent[0].mac, true, now);
+            }
+            continue;
+        }
+        now += wait;
+    }
+
+    mesh_downlink_entry_t entry;
+    TEST_ASSERT_TRUE(mesh_downlink_find(id, &entry));
+    TEST_ASSERT_EQUAL(MESH_DL_FAILED, entry.state);
+    TEST_ASSERT_EQUAL(sent_count, entry.attempts);
+
+    mesh_downlink_stats_t stats;
+    mesh_downlink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+    TEST_ASSERT_GREATER_THAN(0, stats.link_failures);
+    TEST_ASSERT_GREATER_THAN(0, stats.ack_timeouts);
+}
+
+TEST_CASE("mesh_downlink accepts an ack that arrives after its timeout", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+
+    uint32_t id = submit(4, "disarm", 0);
+    mesh_downlink_run(0);
+    mesh_downlink_on_sent(sent[0].mac, true, 1);
+    mesh_downlink_run(1000);   // Ack timeout, retry scheduled
+    TEST_ASSERT_EQUAL(MESH_DL_QUEUED, state_of(id));
+
+    ack(sent[0].mac, id, 1001);
+    TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_of(id));
+}
+
+TEST_CASE("mesh_downlink limits devices in flight", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 4));
+    sent_count = 0;
+
+    for (int d = 0; d < 10; d++) {
+        submit(d, "disarm", 0);
+    }
+    mesh_downlink_run(0);
+    TEST_ASSERT_EQUAL(4, sent_count);
+
+    // Finishing one lets the next device go
+    mesh_downlink_on_sent(sent[0].mac, true, 1);
+    ack(sent[0].mac, sent[0].cmd_id, 2);
+    mesh_downlink_run(2);
+    TEST_ASSERT_EQUAL(5, sent_count);
+}
+
+TEST_CASE("mesh_downlink reuses the oldest finished slot across device churn", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    uint32_t now = 0;
+    uint32_t first = 0, second = 0;
+
+    // Far more distinct devices than slots: every device entry is released
+    // after its ack and leaves the MAC index again
+    for (int d = 0; d < 1000; d++) {
+        sent_count = 0;
+        uint32_t id = submit(d, "disarm", now);
+        first = d == 0 ? id : first;
+        second = d == 1 ? id : second;
+        mesh_downlink_run(now);
+        TEST_ASSERT_EQUAL(1, sent_count);
+        mesh_downlink_on_sent(sent[0].mac, true, now);
+        ack(sent[0].mac, id, now);
+        TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_of(id));
+        now++;
+    }
+
+    // The earliest commands were recycled first; the latest are kept
+    mesh_downlink_entry_t entry;
+    TEST_ASSERT_FALSE(mesh_downlink_find(first, &entry));
+    TEST_ASSERT_FALSE(mesh_downlink_find(second, &entry));
+    TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_for(999));
+
+    // A known device still finds its own queue behind the index
+    sent_count = 0;
+    uint32_t a = submit(999, "arm", now);
+    uint32_t b = submit(999, "disarm", now);
+    mesh_downlink_run(now);
+    TEST_ASSERT_EQUAL(1, sent_count);
+    TEST_ASSERT_EQUAL_UINT32(a, sent[0].cmd_id);
+    TEST_ASSERT_EQUAL(MESH_DL_QUEUED, state_of(b));
+
+    mesh_downlink_stats_t stats;
+    mesh_downlink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1000, stats.acked);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.pending);
+}
+
+TEST_CASE("mesh_downlink finds devices after index neighbours are released", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 16));
+    uint32_t ids[64];
+    for (int d = 0; d < 64; d++) {
+        ids[d] = submit(d, "disarm", 0);
+    }
+
+    // Sixteen devices at a time are acked and released while the rest stay
+    // indexed; each later ack still has to find its device
+    for (int round = 0; round < 4; round++) {
+        sent_count = 0;
+        mesh_downlink_run(0);
+        TEST_ASSERT_EQUAL(16, sent_count);
+        for (int i = 0; i < sent_count; i++) {
+            mesh_downlink_on_sent(sent[i].mac, true, 0);
+            ack(sent[i].mac, sent[i].cmd_id, 0);
+        }
+    }
+    for (int d = 0; d < 64; d++) {
+        TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_of(ids[d]));
+    }
+
+    // Released devices come back as new entries, one queue each
+    for (int d = 0; d < 16; d++) {
+        submit(d, "arm", 1);
+        submit(d, "disarm", 1);
+    }
+    sent_count = 0;
+    mesh_downlink_run(1);
+    TEST_ASSERT_EQUAL(16, sent_count);
+    mesh_downlink_stats_t stats;
+    mesh_downlink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(64, stats.acked);
+    TEST_ASSERT_EQUAL_UINT32(32, stats.pending);
+}
+
+TEST_CASE("mesh_downlink broadcasts a group command and repairs silent devices", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+    make_group(4);
+
+    uint32_t id;
+    int covered;
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_submit_group(group, 4, "disarm", "{\"command\":\"x\"}", 0, &id, &covered));
+    TEST_ASSERT_EQUAL(4, covered);
+
+    // One broadcast for everyone, no bitmap needed
+    uint32_t wait = mesh_downlink_run(0);
+    TEST_ASSERT_EQUAL(1, sent_count);
+    TEST_ASSERT_TRUE(is_broadcast(sent[0].mac));
+    TEST_ASSERT_EQUAL_STRING(MESH_BROADCAST_ID, sent[0].device_id);
+    TEST_ASSERT_EQUAL_UINT32(id, sent[0].cmd_id);
+    TEST_ASSERT_FALSE(sent[0].has_targets);
+    TEST_ASSERT_EQUAL(MESH_DL_BROADCAST, state_for(2));
+
+    ack(group[0].mac, id, 3);
+    ack(group[1].mac, id, 4);
+    TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_for(0));
+    mesh_downlink_run(wait - 1);
+    TEST_ASSERT_EQUAL(1, sent_count);
+
+    // Window closed: the two silent devices get unicasts with the same id
+    mesh_downlink_run(wait);
+    TEST_ASSERT_EQUAL(3, sent_count);
+    TEST_ASSERT_FALSE(is_broadcast(sent[1].mac));
+    TEST_ASSERT_EQUAL_UINT32(id, sent[1].cmd_id);
+    TEST_ASSERT_EQUAL_UINT32(id, sent[2].cmd_id);
+
+    mesh_downlink_stats_t stats;
+    mesh_downlink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.broadcasts);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.repairs);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.acked);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.pending);
+}
+
+TEST_CASE("mesh_downlink settles a slot only with its own device's ack", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+    make_group(2);
+
+    uint32_t id;
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_submit_group(group, 2, "disarm", "{\"command\":\"x\"}", 0, &id, NULL));
+    mesh_downlink_run(0);
+
+    // Device 1's signed ack for the shared group id, replayed from device 0's MAC
+    mesh_downlink_on_ack(group[0].mac, group[1].device_id, id, MESH_ACK_OK, 1);
+    TEST_ASSERT_EQUAL(MESH_DL_BROADCAST, state_for(0));
+
+    ack(group[0].mac, id, 2);
+    TEST_ASSERT_EQUAL(MESH_DL_ACKED, state_for(0));
+}
+
+TEST_CASE("mesh_downlink group bitmap leaves out other devices", "[downlink]") {
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(record_send, 8));
+    sent_count = 0;
+
+    // A device outside the group that shares device 0's bit
+    int twin = 10;
+    char device_id[16];
+    do {
+        make_device_id(device_id, ++twin);
+    } while (protocol_target_bit(device_id) != protocol_target_bit("ESP32-0"));
+
+    int count = 10;
+    make_group(count);
+    for (int d = 0; d < count; d++) {
+        group[d].selected = d % 2 == 0;
+    }
+    make_mac(group[count].mac, twin);
+    make_device_id(group[count].device_id, twin);
+    group[count].selected = false;
+    count++;
+
+    // Device 2 is busy with an earlier command, so it must wait its turn
+    submit(2, "arm", 0);
+    mesh_downlink_run(0);
+    TEST_ASSERT_EQUAL(1, sent_count);
+
+    uint32_t id;
+    int covered;
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_submit_group(group, count, "disarm", "{}", 0, &id, &covered));
+    TEST_ASSERT_EQUAL(3, covered);   // 4, 6, 8
+    mesh_downlink_run(0);
+    TEST_ASSERT_EQUAL(3, sent_count);
+
+    // Device 0 collides with the twin and goes unicast alongside the broadcast
+    int b = is_broadcast(sent[1].mac) ? 1 : 2;
+    TEST_ASSERT_TRUE(sent[b].has_targets);
+    TEST_ASSERT_EQUAL_MEMORY(group[0].mac, sent[3 - b].mac, 6);
+    for (int d = 0; d < count; d++) {
+        bool in_bitmap = protocol_targets_include(sent[b].targets, protocol_target_bit(group[d].device_id));
+        if (!group[d].selected || d == 0 || d == 2) {
+            TEST_ASSERT_FALSE(in_bitmap);
+        } else {
+            TEST_ASSERT_TRUE(in_bitmap);
+        }
+    }
+    TEST_ASSERT_EQUAL(MESH_DL_QUEUED, state_for(2));
+    TEST_ASSERT_EQUAL(MESH_DL_FREE, state_for(1));
+}
+
+// === Channel simulation ===
+
+#define SIM_DEVICES 100
+#define SIM_FLEET_MAX 128        // Fits the default command table
+#define SIM_AIR_MS 1            // One frame on the air
+#define SIM_TURNAROUND_MS 2     // Device receive to ack
+#define SIM_LOSS_PERCENT 5      // Per frame, both directions
+#define SIM_EVENTS 8192
+
+typedef struct {
+    uint32_t at;
+    uint8_t mac[6];
+    uint32_t id;
+    bool is_ack;
+    bool delivered;
+} sim_event_t;
+
+static sim_event_t events[SIM_EVENTS];
+static int event_count;
+static uint32_t sim_now;
+static uint32_t channel_free_at;
+static int sim_fleet;
+
+static void schedule(uint32_t at, const uint8_t *mac, uint32_t id, bool is_ack, bool delivered)
+{
+    TEST_ASSERT_TRUE(event_count < SIM_EVENTS);
+    sim_event_t *e = &events[event_count++];
+    e->at = at;
+    memcpy(e->mac, mac, 6);
+    e->id = id;
+    e->is_ack = is_ack;
+    e->delivered = delivered;
+}
+
+// The channel carries one frame at a time; a lost frame is reported as a
+// link failure, a lost ack is simply never seen
+static esp_err_t sim_send(const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+    mesh_fields_t fields;
+    protocol_v2_decode(frame, (int)len, &fields);
+
+    uint32_t start = channel_free_at > sim_now ? channel_free_at : sim_now;
+    uint32_t done = start + SIM_AIR_MS;
+    channel_free_at = done;
+
+    // A broadcast is heard (or missed) by every device on its own; the
+    // acks then queue up for the channel
+    if (is_broadcast(mac)) {
+        schedule(done, mac, fields.cmd_id, false, true);
+        for (int d = 0; d < sim_fleet; d++) {
+            char device_id[16];
+            make_device_id(device_id, d);
+            bool targeted = !(fields.present & MESH_HAS(MESH_FIELD_TARGETS)) ||
+                            protocol_targets_include(fields.targets, protocol_target_bit(device_id));
+            if (targeted && rand() % 100 >= SIM_LOSS_PERCENT && rand() % 100 >= SIM_LOSS_PERCENT) {
+                uint32_t ack_start = done + SIM_TURNAROUND_MS;
+                if (ack_start < channel_free_at) {
+                    ack_start = channel_free_at;
+                }
+                channel_free_at = ack_start + SIM_AIR_MS;
+                uint8_t device_mac[6];
+                make_mac(device_mac, d);
+                schedule(ack_start + SIM_AIR_MS, device_mac, fields.cmd_id, true, true);
+            }
+        }
+        sent_count++;
+        return ESP_OK;
+    }
+
+    bool delivered = rand() % 100 >= SIM_LOSS_PERCENT;
+    schedule(done, mac, fields.cmd_id, false, delivered);
+
+    if (delivered && rand() % 100 >= SIM_LOSS_PERCENT) {
+        uint32_t ack_start = done + SIM_TURNAROUND_MS;
+        if (ack_start < channel_free_at) {
+            ack_start = channel_free_at;
+        }
+        channel_free_at = ack_start + SIM_AIR_MS;
+        schedule(ack_start + SIM_AIR_MS, mac, fields.cmd_id, true, true);
+    }
+    sent_count++;
+    return ESP_OK;
+}
+
+static uint32_t simulate_disarm_all(int devices, int max_inflight, bool broadcast,
+                                    uint32_t *max_latency, uint32_t *retransmits)
+{
+    srand(7);
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_init(sim_send, max_inflight));
+    sent_count = 0;
+    event_count = 0;
+    sim_now = 0;
+    channel_free_at = 0;
+    sim_fleet = devices;
+
+    if (broadcast) {
+        make_group(devices);
+        TEST_ASSERT_EQUAL(ESP_OK, mesh_downlink_submit_group(group, devices, "disarm", "{\"command\":\"x\"}",
+                                                             0, NULL, NULL));
+    } else {
+        for (int d = 0; d < devices; d++) {
+            submit(d, "disarm", 0);
+        }
+    }
+
+    mesh_downlink_stats_t stats;
+    for (sim_now = 0; sim_now < 60000; sim_now++) {
+        for (int i = 0; i < event_count;) {
+            if (events[i].at > sim_now) {
+                i++;
+                continue;
+            }
+            sim_event_t e = events[i];
+            events[i] = events[--event_count];
+            if (e.is_ack) {
+                ack(e.mac, e.id, sim_now);
+            } else {
+                mesh_downlink_on_sent(e.mac, e.delivered, sim_now);
+            }
+        }
+        mesh_downlink_run(sim_now);
+        mesh_downlink_get_stats(&stats);
+        if (stats.pending == 0) {
+            break;
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(devices, stats.acked);
+    *retransmits = stats.retransmits;
+    *max_latency = 0;
+    int cursor = 0;
+    mesh_downlink_entry_t entry;
+    while (mesh_downlink_next(&cursor, &entry)) {
+        uint32_t latency = entry.done_ms - entry.queued_ms;
+        *max_latency = latency > *max_latency ? latency : *max_latency;
+    }
+    return sim_now;
+}
+
+TEST_CASE("mesh_downlink disarm-all simulation", "[downlink][perf]") {
+    uint32_t pipelined_latency, pipelined_retx, serial_latency, serial_retx;
+    uint32_t pipelined = simulate_disarm_all(SIM_DEVICES, 8, false, &pipelined_latency, &pipelined_retx);
+    uint32_t serial = simulate_disarm_all(SIM_DEVICES, 1, false, &serial_latency, &serial_retx);
+
+    printf("\n%d devices, %d ms air time, %d%% loss each way\n", SIM_DEVICES, SIM_AIR_MS, SIM_LOSS_PERCENT);
+    printf("%-22s %12s %16s %12s\n", "mode", "all acked ms", "slowest cmd ms", "retransmits");
+    printf("%-22s %12lu %16lu %12lu\n", "pipelined (8 devices)", (unsigned long)pipelined,
+           (unsigned long)pipelined_latency, (unsigned long)pipelined_retx);
+    printf("%-22s %12lu %16lu %12lu\n", "one device at a time", (unsigned long)serial,
+           (unsigned long)serial_latency, (unsigned long)serial_retx);
+
+    TEST_ASSERT_TRUE(pipelined < 1000);
+    TEST_ASSERT_TRUE(pipelined < serial);
+}
+
+TEST_CASE("mesh_downlink group broadcast by fleet size", "[downlink][perf]") {
+    static const int fleets[] = {8, 16, 32, 64, SIM_FLEET_MAX};
+
+    printf("\n%d ms air time, %d%% loss each way, 8 devices in flight for unicasts\n", SIM_AIR_MS, SIM_LOSS_PERCENT);
+    printf("%-8s %14s %14s %12s %12s %10s\n", "devices", "unicast ms", "broadcast ms", "unicast tx", "broadcast tx", "repairs");
+    for (size_t f = 0; f < sizeof(fleets) / sizeof(fleets[0]); f++) {
+        uint32_t latency, retx;
+        uint32_t unicast = simulate_disarm_all(fleets[f], 8, false, &latency, &retx);
+        int unicast_tx = sent_count;
+        uint32_t broadcast = simulate_disarm_all(fleets[f], 8, true, &latency, &retx);
+        int broadcast_tx = sent_count;
+        mesh_downlink_stats_t stats;
+        mesh_downlink_get_stats(&stats);
+
+        printf("%-8d %14lu %14lu %12d %12d %10lu\n", fleets[f], (unsigned long)unicast, (unsigned long)broadcast,
+               unicast_tx, broadcast_tx, (unsigned long)stats.repairs);
+        TEST_ASSERT_EQUAL_UINT32(1, stats.broadcasts);
+        TEST_ASSERT_TRUE(broadcast_tx < unicast_tx);
+        if (fleets[f] >= 32) {
+            TEST_ASSERT_TRUE(broadcast < unicast);
+        }
+    }
+}
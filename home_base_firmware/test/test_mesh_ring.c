@@ -0,0 +1,227 @@
+/*
+ * Tests and benchmark for the ESP-NOW ingress ring (mesh_ring.c)
+ *
+ * Functional cases cover ordering, wrap-around and drop-on-full.
+ * The [perf] case compares the ring against the previous FreeRTOS queue
+ * path (copy to stack, xQueueSend with 100 ms block, copy out) under a
+ * burst that outruns the consumer, reporting frames/sec, drop rate and how
+ * long the producer (the WiFi task in firmware) was stalled.
+ *
+ * Runs on target or on the host via `idf.py --preview set-target linux`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "protocol.h"
+#include "mesh_ring.h"
+
+#define TEST_SLOTS 8
+
+static mesh_rx_frame_t test_slots[TEST_SLOTS];
+
+static void fill_frame(mesh_rx_frame_t *frame, uint32_t n)
+{
+    memset(&frame->msg, 0, sizeof(frame->msg));
+    frame->msg.type = MSG_TYPE_LOG;
+    frame->msg.timestamp = n;
+    snprintf(frame->msg.device_id, sizeof(frame->msg.device_id), "ESP32-%04lu", (unsigned long)n);
+}
+
+TEST_CASE("mesh_ring rejects non power of two capacity", "[mesh_ring]") {
+    mesh_ring_t ring;
+    TEST_ASSERT_FALSE(mesh_ring_init(&ring, test_slots, 6));
+    TEST_ASSERT_TRUE(mesh_ring_init(&ring, test_slots, TEST_SLOTS));
+}
+
+TEST_CASE("mesh_ring preserves FIFO order across wrap-around", "[mesh_ring]") {
+    mesh_ring_t ring;
+    TEST_ASSERT_TRUE(mesh_ring_init(&ring, test_slots, TEST_SLOTS));
+
+    uint32_t next_in = 0, next_out = 0;
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 5; i++) {
+            mesh_rx_frame_t *frame = mesh_ring_reserve(&ring);
+            TEST_ASSERT_NOT_NULL(frame);
+            fill_frame(frame, next_in++);
+            mesh_ring_commit(&ring);
+        }
+        mesh_rx_frame_t *frame;
+        while ((frame = mesh_ring_peek(&ring)) != NULL) {
+            TEST_ASSERT_EQUAL_UINT32(next_out++, frame->msg.timestamp);
+            mesh_ring_release(&ring);
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(25, next_out);
+    TEST_ASSERT_EQUAL_UINT32(0, mesh_ring_depth(&ring));
+    TEST_ASSERT_EQUAL_UINT32(0, atomic_load(&ring.dropped));
+}
+
+TEST_CASE("mesh_ring drops without blocking when full", "[mesh_ring]") {
+    mesh_ring_t ring;
+    TEST_ASSERT_TRUE(mesh_ring_init(&ring, test_slots, TEST_SLOTS));
+
+    for (int i = 0; i < TEST_SLOTS; i++) {
+        mesh_rx_frame_t *frame = mesh_ring_reserve(&ring);
+        TEST_ASSERT_NOT_NULL(frame);
+        fill_frame(frame, i);
+        mesh_ring_commit(&ring);
+    }
+
+    TEST_ASSERT_NULL(mesh_ring_reserve(&ring));
+    TEST_ASSERT_EQUAL_UINT32(1, atomic_load(&ring.dropped));
+    TEST_ASSERT_EQUAL_UINT32(TEST_SLOTS, atomic_load(&ring.high_water));
+
+    // Oldest frame is still intact and frees a slot once released
+    TEST_ASSERT_EQUAL_UINT32(0, mesh_ring_peek(&ring)->msg.timestamp);
+    mesh_ring_release(&ring);
+    TEST_ASSERT_NOT_NULL(mesh_ring_reserve(&ring));
+}
+
+// === Benchmark ===
+
+#define BENCH_FRAMES   20000
+#define BENCH_SLOTS    32
+#define BENCH_WORK_US  25     // Simulated per-frame processing cost
+#define BENCH_BURST    64     // Frames offered back-to-back before a short gap
+#define BENCH_GAP_US   1000
+
+typedef enum {
+    BENCH_QUEUE_BLOCKING,     // Previous path: xQueueSend(..., 100 ms)
+    BENCH_QUEUE_NONBLOCKING,  // Queue with zero timeout (copy cost only)
+    BENCH_RING,
+} bench_mode_t;
+
+static mesh_rx_frame_t bench_slots[BENCH_SLOTS];
+static mesh_ring_t bench_ring;
+static QueueHandle_t bench_queue;
+static TaskHandle_t bench_consumer;
+static volatile bool bench_done;
+static volatile uint32_t bench_delivered;
+
+static void busy_wait_us(uint32_t us)
+{
+    int64_t end = esp_timer_get_time() + us;
+    while (esp_timer_get_time() < end) {
+    }
+}
+
+static void bench_queue_consumer(void *arg)
+{
+    mesh_message_t msg;
+    while (!bench_done || uxQueueMessagesWaiting(bench_queue) > 0) {
+        if (xQueueReceive(bench_queue, &msg, pdMS_TO_TICKS(10)) == pdTRUE) {
+            busy_wait_us(BENCH_WORK_US);
+            bench_delivered++;
+        }
+    }
+    bench_consumer = NULL;
+    vTaskDelete(NULL);
+}
+
+static void bench_ring_consumer(void *arg)
+{
+    while (!bench_done || mesh_ring_depth(&bench_ring) > 0) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        mesh_rx_frame_t *frame;
+        while ((frame = mesh_ring_peek(&bench_ring)) != NULL) {
+            busy_wait_us(BENCH_WORK_US);
+            bench_delivered++;
+            mesh_ring_release(&bench_ring);
+        }
+    }
+    bench_consumer = NULL;
+    vTaskDelete(NULL);
+}
+
+static void run_bench(bench_mode_t mode, const char *label)
+{
+    static const uint8_t mac[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x01};
+    mesh_message_t wire = {
+        .type = MSG_TYPE_MOTION,
+        .device_id = "ESP32-BENCH",
+        .payload = "{\"motion\":true,\"sensitivity\":5,\"cooldown\":30000}",
+    };
+
+    bench_done = false;
+    bench_delivered = 0;
+
+    if (mode == BENCH_RING) {
+        TEST_ASSERT_TRUE(mesh_ring_init(&bench_ring, bench_slots, BENCH_SLOTS));
+        xTaskCreate(bench_ring_consumer, "bench_cons", 4096, NULL, 5, &bench_consumer);
+    } else {
+        bench_queue = xQueueCreate(BENCH_SLOTS, sizeof(mesh_message_t));
+        TEST_ASSERT_NOT_NULL(bench_queue);
+        xTaskCreate(bench_queue_consumer, "bench_cons", 4096, NULL, 5, &bench_consumer);
+    }
+
+    uint32_t dropped = 0;
+    int64_t stall_us = 0, max_stall_us = 0;
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+        wire.timestamp = i;
+        int64_t t0 = esp_timer_get_time();
+
+        if (mode == BENCH_RING) {
+            mesh_rx_frame_t *frame = mesh_ring_reserve(&bench_ring);
+            if (frame) {
+                memcpy(&frame->msg, &wire, sizeof(wire));
+                memcpy(frame->src_mac, mac, sizeof(mac));
+                mesh_ring_commit(&bench_ring);
+                xTaskNotifyGive(bench_consumer);
+            } else {
+                dropped++;
+            }
+        } else {
+            mesh_message_t msg;
+            memcpy(&msg, &wire, sizeof(wire));
+            TickType_t wait = (mode == BENCH_QUEUE_BLOCKING) ? pdMS_TO_TICKS(100) : 0;
+            if (xQueueSend(bench_queue, &msg, wait) != pdTRUE) {
+                dropped++;
+            }
+        }
+
+        int64_t spent = esp_timer_get_time() - t0;
+        stall_us += spent;
+        if (spent > max_stall_us) {
+            max_stall_us = spent;
+        }
+
+        if ((i % BENCH_BURST) == BENCH_BURST - 1) {
+            busy_wait_us(BENCH_GAP_US);
+        }
+    }
+
+    bench_done = true;
+    while (bench_consumer) {
+        vTaskDelay(1);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    if (mode != BENCH_RING) {
+        vQueueDelete(bench_queue);
+    }
+
+    printf("%-22s %10.0f %9.2f%% %12lld %12lld\n", label,
+           bench_delivered * 1e6 / (double)elapsed_us,
+           100.0 * dropped / BENCH_FRAMES,
+           (long long)stall_us, (long long)max_stall_us);
+
+    TEST_ASSERT_EQUAL_UINT32(BENCH_FRAMES, bench_delivered + dropped);
+}
+
+TEST_CASE("mesh_ring vs queue ingress benchmark", "[mesh_ring][perf]") {
+    printf("\n%d frames, %d slots, %d us work/frame, bursts of %d every %d us\n",
+           BENCH_FRAMES, BENCH_SLOTS, BENCH_WORK_US, BENCH_BURST, BENCH_GAP_US);
+    printf("%-22s %10s %10s %12s %12s\n", "path", "frames/s", "dropped", "stall_us", "max_stall_us");
+
+    run_bench(BENCH_QUEUE_BLOCKING, "queue (100 ms block)");
+    run_bench(BENCH_QUEUE_NONBLOCKING, "queue (no block)");
+    run_bench(BENCH_RING, "slot ring");
+}
@@ -0,0 +1,155 @@
+/*
+ * Tests for the hashed timer wheel (mesh_timer_wheel.c)
+ *
+ * Validates that timers fire on their deadline tick and not before, that
+ * re-arming pushes a deadline out, that deadlines beyond one revolution
+ * and across tick counter wrap-around are handled, and that cancelled
+ * timers never fire.
+ *
+ * The [perf] case simulates a fleet sending heartbeats with some devices
+ * going silent, and compares the wheel against scanning every device each
+ * tick: cost per heartbeat, cost per tick, and detection accuracy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "mesh_timer_wheel.h"
+
+#define SIM_DEVICES 10000
+#define SIM_TICKS 7200           // Two hours of 1 s ticks
+#define SIM_PERIOD 30            // Heartbeat every 30 s
+#define SIM_TIMEOUT 90
+#define SIM_SILENT_EVERY 100     // 1% of devices stop sending
+
+static mesh_timer_wheel_t wheel;
+
+static int drain(uint32_t now)
+{
+    int fired = 0;
+    while (mesh_timer_wheel_poll(&wheel, now)) {
+        fired++;
+    }
+    return fired;
+}
+
+TEST_CASE("mesh_timer_wheel fires on the deadline tick", "[timer_wheel]") {
+    mesh_timer_t a = {0}, b = {0};
+    mesh_timer_wheel_init(&wheel, 100);
+
+    mesh_timer_wheel_arm(&wheel, &a, 105);
+    mesh_timer_wheel_arm(&wheel, &b, 110);
+    TEST_ASSERT_EQUAL_UINT32(2, wheel.armed);
+
+    TEST_ASSERT_EQUAL(0, drain(104));
+    TEST_ASSERT_EQUAL_PTR(&a, mesh_timer_wheel_poll(&wheel, 105));
+    TEST_ASSERT_NULL(mesh_timer_wheel_poll(&wheel, 105));
+    TEST_ASSERT_FALSE(mesh_timer_is_armed(&a));
+
+    // Re-arming moves the deadline out
+    mesh_timer_wheel_arm(&wheel, &b, 120);
+    TEST_ASSERT_EQUAL(0, drain(119));
+    TEST_ASSERT_EQUAL_PTR(&b, mesh_timer_wheel_poll(&wheel, 125));
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.armed);
+}
+
+TEST_CASE("mesh_timer_wheel handles long deadlines, wrap and cancel", "[timer_wheel]") {
+    mesh_timer_t far = {0}, wrap = {0}, gone = {0}, late = {0};
+    mesh_timer_wheel_init(&wheel, UINT32_MAX - 10);
+
+    // Same slot as a near deadline, three revolutions later
+    mesh_timer_wheel_arm(&wheel, &far, UINT32_MAX - 5 + 3 * MESH_TIMER_WHEEL_SLOTS);
+    mesh_timer_wheel_arm(&wheel, &wrap, 20);                 // After the counter wraps
+    mesh_timer_wheel_arm(&wheel, &gone, UINT32_MAX - 5);
+    mesh_timer_wheel_cancel(&wheel, &gone);
+
+    TEST_ASSERT_EQUAL(0, drain(19));
+    TEST_ASSERT_EQUAL_PTR(&wrap, mesh_timer_wheel_poll(&wheel, 20));
+    TEST_ASSERT_EQUAL(0, drain(UINT32_MAX - 5 + 3 * MESH_TIMER_WHEEL_SLOTS - 1));
+    TEST_ASSERT_EQUAL_PTR(&far, mesh_timer_wheel_poll(&wheel, UINT32_MAX - 5 + 3 * MESH_TIMER_WHEEL_SLOTS));
+
+    // A deadline already swept fires on the next poll
+    mesh_timer_wheel_arm(&wheel, &late, 0);
+    TEST_ASSERT_EQUAL_PTR(&late, mesh_timer_wheel_poll(&wheel, 1000));
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.armed);
+}
+
+TEST_CASE("mesh_timer_wheel heartbeat fleet simulation", "[timer_wheel][perf]") {
+    static mesh_timer_t timers[SIM_DEVICES];
+    static uint32_t last_seen[SIM_DEVICES];
+    static uint32_t silent_at[SIM_DEVICES];
+    static bool scan_offline[SIM_DEVICES];
+
+    srand(1);
+    memset(timers, 0, sizeof(timers));
+    memset(scan_offline, 0, sizeof(scan_offline));
+    int expected = 0;
+    for (int d = 0; d < SIM_DEVICES; d++) {
+        // Every device sends at least once before going silent
+        silent_at[d] = (d % SIM_SILENT_EVERY == 0)
+                           ? (uint32_t)(SIM_PERIOD + rand() % (SIM_TICKS - SIM_TIMEOUT - 2 * SIM_PERIOD))
+                           : UINT32_MAX;
+        expected += silent_at[d] != UINT32_MAX;
+    }
+
+    // Wheel: re-arm on each heartbeat, poll once per tick
+    mesh_timer_wheel_init(&wheel, 0);
+    int64_t arm_us = 0, poll_us = 0;
+    long beats = 0;
+    int detected = 0, early = 0, max_late = 0;
+    for (uint32_t t = 0; t < SIM_TICKS; t++) {
+        int64_t start = esp_timer_get_time();
+        for (int d = (int)(t % SIM_PERIOD); d < SIM_DEVICES; d += SIM_PERIOD) {
+            if (t < silent_at[d]) {
+                last_seen[d] = t;
+                mesh_timer_wheel_arm(&wheel, &timers[d], t + SIM_TIMEOUT);
+                beats++;
+            }
+        }
+        arm_us += esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        mesh_timer_t *timer;
+        while ((timer = mesh_timer_wheel_poll(&wheel, t)) != NULL) {
+            int d = (int)(timer - timers);
+            int late = (int)(t - last_seen[d]) - SIM_TIMEOUT;
+            early += (late < 0 || t < silent_at[d]) ? 1 : 0;
+            max_late = late > max_late ? late : max_late;
+            detected++;
+        }
+        poll_us += esp_timer_get_time() - start;
+    }
+
+    // Baseline: record last seen, scan every device each tick
+    memset(last_seen, 0, sizeof(last_seen));
+    int64_t scan_us = 0;
+    int scan_detected = 0;
+    for (uint32_t t = 0; t < SIM_TICKS; t++) {
+        for (int d = (int)(t % SIM_PERIOD); d < SIM_DEVICES; d += SIM_PERIOD) {
+            if (t < silent_at[d]) {
+                last_seen[d] = t;
+            }
+        }
+        int64_t start = esp_timer_get_time();
+        for (int d = 0; d < SIM_DEVICES; d++) {
+            if (!scan_offline[d] && t - last_seen[d] >= SIM_TIMEOUT) {
+                scan_offline[d] = true;
+                scan_detected++;
+            }
+        }
+        scan_us += esp_timer_get_time() - start;
+    }
+
+    TEST_ASSERT_EQUAL(expected, detected);
+    TEST_ASSERT_EQUAL(expected, scan_detected);
+    TEST_ASSERT_EQUAL(0, early);
+    TEST_ASSERT_EQUAL(0, max_late);
+
+    printf("\n%d devices, %d s simulated, %ld heartbeats, %d went silent\n",
+           SIM_DEVICES, SIM_TICKS, beats, expected);
+    printf("%-12s %14s %14s %12s\n", "method", "ns/heartbeat", "us/tick", "late (ticks)");
+    printf("%-12s %14.1f %14.2f %12d\n", "wheel", arm_us * 1000.0 / beats, (double)poll_us / SIM_TICKS, max_late);
+    printf("%-12s %14s %14.2f %12d\n", "full scan", "-", (double)scan_us / SIM_TICKS, 0);
+}
@@ -0,0 +1,313 @@
+/*
+ * Tests for edge Ed25519 verification (mesh_verify.c)
+ *
+ * Validates that frames signed over "{timestamp}:{payload}" with a loaded
+ * key verify, that tampered frames (including a renumbered boot_id or seq)
+ * are flagged as forged, that malformed keys are refused, and that backend
+ * command signatures verify with the network key and are refused when stale
+ * or replayed.
+ *
+ * The [perf] case reports verifications/sec for the raw libsodium call,
+ * the single-frame path and the burst path. Runs on target or on the host
+ * via `idf.py --preview set-target linux`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "sodium.h"
+#include "protocol.h"
+#include "mesh_verify.h"
+
+#define BENCH_FRAMES 2000
+#define BENCH_BURST 8
+
+static uint8_t device_pk[crypto_sign_PUBLICKEYBYTES];
+static uint8_t device_sk[crypto_sign_SECRETKEYBYTES];
+static bool keys_ready = false;
+
+static void setup_keys(void)
+{
+    if (keys_ready) {
+        return;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_init());
+    crypto_sign_keypair(device_pk, device_sk);
+
+    char hex[2 * crypto_sign_PUBLICKEYBYTES + 1];
+    sodium_bin2hex(hex, sizeof(hex), device_pk, sizeof(device_pk));
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_set_key("ESP32-SIGNED", hex));
+    keys_ready = true;
+}
+
+static void make_signed(mesh_message_t *msg, uint8_t type, const char *device_id, uint32_t timestamp)
+{
+    char message[256];
+    memset(msg, 0, sizeof(*msg));
+    msg->type = type;
+    strncpy(msg->device_id, device_id, sizeof(msg->device_id) - 1);
+    msg->timestamp = timestamp;
+    snprintf(msg->payload, sizeof(msg->payload), "{\"motion\":true,\"sensitivity\":5,\"cooldown\":30000}");
+
+    int len = snprintf(message, sizeof(message), "%lu:%s", (unsigned long)timestamp, msg->payload);
+    crypto_sign_detached(msg->signature, NULL, (const unsigned char *)message, len, device_sk);
+}
+
+TEST_CASE("mesh_verify accepts valid and drops forged frames", "[mesh_verify]") {
+    setup_keys();
+    mesh_message_t msg;
+
+    make_signed(&msg, MSG_TYPE_MOTION, "ESP32-SIGNED", 1735689600);
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, mesh_verify_message(&msg));
+
+    msg.payload[10] ^= 0x01;
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+
+    make_signed(&msg, MSG_TYPE_LOG, "ESP32-SIGNED", 1735689600);
+    msg.timestamp++;
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+
+    make_signed(&msg, MSG_TYPE_LOG, "ESP32-NOKEY", 1735689600);
+    TEST_ASSERT_EQUAL(MESH_AUTH_UNKNOWN_KEY, mesh_verify_message(&msg));
+
+    make_signed(&msg, MSG_TYPE_HEARTBEAT, "ESP32-SIGNED", 1735689600);
+    TEST_ASSERT_EQUAL(MESH_AUTH_UNSIGNED, mesh_verify_message(&msg));
+}
+
+// Sign fields the way the device does: over the payload the home base renders
+static void sign_fields(mesh_fields_t *fields, uint8_t *signature)
+{
+    char payload[sizeof(((mesh_message_t *)0)->payload)];
+    char message[256];
+    protocol_render_payload(fields, payload, sizeof(payload));
+    int len = snprintf(message, sizeof(message), "%lu:%s", (unsigned long)fields->timestamp, payload);
+    crypto_sign_detached(signature, NULL, (const unsigned char *)message, len, device_sk);
+    fields->signature = signature;
+    fields->present |= MESH_HAS(MESH_FIELD_SIGNATURE);
+}
+
+TEST_CASE("mesh_verify covers a v2 frame's boot_id and seq", "[mesh_verify]") {
+    setup_keys();
+    mesh_fields_t fields;
+    mesh_message_t msg;
+    uint8_t signature[crypto_sign_BYTES];
+
+    memset(&fields, 0, sizeof(fields));
+    fields.type = MSG_TYPE_MOTION;
+    strcpy(fields.device_id, "ESP32-SIGNED");
+    fields.timestamp = 1735689600;
+    fields.motion = true;
+    fields.boot_id = 12;
+    fields.seq = 4321;
+    fields.present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_MOTION) |
+                     MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+    sign_fields(&fields, signature);
+
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, mesh_verify_message(&msg));
+
+    // A captured frame renumbered to slip past the replay window
+    fields.seq++;
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+
+    fields.seq--;
+    fields.boot_id++;
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+}
+
+TEST_CASE("mesh_verify covers a command ack", "[mesh_verify]") {
+    setup_keys();
+    mesh_fields_t fields;
+    mesh_message_t msg;
+    uint8_t signature[crypto_sign_BYTES];
+
+    memset(&fields, 0, sizeof(fields));
+    fields.type = MSG_TYPE_ACK;
+    strcpy(fields.device_id, "ESP32-SIGNED");
+    fields.cmd_id = 77;
+    fields.status = MESH_ACK_OK;
+    fields.boot_id = 12;
+    fields.seq = 4322;
+    fields.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_STATUS) |
+                     MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+    sign_fields(&fields, signature);
+
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, mesh_verify_message(&msg));
+
+    // Spoofed acks: another command, a flipped status, or none at all
+    fields.cmd_id = 78;
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+
+    fields.cmd_id = 77;
+    fields.status = MESH_ACK_BUSY;
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+
+    fields.status = MESH_ACK_OK;
+    fields.signature = NULL;
+    fields.present &= ~MESH_HAS(MESH_FIELD_SIGNATURE);
+    protocol_fields_to_message(&fields, &msg);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, mesh_verify_message(&msg));
+}
+
+TEST_CASE("mesh_verify refuses malformed keys", "[mesh_verify]") {
+    setup_keys();
+    char zeros[65];
+    memset(zeros, '0', 64);
+    zeros[64] = '\0';
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mesh_verify_set_key("ESP32-BAD", "abcd"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mesh_verify_set_key("ESP32-BAD", zeros));   // small-order point
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+                      mesh_verify_set_key("ESP32-BAD", "zz00000000000000000000000000000000000000000000000000000000000000"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mesh_verify_set_key("DEVICE-ID-TOO-LONG-FOR-FRAME", zeros));
+}
+
+TEST_CASE("mesh_verify_batch sets a verdict on every frame", "[mesh_verify]") {
+    setup_keys();
+    mesh_rx_frame_t storage[4];
+    mesh_rx_frame_t *frames[4];
+    for (int i = 0; i < 4; i++) {
+        frames[i] = &storage[i];
+        storage[i].auth = MESH_AUTH_PENDING;
+        make_signed(&storage[i].msg, MSG_TYPE_LOG, "ESP32-SIGNED", 1000 + i);
+    }
+    storage[2].msg.signature[0] ^= 0x80;
+
+    mesh_verify_batch(frames, 4);
+
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, storage[0].auth);
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, storage[1].auth);
+    TEST_ASSERT_EQUAL(MESH_AUTH_FORGED, storage[2].auth);
+    TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, storage[3].auth);
+}
+
+TEST_CASE("mesh_verify checks command signatures with the network key", "[mesh_verify]") {
+    setup_keys();
+    uint8_t pk[crypto_sign_PUBLICKEYBYTES], sk[crypto_sign_SECRETKEYBYTES], sig[crypto_sign_BYTES];
+    char pk_hex[65], sig_hex[129];
+    const char *message = "1735689600:00112233445566778899aabbccddeeff:set_led:{\"color\": \"red\"}";
+
+    crypto_sign_keypair(pk, sk);
+    crypto_sign_detached(sig, NULL, (const unsigned char *)message, strlen(message), sk);
+    sodium_bin2hex(pk_hex, sizeof(pk_hex), pk, sizeof(pk));
+    sodium_bin2hex(sig_hex, sizeof(sig_hex), sig, sizeof(sig));
+
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_set_network_key(pk_hex));
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_network_signature(message, sig_hex));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC,
+                      mesh_verify_network_signature("1735689600:00112233445566778899aabbccddeeff:reboot:{}", sig_hex));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mesh_verify_network_signature(message, "00"));
+}
+
+static void sign_request(const uint8_t *sk, int64_t timestamp, const char *nonce, const char *body, char *sig_hex)
+{
+    char message[256];
+    uint8_t sig[crypto_sign_BYTES];
+    snprintf(message, sizeof(message), "%lld:%s:%s", (long long)timestamp, nonce, body);
+    crypto_sign_detached(sig, NULL, (const unsigned char *)message, strlen(message), sk);
+    sodium_bin2hex(sig_hex, 2 * crypto_sign_BYTES + 1, sig, sizeof(sig));
+}
+
+TEST_CASE("mesh_verify refuses stale and replayed backend requests", "[mesh_verify]") {
+    setup_keys();
+    uint8_t pk[crypto_sign_PUBLICKEYBYTES], sk[crypto_sign_SECRETKEYBYTES];
+    char pk_hex[65], sig_hex[129];
+    const int64_t now = 1735689600;
+    const char *body = "reboot:{}";
+
+    crypto_sign_keypair(pk, sk);
+    sodium_bin2hex(pk_hex, sizeof(pk_hex), pk, sizeof(pk));
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_set_network_key(pk_hex));
+
+    // Fresh, then the same nonce again is a replay
+    sign_request(sk, now - 5, "aa01", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_command(now - 5, "aa01", body, sig_hex, now));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, mesh_verify_command(now - 5, "aa01", body, sig_hex, now));
+
+    // Outside the window either way, or before the clock has synced
+    sign_request(sk, now - 61, "aa02", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, mesh_verify_command(now - 61, "aa02", body, sig_hex, now));
+    sign_request(sk, now + 61, "aa03", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, mesh_verify_command(now + 61, "aa03", body, sig_hex, now));
+    sign_request(sk, 100, "aa04", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, mesh_verify_command(100, "aa04", body, sig_hex, 100));
+
+    // A forged request must not burn its nonce
+    sign_request(sk, now, "aa05", "reboot:{\"x\": 1}", sig_hex);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, mesh_verify_command(now, "aa05", body, sig_hex, now));
+    sign_request(sk, now, "aa05", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_command(now, "aa05", body, sig_hex, now));
+
+    // Flooding the cache evicts old nonces, which the window then refuses
+    char nonce[16];
+    for (int i = 0; i < 64; i++) {
+        snprintf(nonce, sizeof(nonce), "bb%02d", i);
+        sign_request(sk, now + 120, nonce, body, sig_hex);
+        TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_command(now + 120, nonce, body, sig_hex, now + 120));
+    }
+    sign_request(sk, now - 5, "aa01", body, sig_hex);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, mesh_verify_command(now - 5, "aa01", body, sig_hex, now + 120));
+}
+
+TEST_CASE("mesh_verify only provisions the first network key unsigned", "[mesh_verify]") {
+    setup_keys();
+    uint8_t pk[crypto_sign_PUBLICKEYBYTES], sk[crypto_sign_SECRETKEYBYTES];
+    char pk_hex[65];
+
+    crypto_sign_keypair(pk, sk);
+    sodium_bin2hex(pk_hex, sizeof(pk_hex), pk, sizeof(pk));
+    TEST_ASSERT_EQUAL(ESP_OK, mesh_verify_set_network_key(pk_hex));
+    TEST_ASSERT_TRUE(mesh_verify_has_network_key());
+
+    crypto_sign_keypair(pk, sk);
+    sodium_bin2hex(pk_hex, sizeof(pk_hex), pk, sizeof(pk));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, mesh_verify_provision_network_key(pk_hex));
+}
+
+TEST_CASE("mesh_verify single vs burst benchmark", "[mesh_verify][perf]") {
+    static mesh_rx_frame_t storage[BENCH_FRAMES];
+    static mesh_rx_frame_t *frames[BENCH_FRAMES];
+    setup_keys();
+
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        make_signed(&storage[i].msg, MSG_TYPE_MOTION, "ESP32-SIGNED", 1735689600 + i);
+        frames[i] = &storage[i];
+    }
+
+    char message[256];
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        int len = snprintf(message, sizeof(message), "%lu:%s",
+                           (unsigned long)storage[i].msg.timestamp, storage[i].msg.payload);
+        TEST_ASSERT_EQUAL(0, crypto_sign_verify_detached(storage[i].msg.signature,
+                                                         (const unsigned char *)message, len, device_pk));
+    }
+    int64_t raw_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, mesh_verify_message(&storage[i].msg));
+    }
+    int64_t single_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_FRAMES; i += BENCH_BURST) {
+        mesh_verify_batch(&frames[i], BENCH_BURST);
+    }
+    int64_t batch_us = esp_timer_get_time() - start;
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        TEST_ASSERT_EQUAL(MESH_AUTH_VERIFIED, storage[i].auth);
+    }
+
+    printf("\n%d signed frames, bursts of %d\n", BENCH_FRAMES, BENCH_BURST);
+    printf("%-24s %12s %10s\n", "path", "verifies/s", "us/frame");
+    printf("%-24s %12.0f %10.1f\n", "libsodium (raw)", BENCH_FRAMES * 1e6 / raw_us, (double)raw_us / BENCH_FRAMES);
+    printf("%-24s %12.0f %10.1f\n", "mesh_verify_message", BENCH_FRAMES * 1e6 / single_us, (double)single_us / BENCH_FRAMES);
+    printf("%-24s %12.0f %10.1f\n", "mesh_verify_batch", BENCH_FRAMES * 1e6 / batch_us, (double)batch_us / BENCH_FRAMES);
+}
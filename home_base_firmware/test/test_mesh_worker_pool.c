@@ -0,0 +1,214 @@
+/*
+ * Tests for the sharded mesh worker pool (mesh_worker_pool.c)
+ *
+ * Validates that frames from one device are always handled by the same
+ * worker in arrival order, that motion frames overtake queued logs, that
+ * logs are shed before their lane overflows or when the lanes ahead of them
+ * back up, and that per-worker counters add up.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "protocol.h"
+#include "mesh_worker_pool.h"
+
+#define POOL_TEST_DEVICES 6
+#define POOL_TEST_FRAMES_PER_DEVICE 200
+#define POOL_TEST_QUEUED_LOGS 10
+
+static _Atomic uint32_t handled_total = 0;
+static uint32_t next_expected[POOL_TEST_DEVICES];
+static _Atomic uint32_t order_errors = 0;
+
+// Priority test: the first frame blocks the worker until the gate opens
+static SemaphoreHandle_t gate = NULL;
+static uint8_t handled_types[POOL_TEST_QUEUED_LOGS + 2];
+static _Atomic uint32_t handled_count = 0;
+
+static void record_frame(mesh_rx_frame_t *frame)
+{
+    if (gate) {
+        uint32_t n = atomic_fetch_add(&handled_count, 1);
+        if (n == 0) {
+            xSemaphoreTake(gate, portMAX_DELAY);
+        }
+        if (n < sizeof(handled_types)) {
+            handled_types[n] = frame->msg.type;
+        }
+        return;
+    }
+
+    int device = frame->src_mac[5];
+    if (frame->msg.timestamp != next_expected[device]) {
+        order_errors++;
+    }
+    next_expected[device] = frame->msg.timestamp + 1;
+    handled_total++;
+}
+
+static void start_pool(void)
+{
+    esp_err_t err = mesh_worker_pool_start(record_frame);
+    TEST_ASSERT_TRUE(err == ESP_OK || err == ESP_ERR_INVALID_STATE);
+}
+
+static void submit_blocking(uint8_t type, int device, uint32_t timestamp)
+{
+    uint8_t mac[6] = {0x10, 0x20, 0x30, 0x40, 0x50, (uint8_t)device};
+    mesh_message_t msg = { .type = type, .timestamp = timestamp };
+    snprintf(msg.device_id, sizeof(msg.device_id), "ESP32-%03d", device);
+
+    // Back off instead of dropping so every frame is delivered
+    while (!mesh_worker_pool_submit(mac, -60, &msg)) {
+        vTaskDelay(1);
+    }
+}
+
+TEST_CASE("mesh_worker_pool shards by device_id deterministically", "[mesh_pool]") {
+    int shard = mesh_worker_pool_shard("ESP32-ABC123");
+    TEST_ASSERT_EQUAL(shard, mesh_worker_pool_shard("ESP32-ABC123"));
+    TEST_ASSERT_TRUE(shard >= 0 && shard < mesh_worker_pool_get_worker_count());
+}
+
+TEST_CASE("mesh_worker_pool maps message types to lanes", "[mesh_pool]") {
+    TEST_ASSERT_EQUAL(MESH_LANE_MOTION, mesh_worker_pool_lane_for_type(MSG_TYPE_MOTION));
+    TEST_ASSERT_EQUAL(MESH_LANE_COMMAND, mesh_worker_pool_lane_for_type(MSG_TYPE_COMMAND));
+    TEST_ASSERT_EQUAL(MESH_LANE_COMMAND, mesh_worker_pool_lane_for_type(MSG_TYPE_ACK));
+    TEST_ASSERT_EQUAL(MESH_LANE_HEARTBEAT, mesh_worker_pool_lane_for_type(MSG_TYPE_HEARTBEAT));
+    TEST_ASSERT_EQUAL(MESH_LANE_LOG, mesh_worker_pool_lane_for_type(MSG_TYPE_LOG));
+    TEST_ASSERT_EQUAL(MESH_LANE_LOG, mesh_worker_pool_lane_for_type(0x7F));
+}
+
+TEST_CASE("mesh_worker_pool keeps per-device order", "[mesh_pool]") {
+    start_pool();
+
+    uint32_t submitted = 0;
+    for (uint32_t n = 0; n < POOL_TEST_FRAMES_PER_DEVICE; n++) {
+        for (int d = 0; d < POOL_TEST_DEVICES; d++) {
+            submit_blocking(MSG_TYPE_LOG, d, n);
+            submitted++;
+        }
+    }
+
+    while (handled_total < submitted) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, order_errors);
+
+    // Let the workers publish their counters for the last frames
+    vTaskDelay(pdMS_TO_TICKS(20));
+    uint32_t processed = 0;
+    for (int i = 0; i < mesh_worker_pool_get_worker_count(); i++) {
+        mesh_worker_stats_t stats;
+        mesh_worker_pool_get_stats(i, &stats);
+        TEST_ASSERT_EQUAL_UINT32(stats.lanes[MESH_LANE_LOG].accepted, stats.lanes[MESH_LANE_LOG].processed);
+        processed += stats.processed;
+    }
+    TEST_ASSERT_EQUAL_UINT32(submitted, processed);
+}
+
+TEST_CASE("mesh_worker_pool serves motion ahead of queued logs", "[mesh_pool]") {
+    gate = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(gate);
+    start_pool();
+
+    // First log occupies the worker; the rest queue up behind it
+    submit_blocking(MSG_TYPE_LOG, 0, 0);
+    while (handled_count == 0) {
+        vTaskDelay(1);
+    }
+    for (int i = 1; i <= POOL_TEST_QUEUED_LOGS; i++) {
+        submit_blocking(MSG_TYPE_LOG, 0, i);
+    }
+    submit_blocking(MSG_TYPE_MOTION, 0, 100);
+
+    xSemaphoreGive(gate);
+    while (handled_count < POOL_TEST_QUEUED_LOGS + 2) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    TEST_ASSERT_EQUAL_HEX8(MSG_TYPE_LOG, handled_types[0]);
+    TEST_ASSERT_EQUAL_HEX8(MSG_TYPE_MOTION, handled_types[1]);
+    TEST_ASSERT_EQUAL_HEX8(MSG_TYPE_LOG, handled_types[2]);
+    gate = NULL;
+}
+
+// Hold device 0's worker inside the handler so later frames stay queued
+static void hold_worker(void)
+{
+    gate = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(gate);
+    handled_count = 0;
+    start_pool();
+    submit_blocking(MSG_TYPE_LOG, 0, 0);
+    while (handled_count == 0) {
+        vTaskDelay(1);
+    }
+}
+
+static void release_worker(uint32_t queued)
+{
+    xSemaphoreGive(gate);
+    while (handled_count < queued + 1) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    gate = NULL;
+}
+
+static bool submit_once(uint8_t type, uint32_t timestamp)
+{
+    uint8_t mac[6] = {0x10, 0x20, 0x30, 0x40, 0x50, 0};
+    mesh_message_t msg = { .type = type, .timestamp = timestamp };
+    snprintf(msg.device_id, sizeof(msg.device_id), "ESP32-%03d", 0);
+    return mesh_worker_pool_submit(mac, -60, &msg);
+}
+
+TEST_CASE("mesh_worker_pool sheds logs before their lane overflows", "[mesh_pool]") {
+    hold_worker();
+    int worker = mesh_worker_pool_shard("ESP32-000");
+    mesh_worker_stats_t before, after;
+    mesh_worker_pool_get_stats(worker, &before);
+
+    uint32_t queued = 0;
+    while (queued < 64 && submit_once(MSG_TYPE_LOG, queued + 1)) {
+        queued++;
+    }
+    mesh_worker_pool_get_stats(worker, &after);
+    TEST_ASSERT_EQUAL_UINT32(24, queued + 1);   // 75% of the 32-slot log lane, with the held frame
+    TEST_ASSERT_EQUAL_UINT32(1, after.lanes[MESH_LANE_LOG].shed - before.lanes[MESH_LANE_LOG].shed);
+    TEST_ASSERT_EQUAL_UINT32(before.lanes[MESH_LANE_LOG].dropped, after.lanes[MESH_LANE_LOG].dropped);
+
+    // Motion still gets in
+    TEST_ASSERT_TRUE(submit_once(MSG_TYPE_MOTION, 100));
+    release_worker(queued + 1);
+}
+
+TEST_CASE("mesh_worker_pool sheds logs when the lanes ahead back up", "[mesh_pool]") {
+    hold_worker();
+    int worker = mesh_worker_pool_shard("ESP32-000");
+
+    // 48 frames ahead of logs: 75% of the motion, command and heartbeat slots
+    uint32_t queued = 0;
+    for (int i = 0; i < 32; i++, queued++) {
+        TEST_ASSERT_TRUE(submit_once(MSG_TYPE_HEARTBEAT, i));
+    }
+    for (int i = 0; i < 15; i++, queued++) {
+        TEST_ASSERT_TRUE(submit_once(MSG_TYPE_MOTION, i));
+    }
+    TEST_ASSERT_TRUE(submit_once(MSG_TYPE_LOG, 1));
+    queued++;
+    TEST_ASSERT_TRUE(submit_once(MSG_TYPE_MOTION, 15));
+    queued++;
+
+    mesh_worker_stats_t before, after;
+    mesh_worker_pool_get_stats(worker, &before);
+    TEST_ASSERT_FALSE(submit_once(MSG_TYPE_LOG, 2));
+    mesh_worker_pool_get_stats(worker, &after);
+    TEST_ASSERT_EQUAL_UINT32(1, after.lanes[MESH_LANE_LOG].shed - before.lanes[MESH_LANE_LOG].shed);
+    release_worker(queued);
+}
@@ -0,0 +1,315 @@
+/*
+ * Tests for the shared ESP-NOW frame codec (protocol.c)
+ *
+ * Validates v2 round trips (including command acks and group commands), that v2 frames render the exact payload text a
+ * v1 sender would have signed, that v1 frames still decode, and that
+ * truncated or malformed frames are rejected while unknown fields are
+ * skipped.
+ *
+ * The [perf] case prints encode/decode cost and on-air size per message
+ * type for v1 versus v2. Runs on target or on the host via
+ * `idf.py --preview set-target linux`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "protocol.h"
+
+#define BENCH_ITERATIONS 100000
+
+static uint8_t test_signature[64];
+
+static void make_heartbeat(mesh_fields_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->type = MSG_TYPE_HEARTBEAT;
+    strcpy(f->device_id, "ESP32-C6-A1B2C3");
+    f->timestamp = 1735689600;
+    f->heap = 214532;
+    f->uptime = 86400;
+    f->boot_id = 12;
+    f->seq = 4321;
+    f->present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_HEAP) | MESH_HAS(MESH_FIELD_UPTIME) |
+                 MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+}
+
+static void make_motion(mesh_fields_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->type = MSG_TYPE_MOTION;
+    strcpy(f->device_id, "ESP32-C6-A1B2C3");
+    f->timestamp = 1735689600;
+    f->motion = true;
+    f->sensitivity = 5;
+    f->cooldown_ms = 30000;
+    f->signature = test_signature;
+    f->present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_MOTION) |
+                 MESH_HAS(MESH_FIELD_SENSITIVITY) | MESH_HAS(MESH_FIELD_COOLDOWN_MS) |
+                 MESH_HAS(MESH_FIELD_SIGNATURE);
+}
+
+static void make_log(mesh_fields_t *f, const char *text)
+{
+    memset(f, 0, sizeof(*f));
+    f->type = MSG_TYPE_LOG;
+    strcpy(f->device_id, "ESP32-C6-A1B2C3");
+    f->timestamp = 1735689600;
+    f->payload = text;
+    f->payload_len = (uint16_t)strlen(text);
+    f->signature = test_signature;
+    f->present = MESH_HAS(MESH_FIELD_TIMESTAMP) | MESH_HAS(MESH_FIELD_PAYLOAD) | MESH_HAS(MESH_FIELD_SIGNATURE);
+}
+
+static const char *test_log_text = "{\"level\":\"info\",\"msg\":\"PIR armed after cooldown\"}";
+
+TEST_CASE("protocol v2 round-trips a heartbeat", "[protocol]") {
+    mesh_fields_t in, out;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    make_heartbeat(&in);
+
+    int len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_TRUE(protocol_is_v2(frame, len));
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, len, &out));
+
+    TEST_ASSERT_EQUAL_HEX8(MSG_TYPE_HEARTBEAT, out.type);
+    TEST_ASSERT_EQUAL_STRING("ESP32-C6-A1B2C3", out.device_id);
+    TEST_ASSERT_EQUAL_UINT32(in.timestamp, out.timestamp);
+    TEST_ASSERT_EQUAL_UINT32(in.heap, out.heap);
+    TEST_ASSERT_EQUAL_UINT32(in.uptime, out.uptime);
+    TEST_ASSERT_EQUAL_UINT32(in.boot_id, out.boot_id);
+    TEST_ASSERT_EQUAL_UINT32(in.seq, out.seq);
+    TEST_ASSERT_TRUE(out.present & MESH_HAS(MESH_FIELD_SEQ));
+    TEST_ASSERT_NULL(out.signature);
+}
+
+TEST_CASE("protocol v2 round-trips a command ack", "[protocol]") {
+    mesh_fields_t in, out;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    memset(&in, 0, sizeof(in));
+    in.type = MSG_TYPE_ACK;
+    strcpy(in.device_id, "ESP32-C6-A1B2C3");
+    in.cmd_id = 0x7FFFFFF1;
+    in.status = MESH_ACK_BUSY;
+    in.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_STATUS);
+
+    int len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, len, &out));
+    TEST_ASSERT_EQUAL_HEX8(MSG_TYPE_ACK, out.type);
+    TEST_ASSERT_EQUAL_UINT32(in.cmd_id, out.cmd_id);
+    TEST_ASSERT_EQUAL(MESH_ACK_BUSY, out.status);
+    TEST_ASSERT_TRUE(out.present & MESH_HAS(MESH_FIELD_CMD_ID));
+}
+
+TEST_CASE("protocol v2 fits a full group command with its target bitmap", "[protocol]") {
+    mesh_fields_t in, out;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    uint8_t targets[MESH_TARGET_BITMAP_LEN] = {0};
+    char payload[sizeof(((mesh_message_t *)0)->payload)];
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+
+    uint16_t bit = protocol_target_bit("ESP32-C6-A1B2C3");
+    targets[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+
+    memset(&in, 0, sizeof(in));
+    in.type = MSG_TYPE_COMMAND;
+    strcpy(in.device_id, MESH_BROADCAST_ID);
+    in.cmd_id = 0x7FFFFFF1;
+    in.payload = payload;
+    in.payload_len = (uint16_t)strlen(payload);
+    in.targets = targets;
+    in.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_PAYLOAD) | MESH_HAS(MESH_FIELD_TARGETS);
+
+    int len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, len, &out));
+    TEST_ASSERT_EQUAL_STRING(MESH_BROADCAST_ID, out.device_id);
+    TEST_ASSERT_TRUE(out.present & MESH_HAS(MESH_FIELD_TARGETS));
+    TEST_ASSERT_TRUE(protocol_targets_include(out.targets, bit));
+    TEST_ASSERT_FALSE(protocol_targets_include(out.targets, (uint16_t)((bit + 1) % (MESH_TARGET_BITMAP_LEN * 8))));
+}
+
+TEST_CASE("protocol v2 renders the same payload a v1 sender signs", "[protocol]") {
+    mesh_fields_t in, out;
+    mesh_message_t msg;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    for (int i = 0; i < 64; i++) {
+        test_signature[i] = (uint8_t)i;
+    }
+
+    make_motion(&in);
+    int len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_TRUE(protocol_decode_frame(frame, len, &msg));
+    TEST_ASSERT_EQUAL_STRING("{\"motion\":true,\"sensitivity\":5,\"cooldown\":30000}", msg.payload);
+    TEST_ASSERT_EQUAL_MEMORY(test_signature, msg.signature, 64);
+
+    make_heartbeat(&in);
+    len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, len, &out));
+    protocol_fields_to_message(&out, &msg);
+    TEST_ASSERT_EQUAL_STRING("{\"heap\":214532,\"uptime\":86400}", msg.payload);
+
+    make_log(&in, test_log_text);
+    len = protocol_v2_encode(&in, frame, sizeof(frame));
+    TEST_ASSERT_TRUE(protocol_decode_frame(frame, len, &msg));
+    TEST_ASSERT_EQUAL_STRING(test_log_text, msg.payload);
+}
+
+TEST_CASE("protocol v2 puts boot_id and seq in the signed motion payload", "[protocol]") {
+    mesh_fields_t in;
+    mesh_message_t msg;
+
+    make_motion(&in);
+    TEST_ASSERT_FALSE(protocol_binds_seq(&in));
+
+    in.boot_id = 12;
+    in.seq = 4321;
+    in.present |= MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+    TEST_ASSERT_TRUE(protocol_binds_seq(&in));
+    protocol_fields_to_message(&in, &msg);
+    TEST_ASSERT_EQUAL_STRING("{\"motion\":true,\"sensitivity\":5,\"cooldown\":30000,\"boot_id\":12,\"seq\":4321}",
+                             msg.payload);
+
+    // Heartbeats are unsigned and keep the v1 payload
+    make_heartbeat(&in);
+    TEST_ASSERT_FALSE(protocol_binds_seq(&in));
+}
+
+TEST_CASE("protocol v2 renders a command ack as signed text", "[protocol]") {
+    mesh_fields_t in;
+    mesh_message_t msg;
+
+    memset(&in, 0, sizeof(in));
+    in.type = MSG_TYPE_ACK;
+    strcpy(in.device_id, "ESP32-C6-A1B2C3");
+    in.cmd_id = 77;
+    in.status = MESH_ACK_BUSY;
+    in.boot_id = 12;
+    in.seq = 4321;
+    in.present = MESH_HAS(MESH_FIELD_CMD_ID) | MESH_HAS(MESH_FIELD_STATUS) |
+                 MESH_HAS(MESH_FIELD_BOOT_ID) | MESH_HAS(MESH_FIELD_SEQ);
+    TEST_ASSERT_TRUE(protocol_binds_seq(&in));
+    protocol_fields_to_message(&in, &msg);
+    TEST_ASSERT_EQUAL_STRING("{\"cmd_id\":77,\"status\":1,\"boot_id\":12,\"seq\":4321}", msg.payload);
+
+    in.present &= ~MESH_HAS(MESH_FIELD_SEQ);
+    TEST_ASSERT_FALSE(protocol_binds_seq(&in));
+    protocol_fields_to_message(&in, &msg);
+    TEST_ASSERT_EQUAL_STRING("{\"cmd_id\":77,\"status\":1}", msg.payload);
+}
+
+TEST_CASE("protocol still decodes fixed-size v1 frames", "[protocol]") {
+    mesh_message_t v1 = {0}, msg;
+    v1.type = MSG_TYPE_LOG;
+    strcpy(v1.device_id, "ESP32-LEGACY");
+    v1.timestamp = 42;
+    strcpy(v1.payload, "{\"level\":\"warn\"}");
+
+    TEST_ASSERT_FALSE(protocol_is_v2((const uint8_t *)&v1, sizeof(v1)));
+    TEST_ASSERT_TRUE(protocol_decode_frame((const uint8_t *)&v1, sizeof(v1), &msg));
+    TEST_ASSERT_EQUAL_STRING("ESP32-LEGACY", msg.device_id);
+    TEST_ASSERT_EQUAL_UINT32(42, msg.timestamp);
+
+    TEST_ASSERT_FALSE(protocol_decode_frame((const uint8_t *)&v1, sizeof(v1) - 1, &msg));
+}
+
+TEST_CASE("protocol v2 rejects truncated and malformed frames", "[protocol]") {
+    mesh_fields_t in, out;
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    make_log(&in, test_log_text);
+    int len = protocol_v2_encode(&in, frame, sizeof(frame));
+
+    // Every strict prefix that cuts a field in half must fail
+    int rejected = 0;
+    for (int cut = 2; cut < len; cut++) {
+        if (!protocol_v2_decode(frame, cut, &out)) {
+            rejected++;
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(0, rejected);
+    TEST_ASSERT_FALSE(protocol_v2_decode(frame, len - 1, &out));
+
+    // No device_id
+    const uint8_t no_id[] = { MESH_PROTO_V2_MARKER, MSG_TYPE_LOG, (MESH_FIELD_TIMESTAMP << 3) | MESH_WIRE_VARINT, 0x01 };
+    TEST_ASSERT_FALSE(protocol_v2_decode(no_id, sizeof(no_id), &out));
+
+    // Oversized device_id
+    uint8_t long_id[24] = { MESH_PROTO_V2_MARKER, MSG_TYPE_LOG, (MESH_FIELD_DEVICE_ID << 3) | MESH_WIRE_BYTES, 20 };
+    TEST_ASSERT_FALSE(protocol_v2_decode(long_id, sizeof(long_id), &out));
+
+    // Unknown wire type
+    const uint8_t bad_wire[] = { MESH_PROTO_V2_MARKER, MSG_TYPE_LOG, (MESH_FIELD_DEVICE_ID << 3) | 5, 0x00 };
+    TEST_ASSERT_FALSE(protocol_v2_decode(bad_wire, sizeof(bad_wire), &out));
+
+    // Encoder refuses to overflow the output buffer
+    TEST_ASSERT_EQUAL(-1, protocol_v2_encode(&in, frame, 20));
+}
+
+TEST_CASE("protocol v2 skips unknown fields", "[protocol]") {
+    mesh_fields_t out;
+    const uint8_t frame[] = {
+        MESH_PROTO_V2_MARKER, MSG_TYPE_HEARTBEAT,
+        (MESH_FIELD_DEVICE_ID << 3) | MESH_WIRE_BYTES, 3, 'd', 'e', 'v',
+        (30 << 3) | MESH_WIRE_VARINT, 0xFF, 0x01,           // future varint field
+        (31 << 3) | MESH_WIRE_BYTES, 2, 0xAA, 0xBB,          // future bytes field
+        (MESH_FIELD_HEAP << 3) | MESH_WIRE_VARINT, 0x80, 0x01,
+    };
+
+    TEST_ASSERT_TRUE(protocol_v2_decode(frame, sizeof(frame), &out));
+    TEST_ASSERT_EQUAL_STRING("dev", out.device_id);
+    TEST_ASSERT_EQUAL_UINT32(128, out.heap);
+    TEST_ASSERT_EQUAL_UINT32(0, out.present & MESH_HAS(30));
+}
+
+static void bench_type(const char *name, const mesh_fields_t *in)
+{
+    uint8_t frame[MESH_PROTO_V2_MAX_LEN];
+    mesh_fields_t out;
+    mesh_message_t msg;
+    volatile int sink = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sink += protocol_v2_encode(in, frame, sizeof(frame));
+    }
+    int64_t encode_us = esp_timer_get_time() - start;
+
+    int len = protocol_v2_encode(in, frame, sizeof(frame));
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sink += protocol_v2_decode(frame, len, &out);
+    }
+    int64_t decode_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sink += protocol_decode_frame(frame, len, &msg);
+    }
+    int64_t to_msg_us = esp_timer_get_time() - start;
+    (void)sink;
+
+    int v1_len = (int)sizeof(mesh_message_t);
+    printf("%-10s %6d %6d %7.1f%% %10.1f %10.1f %12.1f\n", name, v1_len, len,
+           100.0 * (v1_len - len) / v1_len,
+           1000.0 * encode_us / BENCH_ITERATIONS,
+           1000.0 * decode_us / BENCH_ITERATIONS,
+           1000.0 * to_msg_us / BENCH_ITERATIONS);
+}
+
+TEST_CASE("protocol v1 vs v2 size and codec benchmark", "[protocol][perf]") {
+    mesh_fields_t f;
+
+    printf("\n%d iterations per operation\n", BENCH_ITERATIONS);
+    printf("%-10s %6s %6s %8s %10s %10s %12s\n",
+           "type", "v1_B", "v2_B", "saved", "enc_ns", "dec_ns", "dec+render_ns");
+
+    make_heartbeat(&f);
+    bench_type("heartbeat", &f);
+    make_motion(&f);
+    bench_type("motion", &f);
+    make_log(&f, test_log_text);
+    bench_type("log", &f);
+}
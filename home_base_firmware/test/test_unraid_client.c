@@ -0,0 +1,1296 @@
+/*
+ * Tests for the Unraid uplink (unraid_client.c)
+ *
+ * Validates that queued messages share one keep-alive connection, that a
+ * connection the backend dropped is reopened without losing the message,
+ * that an unreachable backend or a full queue is counted rather than
+ * blocking, that each overflow policy gives up the right messages,
+ * that messages are batched until the byte budget or their deadline,
+ * that large batches are gzipped, that CBOR batches name each sender
+ * once, that failing posts back off and open the circuit breaker, and
+ * that batches fail over between targets and motion is hedged on a second
+ * one, and that batches stream over a WebSocket within the backend's
+ * window and are posted when the stream drops. esp_http_client is replaced
+ * by a mock that tracks connections per target, esp_websocket_client by one
+ * that records frames and lets the test play the backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "unity.h"
+#include "esp_http_client.h"
+#include "esp_websocket_client.h"
+#include "protocol.h"
+#include "unraid_client.h"
+#include "mock_flash.h"
+#include "esp_timer.h"
+#include "uplink_breaker.h"
+
+#define UNRAID_TEST_BATCH_MIN 1024   // CONFIG_UNRAID_BATCH_MIN_BYTES default
+
+// === esp_http_client mock ===
+
+struct esp_http_client {
+    bool in_use;
+    char url[128];
+    http_event_handle_cb handler;
+    bool connected;
+    bool gzip;                  // Content-Encoding: gzip is set
+    bool cbor;                  // Content-Type: application/cbor is set
+    bool down;                  // This target is unreachable
+    int status;                 // What this target answers, 0 for mock_status
+    int delay_ms;               // How long it takes to answer
+    int posts;
+    char body[32768];
+};
+
+static struct esp_http_client mock_clients[UNRAID_UPLINK_TARGETS_MAX + 1];
+static struct esp_http_client *mock_last;   // Last client posted to
+static int mock_connects;
+static int mock_posts;
+static bool mock_stale;         // Backend closed the open connection
+static bool mock_unreachable;
+static int mock_body_len;
+static int mock_ids[256];       // Device numbers delivered, in order
+static uint32_t mock_seqs[256]; // Their sequence numbers, 0 if none
+static int mock_id_count;
+static char mock_home_base[32]; // home_base_id of the last batch parsed
+static bool mock_gzip;          // Content-Encoding: gzip is set on the last client posted to
+static bool mock_cbor;          // Content-Type: application/cbor is set there
+static bool mock_parse = true;  // Record delivered device ids
+static int mock_status = 200;   // What the backend answers
+static char mock_local_log[8][160];   // Local log store entries, newest last
+static int mock_local_logs;
+
+// Just enough CBOR to read a batch body back
+static uint64_t cbor_head(const uint8_t **p, int *major)
+{
+    uint8_t initial = *(*p)++;
+    *major = initial >> 5;
+    int info = initial & 31;
+    if (info < 24 || info == 31) {
+        return info;
+    }
+    uint64_t value = 0;
+    for (int n = 1 << (info - 24); n > 0; n--) {
+        value = value << 8 | *(*p)++;
+    }
+    return value;
+}
+
+static void cbor_skip_string(const uint8_t **p, int expect_major, size_t expect_len)
+{
+    int major;
+    uint64_t len = cbor_head(p, &major);
+    TEST_ASSERT_EQUAL(expect_major, major);
+    if (expect_len) {
+        TEST_ASSERT_EQUAL(expect_len, len);
+    }
+    *p += len;
+}
+
+// {"logs": [_ [device, ts, level, category, message, signature, seq?]...], "devices": [...],
+//  "home_base_id"?: ...}
+static void mock_record_cbor(const uint8_t *p)
+{
+    int major, devices[256], count = 0;
+    uint32_t seqs[256];
+    int keys = (int)cbor_head(&p, &major);
+    TEST_ASSERT_TRUE(keys == 2 || keys == 3);
+    TEST_ASSERT_EQUAL(5, major);
+    cbor_skip_string(&p, 3, 4);
+    TEST_ASSERT_EQUAL(31, cbor_head(&p, &major));
+    while (*p != 0xff) {
+        int fields = (int)cbor_head(&p, &major);
+        TEST_ASSERT_TRUE(fields == 6 || fields == 7);
+        devices[count % 256] = (int)cbor_head(&p, &major);
+        cbor_head(&p, &major);            // Timestamp
+        cbor_skip_string(&p, 3, 0);       // Level
+        cbor_skip_string(&p, 3, 0);       // Category
+        cbor_skip_string(&p, 3, 0);       // Message
+        cbor_skip_string(&p, 2, 64);      // Signature
+        seqs[count++ % 256] = fields == 7 ? (uint32_t)cbor_head(&p, &major) : 0;
+    }
+    p++;
+    cbor_skip_string(&p, 3, 7);
+
+    char names[256][16];
+    int named = (int)cbor_head(&p, &major);
+    for (int i = 0; i < named; i++) {
+        int len = (int)cbor_head(&p, &major);
+        snprintf(names[i], sizeof(names[i]), "%.*s", len, (const char *)p);
+        p += len;
+    }
+    mock_home_base[0] = '\0';
+    if (keys == 3) {
+        cbor_skip_string(&p, 3, 12);
+        int len = (int)cbor_head(&p, &major);
+        snprintf(mock_home_base, sizeof(mock_home_base), "%.*s", len, (const char *)p);
+    }
+    for (int i = 0; i < count && mock_id_count < 256; i++) {
+        TEST_ASSERT_TRUE(devices[i] < named);
+        mock_seqs[mock_id_count] = seqs[i];
+        mock_ids[mock_id_count++] = atoi(names[devices[i]] + strlen("ESP32-"));
+    }
+}
+
+static void mock_event(esp_http_client_handle_t client, esp_http_client_event_id_t id)
+{
+    esp_http_client_event_t evt = {.event_id = id, .client = client};
+    client->handler(&evt);
+}
+
+// The client the uplink made for a URL, NULL if there is none
+static struct esp_http_client *mock_target(const char *url)
+{
+    for (int i = 0; i < UNRAID_UPLINK_TARGETS_MAX + 1; i++) {
+        if (mock_clients[i].in_use && strcmp(mock_clients[i].url, url) == 0) {
+            return &mock_clients[i];
+        }
+    }
+    return NULL;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    for (int i = 0; i < UNRAID_UPLINK_TARGETS_MAX + 1; i++) {
+        struct esp_http_client *client = &mock_clients[i];
+        if (!client->in_use) {
+            memset(client, 0, sizeof(*client));
+            client->in_use = true;
+            snprintf(client->url, sizeof(client->url), "%s", config->url);
+            client->handler = config->event_handler;
+            return client;
+        }
+    }
+    return NULL;
+}
+
+static void mock_record(esp_http_client_handle_t client)
+{
+    // Record what the backend received (gzipped bodies are checked by the
+    // tests that send them)
+    if (client->gzip || !mock_parse) {
+        return;
+    }
+    if (client->cbor) {
+        mock_record_cbor((const uint8_t *)client->body);
+        return;
+    }
+    cJSON *root = cJSON_Parse(client->body);
+    cJSON *entry;
+    cJSON_ArrayForEach(entry, cJSON_GetObjectItem(root, "logs")) {
+        const char *id = cJSON_GetObjectItem(entry, "device_id")->valuestring;
+        cJSON *seq = cJSON_GetObjectItem(entry, "seq");
+        if (mock_id_count < 256) {
+            mock_seqs[mock_id_count] = seq ? (uint32_t)seq->valuedouble : 0;
+            mock_ids[mock_id_count++] = atoi(id + strlen("ESP32-"));
+        }
+    }
+    cJSON *home_base = cJSON_GetObjectItem(root, "home_base_id");
+    snprintf(mock_home_base, sizeof(mock_home_base), "%s", home_base ? home_base->valuestring : "");
+    cJSON_Delete(root);
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    if (client->down) {
+        return ESP_FAIL;
+    }
+    if (client->connected && mock_stale) {
+        mock_stale = false;
+        return ESP_FAIL;
+    }
+    if (!client->connected) {
+        if (mock_unreachable) {
+            return ESP_FAIL;
+        }
+        client->connected = true;
+        mock_connects++;
+        mock_event(client, HTTP_EVENT_ON_CONNECTED);
+    }
+    mock_posts++;
+    client->posts++;
+    mock_last = client;
+    mock_gzip = client->gzip;
+    mock_cbor = client->cbor;
+    mock_record(client);
+
+    // A slow target has taken the batch but not yet answered
+    if (client->delay_ms) {
+        usleep(client->delay_ms * 1000);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->connected) {
+        client->connected = false;
+        mock_event(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len)
+{
+    len = len < (int)sizeof(client->body) - 1 ? len : (int)sizeof(client->body) - 1;
+    memcpy(client->body, data, len);
+    client->body[len] = '\0';
+    mock_body_len = len;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) { return ESP_OK; }
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    if (strcmp(key, "Content-Encoding") == 0) {
+        client->gzip = strcmp(value, "gzip") == 0;
+    } else if (strcmp(key, "Content-Type") == 0) {
+        client->cbor = strcmp(value, "application/cbor") == 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key)
+{
+    if (strcmp(key, "Content-Encoding") == 0) {
+        client->gzip = false;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) { return client->status ? client->status : mock_status; }
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    client->in_use = false;
+    return ESP_OK;
+}
+
+// === esp_websocket_client mock ===
+
+struct esp_websocket_client {
+    char uri[160];
+    esp_event_handler_t handler;
+    bool connected;
+    bool fail_send;
+    int starts;
+    int frames;
+    uint8_t frame[8192];        // Last frame sent
+    int frame_len;
+};
+
+static struct esp_websocket_client mock_ws;
+esp_event_base_t WEBSOCKET_EVENTS = "WEBSOCKET_EVENTS";
+
+static void mock_ws_event(int32_t id, const uint8_t *data, int len)
+{
+    esp_websocket_event_data_t evt = {.data_ptr = (const char *)data, .data_len = len, .op_code = 0x2,
+                                      .payload_len = len, .client = &mock_ws};
+    mock_ws.handler(NULL, WEBSOCKET_EVENTS, id, &evt);
+}
+
+// The backend grants a window of unacked frames
+static void mock_ws_window(uint16_t window)
+{
+    const uint8_t frame[] = {0x82, window >> 8, window & 0xFF};
+    mock_ws_event(WEBSOCKET_EVENT_DATA, frame, sizeof(frame));
+}
+
+static void mock_ws_ack(uint32_t seq, uint16_t status)
+{
+    const uint8_t frame[] = {0x81, seq >> 24, (seq >> 16) & 0xFF, (seq >> 8) & 0xFF, seq & 0xFF,
+                             status >> 8, status & 0xFF, 0, 8};
+    mock_ws_event(WEBSOCKET_EVENT_DATA, frame, sizeof(frame));
+}
+
+// Sequence number of the last frame sent
+static uint32_t mock_ws_seq(void)
+{
+    return (uint32_t)mock_ws.frame[2] << 24 | (uint32_t)mock_ws.frame[3] << 16 |
+           (uint32_t)mock_ws.frame[4] << 8 | mock_ws.frame[5];
+}
+
+esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_client_config_t *config)
+{
+    memset(&mock_ws, 0, sizeof(mock_ws));
+    snprintf(mock_ws.uri, sizeof(mock_ws.uri), "%s", config->uri);
+    return &mock_ws;
+}
+
+esp_err_t esp_websocket_register_events(esp_websocket_client_handle_t client, esp_websocket_event_id_t event,
+                                        esp_event_handler_t handler, void *arg)
+{
+    client->handler = handler;
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_start(esp_websocket_client_handle_t client)
+{
+    client->starts++;
+    client->connected = true;
+    mock_ws_event(WEBSOCKET_EVENT_CONNECTED, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_stop(esp_websocket_client_handle_t client)
+{
+    client->connected = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_websocket_client_destroy(esp_websocket_client_handle_t client)
+{
+    client->handler = NULL;
+    return ESP_OK;
+}
+
+bool esp_websocket_client_is_connected(esp_websocket_client_handle_t client)
+{
+    return client->connected;
+}
+
+int esp_websocket_client_send_bin(esp_websocket_client_handle_t client, const char *data, int len, TickType_t timeout)
+{
+    if (!client->connected || client->fail_send) {
+        return -1;
+    }
+    len = len < (int)sizeof(client->frame) ? len : (int)sizeof(client->frame);
+    memcpy(client->frame, data, len);
+    client->frame_len = len;
+    client->frames++;
+    return len;
+}
+
+// === log_storage mock ===
+
+void log_storage_add_log(const char *device_id, const char *level, const char *category, const char *message)
+{
+    if (mock_local_logs < 8) {
+        snprintf(mock_local_log[mock_local_logs++], sizeof(mock_local_log[0]), "%s %s %s", level, category, message);
+    }
+}
+
+// === Tests ===
+
+// Start over with a spool partition of spool_size bytes (0: none)
+static void reset_with_spool(size_t spool_size)
+{
+    mock_flash_init(spool_size);
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_init());
+    unraid_uplink_set_overflow_policy(UNRAID_OVERFLOW_DROP_LOGS);
+    unraid_uplink_set_gzip(false);
+    unraid_uplink_set_format(UNRAID_FORMAT_JSON);
+    mock_connects = 0;
+    mock_posts = 0;
+    mock_stale = false;
+    mock_unreachable = false;
+    mock_id_count = 0;
+    mock_status = 200;
+    mock_local_logs = 0;
+    for (int i = 0; i < UNRAID_UPLINK_TARGETS_MAX + 1; i++) {
+        mock_clients[i].down = false;
+        mock_clients[i].status = 0;
+        mock_clients[i].delay_ms = 0;
+        mock_clients[i].posts = 0;
+    }
+}
+
+static void reset(void)
+{
+    reset_with_spool(0);
+}
+
+static void queue_message(int n, uint8_t type)
+{
+    mesh_message_t msg = {.type = type, .timestamp = 1704268800};
+    snprintf(msg.device_id, sizeof(msg.device_id), "ESP32-%d", n);
+    strcpy(msg.payload, "{\"message\":\"hello\"}");
+    send_log_to_unraid(&msg);
+}
+
+static void queue_log(int n)
+{
+    queue_message(n, MSG_TYPE_LOG);
+}
+
+// Count entries in the last body posted
+static int posted_entries(void)
+{
+    int n = 0;
+    for (const char *p = mock_last->body; (p = strstr(p, "\"device_id\"")) != NULL; p++) {
+        n++;
+    }
+    return n;
+}
+
+TEST_CASE("unraid uplink reuses one connection", "[uplink]") {
+    reset();
+    for (int i = 0; i < 10; i++) {
+        queue_log(i);
+        TEST_ASSERT_TRUE(unraid_uplink_run(0));
+        TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    }
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, mock_connects);
+    TEST_ASSERT_EQUAL(10, mock_posts);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.requests);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.connects);
+    TEST_ASSERT_EQUAL(200, stats.last_status);
+    TEST_ASSERT_TRUE(unraid_uplink_reuse_rate(&stats) > 0.89f);
+    TEST_ASSERT_NOT_NULL(strstr(mock_last->body, "\"device_id\":\"ESP32-9\""));
+}
+
+TEST_CASE("unraid uplink reconnects when the backend drops the connection", "[uplink]") {
+    reset();
+    queue_log(1);
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+    unraid_uplink_flush();
+
+    // The next request hits the dead socket, then succeeds on a new one
+    mock_stale = true;
+    queue_log(2);
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+    unraid_uplink_flush();
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.reconnects);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.connects);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.requests);
+    TEST_ASSERT_NOT_NULL(strstr(mock_last->body, "\"device_id\":\"ESP32-2\""));
+}
+
+TEST_CASE("unraid uplink counts failures and drops instead of blocking", "[uplink]") {
+    reset();
+    mock_unreachable = true;
+    queue_log(1);
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+    TEST_ASSERT_EQUAL(0, unraid_uplink_flush());
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.sent);
+    TEST_ASSERT_EQUAL(0, stats.last_status);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, unraid_uplink_reuse_rate(&stats));
+
+    // Workers never wait: overflow is dropped and counted
+    for (int i = 0; i < 1000; i++) {
+        queue_log(i);
+    }
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_GREATER_THAN(0, stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(1000, stats.queued + stats.dropped);
+}
+
+// Fill the queue with `logs` logs then `motion` motion events, add one more
+// of `type`, and drain it; mock_ids holds the device numbers that survived
+static void overflow_fill(unraid_overflow_policy_t policy, int logs, int motion, uint8_t type)
+{
+    reset();
+    unraid_uplink_set_overflow_policy(policy);
+    int n = 0;
+    for (int i = 0; i < logs; i++) {
+        queue_message(n++, MSG_TYPE_LOG);
+    }
+    for (int i = 0; i < motion; i++) {
+        queue_message(n++, MSG_TYPE_MOTION);
+    }
+    queue_message(n, type);
+
+    while (unraid_uplink_run(0)) {
+    }
+    unraid_uplink_flush();
+    TEST_ASSERT_EQUAL(32, mock_id_count);
+}
+
+static bool survived(int id)
+{
+    for (int i = 0; i < mock_id_count; i++) {
+        if (mock_ids[i] == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("unraid uplink overflow policies", "[uplink]") {
+    unraid_uplink_stats_t stats;
+
+    // Drop newest: a full queue refuses the newcomer, even motion
+    overflow_fill(UNRAID_OVERFLOW_DROP_NEWEST, 31, 1, MSG_TYPE_MOTION);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_FALSE(survived(32));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.dropped_motion);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.evicted);
+    TEST_ASSERT_EQUAL_UINT32(32, stats.queue_high_water);
+
+    // Drop oldest: the first message goes, whatever it is
+    overflow_fill(UNRAID_OVERFLOW_DROP_OLDEST, 0, 32, MSG_TYPE_LOG);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_FALSE(survived(0));
+    TEST_ASSERT_TRUE(survived(32));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.evicted);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.dropped_motion);
+
+    // Drop logs: motion evicts the oldest log, not the older motion event
+    overflow_fill(UNRAID_OVERFLOW_DROP_LOGS, 16, 16, MSG_TYPE_MOTION);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_FALSE(survived(0));
+    TEST_ASSERT_TRUE(survived(16));
+    TEST_ASSERT_TRUE(survived(32));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.evicted);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped_motion);
+
+    // Motion drains ahead of the logs queued before it
+    TEST_ASSERT_EQUAL(16, mock_ids[0]);
+    TEST_ASSERT_EQUAL(1, mock_ids[17]);
+
+    // ...and a log arriving to a queue of motion events is itself dropped
+    overflow_fill(UNRAID_OVERFLOW_DROP_LOGS, 0, 32, MSG_TYPE_LOG);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_FALSE(survived(32));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.evicted);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped_motion);
+}
+
+TEST_CASE("unraid uplink batches logs into one request", "[uplink]") {
+    reset();
+    for (int i = 0; i < 10; i++) {
+        queue_log(i);
+    }
+    while (unraid_uplink_run(0)) {
+    }
+
+    // Routine logs wait for their deadline or a flush
+    TEST_ASSERT_EQUAL(0, mock_posts);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(-1, unraid_uplink_flush());
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, mock_posts);
+    TEST_ASSERT_EQUAL(10, posted_entries());
+    TEST_ASSERT_EQUAL_UINT32(10, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.batches);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.max_batch);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.flushes[UNRAID_FLUSH_FORCED]);
+    TEST_ASSERT_EQUAL_UINT32(mock_body_len, stats.last_batch_bytes);
+
+    // The body is a well-formed LogIngestRequest
+    cJSON *root = cJSON_Parse(mock_last->body);
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_EQUAL(10, cJSON_GetArraySize(cJSON_GetObjectItem(root, "logs")));
+    cJSON_Delete(root);
+}
+
+TEST_CASE("unraid uplink flushes a full batch", "[uplink]") {
+    reset();
+    int sent = 0;
+    while (mock_posts == 0) {
+        queue_log(sent++);
+        TEST_ASSERT_TRUE(unraid_uplink_run(0));
+        TEST_ASSERT_TRUE(sent < 1000);
+    }
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.flushes[UNRAID_FLUSH_FULL]);
+    TEST_ASSERT_EQUAL_UINT32(sent, stats.sent);
+    TEST_ASSERT_EQUAL(sent, posted_entries());
+    TEST_ASSERT_TRUE(stats.last_batch_bytes >= 4096);
+    TEST_ASSERT_TRUE(stats.last_batch_bytes < 4096 + 1536);
+    cJSON *root = cJSON_Parse(mock_last->body);
+    TEST_ASSERT_NOT_NULL(root);
+    cJSON_Delete(root);
+}
+
+TEST_CASE("unraid uplink posts motion by its short deadline", "[uplink]") {
+    reset();
+    queue_log(1);
+    queue_log(2);
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+
+    // A motion event pulls the routine logs out with it
+    queue_message(3, MSG_TYPE_MOTION);
+    TEST_ASSERT_TRUE(unraid_uplink_run(0));
+    TEST_ASSERT_EQUAL(0, mock_posts);
+    usleep(60 * 1000);
+    TEST_ASSERT_FALSE(unraid_uplink_run(0));
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, mock_posts);
+    TEST_ASSERT_EQUAL(3, posted_entries());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.flushes[UNRAID_FLUSH_DEADLINE]);
+    TEST_ASSERT_TRUE(stats.max_hold_ms >= 50);
+    TEST_ASSERT_TRUE(stats.max_hold_ms < 1000);
+}
+
+TEST_CASE("unraid uplink spools while the backend is down and replays in order", "[uplink]") {
+    reset_with_spool(4 * 64 * 1024);
+    mock_unreachable = true;
+    for (int i = 0; i < 3; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(0, unraid_uplink_flush());
+
+    // Straight after a failure the uplink does not even try
+    int posts = mock_posts;
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    uint32_t requests = stats.requests;
+    queue_log(3);
+    queue_log(4);
+    unraid_uplink_run(0);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(0, unraid_uplink_flush());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(posts, mock_posts);
+    TEST_ASSERT_EQUAL_UINT32(requests, stats.requests);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.spooled);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.failed);
+
+    uplink_spool_stats_t spool;
+    unraid_uplink_get_spool_stats(&spool);
+    TEST_ASSERT_EQUAL_UINT32(2, spool.records);
+    TEST_ASSERT_EQUAL_UINT32(5, spool.entries);
+
+    // Backend back: one batch per replay interval, oldest first
+    mock_unreachable = false;
+    unraid_uplink_set_link(true);
+    TEST_ASSERT_FALSE(unraid_uplink_run(0));
+    TEST_ASSERT_EQUAL(3, mock_id_count);
+    TEST_ASSERT_FALSE(unraid_uplink_run(0));
+    TEST_ASSERT_EQUAL(3, mock_id_count);
+    usleep(250 * 1000);
+    TEST_ASSERT_FALSE(unraid_uplink_run(0));
+    TEST_ASSERT_EQUAL(5, mock_id_count);
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(i, mock_ids[i]);
+    }
+
+    unraid_uplink_get_stats(&stats);
+    unraid_uplink_get_spool_stats(&spool);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.replayed);
+    TEST_ASSERT_TRUE(stats.replay_rate > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, spool.records);
+    TEST_ASSERT_EQUAL_UINT32(2, spool.delivered);
+}
+
+TEST_CASE("unraid uplink spools while the link is down and across a reboot", "[uplink]") {
+    reset_with_spool(4 * 64 * 1024);
+    unraid_uplink_set_link(false);
+    queue_log(1);
+    queue_message(2, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    unraid_uplink_run(0);
+    unraid_uplink_flush();
+    TEST_ASSERT_EQUAL(0, mock_posts);
+
+    // Reboot before the link returns; the spool partition keeps the batch
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_init());
+    uplink_spool_stats_t spool;
+    unraid_uplink_get_spool_stats(&spool);
+    TEST_ASSERT_EQUAL_UINT32(1, spool.recovered);
+    TEST_ASSERT_EQUAL_UINT32(2, spool.entries);
+
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(2, mock_id_count);
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, uplink_spool_pending());
+}
+
+TEST_CASE("unraid uplink spills a full queue to flash", "[uplink]") {
+    reset_with_spool(4 * 64 * 1024);
+    unraid_uplink_set_overflow_policy(UNRAID_OVERFLOW_SPILL);
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_home_base_id("HB-1"));
+    for (int i = 0; i < 40; i++) {
+        queue_log(i);
+    }
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(32, stats.queued);
+    TEST_ASSERT_EQUAL_UINT32(8, stats.spilled);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+
+    // Spilled entries are keyed like batched ones when replayed
+    for (int i = 0; i < 32; i++) {
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    usleep(250 * 1000);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL_UINT32(1, posted_entries());
+    cJSON *root = cJSON_Parse(mock_last->body);
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_EQUAL_STRING("HB-1", cJSON_GetObjectItem(root, "home_base_id")->valuestring);
+    cJSON_Delete(root);
+
+    // Without a spool, spilling falls back to dropping
+    reset();
+    unraid_uplink_set_overflow_policy(UNRAID_OVERFLOW_SPILL);
+    for (int i = 0; i < 40; i++) {
+        queue_log(i);
+    }
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(8, stats.dropped);
+}
+
+TEST_CASE("unraid uplink gzips large batches", "[uplink]") {
+    reset();
+    unraid_uplink_set_gzip(true);
+    for (int i = 0; i < 10; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+
+    // A gzip member whose trailer carries the JSON length
+    TEST_ASSERT_TRUE(mock_gzip);
+    const uint8_t *body = (const uint8_t *)mock_last->body;
+    TEST_ASSERT_EQUAL_HEX8(0x1f, body[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, body[1]);
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    const uint8_t *isize = &body[mock_body_len - 4];
+    uint32_t raw = isize[0] | isize[1] << 8 | isize[2] << 16 | (uint32_t)isize[3] << 24;
+    TEST_ASSERT_EQUAL_UINT32(stats.gzip_in_bytes, raw);
+    TEST_ASSERT_EQUAL_UINT32(mock_body_len, stats.gzip_out_bytes);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.gzipped);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.sent);
+    TEST_ASSERT_TRUE(unraid_uplink_gzip_ratio(&stats) > 3.0f);
+
+    // A lone entry is under the minimum and goes out as plain JSON
+    queue_log(10);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_FALSE(mock_gzip);
+    TEST_ASSERT_EQUAL(1, posted_entries());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.gzipped);
+}
+
+TEST_CASE("unraid uplink posts CBOR batches", "[uplink]") {
+    reset();
+    for (int i = 0; i < 10; i++) {
+        queue_log(i % 3);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    uint32_t json_bytes = stats.last_batch_bytes;
+
+    // Same logs as CBOR: three device names, raw signatures
+    unraid_uplink_set_format(UNRAID_FORMAT_CBOR);
+    mock_id_count = 0;
+    for (int i = 0; i < 10; i++) {
+        queue_log(i % 3);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_TRUE(mock_cbor);
+    TEST_ASSERT_EQUAL(10, mock_id_count);
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(i % 3, mock_ids[i]);
+    }
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(20, stats.sent);
+    TEST_ASSERT_TRUE(stats.last_batch_bytes * 2 < json_bytes);
+
+    // A 33rd sender does not fit the device table and starts a new batch
+    mock_id_count = 0;
+    for (int i = 0; i < 33; i++) {
+        queue_log(100 + i);
+        unraid_uplink_run(0);
+    }
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.flushes[UNRAID_FLUSH_FULL]);
+    TEST_ASSERT_EQUAL(32, mock_id_count);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(33, mock_id_count);
+    TEST_ASSERT_EQUAL(132, mock_ids[32]);
+}
+
+TEST_CASE("unraid uplink switches format on a device-table flush", "[uplink]") {
+    reset();
+    unraid_uplink_set_format(UNRAID_FORMAT_CBOR);
+    mock_id_count = 0;
+    for (int i = 0; i < 32; i++) {
+        queue_log(100 + i);
+        unraid_uplink_run(0);
+    }
+
+    // The 33rd sender flushes the CBOR batch; the batch it starts is JSON
+    unraid_uplink_set_format(UNRAID_FORMAT_JSON);
+    queue_log(132);
+    unraid_uplink_run(0);
+    TEST_ASSERT_TRUE(mock_cbor);
+    TEST_ASSERT_EQUAL(32, mock_id_count);
+
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_FALSE(mock_cbor);
+    TEST_ASSERT_EQUAL(1, posted_entries());
+    TEST_ASSERT_NOT_NULL(strstr(mock_last->body, "ESP32-132"));
+}
+
+TEST_CASE("unraid uplink keys entries by home base and sequence number", "[uplink]") {
+    reset();
+    for (int i = 0; i < 3; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL_STRING("", mock_home_base);   // Not set yet
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, unraid_uplink_set_home_base_id("HB\"1"));
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_home_base_id("HB-1"));
+    for (int i = 3; i < 6; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+    }
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL_STRING("HB-1", mock_home_base);
+    cJSON *root = cJSON_Parse(mock_last->body);
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_EQUAL_STRING("HB-1", cJSON_GetObjectItem(root, "home_base_id")->valuestring);
+    cJSON_Delete(root);
+
+    // Ascending across batches
+    TEST_ASSERT_EQUAL(6, mock_id_count);
+    TEST_ASSERT_TRUE(mock_seqs[0] > 0);
+    for (int i = 1; i < 6; i++) {
+        TEST_ASSERT_EQUAL_UINT32(mock_seqs[0] + i, mock_seqs[i]);
+    }
+
+    // CBOR carries the same keys
+    unraid_uplink_set_format(UNRAID_FORMAT_CBOR);
+    queue_log(6);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL_STRING("HB-1", mock_home_base);
+    TEST_ASSERT_EQUAL_UINT32(mock_seqs[5] + 1, mock_seqs[6]);
+
+    // After a reboot numbering resumes past everything handed out before
+    uint32_t last = mock_seqs[6];
+    reset();
+    unraid_uplink_set_home_base_id("HB-1");
+    queue_log(7);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, mock_id_count);
+    TEST_ASSERT_TRUE(mock_seqs[0] > last);
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(mock_seqs[0] + 1, stats.next_seq);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.unkeyed);
+}
+
+TEST_CASE("unraid uplink circuit breaker", "[uplink]") {
+    reset();
+    mock_status = 503;
+
+    // Three failed posts in a row open the breaker; each holds off the next
+    // post, so skip the wait the way a link coming up does
+    for (int i = 0; i < 3; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+        TEST_ASSERT_EQUAL(503, unraid_uplink_flush());
+        if (i < 2) {
+            queue_log(10 + i);
+            unraid_uplink_run(0);
+            TEST_ASSERT_EQUAL(0, unraid_uplink_flush());   // Held off, not posted
+            unraid_uplink_set_link(true);
+        }
+    }
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_OPEN, stats.breaker_state);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.breaker_opens);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.shed);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.requests);
+    TEST_ASSERT_EQUAL_UINT32(UNRAID_TEST_BATCH_MIN, stats.batch_budget);
+    TEST_ASSERT_EQUAL(1, mock_local_logs);
+    TEST_ASSERT_NOT_NULL(strstr(mock_local_log[0], "error uplink Uplink breaker closed -> open after 3 failures"));
+
+    // Open: nothing goes out
+    queue_log(3);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(0, unraid_uplink_flush());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.requests);
+
+    // The probe succeeds and closes it; both transitions are logged
+    mock_status = 200;
+    unraid_uplink_set_link(true);
+    queue_log(4);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_CLOSED, stats.breaker_state);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.breaker_probes);
+    TEST_ASSERT_TRUE(stats.batch_budget > UNRAID_TEST_BATCH_MIN);
+    TEST_ASSERT_EQUAL(3, mock_local_logs);
+    TEST_ASSERT_NOT_NULL(strstr(mock_local_log[1], "open -> half_open"));
+    TEST_ASSERT_NOT_NULL(strstr(mock_local_log[2], "half_open -> closed, backend answered 200"));
+}
+
+#define TARGET_A "http://10.0.0.1:8000/logs/ingest"
+#define TARGET_B "http://10.0.0.2:8000/logs/ingest"
+#define TARGET_C "http://10.0.0.3:8000/logs/ingest"
+
+TEST_CASE("unraid uplink fails over between targets", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_A ", " TARGET_B, 0));
+    struct esp_http_client *a = mock_target(TARGET_A);
+    struct esp_http_client *b = mock_target(TARGET_B);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+
+    // The first target is down: the batch moves on to the second
+    a->down = true;
+    queue_log(1);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, b->posts);
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failovers);
+    TEST_ASSERT_EQUAL(1, stats.active_target);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failed);
+
+    // While its breaker holds it off, batches go straight to the second
+    queue_log(2);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(2, b->posts);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failovers);
+
+    unraid_uplink_target_stats_t targets[UNRAID_UPLINK_TARGETS_MAX];
+    TEST_ASSERT_EQUAL(2, unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX));
+    TEST_ASSERT_EQUAL_STRING(TARGET_A, targets[0].url);
+    TEST_ASSERT_EQUAL_UINT32(1, targets[0].failed);
+    TEST_ASSERT_EQUAL_UINT32(2, targets[1].answered);
+
+    // Back up and probed: the first target takes over again
+    a->down = false;
+    unraid_uplink_set_link(true);
+    queue_log(3);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, a->posts);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.active_target);
+
+    // Every target down: spooled or counted, never lost silently
+    a->down = true;
+    b->down = true;
+    queue_log(4);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(0, unraid_uplink_flush());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.failovers);
+}
+
+TEST_CASE("unraid uplink reloads targets", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_A "," TARGET_B, 0));
+    queue_log(1);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    struct esp_http_client *a = mock_target(TARGET_A);
+
+    // Bad lists are refused and leave the targets as they were
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, unraid_uplink_set_targets("", 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, unraid_uplink_set_targets("ftp://10.0.0.1/logs", 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, unraid_uplink_set_targets(
+        TARGET_A "," TARGET_B "," TARGET_A "," TARGET_B "," TARGET_A, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, unraid_uplink_set_targets(TARGET_A, UNRAID_UPLINK_HEDGE_MAX_MS + 1));
+    unraid_uplink_target_stats_t targets[UNRAID_UPLINK_TARGETS_MAX];
+    TEST_ASSERT_EQUAL(2, unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX));
+
+    // Reordered: a kept target keeps its client, connection and counters;
+    // a dropped one is cleaned up
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_B "," TARGET_A, 25));
+    TEST_ASSERT_EQUAL(2, unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX));
+    TEST_ASSERT_EQUAL_STRING(TARGET_B, targets[0].url);
+    TEST_ASSERT_EQUAL_UINT32(1, targets[1].answered);
+    TEST_ASSERT_EQUAL_PTR(a, mock_target(TARGET_A));
+    TEST_ASSERT_TRUE(a->connected);
+    TEST_ASSERT_EQUAL_UINT32(25, unraid_uplink_get_hedge_ms());
+
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_B, 0));
+    TEST_ASSERT_NULL(mock_target(TARGET_A));
+    TEST_ASSERT_EQUAL(1, unraid_uplink_get_targets(targets, UNRAID_UPLINK_TARGETS_MAX));
+}
+
+TEST_CASE("unraid uplink hedges slow motion batches", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_A "," TARGET_B, 50));
+    struct esp_http_client *a = mock_target(TARGET_A);
+    struct esp_http_client *b = mock_target(TARGET_B);
+
+    // The first target takes 300 ms; the second gets the batch after 50
+    a->delay_ms = 300;
+    queue_message(1, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, a->posts);
+    TEST_ASSERT_EQUAL(1, b->posts);
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.hedges);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.hedge_wins);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent);
+
+    // Routine logs are never hedged
+    queue_log(2);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, b->posts);
+
+    // A first target answering within the budget cancels the hedge
+    a->delay_ms = 0;
+    queue_message(3, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    usleep(100 * 1000);
+    TEST_ASSERT_EQUAL(1, b->posts);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.hedges);
+
+    // A slow first target that fails is covered by the hedge
+    a->delay_ms = 150;
+    a->status = 503;
+    queue_message(4, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.hedges);
+    TEST_ASSERT_EQUAL(1, stats.active_target);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failovers);
+}
+
+TEST_CASE("unraid uplink fails over past a failed hedge", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_targets(TARGET_A "," TARGET_B "," TARGET_C, 50));
+    struct esp_http_client *a = mock_target(TARGET_A);
+    struct esp_http_client *b = mock_target(TARGET_B);
+    struct esp_http_client *c = mock_target(TARGET_C);
+
+    // Both the first target and its hedge fail: the batch goes straight to
+    // the third instead of being posted to the hedge target again
+    a->delay_ms = 150;
+    a->status = 503;
+    b->status = 503;
+    queue_message(1, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, a->posts);
+    TEST_ASSERT_EQUAL(1, b->posts);
+    TEST_ASSERT_EQUAL(1, c->posts);
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.hedges);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failovers);
+    TEST_ASSERT_EQUAL(2, stats.active_target);
+}
+
+TEST_CASE("unraid uplink streams batches within the window", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_stream(true));
+    TEST_ASSERT_EQUAL_STRING("ws://192.168.1.100:8000/ws/uplink", mock_ws.uri);
+
+    // Connected but no window yet: posted
+    queue_message(1, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(1, mock_posts);
+    TEST_ASSERT_EQUAL(0, mock_ws.frames);
+
+    // Motion goes out as soon as it is taken off the queue
+    mock_ws_window(2);
+    queue_message(2, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(1, mock_ws.frames);
+    TEST_ASSERT_EQUAL_UINT8(0x01, mock_ws.frame[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, mock_ws.frame[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, mock_ws_seq());
+    TEST_ASSERT_EQUAL_MEMORY("{\"logs\":[{\"device_id\":\"ESP32-2\"", &mock_ws.frame[6], 29);
+
+    // A log waits a moment for company, then takes the second credit
+    queue_log(3);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(1, mock_ws.frames);
+    TEST_ASSERT_EQUAL(202, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(2, mock_ws.frames);
+
+    // The window is used up, so the next batch is posted
+    queue_log(4);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(2, mock_posts);
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_TRUE(stats.stream_up);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.streamed);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.stream_in_flight);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.stream_fallbacks);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.sent);
+
+    // Acks settle the frames and reopen the window (8 from here on)
+    mock_ws_ack(0, 200);
+    mock_ws_ack(1, 200);
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.stream_acked);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.stream_in_flight);
+    TEST_ASSERT_EQUAL_UINT32(8, stats.stream_window);
+    TEST_ASSERT_EQUAL(200, stats.last_status);
+
+    // Off again: the socket goes and batches are posted
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_stream(false));
+    TEST_ASSERT_FALSE(unraid_uplink_get_stream());
+    queue_message(5, MSG_TYPE_MOTION);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(3, mock_posts);
+}
+
+TEST_CASE("unraid uplink posts unacked frames when the stream drops", "[uplink]") {
+    reset();
+    TEST_ASSERT_EQUAL(ESP_OK, unraid_uplink_set_stream(true));
+    mock_ws_window(8);
+    for (int i = 0; i < 3; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+        TEST_ASSERT_EQUAL(202, unraid_uplink_flush());
+    }
+    mock_ws_ack(0, 200);
+
+    // The socket drops with two frames unacked: they are posted in order
+    mock_ws.connected = false;
+    mock_ws_event(WEBSOCKET_EVENT_DISCONNECTED, NULL, 0);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(2, mock_posts);
+    TEST_ASSERT_EQUAL(2, mock_id_count);
+    TEST_ASSERT_EQUAL(1, mock_ids[0]);
+    TEST_ASSERT_EQUAL(2, mock_ids[1]);
+
+    // Batches are posted until it reconnects, then numbering carries on
+    queue_log(3);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(200, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL(3, mock_posts);
+    mock_ws.connected = true;
+    mock_ws_event(WEBSOCKET_EVENT_CONNECTED, NULL, 0);
+    mock_ws_window(8);
+    queue_log(4);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(202, unraid_uplink_flush());
+    TEST_ASSERT_EQUAL_UINT32(3, mock_ws_seq());
+
+    // A frame the backend could not take restarts the stream and is posted
+    mock_ws_ack(3, 503);
+    TEST_ASSERT_EQUAL(4, mock_ws.frames);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(2, mock_ws.starts);
+    TEST_ASSERT_EQUAL(4, mock_posts);
+    TEST_ASSERT_EQUAL(4, mock_ids[mock_id_count - 1]);
+
+    // So is one whose send failed
+    mock_ws_window(8);
+    mock_ws.fail_send = true;
+    queue_log(5);
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(202, unraid_uplink_flush());
+    mock_ws.fail_send = false;
+    unraid_uplink_run(0);
+    TEST_ASSERT_EQUAL(5, mock_posts);
+    TEST_ASSERT_EQUAL(5, mock_ids[mock_id_count - 1]);
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.stream_resent);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.stream_in_flight);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failed);
+}
+
+TEST_CASE("unraid uplink JSON vs CBOR encoding", "[uplink][perf]") {
+    const unraid_uplink_format_t formats[] = {UNRAID_FORMAT_JSON, UNRAID_FORMAT_CBOR};
+    for (int f = 0; f < 2; f++) {
+        reset();
+        unraid_uplink_set_format(formats[f]);
+        mock_parse = false;
+
+        // 16 sensors, motion and log text, random signatures
+        mesh_message_t msg = {.type = MSG_TYPE_LOG};
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < 2000; i++) {
+            msg.type = i % 4 ? MSG_TYPE_LOG : MSG_TYPE_MOTION;
+            msg.timestamp = 1704268800 + i;
+            snprintf(msg.device_id, sizeof(msg.device_id), "ESP32-%d", i % 16);
+            snprintf(msg.payload, sizeof(msg.payload), "{\"message\":\"PIR zone %d triggered\"}", i % 5);
+            for (int j = 0; j < 64; j++) {
+                msg.signature[j] = (uint8_t)(i * 31 + j * 7);
+            }
+            send_log_to_unraid(&msg);
+            unraid_uplink_run(0);
+        }
+        unraid_uplink_flush();
+        int64_t us = esp_timer_get_time() - start;
+        mock_parse = true;
+
+        unraid_uplink_stats_t stats;
+        unraid_uplink_get_stats(&stats);
+        printf("%s: %.1f us/log, %lu batches of avg %.1f entries, ~%lu bytes/entry\n",
+               unraid_uplink_format_name(formats[f]), (double)us / 2000, (unsigned long)stats.batches,
+               (double)stats.batched / stats.batches,
+               (unsigned long)(stats.last_batch_bytes / (stats.last_batch ? stats.last_batch : 1)));
+        TEST_ASSERT_EQUAL_UINT32(2000, stats.sent);
+    }
+}
+
+TEST_CASE("unraid uplink requests per 1000 logs", "[uplink][perf]") {
+    reset();
+    for (int i = 0; i < 1000; i++) {
+        queue_log(i);
+        unraid_uplink_run(0);
+    }
+    unraid_uplink_flush();
+
+    unraid_uplink_stats_t stats;
+    unraid_uplink_get_stats(&stats);
+    printf("1000 logs: %lu requests, %lu batches (avg %.1f, max %lu entries), %lu connects\n",
+           (unsigned long)stats.requests, (unsigned long)stats.batches,
+           stats.batches ? (double)stats.batched / stats.batches : 0.0,
+           (unsigned long)stats.max_batch, (unsigned long)stats.connects);
+    TEST_ASSERT_EQUAL_UINT32(1000, stats.sent);
+    TEST_ASSERT_TRUE(stats.requests < 1000 / 10);
+}
@@ -0,0 +1,133 @@
+/*
+ * Tests for the uplink circuit breaker and batch sizing (uplink_breaker.c)
+ *
+ * Validates that failures hold posts off and open the breaker at the
+ * threshold, that the open backoff doubles per failed probe up to its cap
+ * with bounded jitter, that a successful probe closes the breaker, and that
+ * the batch budget grows while the backend is fast and shrinks when it is
+ * slow or failing. Time is simulated.
+ */
+
+#include "unity.h"
+#include "uplink_breaker.h"
+
+#define MS 1000LL
+
+static const uplink_breaker_config_t s_config = {
+    .failure_threshold = 3,
+    .backoff_min_ms = 1000,
+    .backoff_max_ms = 8000,
+    .batch_min = 1024,
+    .batch_max = 4096,
+    .rtt_target_ms = 500,
+};
+
+// Fail until the breaker opens; returns when it did
+static int64_t trip(uplink_breaker_t *b, int64_t now)
+{
+    while (b->state != UPLINK_BREAKER_OPEN) {
+        now = b->retry_at_us > now ? b->retry_at_us : now;
+        TEST_ASSERT_TRUE(uplink_breaker_allow(b, now));
+        uplink_breaker_record(b, 503, 20, now);
+    }
+    return now;
+}
+
+TEST_CASE("uplink_breaker opens after consecutive failures", "[uplink_breaker]") {
+    uplink_breaker_t b;
+    uplink_breaker_init(&b, &s_config);
+    int64_t now = 0;
+
+    // A failure below the threshold holds posts off for the minimum backoff
+    uplink_breaker_record(&b, 0, 0, now);
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_CLOSED, b.state);
+    TEST_ASSERT_FALSE(uplink_breaker_allow(&b, now + 999 * MS));
+    TEST_ASSERT_TRUE(uplink_breaker_allow(&b, now + 1000 * MS));
+    TEST_ASSERT_EQUAL_UINT32(1, b.shed);
+
+    // A success in between starts the count over
+    uplink_breaker_record(&b, 200, 20, now + 1000 * MS);
+    TEST_ASSERT_EQUAL_UINT32(0, b.failures);
+    uplink_breaker_record(&b, 500, 20, now + 1001 * MS);
+    uplink_breaker_record(&b, 429, 20, now + 1002 * MS);
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_CLOSED, b.state);
+
+    // Answers other than 5xx and 429 mean the backend is up
+    uplink_breaker_record(&b, 400, 20, now + 1003 * MS);
+    TEST_ASSERT_EQUAL_UINT32(0, b.failures);
+
+    now = trip(&b, now + 2000 * MS);
+    TEST_ASSERT_EQUAL_UINT32(3, b.failures);
+    TEST_ASSERT_EQUAL_UINT32(1, b.opens);
+}
+
+TEST_CASE("uplink_breaker probes with exponential backoff", "[uplink_breaker]") {
+    uplink_breaker_t b;
+    uplink_breaker_init(&b, &s_config);
+    int64_t now = trip(&b, 0);
+
+    // Each failed probe doubles the wait: 1, 2, 4, 8, 8 s, plus up to 25%
+    const uint32_t waits[] = {1000, 2000, 4000, 8000, 8000};
+    for (int i = 0; i < 5; i++) {
+        int64_t wait_ms = (b.retry_at_us - now) / MS;
+        TEST_ASSERT_TRUE(wait_ms >= waits[i]);
+        TEST_ASSERT_TRUE(wait_ms <= waits[i] + waits[i] / 4);
+
+        TEST_ASSERT_FALSE(uplink_breaker_allow(&b, b.retry_at_us - 1));
+        TEST_ASSERT_EQUAL(UPLINK_BREAKER_OPEN, b.state);
+        now = b.retry_at_us;
+        TEST_ASSERT_TRUE(uplink_breaker_allow(&b, now));
+        TEST_ASSERT_EQUAL(UPLINK_BREAKER_HALF_OPEN, b.state);
+        uplink_breaker_record(&b, 0, 0, now);
+        TEST_ASSERT_EQUAL(UPLINK_BREAKER_OPEN, b.state);
+    }
+    TEST_ASSERT_EQUAL_UINT32(6, b.opens);
+    TEST_ASSERT_EQUAL_UINT32(5, b.probes);
+
+    // A good probe closes it and the backoff starts over
+    now = b.retry_at_us;
+    TEST_ASSERT_TRUE(uplink_breaker_allow(&b, now));
+    uplink_breaker_record(&b, 200, 30, now);
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_CLOSED, b.state);
+    TEST_ASSERT_TRUE(uplink_breaker_allow(&b, now));
+    TEST_ASSERT_EQUAL_UINT32(1000, b.backoff_ms);
+
+    // Probing early on request
+    now = trip(&b, now);
+    uplink_breaker_probe_now(&b);
+    TEST_ASSERT_TRUE(uplink_breaker_allow(&b, now));
+    TEST_ASSERT_EQUAL(UPLINK_BREAKER_HALF_OPEN, b.state);
+}
+
+TEST_CASE("uplink_breaker sizes batches by RTT and status", "[uplink_breaker]") {
+    uplink_breaker_t b;
+    uplink_breaker_init(&b, &s_config);
+    TEST_ASSERT_EQUAL_UINT32(4096, b.batch_bytes);
+
+    // Failures halve it down to the floor
+    uplink_breaker_record(&b, 503, 20, 0);
+    TEST_ASSERT_EQUAL_UINT32(2048, b.batch_bytes);
+    uplink_breaker_record(&b, 0, 0, 0);
+    uplink_breaker_record(&b, 0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT32(1024, b.batch_bytes);
+
+    // Fast answers add an eighth of the maximum each, up to the maximum
+    for (int i = 0; i < 5; i++) {
+        uplink_breaker_record(&b, 200, 100, 0);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1024 + 5 * 512, b.batch_bytes);
+    for (int i = 0; i < 5; i++) {
+        uplink_breaker_record(&b, 200, 100, 0);
+    }
+    TEST_ASSERT_EQUAL_UINT32(4096, b.batch_bytes);
+
+    // Slow answers take a quarter off each time
+    uplink_breaker_record(&b, 200, 900, 0);
+    TEST_ASSERT_EQUAL_UINT32(3072, b.batch_bytes);
+    uplink_breaker_record(&b, 200, 900, 0);
+    TEST_ASSERT_EQUAL_UINT32(2304, b.batch_bytes);
+
+    // Smoothed RTT follows the samples an eighth at a time
+    TEST_ASSERT_TRUE(b.srtt_ms > 100 && b.srtt_ms < 900);
+    TEST_ASSERT_EQUAL_UINT32(900, b.last_rtt_ms);
+}
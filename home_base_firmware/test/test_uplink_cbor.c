@@ -0,0 +1,112 @@
+/*
+ * Tests for the uplink CBOR writer (uplink_cbor.c)
+ *
+ * Validates the encodings against the examples in RFC 8949 Appendix A,
+ * that every integer and string length takes its shortest head, and that
+ * writing past the buffer is flagged instead of truncating an item.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "uplink_cbor.h"
+
+static uint8_t s_buf[64];
+static uplink_cbor_writer_t s_w;
+
+static void start(void)
+{
+    memset(s_buf, 0xAA, sizeof(s_buf));
+    uplink_cbor_init(&s_w, s_buf, sizeof(s_buf));
+}
+
+static void expect(const uint8_t *bytes, size_t len)
+{
+    TEST_ASSERT_FALSE(s_w.overflow);
+    TEST_ASSERT_EQUAL(len, s_w.len);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, s_buf, len);
+}
+
+TEST_CASE("uplink_cbor encodes unsigned integers", "[uplink_cbor]") {
+    const struct {
+        uint64_t value;
+        uint8_t bytes[9];
+        size_t len;
+    } cases[] = {
+        {0, {0x00}, 1},
+        {23, {0x17}, 1},
+        {24, {0x18, 0x18}, 2},
+        {100, {0x18, 0x64}, 2},
+        {1000, {0x19, 0x03, 0xe8}, 3},
+        {1000000, {0x1a, 0x00, 0x0f, 0x42, 0x40}, 5},
+        {1000000000000ULL, {0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00}, 9},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        start();
+        uplink_cbor_put_uint(&s_w, cases[i].value);
+        expect(cases[i].bytes, cases[i].len);
+    }
+}
+
+TEST_CASE("uplink_cbor encodes strings, arrays and maps", "[uplink_cbor]") {
+    start();
+    uplink_cbor_put_text(&s_w, "", 0);
+    uplink_cbor_put_text(&s_w, "IETF", 4);
+    expect((const uint8_t[]){0x60, 0x64, 'I', 'E', 'T', 'F'}, 6);
+
+    start();
+    uplink_cbor_put_bytes(&s_w, (const uint8_t[]){1, 2, 3, 4}, 4);
+    expect((const uint8_t[]){0x44, 1, 2, 3, 4}, 5);
+
+    // {1: 2, 3: [4, 5]}
+    start();
+    uplink_cbor_put_map(&s_w, 2);
+    uplink_cbor_put_uint(&s_w, 1);
+    uplink_cbor_put_uint(&s_w, 2);
+    uplink_cbor_put_uint(&s_w, 3);
+    uplink_cbor_put_array(&s_w, 2);
+    uplink_cbor_put_uint(&s_w, 4);
+    uplink_cbor_put_uint(&s_w, 5);
+    expect((const uint8_t[]){0xa2, 0x01, 0x02, 0x03, 0x82, 0x04, 0x05}, 7);
+
+    // [_ 1, []]
+    start();
+    uplink_cbor_put_indefinite_array(&s_w);
+    uplink_cbor_put_uint(&s_w, 1);
+    uplink_cbor_put_array(&s_w, 0);
+    uplink_cbor_put_break(&s_w);
+    expect((const uint8_t[]){0x9f, 0x01, 0x80, 0xff}, 4);
+
+    // A 64-byte signature takes a two-byte head
+    static uint8_t sig[64];
+    uint8_t big[70];
+    uplink_cbor_init(&s_w, big, sizeof(big));
+    uplink_cbor_put_bytes(&s_w, sig, sizeof(sig));
+    TEST_ASSERT_EQUAL(66, s_w.len);
+    TEST_ASSERT_EQUAL_HEX8(0x58, big[0]);
+    TEST_ASSERT_EQUAL_HEX8(64, big[1]);
+}
+
+TEST_CASE("uplink_cbor string sizes match what is written", "[uplink_cbor]") {
+    static char text[300];
+    static uint8_t out[310];
+    const size_t lens[] = {0, 23, 24, 255, 256, 300};
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        uplink_cbor_init(&s_w, out, sizeof(out));
+        uplink_cbor_put_text(&s_w, text, lens[i]);
+        TEST_ASSERT_EQUAL(uplink_cbor_string_size(lens[i]), s_w.len);
+    }
+}
+
+TEST_CASE("uplink_cbor flags writes past the buffer", "[uplink_cbor]") {
+    uint8_t small[4];
+    uplink_cbor_init(&s_w, small, sizeof(small));
+    uplink_cbor_put_text(&s_w, "abc", 3);
+    TEST_ASSERT_FALSE(s_w.overflow);
+
+    // Once a put fails, later ones write nothing
+    uplink_cbor_put_text(&s_w, "de", 2);
+    TEST_ASSERT_TRUE(s_w.overflow);
+    TEST_ASSERT_EQUAL(4, s_w.len);
+    uplink_cbor_put_uint(&s_w, 0);
+    TEST_ASSERT_EQUAL(4, s_w.len);
+}
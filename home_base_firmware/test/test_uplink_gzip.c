@@ -0,0 +1,107 @@
+/*
+ * Tests for the uplink gzip encoder (uplink_gzip.c)
+ *
+ * Validates that the output is a gzip member whose trailer matches the
+ * input, that output is identical run to run, and that inputs it cannot
+ * shrink or hold are refused so the caller sends them as is.
+ *
+ * The [perf] case reports the compression ratio and CPU time per batch for
+ * signed batches of increasing size, to decide whether to enable
+ * CONFIG_UNRAID_UPLINK_GZIP.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "uplink_gzip.h"
+
+static uint8_t s_in[8192];
+static uint8_t s_out[8192];
+
+// A LogIngestRequest body the way the uplink renders it: compact JSON with
+// a random Ed25519 signature per entry
+static size_t signed_batch(int entries)
+{
+    size_t used = snprintf((char *)s_in, sizeof(s_in), "{\"logs\":[");
+    for (int i = 0; i < entries; i++) {
+        char sig[129];
+        for (int j = 0; j < 64; j++) {
+            snprintf(&sig[2 * j], 3, "%02x", (unsigned)(esp_random() & 0xFF));
+        }
+        used += snprintf((char *)&s_in[used], sizeof(s_in) - used,
+                         "%s{\"device_id\":\"ESP32-%d\",\"timestamp\":%d,\"level\":\"info\","
+                         "\"category\":\"motion\",\"message\":\"motion zone %d\",\"signature\":\"%s\"}",
+                         i ? "," : "", i % 8, 1704268800 + i, i % 3, sig);
+    }
+    used += snprintf((char *)&s_in[used], sizeof(s_in) - used, "]}");
+    return used;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+TEST_CASE("uplink_gzip writes a gzip member", "[uplink_gzip]") {
+    size_t len = signed_batch(10);
+    size_t out = uplink_gzip(s_in, len, s_out, sizeof(s_out));
+    TEST_ASSERT_TRUE(out > 18);
+    TEST_ASSERT_TRUE(out < len);
+
+    // Magic, deflate, no flags; CRC-32 and length of the input at the end
+    TEST_ASSERT_EQUAL_HEX8(0x1f, s_out[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, s_out[1]);
+    TEST_ASSERT_EQUAL_HEX8(8, s_out[2]);
+    TEST_ASSERT_EQUAL_HEX8(0, s_out[3]);
+    TEST_ASSERT_EQUAL_HEX32(esp_rom_crc32_le(0, s_in, len), le32(&s_out[out - 8]));
+    TEST_ASSERT_EQUAL_UINT32(len, le32(&s_out[out - 4]));
+
+    // First block is final and dynamic-Huffman
+    TEST_ASSERT_EQUAL(1, s_out[10] & 1);
+    TEST_ASSERT_EQUAL(2, (s_out[10] >> 1) & 3);
+
+    // Same input, same bytes: nothing carries over between calls
+    static uint8_t again[sizeof(s_out)];
+    TEST_ASSERT_EQUAL(out, uplink_gzip(s_in, len, again, sizeof(again)));
+    TEST_ASSERT_EQUAL_MEMORY(s_out, again, out);
+}
+
+TEST_CASE("uplink_gzip refuses what it cannot shrink or hold", "[uplink_gzip]") {
+    for (size_t i = 0; i < 1024; i++) {
+        s_in[i] = (uint8_t)esp_random();
+    }
+    TEST_ASSERT_EQUAL(0, uplink_gzip(s_in, 1024, s_out, 1023));
+    TEST_ASSERT_EQUAL(0, uplink_gzip(s_in, 0, s_out, sizeof(s_out)));
+    TEST_ASSERT_EQUAL(0, uplink_gzip(s_in, UPLINK_GZIP_MAX_INPUT + 1, s_out, sizeof(s_out)));
+
+    // Runs longer than a match still compress
+    memset(s_in, 'a', sizeof(s_in));
+    size_t out = uplink_gzip(s_in, sizeof(s_in), s_out, sizeof(s_out));
+    TEST_ASSERT_TRUE(out > 0 && out < 100);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(s_in), le32(&s_out[out - 4]));
+}
+
+TEST_CASE("uplink_gzip ratio and cost per batch", "[uplink_gzip][perf]") {
+    const int sizes[] = {1, 4, 8, 16, 24};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t len = signed_batch(sizes[s]);
+        size_t out = 0;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < 100; i++) {
+            out = uplink_gzip(s_in, len, s_out, sizeof(s_out));
+        }
+        int64_t us = (esp_timer_get_time() - start) / 100;
+        printf("%2d entries: %4u -> %4u bytes (%.2fx), %lld us/batch\n", sizes[s],
+               (unsigned)len, (unsigned)out, out ? (double)len / out : 0.0, (long long)us);
+        TEST_ASSERT_TRUE(out > 0);
+    }
+
+    // The signatures are random, so the ratio stays modest; the rest of each
+    // entry repeats from one to the next
+    size_t len = signed_batch(16);
+    size_t out = uplink_gzip(s_in, len, s_out, sizeof(s_out));
+    TEST_ASSERT_TRUE(len > 2 * out);
+}
@@ -0,0 +1,202 @@
+/*
+ * Tests for the uplink store-and-forward spool (uplink_spool.c)
+ *
+ * Validates that batches come back oldest-first and only once, that pending
+ * batches survive a reboot while delivered ones do not, that torn writes and
+ * flipped bits are caught by the CRC, that a full spool gives up its oldest
+ * segment, that its head only moves when the oldest batch goes, and that
+ * segments are erased evenly. Flash is the RAM-backed
+ * partition from mock_flash.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "mock_flash.h"
+#include "uplink_spool.h"
+
+#define SEGMENT (64 * 1024)
+
+static void append_batch(int n)
+{
+    char body[64];
+    int len = snprintf(body, sizeof(body), "{\"logs\":[{\"n\":%d}]}", n);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_append(body, len, 1));
+}
+
+// Peek at the oldest batch and return its number
+static int peek_batch(void)
+{
+    char body[64] = {0};
+    size_t len = 0;
+    uint32_t entries = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_peek(body, sizeof(body) - 1, &len, &entries));
+    TEST_ASSERT_EQUAL_UINT32(1, entries);
+    int n = -1;
+    sscanf(body, "{\"logs\":[{\"n\":%d}]}", &n);
+    return n;
+}
+
+TEST_CASE("uplink_spool returns batches oldest first", "[uplink_spool]") {
+    mock_flash_init(4 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+
+    for (int i = 0; i < 5; i++) {
+        append_batch(i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, uplink_spool_pending());
+
+    // Peeking does not consume
+    TEST_ASSERT_EQUAL(0, peek_batch());
+    TEST_ASSERT_EQUAL(0, peek_batch());
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(i, peek_batch());
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_pop());
+    }
+
+    char body[64];
+    size_t len;
+    uint32_t entries;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, uplink_spool_peek(body, sizeof(body), &len, &entries));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, uplink_spool_pop());
+
+    uplink_spool_stats_t stats;
+    uplink_spool_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.records);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.bytes);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.appended);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.delivered);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.segments);
+}
+
+TEST_CASE("uplink_spool head moves only when the oldest batch goes", "[uplink_spool]") {
+    mock_flash_init(4 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    append_batch(0);
+
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(i, peek_batch());
+        uint64_t head = uplink_spool_head();
+        append_batch(i + 1);   // Appends while a replay is posting leave the head alone
+        TEST_ASSERT_TRUE(uplink_spool_head() == head);
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_pop());
+        TEST_ASSERT_TRUE(uplink_spool_head() != head);
+    }
+    TEST_ASSERT_EQUAL(5, peek_batch());
+}
+
+TEST_CASE("uplink_spool keeps pending batches across a reboot", "[uplink_spool]") {
+    mock_flash_init(4 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    for (int i = 0; i < 10; i++) {
+        append_batch(i);
+    }
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_pop());
+    }
+
+    // Reboot: the delivered four stay delivered
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    uplink_spool_stats_t stats;
+    uplink_spool_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.recovered);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.records);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.entries);
+    TEST_ASSERT_EQUAL(4, peek_batch());
+
+    // New batches queue behind the recovered ones
+    append_batch(10);
+    for (int i = 4; i <= 10; i++) {
+        TEST_ASSERT_EQUAL(i, peek_batch());
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_pop());
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, uplink_spool_pending());
+
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    TEST_ASSERT_EQUAL_UINT32(0, uplink_spool_pending());
+}
+
+TEST_CASE("uplink_spool drops a torn write and a corrupted batch", "[uplink_spool]") {
+    mock_flash_init(4 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    append_batch(0);
+    append_batch(1);
+
+    // Power lost halfway through the third batch
+    mock_flash_fail_after(10);
+    char body[] = "{\"logs\":[{\"n\":2}]}";
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, uplink_spool_append(body, strlen(body), 1));
+    mock_flash_fail_after(-1);
+
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    TEST_ASSERT_EQUAL_UINT32(2, uplink_spool_pending());
+
+    // A bit flips in the first batch's payload after recovery
+    mock_flash_flip(16 + 20 + 3);
+    TEST_ASSERT_EQUAL(1, peek_batch());
+
+    uplink_spool_stats_t stats;
+    uplink_spool_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.corrupt);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.records);
+}
+
+TEST_CASE("uplink_spool overwrites the oldest segment when full", "[uplink_spool]") {
+    mock_flash_init(2 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+
+    static char big[4000];
+    memset(big, 'x', sizeof(big));
+    int per_segment = (SEGMENT - 16) / (20 + sizeof(big));
+    uint64_t head = 0;
+    for (int i = 0; i < 3 * per_segment; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_append(big, sizeof(big), 10));
+        if (i == 0) {
+            head = uplink_spool_head();
+        }
+    }
+    // A batch peeked before the overwrite must not be popped afterwards
+    TEST_ASSERT_TRUE(uplink_spool_head() != head);
+
+    uplink_spool_stats_t stats;
+    uplink_spool_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(per_segment, stats.lost);
+    TEST_ASSERT_EQUAL_UINT32(2 * per_segment, stats.records);
+    TEST_ASSERT_EQUAL_UINT32(20 * per_segment, stats.entries);
+
+    // Too big for any segment
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, uplink_spool_append(big, SEGMENT, 1));
+}
+
+TEST_CASE("uplink_spool wears segments evenly", "[uplink_spool]") {
+    mock_flash_init(8 * SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+
+    // Steady traffic with delivery keeping up, across several reboots
+    static char body[2000];
+    memset(body, 'y', sizeof(body));
+    for (int boot = 0; boot < 4; boot++) {
+        for (int i = 0; i < 500; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_append(body, sizeof(body), 1));
+            TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_pop());
+        }
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_spool_init());
+    }
+
+    uplink_spool_stats_t stats;
+    uplink_spool_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.records);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.lost);
+    TEST_ASSERT_TRUE(stats.min_erases > 0);
+    TEST_ASSERT_TRUE(stats.max_erases - stats.min_erases <= 1);
+}
+
+TEST_CASE("uplink_spool without a partition", "[uplink_spool]") {
+    mock_flash_init(0);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, uplink_spool_init());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, uplink_spool_append("x", 1, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, uplink_spool_pending());
+
+    mock_flash_init(SEGMENT);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, uplink_spool_init());
+}
@@ -0,0 +1,165 @@
+/*
+ * Tests for streaming uplink framing and flow control (uplink_stream.c)
+ *
+ * Validates that nothing is sent before the backend grants a window and no
+ * more than the window is ever unacked, that acks must come in order and
+ * carry back each batch's entry count, that batches survive a dropped
+ * connection for posting, that the in-flight ring wraps without splitting
+ * a batch, and that truncated or unknown frames are refused.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "uplink_stream.h"
+
+static uint64_t s_ring[512];   // 4 KB
+static uplink_stream_t s;
+
+static void window(uint16_t n)
+{
+    const uint8_t frame[] = {UPLINK_STREAM_FRAME_WINDOW, n >> 8, n & 0xFF};
+    uplink_stream_ack_t ack;
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_stream_receive(&s, frame, sizeof(frame), &ack));
+    TEST_ASSERT_EQUAL(UPLINK_STREAM_FRAME_WINDOW, ack.type);
+}
+
+static esp_err_t ack(uint32_t seq, uint16_t status, uint16_t n, uplink_stream_ack_t *out)
+{
+    const uint8_t frame[] = {UPLINK_STREAM_FRAME_ACK, seq >> 24, (seq >> 16) & 0xFF, (seq >> 8) & 0xFF, seq & 0xFF,
+                             status >> 8, status & 0xFF, n >> 8, n & 0xFF};
+    return uplink_stream_receive(&s, frame, sizeof(frame), out);
+}
+
+static uint32_t push(const char *body, uint32_t entries)
+{
+    uint32_t seq = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, uplink_stream_push(&s, body, strlen(body), entries, 0, &seq));
+    return seq;
+}
+
+TEST_CASE("uplink_stream waits for a window and keeps within it", "[uplink_stream]") {
+    uplink_stream_init(&s, s_ring, sizeof(s_ring));
+    uint32_t seq;
+    TEST_ASSERT_FALSE(uplink_stream_can_push(&s, 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, uplink_stream_push(&s, "{}", 2, 1, 0, &seq));
+
+    window(2);
+    TEST_ASSERT_EQUAL_UINT32(0, push("{\"logs\":[1]}", 1));
+    TEST_ASSERT_EQUAL_UINT32(1, push("{\"logs\":[2,3]}", 2));
+    TEST_ASSERT_FALSE(uplink_stream_can_push(&s, 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, uplink_stream_push(&s, "{}", 2, 1, 0, &seq));
+    TEST_ASSERT_EQUAL_UINT32(2, s.stalls);
+
+    // An ack reports the entries and may change the window
+    uplink_stream_ack_t a;
+    TEST_ASSERT_EQUAL(ESP_OK, ack(0, 200, 3, &a));
+    TEST_ASSERT_EQUAL_UINT32(0, a.seq);
+    TEST_ASSERT_EQUAL_UINT16(200, a.status);
+    TEST_ASSERT_EQUAL_UINT32(1, a.entries);
+    uplink_stream_drop_oldest(&s);
+    TEST_ASSERT_EQUAL_UINT16(3, s.window);
+    TEST_ASSERT_EQUAL_UINT16(1, s.in_flight);
+    TEST_ASSERT_EQUAL_UINT32(2, push("{}", 1));
+    TEST_ASSERT_EQUAL_UINT32(3, push("{}", 1));
+    TEST_ASSERT_FALSE(uplink_stream_can_push(&s, 2));
+}
+
+TEST_CASE("uplink_stream refuses acks out of order", "[uplink_stream]") {
+    uplink_stream_init(&s, s_ring, sizeof(s_ring));
+    uplink_stream_ack_t a;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, ack(0, 200, 8, &a));   // Nothing in flight
+
+    window(8);
+    push("{\"a\":1}", 1);
+    push("{\"b\":2}", 4);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, ack(1, 200, 8, &a));
+    TEST_ASSERT_EQUAL(ESP_OK, ack(0, 422, 8, &a));
+    uplink_stream_drop_oldest(&s);
+    TEST_ASSERT_EQUAL(ESP_OK, ack(1, 200, 8, &a));
+    TEST_ASSERT_EQUAL_UINT32(4, a.entries);
+    uplink_stream_drop_oldest(&s);
+    TEST_ASSERT_EQUAL_UINT32(2, s.acked);
+    TEST_ASSERT_NULL(uplink_stream_oldest(&s, NULL, NULL, NULL));
+}
+
+TEST_CASE("uplink_stream keeps unacked batches across a disconnect", "[uplink_stream]") {
+    uplink_stream_init(&s, s_ring, sizeof(s_ring));
+    window(8);
+    push("{\"first\":1}", 1);
+    push("{\"second\":2}", 2);
+
+    uplink_stream_disconnected(&s);
+    TEST_ASSERT_FALSE(uplink_stream_can_push(&s, 2));
+
+    size_t len;
+    uint32_t entries, seq;
+    const char *body = uplink_stream_oldest(&s, &len, &entries, &seq);
+    TEST_ASSERT_NOT_NULL(body);
+    TEST_ASSERT_EQUAL(strlen("{\"first\":1}"), len);
+    TEST_ASSERT_EQUAL_MEMORY("{\"first\":1}", body, len);
+    TEST_ASSERT_EQUAL_UINT32(1, entries);
+    TEST_ASSERT_EQUAL_UINT32(0, seq);
+    uplink_stream_drop_oldest(&s);
+    body = uplink_stream_oldest(&s, &len, &entries, &seq);
+    TEST_ASSERT_EQUAL_MEMORY("{\"second\":2}", body, len);
+    TEST_ASSERT_EQUAL_UINT32(1, seq);
+    uplink_stream_drop_oldest(&s);
+    TEST_ASSERT_EQUAL_UINT16(0, s.in_flight);
+
+    // Sequence numbers carry on over the next connection
+    window(8);
+    TEST_ASSERT_EQUAL_UINT32(2, push("{}", 1));
+}
+
+TEST_CASE("uplink_stream wraps the ring without splitting a batch", "[uplink_stream]") {
+    uplink_stream_init(&s, s_ring, sizeof(s_ring));
+    window(100);
+    char body[1200];
+    uplink_stream_ack_t a;
+    uint32_t seq;
+
+    // Three batches fill most of 4 KB; the next fits only once the oldest is
+    // acked, and then goes to the start of the buffer
+    for (int i = 0; i < 3; i++) {
+        memset(body, 'a' + i, sizeof(body));
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_stream_push(&s, body, sizeof(body), 1, 0, &seq));
+    }
+    for (int lap = 0; lap < 20; lap++) {
+        TEST_ASSERT_FALSE(uplink_stream_can_push(&s, sizeof(body)));
+
+        size_t len;
+        const uint8_t *oldest = uplink_stream_oldest(&s, &len, NULL, &seq);
+        TEST_ASSERT_EQUAL(sizeof(body), len);
+        TEST_ASSERT_TRUE(oldest >= (const uint8_t *)s_ring && oldest + len <= (const uint8_t *)s_ring + sizeof(s_ring));
+        for (size_t i = 0; i < len; i++) {
+            TEST_ASSERT_EQUAL('a' + (seq % 26), oldest[i]);
+        }
+        TEST_ASSERT_EQUAL(ESP_OK, ack(seq, 200, 100, &a));
+        uplink_stream_drop_oldest(&s);
+
+        memset(body, 'a' + (s.next_seq % 26), sizeof(body));
+        TEST_ASSERT_EQUAL(ESP_OK, uplink_stream_push(&s, body, sizeof(body), 1, 0, &seq));
+    }
+    TEST_ASSERT_EQUAL_UINT32(20, s.acked);
+    TEST_ASSERT_EQUAL_UINT16(3, s.in_flight);
+}
+
+TEST_CASE("uplink_stream frames batches and refuses bad frames", "[uplink_stream]") {
+    uint8_t header[UPLINK_STREAM_HEADER];
+    TEST_ASSERT_EQUAL(UPLINK_STREAM_HEADER, uplink_stream_frame_header(header, 0x01020304, true));
+    const uint8_t expected[] = {UPLINK_STREAM_FRAME_BATCH, UPLINK_STREAM_FLAG_GZIP, 0x01, 0x02, 0x03, 0x04};
+    TEST_ASSERT_EQUAL_MEMORY(expected, header, sizeof(expected));
+    uplink_stream_frame_header(header, 7, false);
+    TEST_ASSERT_EQUAL_UINT8(0, header[1]);
+
+    uplink_stream_init(&s, s_ring, sizeof(s_ring));
+    uplink_stream_ack_t a;
+    const uint8_t short_window[] = {UPLINK_STREAM_FRAME_WINDOW, 0};
+    const uint8_t short_ack[] = {UPLINK_STREAM_FRAME_ACK, 0, 0, 0, 0, 0, 200};
+    const uint8_t unknown[] = {0x42, 0, 8};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, uplink_stream_receive(&s, short_window, 0, &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, uplink_stream_receive(&s, short_window, sizeof(short_window), &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, uplink_stream_receive(&s, short_ack, sizeof(short_ack), &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, uplink_stream_receive(&s, unknown, sizeof(unknown), &a));
+    TEST_ASSERT_EQUAL_UINT16(0, s.window);
+}
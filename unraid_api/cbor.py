@@ -0,0 +1,120 @@
+"""Minimal CBOR (RFC 8949) decoder for home base log batches.
+
+Covers what the firmware writes: unsigned and negative integers, byte and
+text strings, arrays and maps (definite or indefinite length), and the
+simple values false, true and null. Tags and floats are rejected.
+"""
+
+import struct
+
+BREAK = object()
+
+
+class CBORDecodeError(ValueError):
+    pass
+
+
+class _Decoder:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n: int) -> bytes:
+        end = self.pos + n
+        if end > len(self.data):
+            raise CBORDecodeError("truncated")
+        chunk = self.data[self.pos:end]
+        self.pos = end
+        return chunk
+
+    def argument(self, info: int) -> int:
+        if info < 24:
+            return info
+        if info == 24:
+            return self.take(1)[0]
+        if info == 25:
+            return struct.unpack(">H", self.take(2))[0]
+        if info == 26:
+            return struct.unpack(">I", self.take(4))[0]
+        if info == 27:
+            return struct.unpack(">Q", self.take(8))[0]
+        raise CBORDecodeError(f"reserved additional info {info}")
+
+    def string(self, major: int, info: int):
+        if info != 31:
+            chunk = self.take(self.argument(info))
+        else:
+            parts = []
+            while True:
+                part = self.item()
+                if part is BREAK:
+                    break
+                if not isinstance(part, bytes if major == 2 else str):
+                    raise CBORDecodeError("bad chunk in indefinite string")
+                parts.append(part if major == 2 else part.encode("utf-8"))
+            chunk = b"".join(parts)
+        if major == 2:
+            return chunk
+        try:
+            return chunk.decode("utf-8")
+        except UnicodeDecodeError:
+            raise CBORDecodeError("invalid UTF-8 in text string")
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 31
+
+        if major == 0:
+            return self.argument(info)
+        if major == 1:
+            return -1 - self.argument(info)
+        if major in (2, 3):
+            return self.string(major, info)
+        if major == 4:
+            if info == 31:
+                items = []
+                while (value := self.item()) is not BREAK:
+                    items.append(value)
+                return items
+            return [self.value() for _ in range(self.argument(info))]
+        if major == 5:
+            result = {}
+            count = None if info == 31 else self.argument(info)
+            pairs = 0
+            while count is None or pairs < count:
+                key = self.item()
+                if key is BREAK and count is None:
+                    break
+                if key is BREAK or isinstance(key, (list, dict)):
+                    raise CBORDecodeError("bad map key")
+                result[key] = self.value()
+                pairs += 1
+            return result
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info == 22:
+                return None
+            if info == 31:
+                return BREAK
+        raise CBORDecodeError(f"unsupported item 0x{initial:02x}")
+
+    def value(self):
+        value = self.item()
+        if value is BREAK:
+            raise CBORDecodeError("unexpected break")
+        return value
+
+
+def loads(data: bytes):
+    """Decode exactly one CBOR item; raises CBORDecodeError if malformed."""
+    decoder = _Decoder(data)
+    try:
+        value = decoder.value()
+    except RecursionError:
+        raise CBORDecodeError("nested too deeply")
+    if decoder.pos != len(data):
+        raise CBORDecodeError("trailing bytes")
+    return value
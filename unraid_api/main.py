@@ -1,8 +1,13 @@
-from fastapi import FastAPI, Depends, HTTPException, status, WebSocket
+from fastapi import FastAPI, APIRouter, Depends, HTTPException, Request, status, WebSocket, WebSocketDisconnect
+from fastapi.exceptions import RequestValidationError
+from fastapi.routing import APIRoute
+from sqlalchemy.exc import IntegrityError
 from sqlalchemy.orm import Session
+from starlette.concurrency import run_in_threadpool
 from typing import List, Optional
-from pydantic import BaseModel
+from pydantic import BaseModel, ValidationError
 from datetime import datetime
+import cbor
 import models
 import security
 import middleware
@@ -12,6 +17,8 @@ import json
 import nacl.encoding
 import nacl.signing
 import secrets
+import struct
+import zlib
 
 # --- Pydantic Models ---
 class NetworkCreate(BaseModel):
@@ -30,9 +37,11 @@ class LogIngestItem(BaseModel):
     category: str
     message: str
     signature: str # Hex signature of the log payload
+    seq: Optional[int] = None # Uplink sequence number, with home_base_id the entry's idempotency key
 
 class LogIngestRequest(BaseModel):
     logs: List[LogIngestItem]
+    home_base_id: Optional[str] = None
 
 class CommandRequest(BaseModel):
     command: str
@@ -59,6 +68,111 @@ os.makedirs("./data", exist_ok=True)
 init_db()
 app = FastAPI(title="Unraid Central API")
 
+# --- Compressed request bodies ---
+# The home base may gzip log batches (Content-Encoding: gzip). Inflated size
+# is capped so a small compressed body cannot expand without bound.
+MAX_INFLATED_BODY = 1024 * 1024
+
+def decode_body(raw: bytes, encoding: str) -> bytes:
+    encoding = encoding.strip().lower()
+    if encoding in ("", "identity"):
+        return raw
+    if encoding == "gzip":
+        wbits = 16 + zlib.MAX_WBITS
+    elif encoding == "deflate":
+        wbits = zlib.MAX_WBITS
+    else:
+        raise HTTPException(status_code=status.HTTP_415_UNSUPPORTED_MEDIA_TYPE,
+                            detail=f"Unsupported Content-Encoding: {encoding}")
+
+    inflater = zlib.decompressobj(wbits)
+    try:
+        body = inflater.decompress(raw, MAX_INFLATED_BODY)
+    except zlib.error:
+        raise HTTPException(status_code=400, detail=f"Invalid {encoding} body")
+    if inflater.unconsumed_tail:
+        raise HTTPException(status_code=status.HTTP_413_REQUEST_ENTITY_TOO_LARGE,
+                            detail="Inflated body too large")
+    if not inflater.eof:
+        raise HTTPException(status_code=400, detail=f"Truncated {encoding} body")
+    return body
+
+class DecompressingRequest(Request):
+    async def body(self) -> bytes:
+        if not hasattr(self, "_decoded_body"):
+            raw = await super().body()
+            self._decoded_body = decode_body(raw, self.headers.get("content-encoding", ""))
+        return self._decoded_body
+
+class DecompressingRoute(APIRoute):
+    def get_route_handler(self):
+        handler = super().get_route_handler()
+
+        async def decompressing_handler(request: Request):
+            return await handler(DecompressingRequest(request.scope, request.receive))
+
+        return decompressing_handler
+
+ingest_router = APIRouter(route_class=DecompressingRoute)
+
+# --- Log batch formats ---
+# application/json: LogIngestRequest. application/cbor: the home base's
+# binary batch, {"logs": [[device, timestamp, level, category, message,
+# signature], ...], "devices": [device_id, ...]}, where device indexes
+# "devices" and signature is 64 raw bytes.
+def batch_from_cbor(body: bytes) -> dict:
+    try:
+        doc = cbor.loads(body)
+    except cbor.CBORDecodeError as e:
+        raise HTTPException(status_code=400, detail=f"Invalid CBOR body: {e}")
+
+    if not isinstance(doc, dict) or not isinstance(doc.get("logs"), list) or not isinstance(doc.get("devices"), list):
+        raise HTTPException(status_code=400, detail="CBOR batch needs logs and devices arrays")
+    devices = doc["devices"]
+    logs = []
+    for entry in doc["logs"]:
+        # A seventh element is the entry's sequence number
+        if (not isinstance(entry, list) or len(entry) not in (6, 7) or not isinstance(entry[0], int)
+                or not 0 <= entry[0] < len(devices) or not isinstance(entry[5], bytes)):
+            raise HTTPException(status_code=400, detail="Malformed CBOR log entry")
+        log = {
+            "device_id": devices[entry[0]],
+            "timestamp": entry[1],
+            "level": entry[2],
+            "category": entry[3],
+            "message": entry[4],
+            "signature": entry[5].hex()
+        }
+        if len(entry) == 7:
+            log["seq"] = entry[6]
+        logs.append(log)
+    batch = {"logs": logs}
+    if "home_base_id" in doc:
+        batch["home_base_id"] = doc["home_base_id"]
+    return batch
+
+def parse_log_batch(body: bytes, content_type: str) -> LogIngestRequest:
+    if content_type == "application/cbor":
+        doc = batch_from_cbor(body)
+    elif content_type == "application/json":
+        try:
+            doc = json.loads(body)
+        except ValueError:
+            raise HTTPException(status_code=400, detail="Invalid JSON body")
+    else:
+        raise HTTPException(status_code=status.HTTP_415_UNSUPPORTED_MEDIA_TYPE,
+                            detail=f"Unsupported Content-Type: {content_type}")
+
+    try:
+        return LogIngestRequest.model_validate(doc)
+    except ValidationError as e:
+        raise RequestValidationError(e.errors())
+
+async def read_log_batch(request: Request) -> LogIngestRequest:
+    body = await request.body()
+    content_type = request.headers.get("content-type", "application/json").split(";")[0].strip().lower()
+    return parse_log_batch(body, content_type)
+
 # --- Routes ---
 
 @app.post("/auth/session", response_model=Token)
@@ -106,11 +220,43 @@ def register_device(network_id: int, device: DeviceCreate, db: Session = Depends
 def list_devices(network_id: int, db: Session = Depends(get_db)):
     return db.query(models.Device).filter(models.Device.network_id == network_id).all()
 
-@app.post("/logs/ingest")
-def ingest_logs(batch: LogIngestRequest, db: Session = Depends(get_db)):
+# Sequence numbers in the batch already stored for its home base, and its
+# high-water mark. The uplink numbers entries in ascending order, so anything
+# above the mark is new; only entries at or below it (retries, spool replays
+# behind live traffic) are looked up.
+def stored_seqs(batch: LogIngestRequest, db: Session):
+    mark = db.get(models.UplinkSequence, batch.home_base_id)
+    high_water = mark.high_water if mark else 0
+    older = [item.seq for item in batch.logs if item.seq is not None and item.seq <= high_water]
+    seen = set()
+    if older:
+        rows = db.query(models.DeviceLog.seq).filter(models.DeviceLog.home_base_id == batch.home_base_id,
+                                                     models.DeviceLog.seq.in_(older))
+        seen = {row.seq for row in rows}
+    return seen, high_water
+
+def store_logs(batch: LogIngestRequest, db: Session) -> dict:
+    try:
+        return store_new_logs(batch, db)
+    except IntegrityError:
+        # The same entries came in concurrently (a hedged post, a stream
+        # frame and its fallback); the other request stored them
+        db.rollback()
+        return store_new_logs(batch, db)
+
+def store_new_logs(batch: LogIngestRequest, db: Session) -> dict:
     count = 0
     errors = 0
+    duplicates = 0
+    keyed = batch.home_base_id is not None
+    seen, high_water = stored_seqs(batch, db) if keyed else (set(), 0)
+    top = high_water
     for log_item in batch.logs:
+        seq = log_item.seq if keyed else None
+        if seq is not None and seq in seen:
+            duplicates += 1
+            continue
+
         # 1. Fetch device public key
         device = db.query(models.Device).filter(models.Device.device_id == log_item.device_id).first()
         if not device:
@@ -137,13 +283,33 @@ def ingest_logs(batch: LogIngestRequest, db: Session = Depends(get_db)):
             timestamp=datetime.fromtimestamp(log_item.timestamp),
             level=log_item.level,
             category=log_item.category,
-            message=log_item.message
+            message=log_item.message,
+            home_base_id=batch.home_base_id if seq is not None else None,
+            seq=seq
         )
         db.add(log_entry)
         count += 1
-
+        if seq is not None:
+            seen.add(seq)
+            top = max(top, seq)
+
+    if top > high_water:
+        mark = db.get(models.UplinkSequence, batch.home_base_id)
+        if mark:
+            mark.high_water = top
+        else:
+            db.add(models.UplinkSequence(home_base_id=batch.home_base_id, high_water=top))
     db.commit()
-    return {"status": "ok", "ingested": count, "errors": errors}
+    result = {"status": "ok", "ingested": count, "errors": errors, "duplicates": duplicates}
+    if keyed:
+        result["high_water"] = top
+    return result
+
+@ingest_router.post("/logs/ingest")
+def ingest_logs(batch: LogIngestRequest = Depends(read_log_batch), db: Session = Depends(get_db)):
+    return store_logs(batch, db)
+
+app.include_router(ingest_router)
 
 @app.get("/logs")
 def get_logs(device_id: Optional[str] = None, limit: int = 100, db: Session = Depends(get_db)):
@@ -191,6 +357,7 @@ def send_command(network_id: int, cmd: CommandRequest, db: Session = Depends(get
             "nonce": nonce,
             "command": cmd.command,
             "payload": cmd.payload,
+            "payload_json": payload_str,  # Exact signed text; the home base cannot re-serialize identically
             "signature": signature_hex
         }
     }
@@ -201,3 +368,50 @@ async def websocket_endpoint(websocket: WebSocket):
     while True:
         data = await websocket.receive_text()
         await websocket.send_text(f"Message text was: {data}")
+
+# --- Streaming uplink ---
+# The home base keeps one WebSocket open here instead of POSTing each batch.
+# Every binary frame it sends is a batch: type (0x01), flags (bit 0: gzip),
+# a big-endian 32-bit sequence number, then the body it would have POSTed to
+# /logs/ingest (CBOR if it does not start with "{"). Each batch is answered
+# in order with an ack: type (0x81), the sequence number, the status
+# /logs/ingest would have returned and the window, the number of batches the
+# home base may have unacknowledged. The window is also sent on connect
+# (type 0x82) so the home base knows it may start sending.
+UPLINK_FRAME_BATCH = 0x01
+UPLINK_FRAME_ACK = 0x81
+UPLINK_FRAME_WINDOW = 0x82
+UPLINK_FLAG_GZIP = 0x01
+UPLINK_WINDOW = 8
+
+def ingest_frame(frame: bytes, db: Session) -> tuple:
+    if len(frame) < 6 or frame[0] != UPLINK_FRAME_BATCH:
+        return None, 400
+    seq = int.from_bytes(frame[2:6], "big")
+    body = frame[6:]
+    try:
+        if frame[1] & UPLINK_FLAG_GZIP:
+            body = decode_body(body, "gzip")
+        batch = parse_log_batch(body, "application/json" if body[:1] == b"{" else "application/cbor")
+    except HTTPException as e:
+        return seq, e.status_code
+    except RequestValidationError:
+        return seq, status.HTTP_422_UNPROCESSABLE_ENTITY
+    store_logs(batch, db)
+    return seq, 200
+
+@app.websocket("/ws/uplink")
+async def uplink_stream(websocket: WebSocket, db: Session = Depends(get_db)):
+    await websocket.accept()
+    await websocket.send_bytes(struct.pack(">BH", UPLINK_FRAME_WINDOW, UPLINK_WINDOW))
+    try:
+        while True:
+            frame = await websocket.receive_bytes()
+            seq, code = await run_in_threadpool(ingest_frame, frame, db)
+            if seq is None:
+                # Not a batch frame; the stream is out of step, so drop it
+                await websocket.close(code=status.WS_1003_UNSUPPORTED_DATA)
+                return
+            await websocket.send_bytes(struct.pack(">BIHH", UPLINK_FRAME_ACK, seq, code, UPLINK_WINDOW))
+    except WebSocketDisconnect:
+        pass
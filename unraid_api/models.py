@@ -1,4 +1,4 @@
-from sqlalchemy import create_engine, Column, Integer, String, Boolean, ForeignKey, DateTime, Text
+from sqlalchemy import create_engine, inspect, text, Column, Integer, String, Boolean, ForeignKey, DateTime, Text, Index
 from sqlalchemy.orm import declarative_base, relationship, sessionmaker
 from datetime import datetime
 
@@ -50,9 +50,20 @@ class DeviceLog(Base):
     level = Column(String)
     category = Column(String)
     message = Column(Text)
+    # Idempotency key from the home base uplink; unset for unkeyed entries
+    home_base_id = Column(String, nullable=True)
+    seq = Column(Integer, nullable=True)
 
     device = relationship("Device", back_populates="logs")
 
+    __table_args__ = (Index("ix_device_logs_home_base_seq", "home_base_id", "seq", unique=True),)
+
+class UplinkSequence(Base):
+    # Highest sequence number stored per home base
+    __tablename__ = "uplink_sequences"
+    home_base_id = Column(String, primary_key=True)
+    high_water = Column(Integer, default=0)
+
 class MotionEvent(Base):
     __tablename__ = "motion_events"
     id = Column(Integer, primary_key=True, index=True)
@@ -80,5 +91,17 @@ class CommandNonce(Base):
     timestamp = Column(DateTime, index=True)
     network_id = Column(Integer, ForeignKey("networks.id"))
 
+def upgrade_db():
+    # device_logs predates the idempotency key
+    columns = [c["name"] for c in inspect(engine).get_columns("device_logs")]
+    if "seq" in columns:
+        return
+    with engine.begin() as conn:
+        conn.execute(text("ALTER TABLE device_logs ADD COLUMN home_base_id VARCHAR"))
+        conn.execute(text("ALTER TABLE device_logs ADD COLUMN seq INTEGER"))
+    for index in DeviceLog.__table__.indexes:
+        index.create(bind=engine, checkfirst=True)
+
 def init_db():
     Base.metadata.create_all(bind=engine)
+    upgrade_db()
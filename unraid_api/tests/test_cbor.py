@@ -0,0 +1,189 @@
+"""Tests for CBOR log batches: the decoder, /logs/ingest, and JSON vs CBOR decode cost."""
+
+import gzip
+import json
+import os
+import struct
+import time
+
+import pytest
+import cbor
+from main import LogIngestRequest, batch_from_cbor
+
+
+def encode_head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, fmt, limit in ((24, ">B", 0xFF), (25, ">H", 0xFFFF), (26, ">I", 0xFFFFFFFF), (27, ">Q", None)):
+        if limit is None or value <= limit:
+            return bytes([major << 5 | info]) + struct.pack(fmt, value)
+
+
+def encode(value):
+    """CBOR the way the firmware writes it (indefinite-length logs array)."""
+    if isinstance(value, bool) or value is None:
+        return bytes([{False: 0xf4, True: 0xf5, None: 0xf6}[value]])
+    if isinstance(value, int):
+        return encode_head(0, value)
+    if isinstance(value, bytes):
+        return encode_head(2, len(value)) + value
+    if isinstance(value, str):
+        raw = value.encode("utf-8")
+        return encode_head(3, len(raw)) + raw
+    if isinstance(value, list):
+        return encode_head(4, len(value)) + b"".join(encode(v) for v in value)
+    if isinstance(value, dict):
+        return encode_head(5, len(value)) + b"".join(encode(k) + encode(v) for k, v in value.items())
+    raise TypeError(value)
+
+
+def encode_batch(logs, devices, home_base_id=None):
+    body = encode_head(5, 3 if home_base_id else 2) + encode("logs") + b"\x9f"
+    body += b"".join(encode(entry) for entry in logs)
+    body += b"\xff" + encode("devices") + encode(devices)
+    if home_base_id:
+        body += encode("home_base_id") + encode(home_base_id)
+    return body
+
+
+@pytest.mark.parametrize("hex_bytes,value", [
+    ("00", 0),
+    ("17", 23),
+    ("1818", 24),
+    ("1903e8", 1000),
+    ("1a000f4240", 1000000),
+    ("1b000000e8d4a51000", 1000000000000),
+    ("20", -1),
+    ("3863", -100),
+    ("60", ""),
+    ("6449455446", "IETF"),
+    ("4401020304", b"\x01\x02\x03\x04"),
+    ("83010203", [1, 2, 3]),
+    ("9f018202039f0405ffff", [1, [2, 3], [4, 5]]),
+    ("a201020304", {1: 2, 3: 4}),
+    ("bf61610161629f0203ffff", {"a": 1, "b": [2, 3]}),
+    ("7f657374726561646d696e67ff", "streaming"),
+    ("f4", False),
+    ("f5", True),
+    ("f6", None),
+])
+def test_rfc8949_examples(hex_bytes, value):
+    """Test decoding the RFC 8949 Appendix A examples the firmware can emit."""
+    assert cbor.loads(bytes.fromhex(hex_bytes)) == value
+
+
+@pytest.mark.parametrize("hex_bytes", [
+    "",                 # Nothing
+    "19ff",             # Truncated argument
+    "62ff",             # Truncated string
+    "1c",               # Reserved additional info
+    "c0",               # Tags are not supported
+    "fb3ff0000000000000",  # Floats are not supported
+    "ff",               # Stray break
+    "8201",             # Array shorter than declared
+    "0000",             # Trailing bytes
+    "62c328",           # Invalid UTF-8
+])
+def test_malformed(hex_bytes):
+    """Test malformed input raises CBORDecodeError rather than anything else."""
+    with pytest.raises(cbor.CBORDecodeError):
+        cbor.loads(bytes.fromhex(hex_bytes))
+
+
+def test_batch_from_cbor():
+    """Test a firmware-style batch maps to LogIngestRequest fields."""
+    sig = bytes(range(64))
+    body = encode_batch([
+        [1, 1704268800, "NOTICE", "motion", "PIR", sig],
+        [0, 1704268801, "INFO", "system", "boot", sig],
+    ], ["ESP32-A", "ESP32-B"])
+
+    batch = LogIngestRequest.model_validate(batch_from_cbor(body))
+    assert [log.device_id for log in batch.logs] == ["ESP32-B", "ESP32-A"]
+    assert batch.logs[0].timestamp == 1704268800
+    assert batch.logs[0].signature == sig.hex()
+
+
+def test_batch_from_cbor_keyed():
+    """Test sequence numbers and the home base ID come through."""
+    sig = bytes(64)
+    body = encode_batch([
+        [0, 1704268800, "INFO", "system", "boot", sig, 41],
+        [0, 1704268801, "INFO", "system", "up", sig, 42],
+    ], ["ESP32-A"], home_base_id="HB-01")
+
+    batch = LogIngestRequest.model_validate(batch_from_cbor(body))
+    assert batch.home_base_id == "HB-01"
+    assert [log.seq for log in batch.logs] == [41, 42]
+
+
+def test_decode_benchmark():
+    """Report decode time per batch for the JSON and CBOR encodings (pytest -s)."""
+    devices = [f"ESP32-{i}" for i in range(16)]
+    entries = []
+    for i in range(32):
+        entries.append((devices[i % 16], 1704268800 + i, "INFO", "system",
+                        json.dumps({"message": f"PIR zone {i % 5} triggered"}), os.urandom(64)))
+
+    json_body = json.dumps({"logs": [{
+        "device_id": d, "timestamp": ts, "level": lvl, "category": cat, "message": msg, "signature": sig.hex()
+    } for d, ts, lvl, cat, msg, sig in entries]}, separators=(",", ":")).encode("utf-8")
+    cbor_body = encode_batch([[devices.index(d), ts, lvl, cat, msg, sig]
+                              for d, ts, lvl, cat, msg, sig in entries], devices)
+
+    rounds = 200
+    start = time.perf_counter()
+    for _ in range(rounds):
+        from_json = LogIngestRequest.model_validate(json.loads(json_body))
+        for log in from_json.logs:
+            bytes.fromhex(log.signature)
+    json_us = (time.perf_counter() - start) / rounds * 1e6
+
+    start = time.perf_counter()
+    for _ in range(rounds):
+        from_cbor = LogIngestRequest.model_validate(batch_from_cbor(cbor_body))
+        for log in from_cbor.logs:
+            bytes.fromhex(log.signature)
+    cbor_us = (time.perf_counter() - start) / rounds * 1e6
+
+    print(f"\n32-entry batch: json {len(json_body)} bytes {json_us:.0f} us, "
+          f"cbor {len(cbor_body)} bytes {cbor_us:.0f} us")
+    assert from_json == from_cbor
+    assert len(cbor_body) * 2 < len(json_body)
+
+
+@pytest.mark.parametrize("gzipped", [False, True])
+def test_ingest_cbor_batch(client, test_device, test_keypair, gzipped):
+    """Test ingesting a CBOR batch, as sent and gzipped."""
+    logs = []
+    for i in range(3):
+        timestamp = 1704268800 + i
+        message = f"Motion event {i}"
+        signed = test_keypair["signing_key"].sign(f"{timestamp}:{message}".encode('utf-8'))
+        logs.append([0, timestamp, "NOTICE", "motion", message, signed.signature])
+    body = encode_batch(logs, ["ESP32-TEST001"])
+
+    headers = {"Content-Type": "application/cbor"}
+    if gzipped:
+        body = gzip.compress(body)
+        headers["Content-Encoding"] = "gzip"
+    response = client.post("/logs/ingest", content=body, headers=headers)
+
+    assert response.status_code == 200
+    data = response.json()
+    assert data["ingested"] == 3
+    assert data["errors"] == 0
+
+
+def test_ingest_cbor_rejected(client, test_device):
+    """Test malformed CBOR batches and unknown content types are refused."""
+    headers = {"Content-Type": "application/cbor"}
+    bad_index = encode_batch([[1, 1704268800, "INFO", "system", "x", bytes(64)]], ["ESP32-TEST001"])
+    hex_signature = encode_batch([[0, 1704268800, "INFO", "system", "x", "00" * 64]], ["ESP32-TEST001"])
+
+    assert client.post("/logs/ingest", content=b"\x9f", headers=headers).status_code == 400
+    assert client.post("/logs/ingest", content=bad_index, headers=headers).status_code == 400
+    assert client.post("/logs/ingest", content=hex_signature, headers=headers).status_code == 400
+
+    response = client.post("/logs/ingest", content=b"logs", headers={"Content-Type": "text/plain"})
+    assert response.status_code == 415
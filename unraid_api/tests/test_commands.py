@@ -135,3 +135,27 @@ def test_command_payload_serialization(client, test_network, valid_token):
     assert response.status_code == 200
     bundle = response.json()["command_bundle"]
     assert bundle["payload"] == complex_payload
+
+
+def test_command_bundle_verifies_with_network_key(client, test_network, valid_token):
+    """Test that the home base can verify the bundle from its fields alone."""
+    import nacl.encoding
+    import nacl.signing
+
+    response = client.post(
+        f"/networks/{test_network.id}/command",
+        json={
+            "command": "set_led",
+            "payload": {"color": "blue", "brightness": 40}
+        },
+        headers={"Authorization": f"Bearer {valid_token}"}
+    )
+
+    assert response.status_code == 200
+    bundle = response.json()["command_bundle"]
+    assert json.loads(bundle["payload_json"]) == bundle["payload"]
+
+    # Same reconstruction as command_post_handler on the home base
+    message = f"{bundle['timestamp']}:{bundle['nonce']}:{bundle['command']}:{bundle['payload_json']}"
+    verify_key = nacl.signing.VerifyKey(test_network.public_key, encoder=nacl.encoding.HexEncoder)
+    verify_key.verify(message.encode("utf-8"), bytes.fromhex(bundle["signature"]))
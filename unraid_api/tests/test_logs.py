@@ -1,6 +1,11 @@
 """API tests for log ingestion and signature verification."""
 
+import gzip
+import json
+import zlib
+
 import pytest
+import models
 import security
 
 
@@ -107,6 +112,132 @@ def test_ingest_batch(client, test_device, test_keypair):
     assert data["errors"] == 0
 
 
+def signed_batch(test_keypair, count):
+    logs = []
+    for i in range(count):
+        timestamp = 1704268800 + i
+        message = f"Motion event {i}"
+        signed = test_keypair["signing_key"].sign(f"{timestamp}:{message}".encode('utf-8'))
+        logs.append({
+            "device_id": "ESP32-TEST001",
+            "timestamp": timestamp,
+            "level": "INFO",
+            "category": "motion",
+            "message": message,
+            "signature": signed.signature.hex()
+        })
+    return json.dumps({"logs": logs}).encode('utf-8')
+
+
+def keyed_logs(test_keypair, seqs):
+    logs = []
+    for seq in seqs:
+        timestamp = 1704268800 + seq
+        message = f"Motion event {seq}"
+        signed = test_keypair["signing_key"].sign(f"{timestamp}:{message}".encode('utf-8'))
+        logs.append({
+            "device_id": "ESP32-TEST001",
+            "timestamp": timestamp,
+            "level": "INFO",
+            "category": "motion",
+            "message": message,
+            "signature": signed.signature.hex(),
+            "seq": seq
+        })
+    return logs
+
+
+def test_ingest_skips_duplicates(client, test_device, test_keypair, db_session):
+    """Test an entry is stored once per home base and sequence number."""
+    first = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [1, 2, 3]), "home_base_id": "HB-01"})
+    assert first.json()["ingested"] == 3
+    assert first.json()["high_water"] == 3
+
+    # A retried batch, overlapping the next one
+    again = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [2, 3, 4]), "home_base_id": "HB-01"})
+    data = again.json()
+    assert data["ingested"] == 1
+    assert data["duplicates"] == 2
+    assert data["high_water"] == 4
+
+    # The same numbers from another home base are different entries
+    other = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [1]), "home_base_id": "HB-02"})
+    assert other.json()["ingested"] == 1
+
+    assert db_session.query(models.DeviceLog).count() == 5
+
+
+def test_ingest_late_entries_below_high_water(client, test_device, test_keypair, db_session):
+    """Test spooled entries arriving behind newer ones are stored, once."""
+    client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [10, 11]), "home_base_id": "HB-01"})
+
+    late = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [4, 5, 5]), "home_base_id": "HB-01"})
+    data = late.json()
+    assert data["ingested"] == 2
+    assert data["duplicates"] == 1
+    assert data["high_water"] == 11
+
+    replay = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [4, 5, 11]), "home_base_id": "HB-01"})
+    assert replay.json()["ingested"] == 0
+    assert replay.json()["duplicates"] == 3
+    assert db_session.query(models.DeviceLog).count() == 4
+
+
+def test_ingest_spilled_entry_replayed_twice(client, test_device, test_keypair, db_session):
+    """Test a spilled one-entry body replayed after a lost response is stored once."""
+    body = json.dumps({"logs": keyed_logs(test_keypair, [7]), "home_base_id": "HB-01"}).encode('utf-8')
+    for ingested in (1, 0):
+        response = client.post("/logs/ingest", content=body, headers={"Content-Type": "application/json"})
+        assert response.status_code == 200
+        assert response.json()["ingested"] == ingested
+    assert db_session.query(models.DeviceLog).count() == 1
+
+
+def test_ingest_unkeyed_entries_are_not_deduplicated(client, test_device, test_keypair):
+    """Test entries without a home base ID are stored as before."""
+    for _ in range(2):
+        response = client.post("/logs/ingest", json={"logs": keyed_logs(test_keypair, [1])})
+        assert response.json()["ingested"] == 1
+        assert response.json()["duplicates"] == 0
+
+
+@pytest.mark.parametrize("encoding,compress", [
+    ("gzip", gzip.compress),
+    ("deflate", zlib.compress),
+])
+def test_ingest_compressed_batch(client, test_device, test_keypair, encoding, compress):
+    """Test ingesting a batch sent with Content-Encoding."""
+    body = signed_batch(test_keypair, 5)
+    response = client.post("/logs/ingest", content=compress(body), headers={
+        "Content-Type": "application/json",
+        "Content-Encoding": encoding
+    })
+
+    assert response.status_code == 200
+    data = response.json()
+    assert data["ingested"] == 5
+    assert data["errors"] == 0
+
+
+def test_ingest_compressed_batch_rejected(client, test_device, test_keypair):
+    """Test corrupt, truncated, oversized and unknown encodings are refused."""
+    body = gzip.compress(signed_batch(test_keypair, 3))
+    headers = {"Content-Type": "application/json", "Content-Encoding": "gzip"}
+
+    corrupt = body[:12] + bytes(b ^ 0xFF for b in body[12:20]) + body[20:]
+    assert client.post("/logs/ingest", content=corrupt, headers=headers).status_code == 400
+    assert client.post("/logs/ingest", content=body[:-20], headers=headers).status_code == 400
+
+    bomb = gzip.compress(b" " * (2 * 1024 * 1024))
+    assert client.post("/logs/ingest", content=bomb, headers=headers).status_code == 413
+
+    response = client.post("/logs/ingest", content=body, headers={
+        "Content-Type": "application/json",
+        "Content-Encoding": "br"
+    })
+    assert response.status_code == 415
+
+
 def test_get_logs(client, test_device, test_keypair):
     """Test retrieving logs for a device."""
     # First ingest a log
@@ -0,0 +1,69 @@
+"""Tests for the streaming uplink on /ws/uplink: framing, acks and the window."""
+
+import gzip
+import json
+import struct
+
+from main import UPLINK_WINDOW
+
+
+def signed_batch(keypair, count, first=1704268800):
+    logs = []
+    for i in range(count):
+        timestamp = first + i
+        message = f"Motion event {i}"
+        signed = keypair["signing_key"].sign(f"{timestamp}:{message}".encode('utf-8'))
+        logs.append({
+            "device_id": "ESP32-TEST001",
+            "timestamp": timestamp,
+            "level": "NOTICE",
+            "category": "motion",
+            "message": message,
+            "signature": signed.signature.hex()
+        })
+    return json.dumps({"logs": logs}).encode("utf-8")
+
+
+def batch_frame(seq, body, flags=0):
+    return struct.pack(">BBI", 0x01, flags, seq) + body
+
+
+def read_ack(ws):
+    kind, seq, status, window = struct.unpack(">BIHH", ws.receive_bytes())
+    assert kind == 0x81
+    return seq, status, window
+
+
+def test_stream_window_on_connect(client):
+    """Test the window is announced before anything is sent."""
+    with client.websocket_connect("/ws/uplink") as ws:
+        assert struct.unpack(">BH", ws.receive_bytes()) == (0x82, UPLINK_WINDOW)
+
+
+def test_stream_batches_acked_in_order(client, test_device, test_keypair):
+    """Test pipelined batches are stored and acked in order, gzipped or not."""
+    with client.websocket_connect("/ws/uplink") as ws:
+        ws.receive_bytes()
+        ws.send_bytes(batch_frame(7, signed_batch(test_keypair, 2)))
+        ws.send_bytes(batch_frame(8, gzip.compress(signed_batch(test_keypair, 3, 1704269000)), flags=0x01))
+
+        assert read_ack(ws) == (7, 200, UPLINK_WINDOW)
+        assert read_ack(ws) == (8, 200, UPLINK_WINDOW)
+
+    response = client.get("/logs?device_id=ESP32-TEST001")
+    assert len(response.json()) == 5
+
+
+def test_stream_bad_batch_acked_with_status(client, test_device):
+    """Test a batch /logs/ingest would refuse is acked with that status and the stream carries on."""
+    with client.websocket_connect("/ws/uplink") as ws:
+        ws.receive_bytes()
+        ws.send_bytes(batch_frame(1, b"{not json"))
+        ws.send_bytes(batch_frame(2, b"\x9f"))
+        ws.send_bytes(batch_frame(3, b"{}"))
+        ws.send_bytes(batch_frame(4, b"\x00", flags=0x01))
+
+        assert read_ack(ws)[:2] == (1, 400)
+        assert read_ack(ws)[:2] == (2, 400)
+        assert read_ack(ws)[:2] == (3, 422)
+        assert read_ack(ws)[:2] == (4, 400)